@@ -1,6 +1,8 @@
 #include "rsa_chat_core.h"
+#include "rsa_chat_modarith.h"
 
 #include <jni.h>
+#include <algorithm>
 #include <random>
 #include <fstream>
 #include <sstream>
@@ -61,23 +63,6 @@ static int modinv(int a, int m) {
     return x1 < 0 ? x1 + m0 : x1;
 }
 
-static int modpow(int base, int exp, int mod) {
-    if (mod == 1) return 0;
-
-    long long result = 1;
-    long long b = static_cast<long long>(base) % mod;
-    if (b < 0) b += mod;
-
-    while (exp > 0) {
-        if (exp & 1) {
-            result = (result * b) % mod;
-        }
-        b = (b * b) % mod;
-        exp >>= 1;
-    }
-    return static_cast<int>(result);
-}
-
 // ---------- IP helper ----------
 
 std::string getLocalIP() {
@@ -180,28 +165,55 @@ PrivateKey loadPrivateKey(const std::string& filename) {
     return key;
 }
 
-std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub) {
-    std::vector<int> cipher;
-    cipher.reserve(message.size());
+std::size_t encryptMessage(std::span<const std::byte> message, const PublicKey& pub, std::span<CipherWord> cipher) {
+    const std::size_t count = std::min(message.size(), cipher.size());
+    // The small exponents every key uses get an unrolled chain; anything
+    // else, or a malformed even modulus, takes the generic loop
+    if (pub.n > 1 && (pub.n & 1)) {
+        const MontgomeryWord<std::uint32_t> kernel(static_cast<std::uint32_t>(pub.n));
+        const bool fixed = withFixedExponent(static_cast<std::uint64_t>(pub.e), [&](auto exponent) {
+            for (std::size_t i = 0; i < count; ++i) {
+                cipher[i] = fixedPow<decltype(exponent)::value>(kernel, std::to_integer<std::uint32_t>(message[i]));
+            }
+        });
+        if (fixed) return count;
+    }
 
-    for (unsigned char c : message) {
-        int ciph = modpow(static_cast<int>(c), pub.e, pub.n);
-        cipher.push_back(ciph);
+    ModPow32 modpow(pub.n);
+    for (std::size_t i = 0; i < count; ++i) {
+        cipher[i] = static_cast<CipherWord>(modpow(std::to_integer<int>(message[i]), pub.e));
     }
+    return count;
+}
+
+std::size_t decryptMessage(std::span<const CipherWord> cipher, const PrivateKey& priv, std::span<std::byte> message) {
+    const std::size_t count = std::min(cipher.size(), message.size());
+    ModPow32 modpow(priv.n);
+    for (std::size_t i = 0; i < count; ++i) {
+        message[i] = static_cast<std::byte>(modpow(cipher[i], priv.d));
+    }
+    return count;
+}
+
+// int and uint32_t may alias, so the vector API shares the span code
+static std::span<const CipherWord> cipherWords(const std::vector<int>& cipher) {
+    return {reinterpret_cast<const CipherWord*>(cipher.data()), cipher.size()};
+}
+
+std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub) {
+    std::vector<int> cipher(message.size());
+    encryptMessage(std::as_bytes(std::span(message)), pub,
+                   {reinterpret_cast<CipherWord*>(cipher.data()), cipher.size()});
     return cipher;
 }
 
 std::string decryptMessage(const std::vector<int>& cipher, const PrivateKey& priv) {
-    std::string msg;
-    msg.reserve(cipher.size());
-    for (int num : cipher) {
-        long long plain = modpow(num, priv.d, priv.n);
-        msg.push_back(static_cast<char>(plain));
-    }
+    std::string msg(cipher.size(), '\0');
+    decryptMessage(cipherWords(cipher), priv, std::as_writable_bytes(std::span(msg)));
     return msg;
 }
 
-void saveCipherToFile(const std::vector<int>& cipher, const std::string& filename) {
+void saveCipherToFile(std::span<const CipherWord> cipher, const std::string& filename) {
     std::ofstream file(filename);
     for (size_t i = 0; i < cipher.size(); ++i) {
         file << cipher[i];
@@ -210,6 +222,10 @@ void saveCipherToFile(const std::vector<int>& cipher, const std::string& filenam
     file.close();
 }
 
+void saveCipherToFile(const std::vector<int>& cipher, const std::string& filename) {
+    saveCipherToFile(cipherWords(cipher), filename);
+}
+
 std::vector<int> loadCipherFromFile(const std::string& filename) {
     std::ifstream file(filename);
     std::vector<int> cipher;
@@ -278,39 +294,38 @@ Java_com_example_rsa_1chat_MainActivity_nativeEncrypt(
         return env->NewIntArray(0);
     }
 
-    std::string str(utf);
-    env->ReleaseStringUTFChars(msg, utf);
+    const jsize len = env->GetStringUTFLength(msg);
+    LOGI("Message to encrypt: '%s' (len=%d)", utf, len);
 
-    LOGI("Message to encrypt: '%s' (len=%zu)", str.c_str(), str.size());
+    // Reused across calls, so a message costs no native allocation once
+    // the buffer has grown to the longest one seen
+    thread_local std::vector<CipherWord> cipher;
 
     PublicKey pub{e, n};
-    std::vector<int> cipher;
-
+    size_t count = 0;
     try {
-        cipher = encryptMessage(str, pub);
+        cipher.resize(static_cast<size_t>(len));
+        count = encryptMessage(std::as_bytes(std::span(utf, static_cast<size_t>(len))), pub, cipher);
     } catch (const std::exception& ex) {
         LOGE("Encryption exception: %s", ex.what());
-        return env->NewIntArray(0);
-    } catch (...) {
-        LOGE("Unknown encryption error");
-        return env->NewIntArray(0);
     }
+    env->ReleaseStringUTFChars(msg, utf);
 
-    if (cipher.empty()) {
+    if (count == 0) {
         LOGE("Cipher is empty after encryption");
         return env->NewIntArray(0);
     }
 
-    jintArray result = env->NewIntArray(static_cast<jsize>(cipher.size()));
+    jintArray result = env->NewIntArray(static_cast<jsize>(count));
     if (!result) {
         LOGE("Failed to allocate jintArray for cipher");
         return env->NewIntArray(0);
     }
 
     env->SetIntArrayRegion(result, 0,
-                           static_cast<jsize>(cipher.size()),
-                           cipher.data());
-    LOGI("Returning cipher of length %zu", cipher.size());
+                           static_cast<jsize>(count),
+                           reinterpret_cast<const jint*>(cipher.data()));
+    LOGI("Returning cipher of length %zu", count);
     return result;
 }
 
@@ -333,11 +348,20 @@ Java_com_example_rsa_1chat_MainActivity_nativeDecrypt(
         return env->NewStringUTF("");
     }
 
-    std::vector<int> cipher(elements, elements + len);
-    env->ReleaseIntArrayElements(cipherArray, elements, JNI_ABORT);
+    // Words are below n, itself a jint; a negative one is not ciphertext
+    // and would read as a huge uint32_t below
+    if (std::any_of(elements, elements + len, [](jint word) { return word < 0; })) {
+        env->ReleaseIntArrayElements(cipherArray, elements, JNI_ABORT);
+        return env->NewStringUTF("");
+    }
 
+    // Decrypted straight from the Java array into a reused buffer
+    thread_local std::string plain;
+    plain.resize(static_cast<size_t>(len));
     PrivateKey priv{d, n};
-    std::string plain = decryptMessage(cipher, priv);
+    decryptMessage({reinterpret_cast<const CipherWord*>(elements), static_cast<size_t>(len)}, priv,
+                   std::as_writable_bytes(std::span(plain)));
+    env->ReleaseIntArrayElements(cipherArray, elements, JNI_ABORT);
 
     return env->NewStringUTF(plain.c_str());
 }
@@ -362,10 +386,9 @@ Java_com_example_rsa_1chat_MainActivity_nativeSaveCipherToFile(
     jint* elements = env->GetIntArrayElements(cipherArray, nullptr);
     if (!elements) return;
 
-    std::vector<int> cipher(elements, elements + len);
+    saveCipherToFile({reinterpret_cast<const CipherWord*>(elements), static_cast<size_t>(len)}, filepath);
     env->ReleaseIntArrayElements(cipherArray, elements, JNI_ABORT);
 
-    saveCipherToFile(cipher, filepath);
     LOGI("Saved cipher to: %s", filepath.c_str());
 }
 
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -33,6 +36,15 @@ PrivateKey loadPrivateKey(const std::string& filename);
 // Generate a fresh keypair (internal use)
 KeyPair generateKeys();
 
+// Ciphertext word, one per plaintext byte; always below n
+using CipherWord = std::uint32_t;
+
+// Encrypt into caller storage, returns the number of words written
+std::size_t encryptMessage(std::span<const std::byte> message, const PublicKey& pub, std::span<CipherWord> cipher);
+
+// Decrypt into caller storage, returns the number of bytes written
+std::size_t decryptMessage(std::span<const CipherWord> cipher, const PrivateKey& priv, std::span<std::byte> message);
+
 // Encrypt message
 std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub);
 
@@ -40,6 +52,7 @@ std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub
 std::string decryptMessage(const std::vector<int>& cipher, const PrivateKey& priv);
 
 // Save cipher to file
+void saveCipherToFile(std::span<const CipherWord> cipher, const std::string& filename);
 void saveCipherToFile(const std::vector<int>& cipher, const std::string& filename);
 
 // Load cipher from file
@@ -19,6 +19,8 @@ import java.io.InputStreamReader;
 import java.io.PrintWriter;
 import java.net.ServerSocket;
 import java.net.Socket;
+import java.util.ArrayList;
+import java.util.List;
 
 public class MainActivity extends AppCompatActivity {
 
@@ -57,6 +59,9 @@ public class MainActivity extends AppCompatActivity {
     private int myE, myD, myN;
     private int peerE, peerN;
     private boolean keysExchanged = false;
+    // Typed before the peer's key arrived; sent as one batch once it does.
+    // Only touched on the UI thread.
+    private final List<String> pendingMessages = new ArrayList<>();
 
     @Override
     protected void onCreate(Bundle savedInstanceState) {
@@ -191,6 +196,7 @@ public class MainActivity extends AppCompatActivity {
             keysExchanged = false;
 
             runOnUiThread(() -> {
+                pendingMessages.clear();
                 Toast.makeText(this, "Connected!", Toast.LENGTH_SHORT).show();
                 appendToChat("Connected! Exchanging keys...");
             });
@@ -287,6 +293,7 @@ public class MainActivity extends AppCompatActivity {
                     keysExchanged = true;
                     appendToChat("Keys exchanged! Peer's public key: (" + peerE + ", " + peerN + ")");
                     appendToChat("You can now chat securely!\n");
+                    sendPendingMessages();
                 } catch (NumberFormatException e) {
                     appendToChat("Error parsing peer's key");
                 }
@@ -337,14 +344,16 @@ public class MainActivity extends AppCompatActivity {
             return;
         }
 
+        String text = messageInput.getText().toString().trim();
+        if (text.isEmpty()) return;
+
         if (!keysExchanged) {
-            Toast.makeText(this, "Keys not exchanged yet", Toast.LENGTH_SHORT).show();
+            pendingMessages.add(text);
+            appendToChat("Me: " + text + " (queued until keys are exchanged)");
+            messageInput.setText("");
             return;
         }
 
-        String text = messageInput.getText().toString().trim();
-        if (text.isEmpty()) return;
-
 //        appendToChat("Attempting to encrypt with e=" + peerE + " n=" + peerN);
 
         try {
@@ -412,6 +421,33 @@ public class MainActivity extends AppCompatActivity {
         }
     }
 
+    private void sendPendingMessages() {
+        if (pendingMessages.isEmpty()) return;
+
+        // Encrypt the whole backlog, then write it with a single flush
+        StringBuilder batch = new StringBuilder();
+        for (String text : pendingMessages) {
+            int[] cipher = nativeEncrypt(text, peerE, peerN);
+            if (cipher == null || cipher.length == 0) continue;
+            batch.append("MSG:");
+            for (int i = 0; i < cipher.length; i++) {
+                batch.append(cipher[i]);
+                if (i < cipher.length - 1) batch.append(",");
+            }
+            batch.append("\n");
+        }
+        final int count = pendingMessages.size();
+        pendingMessages.clear();
+
+        final String toSend = batch.toString();
+        final PrintWriter out = writer;
+        new Thread(() -> {
+            out.print(toSend);
+            out.flush();
+        }).start();
+        appendToChat("[Sent " + count + " queued message(s)]");
+    }
+
     private void appendToChat(String line) {
         String current = chatView.getText().toString();
         if (current.isEmpty() || current.equals("Not connected.")) {
@@ -0,0 +1,34 @@
+#include "ChatHistory.h"
+
+// Enough to step through; a longer query narrows it down
+static constexpr std::size_t kMaxResults = 1000;
+
+ChatHistory::ChatHistory(QObject *parent) : QObject(parent), m_worker(1) {}
+
+// m_worker is declared after the index, so it finishes its queue and
+// joins before the index goes
+ChatHistory::~ChatHistory() = default;
+
+void ChatHistory::addMessage(int block, const QString &text) {
+  if (block < 0)
+    return;
+  m_worker.submit([this, block, utf8 = text.toStdString()]() {
+    m_index.add(static_cast<SearchIndex::DocId>(block), utf8);
+  });
+}
+
+void ChatHistory::search(const QString &query) {
+  m_worker.submit([this, query]() {
+    const std::vector<SearchIndex::DocId> hits =
+        m_index.search(query.toStdString(), kMaxResults);
+    QList<int> blocks;
+    blocks.reserve(static_cast<qsizetype>(hits.size()));
+    for (SearchIndex::DocId hit : hits)
+      blocks.append(static_cast<int>(hit));
+    // Dropped along with this object's pending events if it is gone
+    QMetaObject::invokeMethod(
+        this,
+        [this, query, blocks]() { emit resultsReady(query, blocks); },
+        Qt::QueuedConnection);
+  });
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "rsa_chat_search.h"
+#include "rsa_chat_thread_pool.h"
+#include <QList>
+#include <QObject>
+#include <QString>
+
+// Search over the chat shown so far. Messages are indexed on a worker
+// thread as they are shown, so the GUI thread only hands text over; a
+// query runs on the same thread after everything added before it and
+// comes back through resultsReady(). The index holds no message text,
+// only the posting lists, and results are positions in the chat view.
+class ChatHistory : public QObject {
+  Q_OBJECT
+public:
+  explicit ChatHistory(QObject *parent = nullptr);
+  ~ChatHistory() override;
+
+  // `block` is where the message sits in the chat view; it must grow
+  // from call to call
+  void addMessage(int block, const QString &text);
+
+  // Words match whole words, case-insensitively; "word*" matches any
+  // word starting with "word". Results are newest first.
+  void search(const QString &query);
+
+signals:
+  void resultsReady(const QString &query, const QList<int> &blocks);
+
+private:
+  SearchIndex m_index; // touched only on m_worker
+  ThreadPool m_worker;
+};
@@ -6,26 +6,43 @@
 
 #include <QCheckBox>
 #include <QHBoxLayout>
+#include <QLabel>
 #include <QLineEdit>
 #include <QPushButton>
+#include <QTextBlock>
+#include <QTextCursor>
 #include <QTextEdit>
 #include <QVBoxLayout>
 
 
 ChatPage::ChatPage(QWidget *parent)
-    : QWidget(parent), m_chatView(new QTextEdit(this)),
+    : QWidget(parent), m_searchEdit(new QLineEdit(this)),
+      m_searchStatus(new QLabel(this)), m_chatView(new QTextEdit(this)),
       m_inputEdit(new QLineEdit(this)),
       m_sendButton(new QPushButton("Send", this)),
-      m_previewCheckBox(new QCheckBox("Enable Preview", this)) {
+      m_fileButton(new QPushButton("File...", this)),
+      m_previewCheckBox(new QCheckBox("Enable Preview", this)),
+      m_latencyLabel(new QLabel(this)) {
   m_chatView->setReadOnly(true);
+  m_latencyLabel->setStyleSheet("color:#888;");
+  m_latencyLabel->setVisible(false);
+  m_searchEdit->setPlaceholderText("Search chat (words, prefix*)");
+  m_searchEdit->setClearButtonEnabled(true);
+
+  auto *searchLayout = new QHBoxLayout;
+  searchLayout->addWidget(m_searchEdit);
+  searchLayout->addWidget(m_searchStatus);
 
   auto *inputLayout = new QHBoxLayout;
   inputLayout->addWidget(m_inputEdit);
   inputLayout->addWidget(m_sendButton);
+  inputLayout->addWidget(m_fileButton);
   inputLayout->addWidget(m_previewCheckBox);
 
   auto *mainLayout = new QVBoxLayout;
+  mainLayout->addLayout(searchLayout);
   mainLayout->addWidget(m_chatView);
+  mainLayout->addWidget(m_latencyLabel);
   mainLayout->addLayout(inputLayout);
 
   setLayout(mainLayout);
@@ -34,11 +51,19 @@ ChatPage::ChatPage(QWidget *parent)
           &ChatPage::onSendButtonClicked);
   connect(m_inputEdit, &QLineEdit::returnPressed, this,
           &ChatPage::onSendButtonClicked);
+  connect(m_fileButton, &QPushButton::clicked, this,
+          &ChatPage::sendFileRequested);
+  connect(m_searchEdit, &QLineEdit::returnPressed, this,
+          &ChatPage::onSearchReturnPressed);
+  connect(m_previewCheckBox, &QCheckBox::toggled, this, [this](bool on) {
+    m_latencyLabel->setVisible(on && !m_latencyLabel->text().isEmpty());
+  });
 }
 
-void ChatPage::appendMessage(const QString &sender, const QString &text) {
+int ChatPage::appendMessage(const QString &sender, const QString &text) {
   m_chatView->append(QStringLiteral("<b>%1:</b> %2")
                          .arg(sender.toHtmlEscaped(), text.toHtmlEscaped()));
+  return m_chatView->document()->blockCount() - 1;
 }
 
 void ChatPage::onSendButtonClicked() {
@@ -55,6 +80,58 @@ void ChatPage::appendPreviewInfo(const QString &info) {
                          .arg(info.toHtmlEscaped()));
 }
 
+void ChatPage::setLatencyInfo(const QString &info) {
+  m_latencyLabel->setText(info);
+  m_latencyLabel->setVisible(isPreviewEnabled() && !info.isEmpty());
+}
+
 bool ChatPage::isPreviewEnabled() const {
   return m_previewCheckBox->isChecked();
 }
+
+void ChatPage::onSearchReturnPressed() {
+  const QString query = m_searchEdit->text().trimmed();
+  if (query.isEmpty()) {
+    m_searchStatus->clear();
+    return;
+  }
+
+  // Return again on the same query steps to the next older hit
+  if (query == m_searchQuery && !m_searchResults.isEmpty()) {
+    m_searchPosition = (m_searchPosition + 1) % m_searchResults.size();
+    showSearchResult();
+    return;
+  }
+
+  m_searchQuery = query;
+  m_searchResults.clear();
+  m_searchStatus->setText("Searching...");
+  emit searchRequested(query);
+}
+
+void ChatPage::showSearchResults(const QString &query,
+                                 const QList<int> &blocks) {
+  if (query != m_searchQuery)
+    return;
+  m_searchResults = blocks;
+  m_searchPosition = 0;
+  if (blocks.isEmpty()) {
+    m_searchStatus->setText("No matches");
+    return;
+  }
+  showSearchResult();
+}
+
+void ChatPage::showSearchResult() {
+  const QTextBlock block = m_chatView->document()->findBlockByNumber(
+      m_searchResults.at(m_searchPosition));
+  if (block.isValid()) {
+    QTextCursor cursor(block);
+    cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    m_chatView->setTextCursor(cursor);
+    m_chatView->ensureCursorVisible();
+  }
+  m_searchStatus->setText(QString("%1 of %2")
+                              .arg(m_searchPosition + 1)
+                              .arg(m_searchResults.size()));
+}
@@ -4,8 +4,10 @@
 
 #pragma once
 
+#include <QList>
 #include <QWidget>
 
+class QLabel;
 class QTextEdit;
 class QLineEdit;
 class QPushButton;
@@ -16,19 +18,39 @@ class ChatPage : public QWidget {
 public:
   explicit ChatPage(QWidget *parent = nullptr);
 
-  void appendMessage(const QString &sender, const QString &text);
+  // Returns the block the message went into, for ChatHistory
+  int appendMessage(const QString &sender, const QString &text);
   void appendPreviewInfo(const QString &info);
+  // Live probe results, one line per peer, shown while preview is on
+  void setLatencyInfo(const QString &info);
   bool isPreviewEnabled() const;
 
+  // Blocks matching `query`, newest first; ignored if the search box has
+  // moved on to another query since
+  void showSearchResults(const QString &query, const QList<int> &blocks);
+
 signals:
   void sendMessageRequested(const QString &text);
+  void sendFileRequested();
+  void searchRequested(const QString &query);
 
 private slots:
   void onSendButtonClicked();
+  void onSearchReturnPressed();
 
 private:
+  void showSearchResult();
+
+  QLineEdit *m_searchEdit;
+  QLabel *m_searchStatus;
   QTextEdit *m_chatView;
   QLineEdit *m_inputEdit;
   QPushButton *m_sendButton;
+  QPushButton *m_fileButton;
   QCheckBox *m_previewCheckBox;
+  QLabel *m_latencyLabel;
+
+  QString m_searchQuery;
+  QList<int> m_searchResults;
+  qsizetype m_searchPosition = 0;
 };
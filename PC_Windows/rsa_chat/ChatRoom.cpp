@@ -0,0 +1,267 @@
+#include "ChatRoom.h"
+#include "rsa_chat_trace.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QtAlgorithms>
+#include <utility>
+#include <vector>
+
+ChatRoom::ChatRoom(const KeyPair &keys, std::unique_ptr<Transport> transport,
+                   QObject *parent)
+    : QObject(parent), m_keys(keys), m_nextId(1),
+      m_transport(std::move(transport)) {
+  // Each connection's events go to its session; a session already
+  // removed has closed its connection and hears nothing more
+  m_transport->setHandlers({
+      [this](ConnectionId connection) { addConnection(connection); },
+      [this](ConnectionId connection, std::string_view data) {
+        if (ChatSession *session = sessionFor(connection))
+          session->transportReceived(data);
+      },
+      [this](ConnectionId connection) {
+        if (ChatSession *session = sessionFor(connection))
+          session->transportClosed();
+      },
+      [this](ConnectionId connection) {
+        if (ChatSession *session = sessionFor(connection))
+          session->transportConnected();
+      },
+      [this](ConnectionId connection) {
+        if (ChatSession *session = sessionFor(connection))
+          session->transportDrained();
+      },
+  });
+  m_driver = std::make_unique<TransportDriver>(*m_transport);
+}
+
+ChatRoom::~ChatRoom() {
+  // Join the workers first; whatever they post back is discarded along
+  // with this object's pending events
+  m_pool.reset();
+  // Sessions close their connections on the way out, which needs the
+  // transport, so they cannot wait for ~QObject
+  qDeleteAll(findChildren<ChatSession *>(Qt::FindDirectChildrenOnly));
+}
+
+bool ChatRoom::listen(quint16 port) { return m_transport->listen(port); }
+
+ChatSession *ChatRoom::connectToHost(const QString &host, quint16 port) {
+  ChatSession *session =
+      addMember(new ChatSession(m_keys, *m_transport, this));
+  if (const ConnectionId connection = session->connectToHost(host, port))
+    m_connections.insert(connection, session);
+  return session;
+}
+
+void ChatRoom::addConnection(ConnectionId connection) {
+  ChatSession *session =
+      addMember(new ChatSession(m_keys, *m_transport, this));
+  m_connections.insert(connection, session);
+  // Reports memberConnected() through the session's connected()
+  session->attachConnection(connection);
+}
+
+ChatSession *ChatRoom::sessionFor(ConnectionId connection) const {
+  return m_connections.value(connection, nullptr);
+}
+
+void ChatRoom::disconnectAll() {
+  // disconnectFromHost() may report the disconnect synchronously, which
+  // removes the member, so don't call it while walking m_members
+  QList<ChatSession *> idle;
+  for (Member &member : m_members) {
+    member.closing = true;
+    if (member.nextWrite == member.nextSeal)
+      idle.append(member.session);
+  }
+  for (ChatSession *session : idle) {
+    session->disconnectFromHost();
+  }
+}
+
+QList<ChatSession *> ChatRoom::members() const {
+  QList<ChatSession *> out;
+  out.reserve(m_order.size());
+  for (quint64 id : m_order) {
+    out.append(m_members.value(id).session);
+  }
+  return out;
+}
+
+int ChatRoom::readyCount() const {
+  int count = 0;
+  for (const Member &member : m_members) {
+    if (member.session->isReady())
+      ++count;
+  }
+  return count;
+}
+
+ChatSession *ChatRoom::addMember(ChatSession *session) {
+  const quint64 id = m_nextId++;
+  session->setSendOptions(m_sendOptions);
+  if (m_wideKeys)
+    session->setWideKeys(*m_wideKeys);
+  if (!m_captureDir.isEmpty()) {
+    // The peer's address is not known yet for outgoing connections
+    const QString path = QDir(m_captureDir).filePath(
+        QString("rsa_chat_%1_%2.rsacap")
+            .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"))
+            .arg(id));
+    if (!session->startCapture(path))
+      qWarning() << "Cannot create capture" << path;
+  }
+  m_members.insert(id, Member{session});
+  m_order.append(id);
+
+  connect(session, &ChatSession::connected, this,
+          [this, session]() { emit memberConnected(session); });
+  connect(session, &ChatSession::keysExchanged, this,
+          [this, session]() { emit memberReady(session); });
+  connect(session, &ChatSession::messageSent, this,
+          [this, session](const ChatSession::SendInfo &info) {
+            emit messageSent(session, info);
+          });
+  connect(session, &ChatSession::latencyUpdated, this,
+          [this, session](const LatencyEstimate &estimate) {
+            emit latencyUpdated(session, estimate);
+          });
+  connect(session, &ChatSession::messageReceived, this,
+          [this, session](const QString &text, quint64 messageId) {
+            emit messageReceived(session, text, messageId);
+          });
+  connect(session, &ChatSession::messageDropped, this,
+          [this, session](const QString &reason) {
+            emit messageDropped(session, reason);
+          });
+  connect(session, &ChatSession::fileReceived, this,
+          [this, session](const QString &name, const QByteArray &data) {
+            emit fileReceived(session, name, data);
+          });
+  connect(session, &ChatSession::errorOccurred, this,
+          [this, session, id](const QString &message) {
+            emit errorOccurred(session, message);
+            // A failed connect never reports disconnected()
+            if (!session->isConnected())
+              removeMember(id);
+          });
+  connect(session, &ChatSession::disconnected, this,
+          [this, id]() { removeMember(id); });
+  return session;
+}
+
+void ChatRoom::removeMember(quint64 id) {
+  auto it = m_members.find(id);
+  if (it == m_members.end())
+    return;
+
+  ChatSession *session = it->session;
+  emit memberLeft(session);
+  m_members.remove(id);
+  m_order.removeOne(id);
+  m_connections.remove(session->connectionId());
+  session->deleteLater();
+}
+
+int ChatRoom::broadcast(const QString &text) {
+  struct Target {
+    quint64 id;
+    quint64 seq;
+    PublicKey pub;
+    // Copied: the member may be gone before a worker gets to it
+    std::optional<AnyRsaKey> widePub;
+    PeerCaps caps;
+  };
+
+  std::vector<Target> targets;
+  bool anyCaps = false;
+  int queued = 0;
+  for (quint64 id : std::as_const(m_order)) {
+    Member &member = m_members[id];
+    if (!member.session->isConnected())
+      continue;
+    // Members still exchanging keys hold the plaintext themselves and
+    // send it as one batch when the key arrives
+    if (!member.session->isReady()) {
+      member.session->sendMessage(text);
+      ++queued;
+      continue;
+    }
+    const AnyRsaKey *widePub = member.session->remoteWideKey();
+    targets.push_back({id, member.nextSeal++,
+                       member.session->remotePublicKey(),
+                       widePub ? std::optional<AnyRsaKey>(*widePub)
+                               : std::nullopt,
+                       member.session->peerCaps()});
+    anyCaps = anyCaps || targets.back().caps.announced;
+  }
+  if (targets.empty())
+    return queued;
+
+  // One ID for the whole fan-out; only XMSG: frames can carry it
+  const std::uint64_t messageId =
+      traceEnabled() && anyCaps ? traceNewMessageId() : 0;
+  TraceSpan messageSpan("send_message", messageId);
+
+  // A lone recipient is sealed inline, which is cheaper than a round trip
+  // through the pool
+  if (targets.size() == 1) {
+    const Target &t = targets.front();
+    deliver(t.id, t.seq,
+            ChatSession::seal(text, t.pub, t.widePub ? &*t.widePub : nullptr,
+                              t.caps, t.caps.announced ? messageId : 0));
+    return queued + 1;
+  }
+
+  if (!m_pool)
+    m_pool = std::make_unique<ThreadPool>();
+  for (const Target &t : targets) {
+    m_pool->submit([this, t, text, messageId]() {
+      ChatSession::SealedFrame sealed =
+          ChatSession::seal(text, t.pub, t.widePub ? &*t.widePub : nullptr,
+                            t.caps, t.caps.announced ? messageId : 0);
+      QMetaObject::invokeMethod(
+          this,
+          [this, id = t.id, seq = t.seq, sealed]() { deliver(id, seq, sealed); },
+          Qt::QueuedConnection);
+    });
+  }
+  return queued + static_cast<int>(targets.size());
+}
+
+int ChatRoom::broadcastFile(const QString &name, const QByteArray &data) {
+  // Chunks are sealed lazily by each session as its channel pump gets to
+  // them, so there is nothing to fan out here
+  int count = 0;
+  for (ChatSession *session : members()) {
+    if (session->sendFile(name, data))
+      ++count;
+  }
+  return count;
+}
+
+void ChatRoom::deliver(quint64 id, quint64 seq,
+                       ChatSession::SealedFrame sealed) {
+  auto it = m_members.find(id);
+  if (it == m_members.end())
+    return;
+  it->sealed.emplace(seq, std::move(sealed));
+
+  // A write can fail synchronously and remove the member, so look it up
+  // again on every round
+  for (;;) {
+    it = m_members.find(id);
+    if (it == m_members.end())
+      return;
+    if (it->sealed.empty() || it->sealed.begin()->first != it->nextWrite) {
+      if (it->closing && it->nextWrite == it->nextSeal)
+        it->session->disconnectFromHost();
+      return;
+    }
+
+    auto node = it->sealed.extract(it->sealed.begin());
+    ++it->nextWrite;
+    it->session->writeSealed(node.mapped());
+  }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ChatSession.h"
+#include "QtTransport.h"
+#include "rsa_chat_thread_pool.h"
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <map>
+#include <memory>
+#include <optional>
+
+// Group chat: one ChatSession per member, each with its own public key.
+// A send seals the message for every member in parallel on a thread pool
+// and writes each frame as soon as it is ready, so one slow recipient
+// never holds up the others. Frames to any one member keep their order.
+//
+// Every member's connection goes through the one transport the room owns,
+// which the Qt event loop drives (TransportDriver), so the room works the
+// same on Qt sockets, epoll or io_uring, with or without the same-host
+// shortcut.
+class ChatRoom : public QObject {
+  Q_OBJECT
+public:
+  ChatRoom(const KeyPair &keys, std::unique_ptr<Transport> transport,
+           QObject *parent = nullptr);
+  ~ChatRoom() override;
+
+  // Peers connecting to `port` join as members; false if it is taken
+  bool listen(quint16 port);
+  quint16 localPort() const { return m_transport->localPort(); }
+
+  // Keys handed to members added from now on
+  void setKeys(const KeyPair &keys) { m_keys = keys; }
+  // Wide key pair offered by members added from now on
+  void setWideKeys(const AnyRsaKeyPair &keys) { m_wideKeys = keys; }
+  // Socket write policy for members added from now on
+  void setSendOptions(const SendOptions &options) { m_sendOptions = options; }
+  // Members added from now on record what they receive into a capture
+  // file of their own in `dir`; empty turns capturing off
+  void setCaptureDirectory(const QString &dir) { m_captureDir = dir; }
+
+  ChatSession *connectToHost(const QString &host, quint16 port);
+  // Disconnects every member once the frames already handed to
+  // broadcast() have been written to it
+  void disconnectAll();
+
+  QList<ChatSession *> members() const;
+  int readyCount() const;
+
+  // Sends `text` to every connected member and returns how many that
+  // was. Members still waiting for the peer's key queue it.
+  int broadcast(const QString &text);
+
+  // Sends a file to every ready member that supports channels and
+  // returns how many that was
+  int broadcastFile(const QString &name, const QByteArray &data);
+
+signals:
+  // The TCP connection is up, in either direction; messages can be sent
+  // from here on
+  void memberConnected(ChatSession *member);
+  void memberReady(ChatSession *member);
+  // Emitted just before the member is removed and deleted
+  void memberLeft(ChatSession *member);
+  void messageReceived(ChatSession *from, const QString &text,
+                       quint64 messageId);
+  void messageDropped(ChatSession *from, const QString &reason);
+  void fileReceived(ChatSession *from, const QString &name,
+                    const QByteArray &data);
+  void messageSent(ChatSession *to, const ChatSession::SendInfo &info);
+  void latencyUpdated(ChatSession *member, const LatencyEstimate &estimate);
+  void errorOccurred(ChatSession *member, const QString &message);
+
+private:
+  struct Member {
+    ChatSession *session = nullptr;
+    quint64 nextSeal = 0;
+    quint64 nextWrite = 0;
+    bool closing = false;
+    // Frames sealed out of order, held until their turn
+    std::map<quint64, ChatSession::SealedFrame> sealed;
+  };
+
+  ChatSession *addMember(ChatSession *session);
+  void addConnection(ConnectionId connection);
+  ChatSession *sessionFor(ConnectionId connection) const;
+  void removeMember(quint64 id);
+  void deliver(quint64 id, quint64 seq, ChatSession::SealedFrame sealed);
+
+  KeyPair m_keys;
+  std::optional<AnyRsaKeyPair> m_wideKeys;
+  SendOptions m_sendOptions;
+  QString m_captureDir;
+  // Members are addressed by a serial number rather than by pointer so a
+  // late result can never land on a new session at a reused address
+  QHash<quint64, Member> m_members;
+  QList<quint64> m_order;
+  quint64 m_nextId;
+  std::unique_ptr<ThreadPool> m_pool;
+  // Destroyed in reverse: the driver goes before the transport
+  std::unique_ptr<Transport> m_transport;
+  std::unique_ptr<TransportDriver> m_driver;
+  QHash<ConnectionId, ChatSession *> m_connections;
+};
@@ -0,0 +1,435 @@
+#include "ChatSession.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+#include <QDebug>
+#include <QTimer>
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+// Transport backlog above which queued channel frames are held back, so
+// an urgent frame never waits behind more than about this much bulk data
+static constexpr std::size_t kSocketHighWater = 64 * 1024;
+
+// One probe in flight at a time; a peer silent this long is reported
+static constexpr int kProbeIntervalMs = 1000;
+static constexpr quint64 kProbeTimeoutUs = 10'000'000;
+
+ChatSession::ChatSession(const KeyPair &keys, Transport &transport,
+                         QObject *parent)
+    : QObject(parent), m_transport(transport), m_scheduler(nullptr),
+      m_core({[this](std::string_view data) {
+                // Pongs never wait for a batch, or it would count as RTT
+                writeFrame(QByteArray(data.data(),
+                                      static_cast<qsizetype>(data.size())));
+                m_scheduler->flush();
+              },
+              [this](const PublicKey &key) { handleKey(key); },
+              [](const PeerCaps &caps) {
+                qInfo() << "Peer capabilities - compression:"
+                        << caps.compression << "channels:" << caps.channels
+                        << "bitpack:" << caps.bitpack
+                        << "probe:" << caps.probe;
+              },
+              [this] { handleKeysExchanged(); },
+              [this](const ProbePong &pong) { handlePong(pong); },
+              [this](Channel channel, quint64 messageId,
+                     std::string_view payload) {
+                m_channelHandlers[static_cast<std::size_t>(channel)](
+                    payload, messageId);
+              },
+              [this](const std::string &reason) {
+                emit messageDropped(QString::fromStdString(reason));
+              }},
+             keys),
+      m_ready(false), m_disconnectPending(false),
+      m_probeTimer(new QTimer(this)) {
+  connect(m_probeTimer, &QTimer::timeout, this, &ChatSession::sendProbe);
+
+  // The QString (or QByteArray) built here is the only per-message
+  // allocation left on the receive path
+  m_channelHandlers[static_cast<std::size_t>(Channel::Chat)] =
+      [this](std::string_view payload, quint64 messageId) {
+        emit messageReceived(QString::fromUtf8(payload.data(), payload.size()),
+                             messageId);
+      };
+  m_channelHandlers[static_cast<std::size_t>(Channel::Control)] =
+      [this](std::string_view payload, quint64) {
+        emit controlReceived(QString::fromUtf8(payload.data(), payload.size()));
+      };
+  m_channelHandlers[static_cast<std::size_t>(Channel::File)] =
+      [this](std::string_view payload, quint64) {
+        std::string_view name;
+        std::string_view data;
+        if (!splitFilePayload(payload, name, data)) {
+          emit messageDropped("Dropped a malformed file transfer.");
+          return;
+        }
+        emit fileReceived(
+            QString::fromUtf8(name.data(), static_cast<qsizetype>(name.size())),
+            QByteArray(data.data(), static_cast<qsizetype>(data.size())));
+      };
+}
+
+ChatSession::~ChatSession() {
+  // The transport's closed() for it goes nowhere now
+  if (m_id != 0 && !m_closing) {
+    m_scheduler->flush();
+    m_transport.close(m_id);
+  }
+}
+
+bool ChatSession::startCapture(const QString &filename) {
+  auto capture = std::make_unique<CaptureWriter>();
+  if (!capture->open(filename.toStdString(), m_core.keys().priv))
+    return false;
+  m_capture = std::move(capture);
+  return true;
+}
+
+ConnectionId ChatSession::connectToHost(const QString &host, quint16 port) {
+  m_target = QString("%1:%2").arg(host).arg(port);
+  const ConnectionId id =
+      m_transport.connectAsync(host.toStdString(), port);
+  if (id == 0) {
+    QMetaObject::invokeMethod(
+        this,
+        [this] { emit errorOccurred("Host not found: " + m_target); },
+        Qt::QueuedConnection);
+    return 0;
+  }
+  setupConnection(id);
+  return id;
+}
+
+void ChatSession::attachConnection(ConnectionId id) {
+  setupConnection(id);
+  transportConnected();
+}
+
+void ChatSession::disconnectFromHost() {
+  if (hasPendingOutput() && isConnected()) {
+    m_disconnectPending = true;
+    return;
+  }
+  if (m_id != 0 && !m_closing) {
+    m_scheduler->flush();
+    m_closing = true;
+    m_transport.close(m_id);
+  }
+}
+
+void ChatSession::setupConnection(ConnectionId id) {
+  m_id = id;
+  m_connected = false;
+  m_closing = false;
+  delete m_scheduler;
+  m_scheduler = new SendScheduler(m_transport, id, m_sendOptions, this);
+  m_core.reset();
+  m_ready = false;
+  m_channelQueue.clear();
+  m_latency = LatencyEstimator{};
+  m_probeOutstanding = false;
+  m_probeStallReported = false;
+}
+
+void ChatSession::transportConnected() {
+  m_connected = true;
+  m_peerAddress = QString::fromStdString(m_transport.peerAddress(m_id));
+  m_scheduler->configureSocket();
+  emit connected();
+  // Send our public key immediately
+  sendPublicKey();
+}
+
+void ChatSession::sendPublicKey() {
+  if (!isConnected())
+    return;
+
+  writeFrame(QByteArray::fromStdString(m_core.helloLines()));
+  // The handshake never waits for a batch to fill
+  m_scheduler->flush();
+
+  qInfo() << "Sent public key:" << m_core.keys().pub.e << m_core.keys().pub.n;
+}
+
+void ChatSession::transportReceived(std::string_view data) {
+  if (m_closing)
+    return;
+
+  if (m_capture)
+    m_capture->record(data.data(), data.size());
+  // The transport's buffer is parsed in place
+  m_core.feed(data);
+}
+
+void ChatSession::handleKey(const PublicKey &key) {
+  // Save their key to file
+  QString ipClean = peerAddress();
+  ipClean.replace('.', '_');
+  ipClean.replace(':', '_');
+  m_peerKeyFile = ipClean + "_public.key";
+
+  std::ofstream file(m_peerKeyFile.toStdString());
+  file << key.e << " " << key.n;
+  file.close();
+
+  qInfo() << "Received public key - e:" << key.e << "n:" << key.n;
+}
+
+void ChatSession::handleKeysExchanged() {
+  m_ready = true;
+  flushOutbox();
+  if (peerCaps().probe) {
+    m_probeTimer->start(kProbeIntervalMs);
+    sendProbe();
+  }
+  emit keysExchanged();
+
+  // Checked after the signal so whatever its handlers send (e.g. a file)
+  // still goes out before a requested disconnect
+  if (m_disconnectPending && !hasPendingOutput()) {
+    m_disconnectPending = false;
+    disconnectFromHost();
+  }
+}
+
+void ChatSession::sendProbe() {
+  if (!isConnected() || !m_ready)
+    return;
+
+  if (m_probeOutstanding) {
+    const quint64 waited = probeClockUs() - m_probeSentUs;
+    m_latency.setUnanswered(waited);
+    emit latencyUpdated(m_latency.estimate());
+    if (waited >= kProbeTimeoutUs && !m_probeStallReported) {
+      m_probeStallReported = true;
+      emit errorOccurred(QString("Peer has not answered for %1 s")
+                             .arg(waited / 1'000'000));
+    }
+    return;
+  }
+
+  m_probeOutstanding = true;
+  m_probeSentUs = probeClockUs();
+  writeFrame(QByteArray::fromStdString(
+      buildPingLine(ProbePing{++m_probeSeq, m_probeSentUs})));
+  // Never held back for a batch, or the batching would count as RTT
+  m_scheduler->flush();
+}
+
+void ChatSession::handlePong(const ProbePong &pong) {
+  // Anything but the answer to our one outstanding ping is stale
+  if (!m_probeOutstanding || pong.seq != m_probeSeq ||
+      pong.sentUs != m_probeSentUs)
+    return;
+
+  m_probeOutstanding = false;
+  m_probeStallReported = false;
+  m_latency.addSample(probeClockUs() - m_probeSentUs, pong.holdUs,
+                      m_localStages.sample(), pong.stages);
+  emit latencyUpdated(m_latency.estimate());
+}
+
+void ChatSession::transportDrained() {
+  // What was held back for the high-water mark can follow now
+  pumpChannels();
+}
+
+void ChatSession::transportClosed() {
+  const bool wasConnected = m_connected;
+  m_connected = false;
+  m_ready = false;
+  m_probeTimer->stop();
+  // A connect that failed, rather than a connection that ended
+  if (!wasConnected && !m_closing) {
+    m_closing = true;
+    emit errorOccurred("Cannot connect to " + m_target);
+    return;
+  }
+  m_closing = true;
+  if (hasPendingOutput()) {
+    qWarning() << "Disconnected with unsent queued messages";
+    m_outbox.clear();
+    m_channelQueue.clear();
+  }
+  emit disconnected();
+}
+
+bool ChatSession::sendMessage(const QString &text) {
+  if (!isConnected())
+    return false;
+  if (!m_ready) {
+    m_outbox.append(text);
+    return true;
+  }
+
+  const quint64 messageId = newMessageId(peerCaps());
+  TraceSpan messageSpan("send_message", messageId);
+  return writeSealed(
+      seal(text, remotePublicKey(), remoteWideKey(), peerCaps(), messageId));
+}
+
+void ChatSession::flushOutbox() {
+  if (m_outbox.isEmpty())
+    return;
+
+  // Seal the whole backlog, then hand it to the socket as one write
+  TraceSpan backlogSpan("send_backlog");
+  QByteArray batch;
+  QList<SendInfo> sent;
+  for (const QString &text : std::as_const(m_outbox)) {
+    SealedFrame sealed = seal(text, remotePublicKey(), remoteWideKey(),
+                              peerCaps(), newMessageId(peerCaps()));
+    batch += sealed.frame;
+    sent.append(sealed.info);
+  }
+  m_outbox.clear();
+
+  {
+    TraceSpan writeSpan("socket_write");
+    for (const SendInfo &info : std::as_const(sent)) {
+      traceFlow("message", info.messageId, true);
+    }
+    writeFrame(batch);
+    m_scheduler->flush();
+  }
+  metricsAdd(Counter::MessagesSent, sent.size());
+  for (const SendInfo &info : std::as_const(sent)) {
+    emit messageSent(info);
+  }
+}
+
+ChatSession::SealedFrame ChatSession::seal(const QString &text,
+                                           const PublicKey &pub,
+                                           const AnyRsaKey *widePub,
+                                           const PeerCaps &caps,
+                                           quint64 messageId) {
+  return sealPayload(text.toStdString(), pub, widePub, caps, messageId,
+                     Channel::Chat, false);
+}
+
+ChatSession::SealedFrame
+ChatSession::sealPayload(const std::string &payload, const PublicKey &pub,
+                         const AnyRsaKey *widePub, const PeerCaps &caps,
+                         quint64 messageId, Channel channel, bool more) {
+  // Scratch reused by every seal on this thread (group sends seal on
+  // pool workers), so sealing allocates little beyond the frame itself
+  thread_local std::vector<CipherWord> cipher;
+  thread_local std::string text;
+
+  FrameHeader header;
+  text.clear();
+  const std::size_t words = appendSealedFrame(
+      payload, pub, widePub, caps, messageId, channel, more, header, cipher,
+      text);
+
+  SealedFrame sealed;
+  sealed.frame = QByteArray(text.data(), static_cast<qsizetype>(text.size()));
+
+  // The preview shows the comma-separated ciphertext, which is the body of
+  // the frame unless it was bit-packed. File chunks skip it: only chat
+  // messages show up in the preview pane.
+  if (channel == Channel::Chat || !caps.announced) {
+    if (header.packedBits != 0) {
+      thread_local std::string preview;
+      preview.clear();
+      appendCipherList(cipher, preview);
+      sealed.info.cipherText = QString::fromLatin1(
+          preview.data(), static_cast<qsizetype>(preview.size()));
+    } else {
+      const std::size_t body = text.rfind(':') + 1;
+      sealed.info.cipherText = QString::fromLatin1(
+          text.data() + body, static_cast<qsizetype>(text.size() - body - 1));
+    }
+  }
+
+  sealed.info.cipherLength = static_cast<int>(words);
+  sealed.info.compressed = header.compressed;
+  sealed.info.plainSize = header.plainSize;
+  sealed.info.messageId = messageId;
+  return sealed;
+}
+
+bool ChatSession::writeSealed(const SealedFrame &sealed) {
+  if (!isConnected() || !m_ready)
+    return false;
+
+  // Send encrypted message over socket
+  {
+    TraceSpan writeSpan("socket_write", sealed.info.messageId);
+    traceFlow("message", sealed.info.messageId, true);
+    enqueueFrame(QueuedFrame{sealed.frame, {}, Channel::Chat, false});
+  }
+  metricsAdd(Counter::MessagesSent);
+  emit messageSent(sealed.info);
+  return true;
+}
+
+bool ChatSession::sendFile(const QString &name, const QByteArray &data) {
+  if (!isConnected() || !m_ready || !peerCaps().channels)
+    return false;
+
+  const std::string payload =
+      buildFilePayload(name.toStdString(),
+                       std::string_view(data.constData(),
+                                        static_cast<std::size_t>(data.size())));
+  if (payload.size() > kMaxChannelMessage)
+    return false;
+
+  for (std::size_t pos = 0; pos < payload.size(); pos += kChannelChunkSize) {
+    const std::size_t len = std::min(kChannelChunkSize, payload.size() - pos);
+    m_channelQueue.push(Channel::File,
+                        QueuedFrame{{}, payload.substr(pos, len), Channel::File,
+                                    pos + len < payload.size()});
+  }
+  pumpChannels();
+  return true;
+}
+
+bool ChatSession::sendControl(const QString &text) {
+  if (!isConnected() || !m_ready || !peerCaps().channels)
+    return false;
+
+  SealedFrame sealed =
+      sealPayload(text.toStdString(), remotePublicKey(), remoteWideKey(),
+                  peerCaps(), 0, Channel::Control, false);
+  enqueueFrame(QueuedFrame{sealed.frame, {}, Channel::Control, false});
+  return true;
+}
+
+void ChatSession::enqueueFrame(QueuedFrame frame) {
+  const Channel channel = frame.channel;
+  m_channelQueue.push(channel, std::move(frame));
+  pumpChannels();
+}
+
+void ChatSession::pumpChannels() {
+  if (!isConnected())
+    return;
+
+  QueuedFrame next;
+  while (m_transport.pendingBytes(m_id) < kSocketHighWater &&
+         m_channelQueue.pop(next)) {
+    if (next.frame.isEmpty()) {
+      TraceSpan sealSpan("seal_chunk");
+      next.frame = sealPayload(next.plain, remotePublicKey(), remoteWideKey(),
+                               peerCaps(), 0, next.channel, next.more)
+                       .frame;
+    }
+    writeFrame(next.frame);
+  }
+
+  if (m_disconnectPending && !hasPendingOutput()) {
+    m_disconnectPending = false;
+    disconnectFromHost();
+  }
+}
+
+bool ChatSession::hasPendingOutput() const {
+  return !m_outbox.isEmpty() || !m_channelQueue.empty();
+}
+
+void ChatSession::writeFrame(const QByteArray &frame) {
+  m_scheduler->enqueue(frame);
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "SendScheduler.h"
+#include "rsa_chat_capture.h"
+#include "rsa_chat_channels.h"
+#include "rsa_chat_probe.h"
+#include "rsa_chat_protocol.h"
+#include "rsa_chat_session.h"
+#include "rsa_chat_transport.h"
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class QTimer;
+
+// One peer connection speaking the chat protocol: key exchange, CAPS
+// negotiation, framing, compression and encryption, the wire side of
+// which is the SessionCore (rsa_chat_session.h) it shares with
+// AsyncSession. Owns no widgets, so the GUI and the headless CLI share
+// it.
+//
+// The bytes go through a Transport (rsa_chat_transport.h) owned by the
+// caller, whose handlers for this connection must be passed on to the
+// transport*() methods below; ChatRoom does that for its members.
+//
+// With peers that announce channel support, chat, control and file
+// traffic are multiplexed over the connection with strict priority (see
+// rsa_chat_channels.h).
+//
+// Peers that announce probe support exchange PING:/PONG: lines about once
+// a second (see rsa_chat_probe.h), which keeps a live RTT and per-stage
+// cost estimate for each end and notices a silent peer long before TCP
+// gives up on it.
+class ChatSession : public QObject {
+  Q_OBJECT
+public:
+  // What sendMessage() put on the wire, for the preview pane
+  struct SendInfo {
+    int cipherLength = 0;
+    bool compressed = false;
+    quint32 plainSize = 0;
+    QString cipherText;
+    quint64 messageId = 0;
+  };
+
+  // A message encrypted for one peer, ready to be written
+  struct SealedFrame {
+    QByteArray frame;
+    SendInfo info;
+  };
+
+  ChatSession(const KeyPair &keys, Transport &transport,
+              QObject *parent = nullptr);
+  ~ChatSession() override;
+
+  // Takes effect for the next connectToHost()/attachConnection()
+  void setSendOptions(const SendOptions &options) { m_sendOptions = options; }
+  // A wide key pair to offer in a WKEY: line; peers that take it seal
+  // for us under it. Takes effect for the next connection too.
+  void setWideKeys(const AnyRsaKeyPair &keys) { m_core.setWideKeys(keys); }
+  // Records every read from now on into `filename` for rsa_chat_replay
+  // (see rsa_chat_capture.h). Returns false if the file cannot be created.
+  bool startCapture(const QString &filename);
+
+  // Returns the connection's id, 0 if the host name does not resolve
+  // (errorOccurred() follows from the event loop)
+  ConnectionId connectToHost(const QString &host, quint16 port);
+  // Server side: takes over an accepted connection and starts the key
+  // exchange straight away
+  void attachConnection(ConnectionId id);
+  // Waits for any queued backlog to go out first
+  void disconnectFromHost();
+
+  ConnectionId connectionId() const { return m_id; }
+  bool isConnected() const { return m_connected && !m_closing; }
+
+  // The transport's handlers for this connection
+  void transportConnected();
+  void transportReceived(std::string_view data);
+  void transportDrained();
+  void transportClosed();
+
+  // True once the peer's public key has arrived
+  bool isReady() const { return m_ready; }
+
+  // Kept after the disconnect, for the goodbye messages
+  QString peerAddress() const { return m_peerAddress; }
+  // Where the peer's public key was saved, empty before the exchange
+  QString peerKeyFile() const { return m_peerKeyFile; }
+  const PublicKey &remotePublicKey() const {
+    return m_core.remotePublicKey();
+  }
+  const PeerCaps &peerCaps() const { return m_core.peerCaps(); }
+  // The peer's WKEY: key, null if it sent none
+  const AnyRsaKey *remoteWideKey() const { return m_core.remoteWideKey(); }
+  const LatencyEstimate &latency() const { return m_latency.estimate(); }
+
+  // Encrypts and sends one chat message. Before the peer's key arrives
+  // the plaintext is queued and the whole backlog goes out in a single
+  // write once it does. Returns false only without a connection.
+  bool sendMessage(const QString &text);
+  int queuedMessages() const { return m_outbox.size(); }
+
+  // Sends a file on the file channel. Chat and control frames overtake
+  // it chunk by chunk. Needs a peer that announced channel support.
+  bool sendFile(const QString &name, const QByteArray &data);
+  // Sends a message on the control channel, ahead of everything else
+  bool sendControl(const QString &text);
+
+  // Compresses, encrypts and frames `text` for a peer with key `pub`
+  // (`widePub` if it sent a WKEY: key) and capabilities `caps`. Touches no
+  // session state, so group sends run it on worker threads.
+  static SealedFrame seal(const QString &text, const PublicKey &pub,
+                          const AnyRsaKey *widePub, const PeerCaps &caps,
+                          quint64 messageId);
+  static SealedFrame sealPayload(const std::string &payload,
+                                 const PublicKey &pub,
+                                 const AnyRsaKey *widePub,
+                                 const PeerCaps &caps, quint64 messageId,
+                                 Channel channel, bool more);
+  // Writes a frame made by seal(). Needs the key exchange to be done.
+  bool writeSealed(const SealedFrame &sealed);
+
+signals:
+  void connected();
+  void keysExchanged();
+  void messageSent(const ChatSession::SendInfo &info);
+  void messageReceived(const QString &text, quint64 messageId);
+  void messageDropped(const QString &reason);
+  void fileReceived(const QString &name, const QByteArray &data);
+  void controlReceived(const QString &text);
+  // After every probe reply, and every interval while one is overdue
+  void latencyUpdated(const LatencyEstimate &estimate);
+  void errorOccurred(const QString &message);
+  void disconnected();
+
+private slots:
+  void sendProbe();
+
+private:
+  void setupConnection(ConnectionId id);
+  void sendPublicKey();
+  void writeFrame(const QByteArray &frame);
+  void handleKey(const PublicKey &key);
+  void handleKeysExchanged();
+  void handlePong(const ProbePong &pong);
+  void flushOutbox();
+
+  // An empty frame is a bulk chunk sealed only when its turn comes
+  struct QueuedFrame {
+    QByteArray frame;
+    std::string plain;
+    Channel channel = Channel::Chat;
+    bool more = false;
+  };
+  void enqueueFrame(QueuedFrame frame);
+  void pumpChannels();
+  bool hasPendingOutput() const;
+
+  Transport &m_transport;
+  ConnectionId m_id = 0;
+  bool m_connected = false;
+  // disconnectFromHost() has closed the connection
+  bool m_closing = false;
+  QString m_target;
+  QString m_peerAddress;
+  SendScheduler *m_scheduler;
+  SendOptions m_sendOptions;
+  SessionCore m_core;
+
+  QString m_peerKeyFile;
+  bool m_ready;
+
+  // Plaintext sent before the key exchange finished
+  QStringList m_outbox;
+  bool m_disconnectPending;
+
+  ChannelQueue<QueuedFrame> m_channelQueue;
+  std::array<std::function<void(std::string_view, quint64)>, kChannelCount>
+      m_channelHandlers;
+
+  QTimer *m_probeTimer;
+  LatencyEstimator m_latency;
+  // Our own side of each estimate; what goes into our pongs is sampled
+  // by the core, so neither resets the other's interval
+  StageSampler m_localStages;
+  quint32 m_probeSeq = 0;
+  bool m_probeOutstanding = false;
+  bool m_probeStallReported = false;
+  quint64 m_probeSentUs = 0;
+
+  std::unique_ptr<CaptureWriter> m_capture;
+};
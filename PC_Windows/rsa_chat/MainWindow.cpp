@@ -1,24 +1,56 @@
 #include "MainWindow.h"
+#include "ChatHistory.h"
 #include "ChatPage.h"
+#include "ChatRoom.h"
 #include "SetupPage.h"
+#include "StatsPanel.h"
 #include "rsa_chat_core.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+#include "rsa_chat_transport.h"
 #include <QDebug>
+#include <QDir>
 #include <QFile>
-#include <QHostAddress>
+#include <QFileDialog>
+#include <QFileInfo>
 #include <QKeyEvent>
 #include <QMessageBox>
 #include <QStackedWidget>
-#include <QTcpServer>
 #include <QTimer>
-#include <fstream>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), m_stack(new QStackedWidget(this)),
       m_setupPage(new SetupPage(this)), m_chatPage(new ChatPage(this)),
-      m_server(new QTcpServer(this)), m_socket(nullptr) {
+      m_history(new ChatHistory(this)), m_room(nullptr),
+      m_statsPanel(nullptr), m_metricsTimer(new QTimer(this)), m_keys{} {
+  // Peers on this machine are reached through shared memory unless
+  // RSA_CHAT_NO_SHM is set; anyone else, or a peer without the shortcut,
+  // over TCP
+  const bool sameHostShortcut = !qEnvironmentVariableIsSet("RSA_CHAT_NO_SHM");
+  m_room = new ChatRoom(
+      m_keys, makeTransport(TransportKind::Qt, sameHostShortcut), this);
+  m_room->setSendOptions(SendOptions::fromEnvironment());
+  // Each peer's traffic is recorded for rsa_chat_replay when this is set
+  m_room->setCaptureDirectory(qEnvironmentVariable("RSA_CHAT_CAPTURE_DIR"));
   setupUi();
   setupConnections();
 
+  // Periodic JSON dump of the hot-path metrics (same data as F6), only
+  // when asked for: nothing is written to the working directory otherwise
+  m_metricsFile = qEnvironmentVariable("RSA_CHAT_METRICS_FILE");
+  if (!m_metricsFile.isEmpty()) {
+    connect(m_metricsTimer, &QTimer::timeout, this, &MainWindow::dumpMetrics);
+    m_metricsTimer->start(10000);
+  }
+
+  // Tracing from launch when a trace file is given, otherwise toggled by F7
+  m_traceFile = qEnvironmentVariable("RSA_CHAT_TRACE_FILE");
+  if (!m_traceFile.isEmpty()) {
+    traceSetEnabled(true);
+  } else {
+    m_traceFile = "rsa_chat_trace.json";
+  }
+
   // Step 1: Get and display local IP
   m_myIP = QString::fromStdString(getLocalIP());
   m_setupPage->setStatusText("Your IP: " + m_myIP +
@@ -28,11 +60,11 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 MainWindow::~MainWindow() {
-  deleteKeyFiles();
-  if (m_socket) {
-    m_socket->disconnectFromHost();
-    m_socket->deleteLater();
+  if (traceEnabled()) {
+    exportTrace();
   }
+  deleteKeyFiles();
+  delete m_room;
 }
 
 void MainWindow::deleteKeyFiles() {
@@ -51,17 +83,10 @@ void MainWindow::deleteKeyFiles() {
     qInfo() << "Deleted:" << privFile;
   }
 
-  // Also delete peer's public key file if we have a connection
-  if (m_socket) {
-    QString peerIP = m_socket->peerAddress().toString();
-    if (peerIP.startsWith("::ffff:")) {
-      peerIP = peerIP.mid(7);
-    }
-    QString peerClean = peerIP;
-    peerClean.replace('.', '_');
-    peerClean.replace(':', '_');
-    QString peerPubFile = peerClean + "_public.key";
-    if (QFile::exists(peerPubFile)) {
+  // Also delete the public key files of everyone still connected
+  for (ChatSession *member : m_room->members()) {
+    QString peerPubFile = member->peerKeyFile();
+    if (!peerPubFile.isEmpty() && QFile::exists(peerPubFile)) {
       QFile::remove(peerPubFile);
       qInfo() << "Deleted:" << peerPubFile;
     }
@@ -86,31 +111,46 @@ void MainWindow::setupConnections() {
 
   connect(m_chatPage, &ChatPage::sendMessageRequested, this,
           &MainWindow::handleSendMessageRequested);
-
-  connect(m_server, &QTcpServer::newConnection, this,
-          &MainWindow::handleNewIncomingConnection);
+  connect(m_chatPage, &ChatPage::sendFileRequested, this,
+          &MainWindow::handleSendFileRequested);
+  connect(m_chatPage, &ChatPage::searchRequested, m_history,
+          &ChatHistory::search);
+  connect(m_history, &ChatHistory::resultsReady, m_chatPage,
+          &ChatPage::showSearchResults);
+
+  connect(m_room, &ChatRoom::memberConnected, this,
+          &MainWindow::handleMemberConnected);
+  connect(m_room, &ChatRoom::memberReady, this,
+          &MainWindow::handleMemberReady);
+  connect(m_room, &ChatRoom::memberLeft, this, &MainWindow::handleMemberLeft);
+  connect(m_room, &ChatRoom::messageReceived, this,
+          &MainWindow::handlePeerMessage);
+  connect(m_room, &ChatRoom::messageDropped, this,
+          [this](ChatSession *, const QString &reason) {
+            m_chatPage->appendMessage("System", reason);
+          });
+  connect(m_room, &ChatRoom::fileReceived, this,
+          &MainWindow::handleFileReceived);
+  connect(m_room, &ChatRoom::messageSent, this,
+          &MainWindow::handleMessageSent);
+  connect(m_room, &ChatRoom::errorOccurred, this,
+          &MainWindow::handleSessionError);
+  connect(m_room, &ChatRoom::latencyUpdated, this,
+          &MainWindow::handleLatencyUpdated);
 }
 
+// Every peer that connects joins the room; nobody is dropped for a
+// newcomer
 void MainWindow::startServer(quint16 port) {
-  if (!m_server->listen(QHostAddress::Any, port)) {
-    qWarning() << "Server listen failed:" << m_server->errorString();
-    m_setupPage->setStatusText("Error: " + m_server->errorString());
+  if (!m_room->listen(port)) {
+    qWarning() << "Server listen failed on port" << port;
+    m_setupPage->setStatusText(
+        QString("Error: cannot listen on port %1").arg(port));
   } else {
-    qInfo() << "Server listening on port" << m_server->serverPort();
+    qInfo() << "Server listening on port" << m_room->localPort();
   }
 }
 
-void MainWindow::setupSocket(QTcpSocket *socket) {
-  connect(socket, &QTcpSocket::connected, this,
-          &MainWindow::handleSocketConnected);
-  connect(socket, &QTcpSocket::readyRead, this,
-          &MainWindow::handleSocketReadyRead);
-  connect(socket, &QTcpSocket::errorOccurred, this,
-          &MainWindow::handleSocketError);
-  connect(socket, &QTcpSocket::disconnected, this,
-          &MainWindow::handleSocketDisconnected);
-}
-
 void MainWindow::handleGenerateKeys() {
   // Step 2: Generate keys with IP in filename
   m_keys = generateAndSaveKeys(m_myIP.toStdString());
@@ -126,168 +166,219 @@ void MainWindow::handleGenerateKeys() {
           .arg(m_keys.pub.e)
           .arg(m_keys.priv.d);
   m_setupPage->appendStatusText(info);
+  m_room->setKeys(m_keys);
 }
 
 void MainWindow::handleConnectToServer(const QString &host, quint16 port) {
-  if (m_socket) {
-    m_socket->deleteLater();
-    m_socket = nullptr;
-  }
-
-  auto *socket = new QTcpSocket(this);
-  m_socket = socket;
-  setupSocket(socket);
-
   m_setupPage->setStatusText("Connecting to " + host + ":" +
                              QString::number(port) + "...");
-  socket->connectToHost(host, port);
+  m_room->connectToHost(host, port);
 }
 
-void MainWindow::handleNewIncomingConnection() {
-  QTcpSocket *client = m_server->nextPendingConnection();
-  if (!client)
-    return;
+QString MainWindow::peerLabel(ChatSession *member) const {
+  return m_room->members().size() > 1 ? member->peerAddress() : "Peer";
+}
 
-  if (m_socket) {
-    m_socket->deleteLater();
+void MainWindow::handleMemberConnected(ChatSession *member) {
+  m_setupPage->setStatusText("Connected to " + member->peerAddress() +
+                             "\nExchanging keys...");
+
+  // Messages typed from here on are queued until the peer's key arrives,
+  // so there is no need to wait on the setup page
+  if (m_stack->currentWidget() != m_chatPage) {
+    m_chatPage->appendMessage("System",
+                              "Connected! Exchanging keys, you can already "
+                              "type.");
+    m_stack->setCurrentWidget(m_chatPage);
   }
+}
 
-  m_socket = client;
-  setupSocket(client);
+void MainWindow::handleMemberReady(ChatSession *member) {
+  if (m_room->readyCount() == 1) {
+    m_chatPage->appendMessage("System", "Keys exchanged! You can now chat.");
+  } else {
+    m_chatPage->appendMessage("System",
+                              member->peerAddress() + " joined the chat.");
+  }
+}
 
-  QString peerIP = client->peerAddress().toString();
-  m_setupPage->setStatusText("Peer connected from " + peerIP +
-                             "\nExchanging keys...");
+void MainWindow::handleMemberLeft(ChatSession *member) {
+  if (m_latency.remove(member))
+    showLatency();
 
-  // Send our public key immediately
-  sendPublicKey();
+  // Still listed in the room while this runs
+  if (m_room->members().size() == 1) {
+    deleteKeyFiles();
+    m_chatPage->appendMessage("System", "Peer disconnected. Keys deleted.");
+    return;
+  }
+
+  QString peerPubFile = member->peerKeyFile();
+  if (!peerPubFile.isEmpty() && QFile::exists(peerPubFile)) {
+    QFile::remove(peerPubFile);
+    qInfo() << "Deleted:" << peerPubFile;
+  }
+  m_chatPage->appendMessage("System",
+                            member->peerAddress() + " left the chat.");
 }
 
-void MainWindow::handleSocketConnected() {
-  m_setupPage->setStatusText("Connected! Exchanging keys...");
-  // Send our public key immediately
-  sendPublicKey();
+void MainWindow::handlePeerMessage(ChatSession *from, const QString &text,
+                                   quint64 messageId) {
+  TraceSpan renderSpan("render", messageId);
+  m_history->addMessage(m_chatPage->appendMessage(peerLabel(from), text),
+                        text);
 }
 
-void MainWindow::sendPublicKey() {
-  if (!m_socket)
+void MainWindow::handleSessionError(ChatSession *member,
+                                    const QString &message) {
+  Q_UNUSED(member);
+  m_chatPage->appendMessage("System", "Error: " + message);
+}
+
+void MainWindow::handleSendMessageRequested(const QString &text) {
+  if (m_room->members().isEmpty()) {
+    m_chatPage->appendMessage("System", "Not connected!");
     return;
+  }
 
-  QString msg = QString("KEY:%1:%2\n").arg(m_keys.pub.e).arg(m_keys.pub.n);
-  m_socket->write(msg.toUtf8());
-  m_socket->flush();
+  // Sealed for every member in parallel (or queued until their key
+  // arrives); previews arrive through handleMessageSent() as each frame
+  // goes out
+  if (m_room->broadcast(text) == 0) {
+    m_chatPage->appendMessage("System", "Not connected!");
+    return;
+  }
 
-  qInfo() << "Sent public key:" << m_keys.pub.e << m_keys.pub.n;
+  // Show in own chat
+  m_history->addMessage(m_chatPage->appendMessage("Me", text), text);
 }
 
-void MainWindow::handleSocketReadyRead() {
-  if (!m_socket)
+void MainWindow::handleSendFileRequested() {
+  QString path = QFileDialog::getOpenFileName(this, "Send File");
+  if (path.isEmpty())
     return;
 
-  QByteArray data = m_socket->readAll();
-  QString message = QString::fromUtf8(data).trimmed();
-
-  QStringList lines = message.split('\n', Qt::SkipEmptyParts);
-  for (const QString &line : lines) {
-    if (line.startsWith("KEY:")) {
-      // Received their public key
-      QStringList parts = line.split(':');
-      if (parts.size() == 3) {
-        bool ok1, ok2;
-        int e = parts[1].toInt(&ok1);
-        int n = parts[2].toInt(&ok2);
-        if (ok1 && ok2) {
-          m_remotePublicKey.e = e;
-          m_remotePublicKey.n = n;
-
-          // Save their key to file
-          QString peerIP = m_socket->peerAddress().toString();
-          if (peerIP.startsWith("::ffff:")) {
-            peerIP = peerIP.mid(7);
-          }
-          QString ipClean = peerIP;
-          ipClean.replace('.', '_');
-          ipClean.replace(':', '_');
-
-          std::string filename = ipClean.toStdString() + "_public.key";
-          std::ofstream file(filename);
-          file << e << " " << n;
-          file.close();
-
-          qInfo() << "Received public key - e:" << e << "n:" << n;
-          m_chatPage->appendMessage("System",
-                                    "Keys exchanged! You can now chat.");
-          m_stack->setCurrentWidget(m_chatPage);
-        }
-      }
-    } else if (line.startsWith("MSG:")) {
-      // Received encrypted message
-      QString cipherStr = line.mid(4); // Remove "MSG:"
-      QStringList cipherParts = cipherStr.split(',', Qt::SkipEmptyParts);
-
-      std::vector<int> cipher;
-      for (const QString &part : cipherParts) {
-        bool ok;
-        int val = part.toInt(&ok);
-        if (ok)
-          cipher.push_back(val);
-      }
-
-      if (!cipher.empty()) {
-        std::string plain = decryptMessage(cipher, m_keys.priv);
-        m_chatPage->appendMessage("Peer", QString::fromStdString(plain));
-      }
-    }
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    m_chatPage->appendMessage("System", "Cannot open " + path);
+    return;
+  }
+  QByteArray data = file.readAll();
+  QString name = QFileInfo(path).fileName();
+
+  // Goes out in chunks on the file channel, so chat keeps flowing while
+  // it transfers
+  int count = m_room->broadcastFile(name, data);
+  if (count == 0) {
+    m_chatPage->appendMessage(
+        "System", "No connected peer can receive files (peer too old?)");
+    return;
   }
+  m_chatPage->appendMessage("System", QString("Sending %1 (%2 bytes)...")
+                                          .arg(name)
+                                          .arg(data.size()));
 }
 
-void MainWindow::handleSocketError(QAbstractSocket::SocketError socketError) {
-  Q_UNUSED(socketError);
-  if (m_socket) {
-    m_chatPage->appendMessage("System", "Error: " + m_socket->errorString());
+void MainWindow::handleFileReceived(ChatSession *from, const QString &name,
+                                    const QByteArray &data) {
+  // Only the base name is trusted, the sender cannot pick the directory
+  QString path =
+      QDir::current().filePath("received_" + QFileInfo(name).fileName());
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+    m_chatPage->appendMessage("System", "Failed to save " + path);
+    return;
   }
+  m_chatPage->appendMessage(peerLabel(from),
+                            QString("[File] %1 (%2 bytes) saved to %3")
+                                .arg(name)
+                                .arg(data.size())
+                                .arg(path));
 }
 
-void MainWindow::handleSocketDisconnected() {
-  deleteKeyFiles();
-  m_chatPage->appendMessage("System", "Peer disconnected. Keys deleted.");
+void MainWindow::handleMessageSent(ChatSession *to,
+                                   const ChatSession::SendInfo &info) {
+  // Show preview info if enabled
+  if (!m_chatPage->isPreviewEnabled())
+    return;
+
+  QString prefix = m_room->members().size() > 1
+                       ? QString("[To: %1] ").arg(to->peerAddress())
+                       : QString();
+  m_chatPage->appendPreviewInfo(prefix +
+                                QString("[Length: %1]").arg(info.cipherLength));
+  if (info.compressed) {
+    m_chatPage->appendPreviewInfo(prefix +
+                                  QString("[Compressed: %1 -> %2 bytes]")
+                                      .arg(info.plainSize)
+                                      .arg(info.cipherLength));
+  }
+  m_chatPage->appendPreviewInfo(prefix +
+                                QString("[Cipher: %1]").arg(info.cipherText));
 }
 
-void MainWindow::handleSendMessageRequested(const QString &text) {
-  if (!m_socket || m_socket->state() != QAbstractSocket::ConnectedState) {
-    m_chatPage->appendMessage("System", "Not connected!");
-    return;
+void MainWindow::handleLatencyUpdated(ChatSession *member,
+                                      const LatencyEstimate &estimate) {
+  m_latency[member] = QString::fromStdString(describeLatency(estimate));
+  showLatency();
+}
+
+void MainWindow::showLatency() {
+  QStringList lines;
+  for (auto it = m_latency.cbegin(); it != m_latency.cend(); ++it) {
+    // Only a group chat needs to say which peer a line is about
+    lines.append(m_latency.size() > 1
+                     ? QString("[%1] %2").arg(it.key()->peerAddress(),
+                                              it.value())
+                     : it.value());
   }
+  m_chatPage->setLatencyInfo(lines.join('\n'));
+}
 
-  // Encrypt message with THEIR public key
-  std::string plain = text.toStdString();
-  std::vector<int> cipher = encryptMessage(plain, m_remotePublicKey);
+void MainWindow::dumpMetrics() {
+  if (!metricsDumpJson(m_metricsFile.toStdString())) {
+    qWarning() << "Failed to write metrics to" << m_metricsFile;
+  }
+}
 
-  // Convert cipher to comma-separated string
-  QString cipherStr;
-  for (size_t i = 0; i < cipher.size(); ++i) {
-    cipherStr += QString::number(cipher[i]);
-    if (i < cipher.size() - 1)
-      cipherStr += ",";
+void MainWindow::exportTrace() {
+  QString processName = "rsa_chat " + m_myIP;
+  if (traceExportChromeJson(m_traceFile.toStdString(),
+                            processName.toStdString())) {
+    qInfo() << "Trace written to" << m_traceFile;
+  } else {
+    qWarning() << "Failed to write trace to" << m_traceFile;
   }
+}
 
-  // Show preview info if enabled
-  if (m_chatPage->isPreviewEnabled()) {
-    m_chatPage->appendPreviewInfo(QString("[Length: %1]").arg(cipher.size()));
-    m_chatPage->appendPreviewInfo(QString("[Cipher: %1]").arg(cipherStr));
+void MainWindow::toggleTracing() {
+  if (!traceEnabled()) {
+    traceSetEnabled(true);
+    m_chatPage->appendMessage("System", "Tracing started (F7 to stop).");
+    return;
   }
 
-  // Send encrypted message over socket
-  m_socket->write(("MSG:" + cipherStr + "\n").toUtf8());
-  m_socket->flush();
+  traceSetEnabled(false);
+  exportTrace();
+  m_chatPage->appendMessage("System", "Trace written to " + m_traceFile);
+}
 
-  // Show in own chat
-  m_chatPage->appendMessage("Me", text);
+void MainWindow::showStats() {
+  if (!m_statsPanel) {
+    m_statsPanel = new StatsPanel(this);
+  }
+  m_statsPanel->show();
+  m_statsPanel->raise();
+  m_statsPanel->activateWindow();
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
   if (event->key() == Qt::Key_F5) {
     showHelp();
+  } else if (event->key() == Qt::Key_F6) {
+    showStats();
+  } else if (event->key() == Qt::Key_F7) {
+    toggleTracing();
   } else {
     QMainWindow::keyPressEvent(event);
   }
@@ -327,7 +418,12 @@ void MainWindow::showHelp() {
 <h3>Keyboard Shortcuts</h3>
 <ul>
 <li><b>F5</b> - Show this help</li>
+<li><b>F6</b> - Show live performance statistics</li>
+<li><b>F7</b> - Start/stop tracing (Chrome trace-event JSON)</li>
 </ul>
+
+<h3>Search</h3>
+<p>Type words in the search box above the chat and press Enter to jump to the newest message containing all of them; Enter again steps to older ones. <code>word*</code> matches any word starting with "word".</p>
 )";
 
   QMessageBox helpBox(this);
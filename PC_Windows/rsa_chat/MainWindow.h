@@ -1,13 +1,17 @@
 #pragma once
 
+#include "ChatSession.h"
 #include "rsa_chat_core.h"
 #include <QMainWindow>
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <QMap>
 
 class QStackedWidget;
+class QTimer;
 class SetupPage;
 class ChatPage;
+class StatsPanel;
+class ChatRoom;
+class ChatHistory;
 class QKeyEvent;
 
 class MainWindow : public QMainWindow {
@@ -22,30 +26,47 @@ protected:
 private slots:
   void handleGenerateKeys();
   void handleConnectToServer(const QString &host, quint16 port);
-  void handleNewIncomingConnection();
-  void handleSocketConnected();
-  void handleSocketReadyRead();
-  void handleSocketError(QAbstractSocket::SocketError socketError);
-  void handleSocketDisconnected();
+  void handleMemberConnected(ChatSession *member);
+  void handleMemberReady(ChatSession *member);
+  void handleMemberLeft(ChatSession *member);
+  void handlePeerMessage(ChatSession *from, const QString &text,
+                         quint64 messageId);
+  void handleMessageSent(ChatSession *to, const ChatSession::SendInfo &info);
+  void handleLatencyUpdated(ChatSession *member,
+                            const LatencyEstimate &estimate);
+  void handleSessionError(ChatSession *member, const QString &message);
   void handleSendMessageRequested(const QString &text);
+  void handleSendFileRequested();
+  void handleFileReceived(ChatSession *from, const QString &name,
+                          const QByteArray &data);
+  void dumpMetrics();
 
 private:
   void setupUi();
   void setupConnections();
-  void setupSocket(QTcpSocket *socket);
   void startServer(quint16 port);
-  void sendPublicKey();
+  QString peerLabel(ChatSession *member) const;
   void deleteKeyFiles();
   void showHelp();
+  void showStats();
+  void toggleTracing();
+  void exportTrace();
+  void showLatency();
 
   QStackedWidget *m_stack;
   SetupPage *m_setupPage;
   ChatPage *m_chatPage;
+  ChatHistory *m_history;
 
-  QTcpServer *m_server;
-  QTcpSocket *m_socket;
+  ChatRoom *m_room;
+
+  StatsPanel *m_statsPanel;
+  QTimer *m_metricsTimer;
+  QString m_metricsFile;
+  QString m_traceFile;
+  // Latest probe summary per member, for the preview area
+  QMap<ChatSession *, QString> m_latency;
 
   QString m_myIP;
   KeyPair m_keys;
-  PublicKey m_remotePublicKey;
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include "QtExecutor.h"
+#include "rsa_chat_async.h"
+#include <QAbstractEventDispatcher>
+#include <QSocketNotifier>
+
+ExecutorDriver::ExecutorDriver(Executor &executor, QObject *parent)
+    : QObject(parent), m_executor(executor) {
+  if (m_executor.waitFd() >= 0) {
+    m_notifier = std::make_unique<QSocketNotifier>(m_executor.waitFd(),
+                                                   QSocketNotifier::Read);
+    QObject::connect(m_notifier.get(), &QSocketNotifier::activated, this,
+                     [this] { m_executor.runOnce(0); });
+  }
+  // Coroutines readied by Qt's own socket events, spawn() or a previous
+  // turn run before the loop sleeps, one turn per pass so widgets stay
+  // responsive under a busy coroutine
+  QObject::connect(QAbstractEventDispatcher::instance(thread()),
+                   &QAbstractEventDispatcher::aboutToBlock, this, [this] {
+                     if (!m_turnQueued && !m_executor.prepareWait())
+                       scheduleTurn();
+                   });
+  // Queued calls are the one thread-safe way into a sleeping Qt loop
+  m_executor.setWakeHandler([this] {
+    QMetaObject::invokeMethod(
+        this, [this] { m_executor.runOnce(0); }, Qt::QueuedConnection);
+  });
+}
+
+ExecutorDriver::~ExecutorDriver() { m_executor.setWakeHandler({}); }
+
+void ExecutorDriver::scheduleTurn() {
+  m_turnQueued = true;
+  QMetaObject::invokeMethod(
+      this,
+      [this] {
+        m_turnQueued = false;
+        m_executor.runOnce(0);
+      },
+      Qt::QueuedConnection);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QObject>
+#include <memory>
+
+class Executor;
+class QSocketNotifier;
+
+// Turns an Executor (rsa_chat_async.h) from the Qt event loop, so
+// coroutine sessions run inside QCoreApplication::exec() next to the
+// widgets instead of in Executor::run(). Like TransportDriver, which it
+// replaces for the executor's transport: the transport's waitFd() is
+// watched with a QSocketNotifier, and before the loop goes to sleep the
+// executor gets a runOnce(0) if coroutines are ready or the transport
+// has work. Jobs post()ed from other threads wake the loop through a
+// queued call. Must be made on the executor's thread, and destroyed
+// before the executor once no other thread posts to it any more.
+class ExecutorDriver : public QObject {
+public:
+  explicit ExecutorDriver(Executor &executor, QObject *parent = nullptr);
+  ~ExecutorDriver() override;
+
+private:
+  void scheduleTurn();
+
+  Executor &m_executor;
+  std::unique_ptr<QSocketNotifier> m_notifier;
+  bool m_turnQueued = false;
+};
@@ -0,0 +1,293 @@
+#include "QtTransport.h"
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QSocketNotifier>
+#include <QTcpSocket>
+#include <QThread>
+
+#if defined(Q_OS_UNIX)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+// Enough for a few frames; the rest waits in the kernel
+static constexpr qint64 kPausedReadBuffer = 64 * 1024;
+
+QtTransport::QtTransport() {
+  m_wakeTimer.setSingleShot(true);
+  QObject::connect(&m_server, &QTcpServer::newConnection, &m_server, [this] {
+    while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+      const ConnectionId id = addSocket(socket);
+      if (m_handlers.accepted)
+        m_handlers.accepted(id);
+    }
+  });
+}
+
+QtTransport::~QtTransport() {
+  for (auto &[id, socket] : m_sockets) {
+    socket->disconnect();
+    socket->abort();
+    delete socket;
+  }
+}
+
+bool QtTransport::listen(std::uint16_t port) {
+  return m_server.listen(QHostAddress::Any, port);
+}
+
+std::uint16_t QtTransport::localPort() const { return m_server.serverPort(); }
+
+ConnectionId QtTransport::connect(const std::string &host,
+                                  std::uint16_t port) {
+  auto *socket = new QTcpSocket;
+  socket->connectToHost(QString::fromStdString(host), port);
+  if (!socket->waitForConnected(5000)) {
+    delete socket;
+    return 0;
+  }
+  return addSocket(socket);
+}
+
+ConnectionId QtTransport::connectAsync(const std::string &host,
+                                       std::uint16_t port) {
+  auto *socket = new QTcpSocket;
+  const ConnectionId id = addSocket(socket);
+  m_connecting.insert(id);
+  QObject::connect(socket, &QTcpSocket::connected, socket, [this, id] {
+    m_connecting.erase(id);
+    if (m_handlers.connected)
+      m_handlers.connected(id);
+  });
+  // A socket that never connected emits no disconnected()
+  QObject::connect(
+      socket, &QTcpSocket::errorOccurred, socket,
+      [this, id, socket] {
+        if (m_connecting.erase(id))
+          finishSocket(id, socket);
+      },
+      Qt::QueuedConnection);
+  // Writes made meanwhile stay in the socket's buffer until it connects
+  socket->connectToHost(QString::fromStdString(host), port);
+  return id;
+}
+
+ConnectionId QtTransport::addSocket(QTcpSocket *socket) {
+  const ConnectionId id = ++m_nextId;
+  m_sockets[id] = socket;
+  socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+  QObject::connect(socket, &QTcpSocket::readyRead, socket,
+                   [this, id, socket] { readSocket(id, socket); });
+  QObject::connect(socket, &QTcpSocket::bytesWritten, socket,
+                   [this, id, socket] {
+                     if (socket->bytesToWrite() == 0 && m_handlers.drained)
+                       m_handlers.drained(id);
+                   });
+  // Queued, so a close() never reports back before the next poll()
+  QObject::connect(
+      socket, &QTcpSocket::disconnected, socket,
+      [this, id, socket] {
+        // Whatever is still buffered is delivered on resume
+        if (m_paused.count(id))
+          m_hungUp.insert(id);
+        else
+          finishSocket(id, socket);
+      },
+      Qt::QueuedConnection);
+  return id;
+}
+
+void QtTransport::readSocket(ConnectionId id, QTcpSocket *socket) {
+  if (m_paused.count(id))
+    return;
+  const qint64 available = socket->bytesAvailable();
+  if (available <= 0)
+    return;
+  m_readBuffer.resize(available);
+  const qint64 received = socket->read(m_readBuffer.data(), available);
+  if (received > 0 && m_handlers.received) {
+    m_handlers.received(id,
+                        std::string_view(m_readBuffer.constData(),
+                                         static_cast<std::size_t>(received)));
+  }
+}
+
+void QtTransport::finishSocket(ConnectionId id, QTcpSocket *socket) {
+  // A close() and the peer's hangup can both get here
+  if (!m_sockets.erase(id))
+    return;
+  m_paused.erase(id);
+  m_hungUp.erase(id);
+  socket->deleteLater();
+  if (m_handlers.closed)
+    m_handlers.closed(id);
+}
+
+void QtTransport::send(ConnectionId id, std::string_view data) {
+  auto it = m_sockets.find(id);
+  if (it == m_sockets.end())
+    return;
+  it->second->write(data.data(), static_cast<qint64>(data.size()));
+  m_dirty.push_back(id);
+}
+
+void QtTransport::flush() {
+  // One write per socket for everything queued since the last flush
+  for (ConnectionId id : m_dirty) {
+    auto it = m_sockets.find(id);
+    if (it != m_sockets.end())
+      it->second->flush();
+  }
+  m_dirty.clear();
+}
+
+std::size_t QtTransport::pendingBytes(ConnectionId id) const {
+  auto it = m_sockets.find(id);
+  return it == m_sockets.end()
+             ? 0
+             : static_cast<std::size_t>(it->second->bytesToWrite());
+}
+
+std::string QtTransport::peerAddress(ConnectionId id) const {
+  auto it = m_sockets.find(id);
+  if (it == m_sockets.end())
+    return {};
+  // IPv4 peers of the dual-stack listener without the ::ffff: prefix
+  QHostAddress address = it->second->peerAddress();
+  bool isV4 = false;
+  const quint32 v4 = address.toIPv4Address(&isV4);
+  if (isV4)
+    address = QHostAddress(v4);
+  return address.toString().toStdString();
+}
+
+void QtTransport::tune(ConnectionId id, const TcpTuning &tuning) {
+  auto it = m_sockets.find(id);
+  if (it == m_sockets.end())
+    return;
+  QTcpSocket *socket = it->second;
+  socket->setSocketOption(QAbstractSocket::LowDelayOption,
+                          tuning.noDelay ? 1 : 0);
+  if (tuning.sendBufferBytes > 0) {
+    socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption,
+                            tuning.sendBufferBytes);
+  }
+  if (tuning.receiveBufferBytes > 0) {
+    socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption,
+                            tuning.receiveBufferBytes);
+  }
+#if defined(TCP_NOTSENT_LOWAT)
+  if (tuning.unsentLimitBytes > 0) {
+    int value = tuning.unsentLimitBytes;
+    ::setsockopt(static_cast<int>(socket->socketDescriptor()), IPPROTO_TCP,
+                 TCP_NOTSENT_LOWAT, &value, sizeof(value));
+  }
+#endif
+}
+
+void QtTransport::close(ConnectionId id) {
+  auto it = m_sockets.find(id);
+  if (it == m_sockets.end())
+    return;
+  // Only the read side sees the connection end
+  setReceiving(id, true);
+  if (m_connecting.erase(id)) {
+    // Nothing to say goodbye to; report it like a failed connect
+    it->second->abort();
+    QTcpSocket *socket = it->second;
+    QMetaObject::invokeMethod(
+        socket, [this, id, socket] { finishSocket(id, socket); },
+        Qt::QueuedConnection);
+    return;
+  }
+  it->second->disconnectFromHost();
+}
+
+void QtTransport::setReceiving(ConnectionId id, bool enabled) {
+  auto it = m_sockets.find(id);
+  if (it == m_sockets.end())
+    return;
+  QTcpSocket *socket = it->second;
+  if (!enabled) {
+    // A full read buffer makes Qt stop reading the socket, so the peer
+    // backs up in the kernel instead of in our memory
+    if (m_paused.insert(id).second)
+      socket->setReadBufferSize(kPausedReadBuffer);
+    return;
+  }
+  if (!m_paused.erase(id))
+    return;
+  socket->setReadBufferSize(0);
+  // What piled up while paused raises no new readyRead
+  QMetaObject::invokeMethod(
+      socket,
+      [this, id, socket] {
+        readSocket(id, socket);
+        if (m_hungUp.count(id))
+          finishSocket(id, socket);
+      },
+      Qt::QueuedConnection);
+}
+
+void QtTransport::watch(int fd) {
+  // An activation is an event, which is all WaitForMoreEvents needs
+  m_watched.push_back(
+      std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Read));
+}
+
+void QtTransport::poll(int timeoutMs) {
+  flush();
+  if (timeoutMs == 0) {
+    // Under a running event loop (TransportDriver) the sockets are served
+    // as soon as the caller returns to it
+    if (QThread::currentThread()->loopLevel() == 0)
+      QCoreApplication::processEvents();
+  } else {
+    if (timeoutMs > 0)
+      m_wakeTimer.start(timeoutMs);
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    m_wakeTimer.stop();
+  }
+  flush();
+}
+
+// The sockets report through the event loop that is about to wait
+bool QtTransport::prepareWait() {
+  flush();
+  return true;
+}
+
+// ---------- TransportDriver ----------
+
+TransportDriver::TransportDriver(Transport &transport, QObject *parent)
+    : QObject(parent), m_transport(transport) {
+  if (m_transport.waitFd() >= 0) {
+    m_notifier = std::make_unique<QSocketNotifier>(m_transport.waitFd(),
+                                                   QSocketNotifier::Read);
+    QObject::connect(m_notifier.get(), &QSocketNotifier::activated, this,
+                     [this] { m_transport.poll(0); });
+  }
+  // Every pass of the loop ends here, so sends made by any event handler
+  // go out together, as they would at the end of poll()
+  QObject::connect(QAbstractEventDispatcher::instance(thread()),
+                   &QAbstractEventDispatcher::aboutToBlock, this, [this] {
+                     if (!m_pollQueued && !m_transport.prepareWait())
+                       schedulePoll();
+                   });
+}
+
+TransportDriver::~TransportDriver() = default;
+
+void TransportDriver::schedulePoll() {
+  m_pollQueued = true;
+  QMetaObject::invokeMethod(
+      this,
+      [this] {
+        m_pollQueued = false;
+        m_transport.poll(0);
+      },
+      Qt::QueuedConnection);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+#include <QByteArray>
+#include <QObject>
+#include <QTcpServer>
+#include <QTimer>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class QTcpSocket;
+class QSocketNotifier;
+
+// Transport over QTcpServer/QTcpSocket. poll() runs the Qt event loop,
+// so a QCoreApplication must exist.
+class QtTransport : public Transport {
+public:
+  QtTransport();
+  ~QtTransport() override;
+
+  bool listen(std::uint16_t port) override;
+  std::uint16_t localPort() const override;
+  ConnectionId connect(const std::string &host, std::uint16_t port) override;
+  ConnectionId connectAsync(const std::string &host,
+                            std::uint16_t port) override;
+  void send(ConnectionId id, std::string_view data) override;
+  void flush() override;
+  std::size_t pendingBytes(ConnectionId id) const override;
+  void close(ConnectionId id) override;
+  void setReceiving(ConnectionId id, bool enabled) override;
+  std::string peerAddress(ConnectionId id) const override;
+  void tune(ConnectionId id, const TcpTuning &tuning) override;
+  void poll(int timeoutMs) override;
+  void watch(int fd) override;
+  int waitFd() const override { return -1; }
+  bool prepareWait() override;
+  const char *name() const override { return "qt"; }
+
+private:
+  ConnectionId addSocket(QTcpSocket *socket);
+  void readSocket(ConnectionId id, QTcpSocket *socket);
+  void finishSocket(ConnectionId id, QTcpSocket *socket);
+
+  QTcpServer m_server;
+  QTimer m_wakeTimer;
+  std::unordered_map<ConnectionId, QTcpSocket *> m_sockets;
+  // Sockets written since the last flush()
+  std::vector<ConnectionId> m_dirty;
+  // connectAsync() sockets still waiting for the handshake
+  std::unordered_set<ConnectionId> m_connecting;
+  // setReceiving(false), and those of them whose peer has since left
+  std::unordered_set<ConnectionId> m_paused;
+  std::unordered_set<ConnectionId> m_hungUp;
+  QByteArray m_readBuffer;
+  // Only there to wake processEvents()
+  std::vector<std::unique_ptr<QSocketNotifier>> m_watched;
+  ConnectionId m_nextId = 0;
+};
+
+// Runs any transport from the Qt event loop, for code that lives under
+// QCoreApplication::exec() rather than calling poll() itself: the
+// transport's waitFd() is watched with a QSocketNotifier, and before the
+// loop goes to sleep the transport flushes what the event handlers sent
+// and gets a poll(0) if it has work already.
+class TransportDriver : public QObject {
+public:
+  explicit TransportDriver(Transport &transport, QObject *parent = nullptr);
+  ~TransportDriver() override;
+
+private:
+  void schedulePoll();
+
+  Transport &m_transport;
+  std::unique_ptr<QSocketNotifier> m_notifier;
+  bool m_pollQueued = false;
+};
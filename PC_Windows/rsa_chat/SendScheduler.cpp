@@ -0,0 +1,87 @@
+#include "SendScheduler.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+#include <QChronoTimer>
+#include <chrono>
+#include <string_view>
+
+static int envInt(const char *name, int fallback) {
+  bool ok = false;
+  int value = qEnvironmentVariableIntValue(name, &ok);
+  return ok && value >= 0 ? value : fallback;
+}
+
+SendOptions SendOptions::fromEnvironment() {
+  SendOptions options;
+  if (qEnvironmentVariable("RSA_CHAT_SEND_MODE") == "throughput") {
+    options.mode = SendMode::Throughput;
+  }
+  options.flushBytes = envInt("RSA_CHAT_FLUSH_BYTES", options.flushBytes);
+  options.flushDelayUs = envInt("RSA_CHAT_FLUSH_US", options.flushDelayUs);
+  options.sendBufferBytes = envInt("RSA_CHAT_SNDBUF", 0);
+  options.receiveBufferBytes = envInt("RSA_CHAT_RCVBUF", 0);
+  return options;
+}
+
+SendScheduler::SendScheduler(Transport &transport, ConnectionId id,
+                             const SendOptions &options, QObject *parent)
+    : QObject(parent), m_transport(transport), m_id(id), m_options(options),
+      m_timer(new QChronoTimer(this)) {
+  m_timer->setSingleShot(true);
+  m_timer->setTimerType(Qt::PreciseTimer);
+  m_timer->setInterval(std::chrono::microseconds(m_options.flushDelayUs));
+  connect(m_timer, &QChronoTimer::timeout, this, &SendScheduler::flush);
+
+  if (m_options.mode == SendMode::Throughput) {
+    m_buffer.reserve(m_options.flushBytes);
+  }
+}
+
+void SendScheduler::configureSocket() {
+  TcpTuning tuning;
+  tuning.noDelay = m_options.mode == SendMode::LowLatency;
+  tuning.sendBufferBytes = m_options.sendBufferBytes;
+  tuning.receiveBufferBytes = m_options.receiveBufferBytes;
+  tuning.unsentLimitBytes = m_options.unsentLimitBytes;
+  m_transport.tune(m_id, tuning);
+}
+
+void SendScheduler::enqueue(const QByteArray &frame) {
+  if (m_options.mode == SendMode::LowLatency) {
+    write(frame);
+    return;
+  }
+
+  m_buffer += frame;
+  if (m_buffer.size() >= m_options.flushBytes) {
+    flush();
+  } else if (!m_timer->isActive()) {
+    // The delay counts from the first frame of a batch, so a steady
+    // trickle cannot hold data back indefinitely
+    m_timer->start();
+  }
+}
+
+void SendScheduler::flush() {
+  m_timer->stop();
+  if (m_buffer.isEmpty())
+    return;
+
+  TraceSpan flushSpan("socket_flush");
+  write(m_buffer);
+  // Keeps the capacity for the next batch
+  m_buffer.resize(0);
+}
+
+void SendScheduler::write(const QByteArray &data) {
+  ScopedTimer timer(Histogram::SocketWrite);
+  m_transport.send(m_id, std::string_view(data.constData(),
+                                          static_cast<std::size_t>(data.size())));
+  // Throughput mode leaves the actual send to the transport's next flush,
+  // before the event loop sleeps, so the kernel sees larger writes
+  if (m_options.mode == SendMode::LowLatency) {
+    m_transport.flush();
+  }
+  metricsAdd(Counter::BytesSent, data.size());
+  metricsAdd(Counter::SocketWrites);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+#include <QByteArray>
+#include <QObject>
+
+class QChronoTimer;
+
+enum class SendMode {
+  // TCP_NODELAY, every frame written and flushed on its own
+  LowLatency,
+  // Nagle left on, frames gathered into one buffer and written when it
+  // reaches flushBytes or flushDelayUs after the first queued frame
+  Throughput,
+};
+
+struct SendOptions {
+  SendMode mode = SendMode::LowLatency;
+  int flushBytes = 16 * 1024;
+  int flushDelayUs = 500;
+  // Kernel socket buffer sizes, 0 keeps the OS default
+  int sendBufferBytes = 0;
+  int receiveBufferBytes = 0;
+  // Cap on data queued in the kernel but not yet sent (TCP_NOTSENT_LOWAT
+  // where available), so prioritised frames are not stuck behind a deep
+  // kernel buffer full of bulk data. 0 disables.
+  int unsentLimitBytes = 128 * 1024;
+
+  // Defaults overridden by RSA_CHAT_SEND_MODE (latency|throughput),
+  // RSA_CHAT_FLUSH_BYTES, RSA_CHAT_FLUSH_US, RSA_CHAT_SNDBUF and
+  // RSA_CHAT_RCVBUF
+  static SendOptions fromEnvironment();
+};
+
+// Sits between a session and its transport connection and decides when
+// bytes hit the wire.
+class SendScheduler : public QObject {
+  Q_OBJECT
+public:
+  SendScheduler(Transport &transport, ConnectionId id,
+                const SendOptions &options, QObject *parent = nullptr);
+
+  const SendOptions &options() const { return m_options; }
+
+  // Applies the socket options; call once the connection is up
+  void configureSocket();
+
+  void enqueue(const QByteArray &frame);
+
+  // Writes anything still gathered, e.g. before disconnecting
+  void flush();
+
+private:
+  void write(const QByteArray &data);
+
+  Transport &m_transport;
+  ConnectionId m_id;
+  SendOptions m_options;
+  QByteArray m_buffer;
+  QChronoTimer *m_timer;
+};
@@ -0,0 +1,75 @@
+#include "StatsPanel.h"
+
+#include <QFontDatabase>
+#include <QPlainTextEdit>
+#include <QTimer>
+#include <QVBoxLayout>
+
+StatsPanel::StatsPanel(QWidget *parent)
+    : QDialog(parent), m_view(new QPlainTextEdit(this)),
+      m_timer(new QTimer(this)) {
+  m_view->setReadOnly(true);
+  m_view->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+  auto *layout = new QVBoxLayout;
+  layout->addWidget(m_view);
+  setLayout(layout);
+
+  setWindowTitle("RSA Chat - Statistics");
+  resize(560, 360);
+
+  connect(m_timer, &QTimer::timeout, this, &StatsPanel::refresh);
+}
+
+void StatsPanel::showEvent(QShowEvent *event) {
+  QDialog::showEvent(event);
+  m_last = metricsSnapshot();
+  refresh();
+  m_timer->start(1000);
+}
+
+void StatsPanel::hideEvent(QHideEvent *event) {
+  m_timer->stop();
+  QDialog::hideEvent(event);
+}
+
+void StatsPanel::refresh() {
+  MetricsSnapshot now = metricsSnapshot();
+  double interval = now.uptimeSeconds - m_last.uptimeSeconds;
+
+  QString text;
+  text += QString("%1 %2 %3\n")
+              .arg("Counter", -20)
+              .arg("Total", 14)
+              .arg("Per second", 14);
+  for (std::size_t i = 0; i < kCounterCount; ++i) {
+    // Rates cover the last refresh interval, not the whole session
+    double rate =
+        interval > 0 ? (now.counters[i] - m_last.counters[i]) / interval : 0.0;
+    text += QString("%1 %2 %3\n")
+                .arg(counterName(static_cast<Counter>(i)), -20)
+                .arg(now.counters[i], 14)
+                .arg(rate, 14, 'f', 1);
+  }
+
+  text += QString("\n%1 %2 %3 %4 %5 %6\n")
+              .arg("Latency (us)", -20)
+              .arg("Count", 10)
+              .arg("p50", 10)
+              .arg("p90", 10)
+              .arg("p99", 10)
+              .arg("max", 10);
+  for (std::size_t i = 0; i < kHistogramCount; ++i) {
+    const HistogramSummary &h = now.histograms[i];
+    text += QString("%1 %2 %3 %4 %5 %6\n")
+                .arg(histogramName(static_cast<Histogram>(i)), -20)
+                .arg(h.count, 10)
+                .arg(h.p50Ns / 1000.0, 10, 'f', 1)
+                .arg(h.p90Ns / 1000.0, 10, 'f', 1)
+                .arg(h.p99Ns / 1000.0, 10, 'f', 1)
+                .arg(h.maxNs / 1000.0, 10, 'f', 1);
+  }
+
+  m_view->setPlainText(text);
+  m_last = now;
+}
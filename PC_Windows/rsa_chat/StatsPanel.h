@@ -0,0 +1,26 @@
+#pragma once
+
+#include "rsa_chat_metrics.h"
+#include <QDialog>
+
+class QPlainTextEdit;
+class QTimer;
+
+// Live view of the hot-path metrics registry (F6)
+class StatsPanel : public QDialog {
+  Q_OBJECT
+public:
+  explicit StatsPanel(QWidget *parent = nullptr);
+
+protected:
+  void showEvent(QShowEvent *event) override;
+  void hideEvent(QHideEvent *event) override;
+
+private slots:
+  void refresh();
+
+private:
+  QPlainTextEdit *m_view;
+  QTimer *m_timer;
+  MetricsSnapshot m_last;
+};
@@ -0,0 +1,346 @@
+// Headless chat peer for scripted runs, soak tests and bots.
+//
+//   rsa_chat_cli --listen [--port 12345]
+//   rsa_chat_cli --connect <host> [--port 12345]
+//   ... [--transport qt|uring|epoll] [--no-shm] [--mode latency|throughput]
+//       [--flush-bytes N] [--flush-us N] [--sndbuf N] [--rcvbuf N]
+//       [--send-file PATH] [--save-files DIR] [--latency FILE|-]
+//       [--capture DIR]
+//
+// Messages to send are read line by line from stdin (or --input FILE);
+// decrypted messages from the peer are printed to stdout, one per line.
+// Status goes to stderr. --latency appends one JSON object per line for
+// every probe result: {"peer": ..., "latency": {...}}.
+//
+// --transport picks the socket backend as for rsa_chat_echo_server; the
+// Qt event loop drives it either way. A peer on this machine is reached
+// through shared memory (rsa_chat_shm.h) unless --no-shm is given.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ChatRoom.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+#include "rsa_chat_transport.h"
+
+class CliPeer : public QObject {
+public:
+    CliPeer(const KeyPair& keys, std::unique_ptr<Transport> transport, const SendOptions& sendOptions,
+            bool quitWhenDone, QObject* parent = nullptr)
+        : QObject(parent), m_room(new ChatRoom(keys, std::move(transport), this)), m_quitWhenDone(quitWhenDone)
+    {
+        m_room->setSendOptions(sendOptions);
+        connect(m_room, &ChatRoom::memberConnected, this, [this](ChatSession* member) {
+            qInfo() << "Connected to" << member->peerAddress();
+            m_connected = true;
+            flushPending();
+        });
+        connect(m_room, &ChatRoom::memberReady, this, [this](ChatSession* member) {
+            qInfo() << "Keys exchanged with" << member->peerAddress();
+            m_everReady = true;
+            if (!m_fileName.isEmpty()) {
+                if (member->sendFile(m_fileName, m_fileData)) {
+                    qInfo() << "Sending" << m_fileName << "to" << member->peerAddress();
+                } else {
+                    qWarning() << member->peerAddress() << "cannot receive files";
+                }
+            }
+            flushPending();
+        });
+        connect(m_room, &ChatRoom::fileReceived, this,
+                [this](ChatSession* member, const QString& name, const QByteArray& data) {
+                    qInfo() << "Received file" << name << "(" << data.size() << "bytes) from"
+                            << member->peerAddress();
+                    if (m_saveDir.isEmpty()) return;
+                    // Only the base name is trusted
+                    QFile file(QDir(m_saveDir).filePath(QFileInfo(name).fileName()));
+                    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+                        qWarning() << "Failed to save" << file.fileName();
+                    }
+                });
+        connect(m_room, &ChatRoom::messageReceived, this,
+                [this](ChatSession*, const QString& text, quint64) { m_out << text << Qt::endl; });
+        connect(m_room, &ChatRoom::messageDropped, this,
+                [](ChatSession*, const QString& reason) { qWarning() << reason; });
+        connect(m_room, &ChatRoom::errorOccurred, this, [](ChatSession* member, const QString& message) {
+            qWarning() << "Socket error from" << member->peerAddress() << ":" << message;
+        });
+        connect(m_room, &ChatRoom::latencyUpdated, this,
+                [this](ChatSession* member, const LatencyEstimate& estimate) {
+                    if (!m_latencyLog.isOpen()) return;
+                    const QString line = QString("{\"peer\": \"%1\", \"latency\": %2}\n")
+                                             .arg(member->peerAddress(),
+                                                  QString::fromStdString(latencyToJson(estimate)));
+                    m_latencyLog.write(line.toUtf8());
+                    m_latencyLog.flush();
+                });
+        connect(m_room, &ChatRoom::memberLeft, this, [this](ChatSession* member) {
+            qInfo() << "Peer left:" << member->peerAddress();
+            QString peerKey = member->peerKeyFile();
+            if (!peerKey.isEmpty()) QFile::remove(peerKey);
+            // memberLeft fires while the member is still listed
+            const bool empty = m_room->members().size() == 1;
+            // A listening bot keeps serving new peers unless told to stop;
+            // a failed connect exits non-zero
+            if (!m_listening) {
+                QCoreApplication::exit(m_everReady ? 0 : 1);
+            } else if (empty && m_quitWhenDone && m_inputDone) {
+                QCoreApplication::quit();
+            }
+        });
+    }
+
+    bool listen(quint16 port) {
+        if (!m_room->listen(port)) {
+            qCritical() << "Failed to listen on port" << port;
+            return false;
+        }
+        m_listening = true;
+        qInfo() << "Listening on port" << m_room->localPort();
+        return true;
+    }
+
+    void connectToHost(const QString& host, quint16 port) {
+        qInfo() << "Connecting to" << host << port;
+        m_room->connectToHost(host, port);
+    }
+
+    // Sent to every peer once keys are exchanged
+    void setFile(const QString& name, const QByteArray& data) {
+        m_fileName = name;
+        m_fileData = data;
+    }
+
+    void setSaveDirectory(const QString& dir) { m_saveDir = dir; }
+    void setCaptureDirectory(const QString& dir) { m_room->setCaptureDirectory(dir); }
+    void setWideKeys(const AnyRsaKeyPair& keys) { m_room->setWideKeys(keys); }
+
+    // "-" is stderr
+    bool setLatencyLog(const QString& path) {
+        if (path == "-") return m_latencyLog.open(stderr, QIODevice::WriteOnly);
+        m_latencyLog.setFileName(path);
+        return m_latencyLog.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    void queueLine(const QString& line) {
+        if (line.isEmpty()) return;
+        m_pending.push_back(line);
+        flushPending();
+    }
+
+    void finishInput() {
+        m_inputDone = true;
+        flushPending();
+    }
+
+private:
+    // Input is handed to the room as soon as a TCP connection is up; members
+    // still exchanging keys queue it and send it as one batch
+    void flushPending() {
+        while (!m_pending.isEmpty()) {
+            if (m_room->broadcast(m_pending.front()) == 0) return;
+            m_pending.removeFirst();
+        }
+
+        // With a file to send, wait for the key so the file is queued
+        // before the disconnect is requested
+        const bool fileQueued = m_fileName.isEmpty() || m_everReady;
+        if (m_inputDone && m_quitWhenDone && m_connected && fileQueued) m_room->disconnectAll();
+    }
+
+    ChatRoom* m_room;
+    bool m_quitWhenDone;
+    bool m_inputDone = false;
+    bool m_connected = false;
+    bool m_everReady = false;
+    bool m_listening = false;
+    QStringList m_pending;
+    QString m_fileName;
+    QByteArray m_fileData;
+    QString m_saveDir;
+    QFile m_latencyLog;
+    QTextStream m_out{stdout};
+};
+
+int main(int argc, char* argv[]) {
+    // rsa_chat_cli --merge-traces out.json a.json b.json ...
+    if (argc >= 4 && std::string(argv[1]) == "--merge-traces") {
+        std::vector<std::string> inputs(argv + 3, argv + argc);
+        if (!traceMergeChromeJson(inputs, argv[2])) {
+            std::cerr << "Failed to merge traces into " << argv[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("rsa_chat_cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless RSA chat peer");
+    parser.addHelpOption();
+    QCommandLineOption listenOption("listen", "Wait for a peer to connect.");
+    QCommandLineOption connectOption("connect", "Connect to a listening peer.", "host");
+    QCommandLineOption portOption("port", "TCP port (default 12345).", "port", "12345");
+    QCommandLineOption transportOption("transport", "Socket backend: qt (default), uring or epoll.", "backend", "qt");
+    QCommandLineOption noShmOption("no-shm", "Use TCP even for peers on this machine.");
+    QCommandLineOption inputOption("input", "Send the lines of <file> instead of stdin.", "file");
+    QCommandLineOption quitOption("quit", "Disconnect and exit once all input has been sent.");
+    QCommandLineOption metricsOption("metrics", "Write metrics JSON to <file> on exit.", "file");
+    QCommandLineOption traceOption("trace", "Record a trace and write it to <file> on exit.", "file");
+    QCommandLineOption modeOption("mode", "Send mode: latency (default) or throughput.", "mode");
+    QCommandLineOption flushBytesOption("flush-bytes", "Throughput mode: write once <n> bytes are queued.", "n");
+    QCommandLineOption flushUsOption("flush-us", "Throughput mode: write <us> after the first queued frame.", "us");
+    QCommandLineOption sndbufOption("sndbuf", "Socket send buffer size in bytes.", "bytes");
+    QCommandLineOption rcvbufOption("rcvbuf", "Socket receive buffer size in bytes.", "bytes");
+    QCommandLineOption sendFileOption("send-file", "Send <file> to each peer on the file channel.", "file");
+    QCommandLineOption saveFilesOption("save-files", "Save received files into <dir>.", "dir");
+    QCommandLineOption latencyOption("latency", "Append probe RTT/stage estimates as JSON lines to <file> (- for stderr).",
+                                     "file");
+    QCommandLineOption captureOption("capture", "Record what each peer sends into a capture file in <dir>.", "dir");
+    QCommandLineOption keyBitsOption("key-bits", "Also offer a wide key of <bits> (32, 64, 512 or 2048) in WKEY:.",
+                                     "bits");
+    parser.addOptions({listenOption, connectOption, portOption, transportOption, noShmOption, inputOption,
+                       quitOption, metricsOption, traceOption, modeOption, flushBytesOption, flushUsOption,
+                       sndbufOption, rcvbufOption, sendFileOption, saveFilesOption, latencyOption, captureOption,
+                       keyBitsOption});
+    parser.process(app);
+
+    if (parser.isSet(listenOption) == parser.isSet(connectOption)) {
+        qCritical() << "Exactly one of --listen or --connect is required";
+        parser.showHelp(1);
+    }
+
+    bool portOk = false;
+    const uint port = parser.value(portOption).toUInt(&portOk);
+    if (!portOk || port > 65535) {
+        qCritical() << "Invalid port" << parser.value(portOption);
+        return 1;
+    }
+
+    TransportKind kind;
+    if (!parseTransportKind(parser.value(transportOption).toStdString(), kind)) {
+        qCritical() << "Unknown transport" << parser.value(transportOption);
+        return 1;
+    }
+    const bool shortcut = !parser.isSet(noShmOption);
+    std::unique_ptr<Transport> transport = makeTransport(kind, shortcut);
+    if (!transport) {
+        qWarning() << parser.value(transportOption) << "is not available here, using Qt sockets";
+        transport = makeTransport(TransportKind::Qt, shortcut);
+    }
+    qInfo() << "Transport:" << transport->name();
+
+    // Flags win over the RSA_CHAT_* environment defaults
+    SendOptions sendOptions = SendOptions::fromEnvironment();
+    if (parser.isSet(modeOption)) {
+        const QString mode = parser.value(modeOption);
+        if (mode == "throughput") {
+            sendOptions.mode = SendMode::Throughput;
+        } else if (mode == "latency") {
+            sendOptions.mode = SendMode::LowLatency;
+        } else {
+            qCritical() << "Unknown mode" << mode;
+            return 1;
+        }
+    }
+    const std::pair<const QCommandLineOption*, int*> sizes[] = {
+        {&flushBytesOption, &sendOptions.flushBytes},
+        {&flushUsOption, &sendOptions.flushDelayUs},
+        {&sndbufOption, &sendOptions.sendBufferBytes},
+        {&rcvbufOption, &sendOptions.receiveBufferBytes},
+    };
+    for (const auto& [option, value] : sizes) {
+        if (!parser.isSet(*option)) continue;
+        bool ok = false;
+        *value = parser.value(*option).toInt(&ok);
+        if (!ok || *value < 0) {
+            qCritical() << "Invalid value for" << option->names().first();
+            return 1;
+        }
+    }
+
+    if (parser.isSet(traceOption)) traceSetEnabled(true);
+
+    // Keys live only in memory; nothing is written for our own pair
+    CliPeer peer(generateKeys(), std::move(transport), sendOptions, parser.isSet(quitOption));
+    if (parser.isSet(sendFileOption)) {
+        QFile file(parser.value(sendFileOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCritical() << "Cannot open" << file.fileName();
+            return 1;
+        }
+        peer.setFile(QFileInfo(file.fileName()).fileName(), file.readAll());
+    }
+    if (parser.isSet(saveFilesOption)) peer.setSaveDirectory(parser.value(saveFilesOption));
+    if (parser.isSet(captureOption)) peer.setCaptureDirectory(parser.value(captureOption));
+    if (parser.isSet(keyBitsOption)) {
+        bool ok = false;
+        const uint bits = parser.value(keyBitsOption).toUInt(&ok);
+        if (!ok || rsaKeyWidthFor(bits) != bits) {
+            qCritical() << "Unsupported key width" << parser.value(keyBitsOption);
+            return 1;
+        }
+        peer.setWideKeys(generateRsaKeys(bits));
+    }
+    if (parser.isSet(latencyOption) && !peer.setLatencyLog(parser.value(latencyOption))) {
+        qCritical() << "Cannot open" << parser.value(latencyOption);
+        return 1;
+    }
+
+    if (parser.isSet(listenOption)) {
+        if (!peer.listen(static_cast<quint16>(port))) return 1;
+    } else {
+        peer.connectToHost(parser.value(connectOption), static_cast<quint16>(port));
+    }
+
+    QThread* reader = nullptr;
+    if (parser.isSet(inputOption)) {
+        QFile file(parser.value(inputOption));
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            qCritical() << "Cannot open" << file.fileName() << ":" << file.errorString();
+            return 1;
+        }
+        QTextStream in(&file);
+        while (!in.atEnd()) peer.queueLine(in.readLine());
+        peer.finishInput();
+    } else {
+        // std::getline blocks, so stdin is read on its own thread and each
+        // line is handed to the event loop
+        reader = QThread::create([&peer]() {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                QString text = QString::fromStdString(line);
+                QMetaObject::invokeMethod(&peer, [&peer, text]() { peer.queueLine(text); },
+                                          Qt::QueuedConnection);
+            }
+            QMetaObject::invokeMethod(&peer, [&peer]() { peer.finishInput(); }, Qt::QueuedConnection);
+        });
+        reader->start();
+    }
+
+    const int rc = app.exec();
+
+    if (parser.isSet(metricsOption)) {
+        metricsDumpJson(parser.value(metricsOption).toStdString());
+    }
+    if (parser.isSet(traceOption)) {
+        traceExportChromeJson(parser.value(traceOption).toStdString(), "rsa_chat_cli");
+    }
+
+    // The stdin reader may still be blocked in getline() and cannot be
+    // joined, so leave without running destructors under its feet
+    std::fflush(stdout);
+    std::_Exit(rc);
+}
@@ -0,0 +1,145 @@
+// Codebook attack: reads captured chat traffic without any private key,
+// to show that unpadded byte-wise RSA leaks everything.
+//
+//   rsa_chat_codebook [--key FILE]... [--threads N] [--frequency] [--quiet] INPUT...
+//
+// INPUT is a capture of the protocol text (KEY:, MSG:, XMSG: lines; "-"
+// reads stdin) or a cipher file as written by the GUI. Keys come from
+// the KEY: lines of the captures and from --key files. Decoded messages
+// go to stdout as "n=<modulus>: text"; throughput goes to stderr.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_codebook.h"
+
+// Capture files are read this much at a time
+static constexpr std::size_t kReadBytes = 4 * 1024 * 1024;
+
+static bool readFile(const std::string& filename, std::string& data) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    data = std::move(buffer).str();
+    return true;
+}
+
+static void addKeyFile(CodebookAttack& attack, const std::string& filename) {
+    std::string text;
+    if (!readFile(filename, text)) {
+        qWarning() << "Cannot open" << filename.c_str();
+        return;
+    }
+    const std::size_t before = attack.keyCount();
+    attack.addKeysFrom(text);
+    if (attack.keyCount() != before) return;
+    // A public key file holds just "e n"
+    std::istringstream in(text);
+    PublicKey pub{};
+    if (in >> pub.e >> pub.n) attack.addKey(pub);
+}
+
+// A cipher file is a binary RSAP file or a single line of numbers;
+// everything else is taken for protocol text
+static bool looksLikeCipherFile(std::string_view head) {
+    if (head.starts_with("RSAP")) return true;
+    const std::string_view firstLine = head.substr(0, head.find('\n'));
+    return !firstLine.empty() && firstLine.find(':') == std::string_view::npos &&
+           firstLine.find_first_not_of("0123456789 \t\r") == std::string_view::npos;
+}
+
+static void attackCipherFile(CodebookAttack& attack, const std::string& filename, bool frequency) {
+    std::vector<CipherWord> cipher;
+    if (!loadCipherPacked(filename, cipher)) {
+        const std::vector<int> words = loadCipherFromFile(filename);
+        cipher.assign(words.begin(), words.end());
+    }
+    std::string plain;
+    if (const Codebook* codebook = attack.decode(cipher, plain)) {
+        std::printf("%s n=%d: %s\n", filename.c_str(), codebook->key().n, plain.c_str());
+    } else if (frequency) {
+        std::printf("%s frequency guess: %s\n", filename.c_str(), frequencyGuess(cipher).c_str());
+    } else {
+        qWarning() << "No known key fits" << filename.c_str() << "(try --frequency)";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decodes captured RSA chat traffic with public keys only");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Traffic captures or cipher files; - reads stdin.", "inputs...");
+    QCommandLineOption keyOption("key", "Public key file, or any file with KEY:e:n lines.", "file");
+    QCommandLineOption threadsOption("threads", "Worker threads (default: one per hardware thread).", "n", "0");
+    QCommandLineOption frequencyOption("frequency", "Guess cipher files no known key fits from word frequencies.");
+    QCommandLineOption quietOption("quiet", "Print only the throughput summary.");
+    parser.addOptions({keyOption, threadsOption, frequencyOption, quietOption});
+    parser.process(app);
+
+    bool threadsOk = false;
+    const uint threads = parser.value(threadsOption).toUInt(&threadsOk);
+    if (!threadsOk) {
+        qCritical() << "Invalid thread count" << parser.value(threadsOption);
+        return 1;
+    }
+    if (parser.positionalArguments().isEmpty()) parser.showHelp(1);
+
+    const bool quiet = parser.isSet(quietOption);
+    std::uint64_t unknown = 0;
+    CodebookAttack attack(
+        {
+            [quiet](const PublicKey& key, std::string_view plain) {
+                if (!quiet) std::printf("n=%d: %.*s\n", key.n, static_cast<int>(plain.size()), plain.data());
+            },
+            [&unknown] { ++unknown; },
+        },
+        threads);
+    for (const QString& file : parser.values(keyOption)) addKeyFile(attack, file.toStdString());
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<char> buffer(kReadBytes);
+    for (const QString& input : parser.positionalArguments()) {
+        const std::string name = input.toStdString();
+        std::ifstream file;
+        std::istream* in = &std::cin;
+        if (name != "-") {
+            file.open(name, std::ios::binary);
+            if (!file) {
+                qWarning() << "Cannot open" << input;
+                continue;
+            }
+            in = &file;
+        }
+
+        bool first = true;
+        while (in->read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || in->gcount() > 0) {
+            const std::string_view chunk(buffer.data(), static_cast<std::size_t>(in->gcount()));
+            if (first && name != "-" && looksLikeCipherFile(chunk)) {
+                attackCipherFile(attack, name, parser.isSet(frequencyOption));
+                break;
+            }
+            first = false;
+            attack.feed(chunk);
+        }
+        attack.finish();
+    }
+    std::fflush(stdout);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const CodebookAttack::Stats& stats = attack.stats();
+    const double mb = static_cast<double>(stats.bytes) / 1e6;
+    std::fprintf(stderr, "%.1f MB in %.3f s (%.1f MB/s), %llu of %llu messages decoded with %zu keys, %llu unknown\n",
+                 mb, seconds, seconds > 0 ? mb / seconds : 0.0, static_cast<unsigned long long>(stats.decoded),
+                 static_cast<unsigned long long>(stats.messages), attack.keyCount(),
+                 static_cast<unsigned long long>(unknown));
+    return 0;
+}
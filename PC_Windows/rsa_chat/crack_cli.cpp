@@ -0,0 +1,187 @@
+// Factoring lab: shows why the demo keys protect nothing. Reads public
+// keys, breaks them and optionally decrypts captured ciphertext.
+//
+//   rsa_chat_crack [--threads N] [--decrypt CIPHER]... KEYFILE|LOG...
+//   rsa_chat_crack --generate N [--bits demo|32|64|96|128] [--threads N]
+//   rsa_chat_crack --batch-gcd [--threads N] [--decrypt CIPHER]... KEYFILE|LOG...
+//
+// Keys are factored one by one with Pollard's rho, or with --batch-gcd
+// all at once by looking for primes shared between them.
+// Inputs are public key files ("e n") or anything holding KEY:e:n lines,
+// such as chat logs. Broken keys go to stdout as "source n= p= q= d=";
+// decrypted text as "file [source]: text". The summary goes to stderr.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "rsa_chat_batchgcd.h"
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_crack.h"
+#include "rsa_chat_rsakey.h"
+
+template <unsigned Bits>
+static void generateTargets(std::size_t count, std::vector<CrackTarget>& targets) {
+    std::mt19937_64 gen(std::random_device{}());
+    for (std::size_t i = 0; i < count; ++i) {
+        const RsaKeyPair<Bits> kp = generateKeysT<Bits>(gen);
+        CrackTarget target;
+        target.source = "generated:" + std::to_string(i + 1);
+        target.e = kp.pub.exponent[0];
+        for (std::size_t j = 0; j < kp.pub.modulus.size(); ++j) target.n[j] = kp.pub.modulus[j];
+        targets.push_back(std::move(target));
+    }
+}
+
+static bool generate(const QString& bits, std::size_t count, std::vector<CrackTarget>& targets) {
+    if (bits == "demo") {
+        for (std::size_t i = 0; i < count; ++i) {
+            const KeyPair kp = generateKeys();
+            CrackTarget target;
+            target.source = "generated:" + std::to_string(i + 1);
+            target.e = static_cast<std::uint64_t>(kp.pub.e);
+            target.n = {static_cast<std::uint64_t>(kp.pub.n), 0};
+            targets.push_back(std::move(target));
+        }
+    } else if (bits == "32") {
+        generateTargets<32>(count, targets);
+    } else if (bits == "64") {
+        generateTargets<64>(count, targets);
+    } else if (bits == "96") {
+        generateTargets<96>(count, targets);
+    } else if (bits == "128") {
+        generateTargets<128>(count, targets);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool loadCipher(const std::string& filename, std::vector<CipherWord>& cipher) {
+    if (loadCipherPacked(filename, cipher)) return true;
+    const std::vector<int> words = loadCipherFromFile(filename);
+    cipher.assign(words.begin(), words.end());
+    return !cipher.empty();
+}
+
+// A capture does not say which key it was made for: try every broken
+// demo key that could have produced it and keep the most readable text
+static void decryptCapture(const std::string& filename, const std::vector<CrackTarget>& targets,
+                           const std::vector<CrackResult>& results) {
+    std::vector<CipherWord> cipher;
+    if (!loadCipher(filename, cipher) || cipher.empty()) {
+        qWarning() << "Cannot read ciphertext from" << filename.c_str();
+        return;
+    }
+    const CipherWord largest = *std::max_element(cipher.begin(), cipher.end());
+
+    std::string text(cipher.size(), '\0');
+    std::string bestText;
+    std::size_t bestKey = targets.size();
+    std::size_t bestScore = 0;
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        PrivateKey priv;
+        if (!demoPrivateKey(targets[i], results[i], priv)) continue;
+        if (largest >= static_cast<CipherWord>(priv.n)) continue;
+
+        decryptMessage(cipher, priv, std::as_writable_bytes(std::span(text)));
+        const std::size_t score = std::count_if(text.begin(), text.end(), [](char c) {
+            const auto u = static_cast<unsigned char>(c);
+            return (u >= 0x20 && u < 0x7f) || u == '\n' || u == '\t' || u >= 0x80;
+        });
+        if (bestKey == targets.size() || score > bestScore) {
+            bestKey = i;
+            bestScore = score;
+            bestText = text;
+        }
+    }
+
+    if (bestKey == targets.size()) {
+        qWarning() << "No broken demo key fits" << filename.c_str();
+        return;
+    }
+    std::printf("%s [%s]: %s\n", filename.c_str(), targets[bestKey].source.c_str(), bestText.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Breaks small RSA keys by factoring n");
+    parser.addHelpOption();
+    parser.addPositionalArgument("inputs", "Public key files or logs with KEY:e:n lines.", "[inputs...]");
+    QCommandLineOption threadsOption("threads", "Worker threads (default: one per hardware thread).", "n", "0");
+    QCommandLineOption decryptOption("decrypt", "Decrypt the captured cipher <file> with a broken key.", "file");
+    QCommandLineOption generateOption("generate", "Crack <n> freshly generated keys instead of reading inputs.",
+                                      "n");
+    QCommandLineOption bitsOption("bits", "Width of generated keys: demo (default), 32, 64, 96 or 128.", "bits",
+                                  "demo");
+    QCommandLineOption batchGcdOption("batch-gcd", "Only break keys that share a prime with another key, "
+                                                   "scanning the whole set at once (batch GCD).");
+    parser.addOptions({threadsOption, decryptOption, generateOption, bitsOption, batchGcdOption});
+    parser.process(app);
+
+    bool threadsOk = false;
+    const uint threads = parser.value(threadsOption).toUInt(&threadsOk);
+    if (!threadsOk) {
+        qCritical() << "Invalid thread count" << parser.value(threadsOption);
+        return 1;
+    }
+
+    std::vector<CrackTarget> targets;
+    if (parser.isSet(generateOption)) {
+        bool countOk = false;
+        const uint count = parser.value(generateOption).toUInt(&countOk);
+        if (!countOk) {
+            qCritical() << "Invalid key count" << parser.value(generateOption);
+            return 1;
+        }
+        if (!generate(parser.value(bitsOption), count, targets)) {
+            qCritical() << "Unsupported key width" << parser.value(bitsOption);
+            return 1;
+        }
+    }
+    for (const QString& input : parser.positionalArguments()) {
+        if (!readCrackTargets(input.toStdString(),
+                              [&targets](CrackTarget&& target) { targets.push_back(std::move(target)); })) {
+            qWarning() << "Cannot open" << input;
+        }
+    }
+    if (targets.empty()) {
+        qCritical() << "No keys to crack";
+        parser.showHelp(1);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<CrackResult> results;
+    SharedFactorReport shared;
+    if (parser.isSet(batchGcdOption)) {
+        shared = crackSharedFactors(targets, threads);
+        results = std::move(shared.results);
+    } else {
+        results = crackKeys(targets, threads);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::size_t broken = 0;
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        if (!results[i].broken) continue;
+        ++broken;
+        std::printf("%s n=%s p=%s q=%s d=%s\n", targets[i].source.c_str(), limbsToDecimal(targets[i].n).c_str(),
+                    limbsToDecimal(results[i].p).c_str(), limbsToDecimal(results[i].q).c_str(),
+                    limbsToDecimal(results[i].d).c_str());
+    }
+    std::fflush(stdout);
+    if (parser.isSet(batchGcdOption)) {
+        std::fprintf(stderr, "%zu distinct moduli, %zu share a prime with another\n", shared.distinctModuli,
+                     shared.sharedModuli);
+    }
+    std::fprintf(stderr, "Broke %zu of %zu keys in %.3f s (%.1f keys/s)\n", broken, targets.size(), seconds,
+                 seconds > 0 ? static_cast<double>(targets.size()) / seconds : 0.0);
+
+    for (const QString& file : parser.values(decryptOption)) decryptCapture(file.toStdString(), targets, results);
+    return 0;
+}
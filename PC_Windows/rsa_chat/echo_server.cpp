@@ -1,53 +1,390 @@
 //
 // Created by Baiyu on 01/12/2025.
 //
+// Echoes every byte back to its sender, for testing clients and
+// transports. With --forward it is instead a proxy between each client
+// and a real peer that emulates a poor network on the way: latency,
+// jitter, a bandwidth cap, small segments and dropped connections, with
+// the throughput of each direction logged every --report seconds. At most
+// --buffer bytes per direction wait in the emulated link; beyond that the
+// sender is not read until half of them are out, so a fast sender meets
+// the rate cap as TCP backpressure instead of growing the proxy.
+//
+//   rsa_chat_echo_server [--port 12345] [--transport qt|uring|epoll] [--no-shm] [--quiet]
+//   rsa_chat_echo_server --forward host:port [--profile wifi] [--latency ms] [--jitter ms]
+//                        [--rate kbit/s] [--fragment bytes] [--drop-mean s] [--buffer bytes] [--seed n]
+//                        [--report s]
+//
+// Two chat peers on one machine go through the proxy like this:
+//
+//   rsa_chat_cli --listen --port 12346
+//   rsa_chat_echo_server --port 12345 --forward 127.0.0.1:12346 --profile wifi
+//   rsa_chat_cli --connect 127.0.0.1 --port 12345
+//
+// Clients on the same machine that use the Transport API get shared
+// memory instead of TCP unless --no-shm is given.
+#include <QByteArray>
+#include <QCommandLineParser>
 #include <QCoreApplication>
-#include <QTcpServer>
-#include <QTcpSocket>
-#include <QHostAddress>
 #include <QDebug>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "rsa_chat_netem.h"
+#include "rsa_chat_transport.h"
+
+using Clock = EmulatedLink::Clock;
+
+// One client and its connection to the forward target
+struct ProxyPair {
+    ProxyPair(ConnectionId clientId, const LinkConditions& conditions, std::uint64_t seed)
+        : client(clientId), toUpstream(conditions, seed), toClient(conditions, seed ^ 0x9e3779b97f4a7c15ull) {}
+
+    ConnectionId client;
+    ConnectionId upstream = 0;
+    EmulatedLink toUpstream;
+    EmulatedLink toClient;
+    Clock::time_point dropAt = Clock::time_point::max();
+    bool upstreamConnected = false;
+    // Reported closed; what is still queued towards the other side goes out
+    bool clientGone = false;
+    bool upstreamGone = false;
+    // Not read while their link is full
+    bool clientPaused = false;
+    bool upstreamPaused = false;
+};
 
-class EchoServer : public QTcpServer {
+class Proxy {
 public:
-    explicit EchoServer(QObject* parent = nullptr)
-        : QTcpServer(parent)
-    {}
-
-protected:
-    void incomingConnection(qintptr socketDescriptor) override {
-        auto* socket = new QTcpSocket(this);
-        if (!socket->setSocketDescriptor(socketDescriptor)) {
-            qWarning() << "Failed to set socket descriptor:" << socket->errorString();
-            socket->deleteLater();
+    Proxy(Transport& transport, std::string host, std::uint16_t port, const LinkConditions& conditions,
+          std::size_t bufferBytes, std::uint64_t seed, bool quiet)
+        : m_transport(transport), m_host(std::move(host)), m_port(port), m_conditions(conditions),
+          m_bufferBytes(bufferBytes), m_seed(seed), m_quiet(quiet) {}
+
+    Transport::Handlers handlers() {
+        // Reading resumes as an emulated link empties, not on drained
+        return {
+            .accepted = [this](ConnectionId id) { onAccepted(id); },
+            .received = [this](ConnectionId id, std::string_view data) { onReceived(id, data); },
+            .closed = [this](ConnectionId id) { onClosed(id); },
+            .connected = [this](ConnectionId id) { onConnected(id); },
+        };
+    }
+
+    [[noreturn]] void run(double reportSeconds) {
+        const auto reportEvery =
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(reportSeconds));
+        Clock::time_point nextReport = Clock::now() + reportEvery;
+        for (;;) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point wake = nextReport;
+            for (auto it = m_pairs.begin(); it != m_pairs.end();) {
+                if (!step(*it, now)) {
+                    it = m_pairs.erase(it);
+                    continue;
+                }
+                wake = std::min({wake, it->toUpstream.nextDue(), it->toClient.nextDue(), it->dropAt});
+                ++it;
+            }
+            if (now >= nextReport) {
+                report(std::chrono::duration<double>(now - nextReport + reportEvery).count());
+                nextReport = now + reportEvery;
+                wake = std::min(wake, nextReport);
+            }
+            const auto waitMs = std::chrono::ceil<std::chrono::milliseconds>(wake - now).count();
+            m_transport.poll(static_cast<int>(std::clamp<decltype(waitMs)>(waitMs, 0, 1000)));
+        }
+    }
+
+private:
+    void onAccepted(ConnectionId id) {
+        // Replies from the target come back through the same poll(), and
+        // so does the outcome of the connect: other clients keep flowing
+        // meanwhile, and what this one sends is held until it is through
+        const std::uint64_t number = ++m_accepted;
+        const ConnectionId upstream = m_transport.connectAsync(m_host, m_port);
+        if (!upstream) {
+            qWarning() << "Cannot resolve" << QString::fromStdString(m_host) << "for client" << id;
+            m_transport.close(id);
             return;
         }
+        ProxyPair& pair = m_pairs.emplace_back(id, m_conditions, m_seed + 2 * number);
+        pair.upstream = upstream;
+        pair.dropAt = pair.toUpstream.dropAt(Clock::now());
+        m_byConnection[id] = &pair;
+        m_byConnection[upstream] = &pair;
+    }
+
+    void onConnected(ConnectionId id) {
+        auto it = m_byConnection.find(id);
+        if (it == m_byConnection.end()) return;
+        it->second->upstreamConnected = true;
+        if (!m_quiet) qInfo() << "Client" << it->second->client << "forwarded as" << id;
+    }
+
+    void onReceived(ConnectionId id, std::string_view data) {
+        auto it = m_byConnection.find(id);
+        if (it == m_byConnection.end()) return;
+        ProxyPair& pair = *it->second;
+        const bool fromClient = id == pair.client;
+        EmulatedLink& link = fromClient ? pair.toUpstream : pair.toClient;
+        link.push(Clock::now(), data);
+        bool& paused = fromClient ? pair.clientPaused : pair.upstreamPaused;
+        if (!paused && link.queuedBytes() >= m_bufferBytes) {
+            m_transport.setReceiving(id, false);
+            paused = true;
+        }
+    }
 
-        qInfo() << "Client connected from"
-                << socket->peerAddress().toString()
-                << ":" << socket->peerPort();
+    void onClosed(ConnectionId id) {
+        auto it = m_byConnection.find(id);
+        if (it == m_byConnection.end()) return;
+        ProxyPair& pair = *it->second;
+        m_byConnection.erase(it);
+        const bool client = id == pair.client;
+        (client ? pair.clientGone : pair.upstreamGone) = true;
+        if (!client && !pair.upstreamConnected) {
+            qWarning() << "Cannot reach" << QString::fromStdString(m_host) << m_port << "for client" << pair.client;
+        } else if (!m_quiet) {
+            qInfo() << (client ? "Client" : "Target of client") << pair.client << "disconnected";
+        }
+    }
 
-        QObject::connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
-            QByteArray data = socket->readAll();
-            qInfo() << "Received" << data;
-            socket->write(data);
-            socket->flush();
-        });
+    // Delivers what is due and closes what is finished; false once both
+    // sides are gone
+    bool step(ProxyPair& pair, Clock::time_point now) {
+        if (now >= pair.dropAt) {
+            qInfo() << "Dropping client" << pair.client << "with" << pair.toUpstream.queuedBytes() << "+"
+                    << pair.toClient.queuedBytes() << "bytes in flight";
+            ++m_drops;
+            pair.dropAt = Clock::time_point::max();
+            closeSide(pair.client, pair.clientGone);
+            closeSide(pair.upstream, pair.upstreamGone);
+        }
+
+        // Each fragment is its own write, so the receiver sees the segmentation
+        const auto forward = [this](ConnectionId to) {
+            return [this, to](std::string_view fragment) {
+                m_transport.send(to, fragment);
+                m_transport.flush();
+            };
+        };
+        if (!pair.upstreamGone) m_upBytes += pair.toUpstream.deliver(now, forward(pair.upstream));
+        if (!pair.clientGone) m_downBytes += pair.toClient.deliver(now, forward(pair.client));
+        resumeIfDrained(pair.client, pair.clientGone, pair.clientPaused, pair.toUpstream);
+        resumeIfDrained(pair.upstream, pair.upstreamGone, pair.upstreamPaused, pair.toClient);
+
+        // A side that left still gets its last words delivered
+        if (pair.clientGone && !pair.upstreamGone && pair.toUpstream.queuedBytes() == 0) {
+            closeSide(pair.upstream, pair.upstreamGone);
+        }
+        if (pair.upstreamGone && !pair.clientGone && pair.toClient.queuedBytes() == 0) {
+            closeSide(pair.client, pair.clientGone);
+        }
+        return !(pair.clientGone && pair.upstreamGone);
+    }
+
+    // Hysteresis, so a full link does not flip the source every fragment
+    void resumeIfDrained(ConnectionId source, bool gone, bool& paused, const EmulatedLink& link) {
+        if (!paused || gone || link.queuedBytes() > m_bufferBytes / 2) return;
+        m_transport.setReceiving(source, true);
+        paused = false;
+    }
+
+    // closed() for it follows from poll() but finds nothing left to do
+    void closeSide(ConnectionId id, bool& gone) {
+        if (gone) return;
+        m_byConnection.erase(id);
+        m_transport.close(id);
+        gone = true;
+    }
 
-        QObject::connect(socket, &QTcpSocket::disconnected,
-                         socket, &QObject::deleteLater);
+    void report(double seconds) {
+        if (m_upBytes == 0 && m_downBytes == 0 && m_pairs.empty()) return;
+        std::size_t queued = 0;
+        for (ProxyPair& pair : m_pairs) queued += pair.toUpstream.queuedBytes() + pair.toClient.queuedBytes();
+        qInfo().noquote() << QString("up %1 kbit/s, down %2 kbit/s, %3 bytes in flight, %4 connections, %5 dropped")
+                                 .arg(static_cast<double>(m_upBytes) * 8 / 1000 / seconds, 0, 'f', 1)
+                                 .arg(static_cast<double>(m_downBytes) * 8 / 1000 / seconds, 0, 'f', 1)
+                                 .arg(queued)
+                                 .arg(m_pairs.size())
+                                 .arg(m_drops);
+        m_upBytes = 0;
+        m_downBytes = 0;
     }
+
+    Transport& m_transport;
+    std::string m_host;
+    std::uint16_t m_port;
+    LinkConditions m_conditions;
+    std::size_t m_bufferBytes;
+    std::uint64_t m_seed;
+    bool m_quiet;
+    // Pairs do not move, so both connection ids can point at theirs
+    std::list<ProxyPair> m_pairs;
+    std::unordered_map<ConnectionId, ProxyPair*> m_byConnection;
+    std::uint64_t m_accepted = 0;
+    std::uint64_t m_upBytes = 0;
+    std::uint64_t m_downBytes = 0;
+    std::uint64_t m_drops = 0;
 };
 
 int main(int argc, char* argv[]) {
     QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("RSA chat echo server and network emulation proxy");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Port to listen on (default 12345, the clients' default).", "port", "12345");
+    QCommandLineOption transportOption("transport",
+                                       "Socket backend: qt (default), uring (Linux io_uring) or epoll (Linux).",
+                                       "backend", "qt");
+    QCommandLineOption noShmOption("no-shm", "Serve same-host clients over TCP too, not shared memory.");
+    QCommandLineOption quietOption("quiet", "Do not log every read; for load tests.");
+    QCommandLineOption forwardOption("forward", "Proxy each client to <host:port> instead of echoing.", "host:port");
+    QCommandLineOption profileOption("profile", "Proxy: start from lan, wifi, congested-wifi or mobile.", "name");
+    QCommandLineOption latencyOption("latency", "Proxy: one-way delay in milliseconds.", "ms");
+    QCommandLineOption jitterOption("jitter", "Proxy: up to +-<ms> on each delay.", "ms");
+    QCommandLineOption rateOption("rate", "Proxy: bandwidth cap per direction in kbit/s.", "kbit/s");
+    QCommandLineOption fragmentOption("fragment", "Proxy: forward in writes of at most <bytes>.", "bytes");
+    QCommandLineOption dropOption("drop-mean", "Proxy: cut connections after <s> seconds on average.", "s");
+    QCommandLineOption bufferOption("buffer",
+                                    "Proxy: stop reading a side while <bytes> from it are in flight "
+                                    "(default 262144).",
+                                    "bytes", "262144");
+    QCommandLineOption seedOption("seed", "Proxy: random seed, for repeatable runs (default 1).", "n", "1");
+    QCommandLineOption reportOption("report", "Proxy: log throughput every <s> seconds (default 1).", "s", "1");
+    parser.addOptions({portOption, transportOption, noShmOption, quietOption, forwardOption, profileOption,
+                       latencyOption, jitterOption, rateOption, fragmentOption, dropOption, bufferOption,
+                       seedOption, reportOption});
+    parser.process(app);
+
+    bool portOk = false;
+    const uint port = parser.value(portOption).toUInt(&portOk);
+    if (!portOk || port > 65535) {
+        qCritical() << "Invalid port" << parser.value(portOption);
+        return 1;
+    }
+    TransportKind kind;
+    if (!parseTransportKind(parser.value(transportOption).toStdString(), kind)) {
+        qCritical() << "Unknown transport" << parser.value(transportOption);
+        return 1;
+    }
+
+    // Explicit flags win over the profile
+    LinkConditions conditions;
+    if (parser.isSet(profileOption) && !parseLinkProfile(parser.value(profileOption).toStdString(), conditions)) {
+        qCritical() << "Unknown profile" << parser.value(profileOption);
+        return 1;
+    }
+    const std::pair<const QCommandLineOption*, double*> numbers[] = {
+        {&latencyOption, &conditions.latencyMs},
+        {&jitterOption, &conditions.jitterMs},
+        {&rateOption, &conditions.rateKbps},
+        {&dropOption, &conditions.dropMeanSeconds},
+    };
+    for (const auto& [option, value] : numbers) {
+        if (!parser.isSet(*option)) continue;
+        bool ok = false;
+        *value = parser.value(*option).toDouble(&ok);
+        if (!ok || *value < 0) {
+            qCritical() << "Invalid value for" << option->names().first();
+            return 1;
+        }
+    }
+    if (parser.isSet(fragmentOption)) {
+        bool ok = false;
+        conditions.fragmentBytes = parser.value(fragmentOption).toUInt(&ok);
+        if (!ok) {
+            qCritical() << "Invalid value for fragment";
+            return 1;
+        }
+    }
+    bool bufferOk = false;
+    const qulonglong bufferBytes = parser.value(bufferOption).toULongLong(&bufferOk);
+    if (!bufferOk || bufferBytes == 0) {
+        qCritical() << "Invalid value for buffer";
+        return 1;
+    }
+    bool seedOk = false;
+    const std::uint64_t seed = parser.value(seedOption).toULongLong(&seedOk);
+    bool reportOk = false;
+    const double reportSeconds = parser.value(reportOption).toDouble(&reportOk);
+    if (!seedOk || !reportOk || reportSeconds <= 0) {
+        qCritical() << "Invalid seed or report interval";
+        return 1;
+    }
+
+    std::string forwardHost;
+    uint forwardPort = 0;
+    if (parser.isSet(forwardOption)) {
+        // The last colon, so IPv6 literals work
+        const QString target = parser.value(forwardOption);
+        const qsizetype colon = target.lastIndexOf(':');
+        bool ok = false;
+        if (colon > 0) forwardPort = target.mid(colon + 1).toUInt(&ok);
+        if (!ok || forwardPort == 0 || forwardPort > 65535) {
+            qCritical() << "Invalid forward target" << target;
+            return 1;
+        }
+        forwardHost = target.left(colon).remove('[').remove(']').toStdString();
+    }
 
-    EchoServer server;
-    const quint16 port = 12345;  // match your client default
-    if (!server.listen(QHostAddress::Any, port)) {
-        qCritical() << "Failed to listen on port" << port << ":" << server.errorString();
+    const bool shortcut = !parser.isSet(noShmOption);
+    std::unique_ptr<Transport> transport = makeTransport(kind, shortcut);
+    if (!transport) {
+        qWarning() << parser.value(transportOption) << "is not available here, using Qt sockets";
+        transport = makeTransport(TransportKind::Qt, shortcut);
+    }
+
+    const bool quiet = parser.isSet(quietOption);
+    Transport* server = transport.get();
+    std::unique_ptr<Proxy> proxy;
+    if (parser.isSet(forwardOption)) {
+        proxy = std::make_unique<Proxy>(*server, forwardHost, static_cast<std::uint16_t>(forwardPort), conditions,
+                                        static_cast<std::size_t>(bufferBytes), seed, quiet);
+        server->setHandlers(proxy->handlers());
+    } else {
+        server->setHandlers({
+            .accepted =
+                [quiet](ConnectionId id) {
+                    if (!quiet) qInfo() << "Client" << id << "connected";
+                },
+            .received =
+                [server, quiet](ConnectionId id, std::string_view data) {
+                    if (!quiet) qInfo() << "Received" << QByteArray(data.data(), static_cast<qsizetype>(data.size()));
+                    server->send(id, data);
+                },
+            .closed =
+                [quiet](ConnectionId id) {
+                    if (!quiet) qInfo() << "Client" << id << "disconnected";
+                },
+        });
+    }
+
+    if (!server->listen(static_cast<quint16>(port))) {
+        qCritical() << "Failed to listen on port" << port;
         return 1;
     }
 
-    qInfo() << "Echo server listening on port" << port << "...";
-    return app.exec();
+    if (proxy) {
+        qInfo().noquote() << QString("Proxy on port %1 to %2:%3 using %4: %5 ms +-%6 ms, %7 kbit/s, %8-byte writes, "
+                                     "drops every %9 s (0 = never), %10 bytes buffered per direction")
+                                 .arg(port)
+                                 .arg(QString::fromStdString(forwardHost))
+                                 .arg(forwardPort)
+                                 .arg(server->name())
+                                 .arg(conditions.latencyMs)
+                                 .arg(conditions.jitterMs)
+                                 .arg(conditions.rateKbps)
+                                 .arg(conditions.fragmentBytes)
+                                 .arg(conditions.dropMeanSeconds)
+                                 .arg(bufferBytes);
+        proxy->run(reportSeconds);
+    }
+
+    qInfo() << "Echo server listening on port" << port << "using" << server->name() << "...";
+    // Replies queued while handling one batch of reads go out together
+    // at the start of the next poll
+    for (;;) server->poll(-1);
 }
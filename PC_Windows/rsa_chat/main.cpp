@@ -1,8 +1,21 @@
 #include <iostream>
+#include <string>
+#include <vector>
 #include <QApplication>
 #include "MainWindow.h"
+#include "rsa_chat_trace.h"
 
 int main(int argc, char *argv[]) {
+    // rsa_chat --merge-traces out.json a.json b.json ...
+    if (argc >= 4 && std::string(argv[1]) == "--merge-traces") {
+        std::vector<std::string> inputs(argv + 3, argv + argc);
+        if (!traceMergeChromeJson(inputs, argv[2])) {
+            std::cerr << "Failed to merge traces into " << argv[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     QApplication app(argc, argv);
 
     MainWindow w;
@@ -0,0 +1,117 @@
+// Replays recorded sessions through the receive path: real traffic for
+// benchmarks, and regression checks on parser throughput and output.
+//
+//   rsa_chat_replay [--paced [--speed X]] [--repeat N] [--min-mbps X]
+//                   [--expect-checksum HEX] [--dump FILE] CAPTURE...
+//
+// CAPTURE files come from rsa_chat_cli --capture or RSA_CHAT_CAPTURE_DIR
+// in the GUI. One summary line per capture goes to stdout; the exit code
+// is 1 if any capture fails to load or misses a check.
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "rsa_chat_capture.h"
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays captured RSA chat sessions through the receive path");
+    parser.addHelpOption();
+    parser.addPositionalArgument("captures", "Capture files.", "captures...");
+    QCommandLineOption pacedOption("paced", "Feed each read at its recorded time instead of as fast as possible.");
+    QCommandLineOption speedOption("speed", "With --paced, play <x> times faster than recorded (default 1).", "x", "1");
+    QCommandLineOption repeatOption("repeat", "Replay each capture <n> times and report the fastest run.", "n", "1");
+    QCommandLineOption minMbpsOption("min-mbps", "Fail if the receive path runs slower than <x> MB/s.", "x");
+    QCommandLineOption checksumOption("expect-checksum", "Fail unless the decoded traffic hashes to <hex>.", "hex");
+    QCommandLineOption dumpOption("dump", "Write the protocol text of the captures to <file>, e.g. for "
+                                          "rsa_chat_codebook.", "file");
+    parser.addOptions({pacedOption, speedOption, repeatOption, minMbpsOption, checksumOption, dumpOption});
+    parser.process(app);
+
+    if (parser.positionalArguments().isEmpty()) parser.showHelp(1);
+
+    ReplayOptions options;
+    if (parser.isSet(pacedOption)) options.pacing = ReplayPacing::Original;
+    bool ok = false;
+    options.speed = parser.value(speedOption).toDouble(&ok);
+    if (!ok || options.speed <= 0) {
+        qCritical() << "Invalid speed" << parser.value(speedOption);
+        return 1;
+    }
+    const uint repeat = parser.value(repeatOption).toUInt(&ok);
+    if (!ok || repeat == 0) {
+        qCritical() << "Invalid repeat count" << parser.value(repeatOption);
+        return 1;
+    }
+    double minMbps = 0.0;
+    if (parser.isSet(minMbpsOption)) {
+        minMbps = parser.value(minMbpsOption).toDouble(&ok);
+        if (!ok) {
+            qCritical() << "Invalid throughput" << parser.value(minMbpsOption);
+            return 1;
+        }
+    }
+    quint64 expectedChecksum = 0;
+    if (parser.isSet(checksumOption)) {
+        expectedChecksum = parser.value(checksumOption).toULongLong(&ok, 16);
+        if (!ok) {
+            qCritical() << "Invalid checksum" << parser.value(checksumOption);
+            return 1;
+        }
+    }
+
+    std::ofstream dump;
+    if (parser.isSet(dumpOption)) {
+        dump.open(parser.value(dumpOption).toStdString(), std::ios::binary);
+        if (!dump) {
+            qCritical() << "Cannot create" << parser.value(dumpOption);
+            return 1;
+        }
+    }
+
+    int rc = 0;
+    for (const QString& input : parser.positionalArguments()) {
+        Capture capture;
+        if (!capture.load(input.toStdString())) {
+            qCritical() << "Cannot read capture" << input;
+            rc = 1;
+            continue;
+        }
+        if (dump.is_open()) dump.write(capture.bytes().data(), static_cast<std::streamsize>(capture.bytes().size()));
+
+        ReplayStats best;
+        for (uint run = 0; run < repeat; ++run) {
+            const ReplayStats stats = replayCapture(capture, options);
+            if (run == 0 || stats.busySeconds < best.busySeconds) best = stats;
+        }
+
+        const double mbps = best.megabytesPerSecond();
+        std::printf("%s: %llu reads, %.2f MB, %llu messages, %llu lines, %llu corrupt, %.1f MB/s, %.0f msg/s, "
+                    "checksum %016llx",
+                    qPrintable(input), static_cast<unsigned long long>(best.segments), best.bytes / 1e6,
+                    static_cast<unsigned long long>(best.messages), static_cast<unsigned long long>(best.lines),
+                    static_cast<unsigned long long>(best.corrupt), mbps,
+                    best.busySeconds > 0 ? best.messages / best.busySeconds : 0.0,
+                    static_cast<unsigned long long>(best.checksum));
+        if (options.pacing == ReplayPacing::Original) {
+            std::printf(", %.2f s for %.2f s recorded, max lag %.0f us", best.wallSeconds,
+                        capture.durationUs() / 1e6, best.maxLagUs);
+        }
+        std::printf("\n");
+
+        if (parser.isSet(minMbpsOption) && mbps < minMbps) {
+            std::fprintf(stderr, "%s: %.1f MB/s is below the required %.1f MB/s\n", qPrintable(input), mbps, minMbps);
+            rc = 1;
+        }
+        if (parser.isSet(checksumOption) && best.checksum != expectedChecksum) {
+            std::fprintf(stderr, "%s: checksum %016llx, expected %016llx\n", qPrintable(input),
+                         static_cast<unsigned long long>(best.checksum),
+                         static_cast<unsigned long long>(expectedChecksum));
+            rc = 1;
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,317 @@
+#include "rsa_chat_async.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+
+#include <algorithm>
+#include <latch>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Without a wake fd, how long a poll may sleep before it checks for jobs
+// posted from other threads
+static constexpr int kPostCheckMs = 10;
+
+// ---------- Executor ----------
+
+// The frame spawn() wraps around a task: started by the executor, gone
+// as soon as the task finishes
+struct Executor::Detached {
+    struct promise_type {
+        Executor* executor = nullptr;
+
+        Detached get_return_object() {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        // A detached task has no one to report to
+        void unhandled_exception() { std::terminate(); }
+        ~promise_type() {
+            if (executor) executor->m_tasks.erase(std::coroutine_handle<promise_type>::from_promise(*this).address());
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+Executor::Detached Executor::detach(Task<void> task) {
+    co_await std::move(task);
+}
+
+Executor::Executor(Transport& transport) : m_transport(transport) {
+    m_transport.setHandlers({.accepted = [this](ConnectionId id) { onAccepted(id); },
+                             .received = [this](ConnectionId id, std::string_view data) { onReceived(id, data); },
+                             .closed = [this](ConnectionId id) { onClosed(id); }});
+#if defined(__linux__)
+    m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd >= 0) m_transport.watch(m_wakeFd);
+#endif
+}
+
+Executor::~Executor() {
+    // Unfinished tasks go first, while the sessions in their frames can
+    // still unregister
+    std::vector<void*> tasks(m_tasks.begin(), m_tasks.end());
+    m_tasks.clear();
+    for (void* frame : tasks) std::coroutine_handle<>::from_address(frame).destroy();
+    m_transport.setHandlers({});
+#if defined(__linux__)
+    if (m_wakeFd >= 0) ::close(m_wakeFd);
+#endif
+}
+
+void Executor::spawn(Task<void> task) {
+    Detached detached = detach(std::move(task));
+    detached.handle.promise().executor = this;
+    m_tasks.insert(detached.handle.address());
+    schedule(detached.handle);
+}
+
+Task<void> Executor::capture(Task<void> task, bool& done) {
+    co_await std::move(task);
+    done = true;
+}
+
+void Executor::runUntil(Task<void> task) {
+    bool done = false;
+    spawn(capture(std::move(task), done));
+    while (!done) runOnce(-1);
+}
+
+ConnectionId Executor::connect(const std::string& host, std::uint16_t port) {
+    const ConnectionId id = m_transport.connect(host, port);
+    // Bytes may arrive before a session takes the connection
+    if (id) m_unclaimed.try_emplace(id);
+    return id;
+}
+
+void Executor::post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        m_posted.push_back(std::move(job));
+    }
+    if (!m_postPending.exchange(true)) wake();
+}
+
+void Executor::wake() {
+#if defined(__linux__)
+    if (m_wakeFd >= 0) {
+        const std::uint64_t one = 1;
+        [[maybe_unused]] const ssize_t n = ::write(m_wakeFd, &one, sizeof(one));
+    }
+#endif
+    if (m_wakeHandler) m_wakeHandler();
+}
+
+void Executor::runPosted() {
+    if (!m_postPending.load(std::memory_order_acquire)) return;
+#if defined(__linux__)
+    if (m_wakeFd >= 0) {
+        std::uint64_t count;
+        [[maybe_unused]] const ssize_t n = ::read(m_wakeFd, &count, sizeof(count));
+    }
+#endif
+    m_postPending.store(false);
+    {
+        std::lock_guard<std::mutex> lock(m_postMutex);
+        m_postedRunning.swap(m_posted);
+    }
+    for (auto& job : m_postedRunning) job();
+    m_postedRunning.clear();
+}
+
+void Executor::runOnce(int timeoutMs) {
+    if (!m_ready.empty() || m_postPending.load(std::memory_order_acquire)) {
+        timeoutMs = 0;
+    } else if (m_wakeFd < 0 && (timeoutMs < 0 || timeoutMs > kPostCheckMs)) {
+        timeoutMs = kPostCheckMs;
+    }
+    m_transport.poll(timeoutMs);
+    runPosted();
+
+    // Only those ready now; what they make ready waits for the next turn,
+    // so a busy coroutine cannot keep the transport from being polled
+    m_running.swap(m_ready);
+    while (!m_running.empty()) {
+        const std::coroutine_handle<> handle = m_running.front();
+        m_running.pop_front();
+        handle.resume();
+    }
+}
+
+bool Executor::prepareWait() {
+    return m_transport.prepareWait() && m_ready.empty() && !m_postPending.load(std::memory_order_acquire);
+}
+
+void Executor::run() {
+    while (!m_stopping) runOnce(-1);
+}
+
+void Executor::stop() {
+    post([this] {
+        m_stopping = true;
+        for (std::coroutine_handle<> handle : m_acceptWaiters) schedule(handle);
+        m_acceptWaiters.clear();
+    });
+}
+
+void Executor::onAccepted(ConnectionId id) {
+    m_unclaimed.try_emplace(id);
+    m_accepted.push_back(id);
+    if (!m_acceptWaiters.empty()) {
+        schedule(m_acceptWaiters.front());
+        m_acceptWaiters.pop_front();
+    }
+}
+
+void Executor::onReceived(ConnectionId id, std::string_view data) {
+    if (auto it = m_sessions.find(id); it != m_sessions.end()) {
+        it->second->feed(data);
+    } else if (auto unclaimed = m_unclaimed.find(id); unclaimed != m_unclaimed.end()) {
+        unclaimed->second.data.append(data);
+    }
+}
+
+void Executor::onClosed(ConnectionId id) {
+    if (auto it = m_sessions.find(id); it != m_sessions.end()) {
+        it->second->closed();
+    } else if (auto unclaimed = m_unclaimed.find(id); unclaimed != m_unclaimed.end()) {
+        // With nothing left to read the entry can go: a session that
+        // finds none knows the connection has closed. The rest wait for
+        // their session so the last message is not lost.
+        if (unclaimed->second.data.empty()) {
+            m_unclaimed.erase(unclaimed);
+        } else {
+            unclaimed->second.closed = true;
+        }
+    }
+}
+
+// ---------- ExecutorPool ----------
+
+ExecutorPool::ExecutorPool(std::size_t threads, std::function<std::unique_ptr<Transport>()> makeTransport)
+    : m_executors(std::max<std::size_t>(threads, 1), nullptr) {
+    std::latch started(static_cast<std::ptrdiff_t>(m_executors.size()));
+    for (std::size_t i = 0; i < m_executors.size(); ++i) {
+        m_threads.emplace_back([this, i, &makeTransport, &started] {
+            std::unique_ptr<Transport> transport = makeTransport();
+            std::unique_ptr<Executor> executor = transport ? std::make_unique<Executor>(*transport) : nullptr;
+            m_executors[i] = executor.get();
+            started.count_down();
+            if (executor) executor->run();
+        });
+    }
+    started.wait();
+}
+
+ExecutorPool::~ExecutorPool() {
+    stop();
+    for (std::thread& thread : m_threads) thread.join();
+}
+
+void ExecutorPool::post(std::size_t index, std::function<void(Executor&)> job) {
+    Executor* executor = m_executors[index];
+    if (executor) executor->post([executor, job = std::move(job)] { job(*executor); });
+}
+
+void ExecutorPool::stop() {
+    for (Executor* executor : m_executors) {
+        if (executor) executor->stop();
+    }
+}
+
+// ---------- AsyncSession ----------
+
+AsyncSession::AsyncSession(Executor& executor, ConnectionId id, const KeyPair& keys,
+                           const AnyRsaKeyPair* wideKeys)
+    : m_executor(executor), m_id(id),
+      m_core({[this](std::string_view data) { m_executor.transport().send(m_id, data); },
+              nullptr,
+              nullptr,
+              [this] { keysExchanged(); },
+              nullptr,
+              [this](Channel channel, std::uint64_t messageId, std::string_view payload) {
+                  m_inbox.push_back({channel, messageId, std::string(payload)});
+              },
+              [this](const std::string&) { ++m_dropped; }},
+             keys) {
+    if (wideKeys) m_core.setWideKeys(*wideKeys);
+    m_executor.transport().send(m_id, m_core.helloLines());
+
+    m_executor.m_sessions[m_id] = this;
+    auto unclaimed = m_executor.m_unclaimed.find(m_id);
+    if (unclaimed == m_executor.m_unclaimed.end()) {
+        // Closed before we took it, with nothing unread
+        closed();
+        return;
+    }
+    const Executor::Unclaimed early = std::move(unclaimed->second);
+    m_executor.m_unclaimed.erase(unclaimed);
+    if (!early.data.empty()) feed(early.data);
+    if (early.closed) closed();
+}
+
+AsyncSession::~AsyncSession() {
+    m_executor.m_sessions.erase(m_id);
+    if (!m_closed) m_executor.transport().close(m_id);
+}
+
+void AsyncSession::close() {
+    if (m_closed) return;
+    // closed() follows from the transport
+    m_executor.transport().close(m_id);
+}
+
+void AsyncSession::feed(std::string_view data) {
+    m_core.feed(data);
+    if (m_recvWaiter && !m_inbox.empty()) m_executor.schedule(std::exchange(m_recvWaiter, {}));
+}
+
+void AsyncSession::keysExchanged() {
+    m_ready = true;
+    for (std::coroutine_handle<> handle : m_readyWaiters) m_executor.schedule(handle);
+    m_readyWaiters.clear();
+}
+
+void AsyncSession::closed() {
+    m_closed = true;
+    m_ready = false;
+    wakeAll();
+}
+
+void AsyncSession::wakeAll() {
+    for (std::coroutine_handle<> handle : m_readyWaiters) m_executor.schedule(handle);
+    m_readyWaiters.clear();
+    if (m_recvWaiter) m_executor.schedule(std::exchange(m_recvWaiter, {}));
+}
+
+bool AsyncSession::write(std::string_view payload, Channel channel) {
+    if (!m_ready) return false;
+    const PeerCaps& caps = m_core.peerCaps();
+    if (channel != Channel::Chat && !caps.channels) return false;
+    if (channel == Channel::File && payload.size() > kMaxChannelMessage) return false;
+
+    const std::uint64_t messageId = channel == Channel::Chat ? newMessageId(caps) : 0;
+    TraceSpan messageSpan("send_message", messageId);
+
+    // Files go out in chunks like ChatSession's. The transport has no
+    // backpressure to interleave them with, so they are queued whole.
+    const std::size_t chunk = channel == Channel::File ? kChannelChunkSize : payload.size();
+    m_frame.clear();
+    std::size_t pos = 0;
+    do {
+        m_piece.assign(payload.substr(pos, chunk));
+        pos += m_piece.size();
+        FrameHeader header;
+        m_core.seal(m_piece, messageId, channel, pos < payload.size(), header, m_cipher, m_frame);
+    } while (pos < payload.size());
+
+    traceFlow("message", messageId, true);
+    m_executor.transport().send(m_id, m_frame);
+    metricsAdd(Counter::MessagesSent);
+    return true;
+}
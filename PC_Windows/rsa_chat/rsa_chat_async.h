@@ -0,0 +1,436 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "rsa_chat_protocol.h"
+#include "rsa_chat_session.h"
+#include "rsa_chat_transport.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Coroutine API for the chat protocol, for servers and bots that run
+// thousands of sessions on one thread without a QObject, a callback
+// chain or a thread per connection:
+//
+//   Task<void> echo(Executor& executor, ConnectionId id, const KeyPair& keys) {
+//       AsyncSession session(executor, id, keys);
+//       if (!co_await session.handshake()) co_return;
+//       while (auto message = co_await session.recv()) {
+//           co_await session.send(message->payload);
+//       }
+//   }
+//
+//   Task<void> serve(Executor& executor, const KeyPair& keys) {
+//       while (ConnectionId id = co_await executor.accept()) {
+//           executor.spawn(echo(executor, id, keys));
+//       }
+//   }
+//
+// An Executor drives one Transport and the coroutines using it on a
+// single thread, so the I/O loop is whichever backend the transport is:
+// the Qt event loop (TransportKind::Qt), io_uring or plain epoll. Under
+// a running QCoreApplication::exec(), e.g. in the GUI, an ExecutorDriver
+// (QtExecutor.h) turns it from the Qt loop instead of run(). An
+// ExecutorPool runs one executor per thread, each with its own transport.
+// Sessions speak the same wire protocol as ChatSession and interoperate
+// with the GUI and rsa_chat_cli.
+
+// ---------- Task ----------
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    // Whoever awaits the task, resumed when it finishes
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            const std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    // Lazy: nothing runs until the task is awaited or spawned
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+    T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+// A coroutine returning T. Awaiting it runs it, and the awaiter resumes
+// right where it finishes, without a trip through the executor.
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle handle;
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{m_handle};
+    }
+
+private:
+    Handle m_handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// ---------- Executor ----------
+
+class AsyncSession;
+
+class Executor {
+public:
+    // Takes over the transport's handlers; it must outlive the executor
+    explicit Executor(Transport& transport);
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    Transport& transport() { return m_transport; }
+
+    // Starts `task` on the next turn of the loop. Its frame is freed when
+    // it finishes, or with the executor if it never does.
+    void spawn(Task<void> task);
+
+    // Runs `job` on the executor's thread at its next turn. The only
+    // member that may be called from other threads, with stop().
+    void post(std::function<void()> job);
+
+    // Next connection accepted by the transport's listening socket, to
+    // hand to an AsyncSession; 0 once the executor is stopping
+    auto accept() {
+        struct Awaiter {
+            Executor& executor;
+            bool await_ready() const noexcept { return !executor.m_accepted.empty() || executor.m_stopping; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.m_acceptWaiters.push_back(handle); }
+            ConnectionId await_resume() {
+                if (executor.m_accepted.empty()) return 0;
+                const ConnectionId id = executor.m_accepted.front();
+                executor.m_accepted.pop_front();
+                return id;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    // Blocks until connected, like Transport::connect(); 0 on failure
+    ConnectionId connect(const std::string& host, std::uint16_t port);
+
+    // Lets every other ready coroutine, and the transport, run first
+    auto yield() {
+        struct Awaiter {
+            Executor& executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor.schedule(handle); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+    // Resumes `handle` on the next turn; executor thread only
+    void schedule(std::coroutine_handle<> handle) { m_ready.push_back(handle); }
+
+    // One turn: polls the transport, waiting up to timeoutMs unless a
+    // coroutine is ready already, then resumes those that are ready
+    void runOnce(int timeoutMs);
+
+    // Turns until stop()
+    void run();
+
+    // For a loop that drives the executor instead of run(), such as
+    // ExecutorDriver under QCoreApplication::exec(): the transport's fd to
+    // wait on (-1 for none), and whether the loop may sleep on it now.
+    // prepareWait() flushes the transport and returns false while a
+    // runOnce(0) has work to do.
+    int waitFd() const { return m_transport.waitFd(); }
+    bool prepareWait();
+
+    // Also called by post(), on the posting thread, for loops that cannot
+    // sleep on the wake fd. Set it before other threads start posting.
+    void setWakeHandler(std::function<void()> handler) { m_wakeHandler = std::move(handler); }
+
+    // Turns until `task` has finished, and returns its result
+    template <typename T>
+    T runUntil(Task<T> task) {
+        std::optional<T> result;
+        bool done = false;
+        spawn(capture(std::move(task), result, done));
+        while (!done) runOnce(-1);
+        return std::move(*result);
+    }
+    void runUntil(Task<void> task);
+
+    // Ends run() and wakes accept() with 0. Thread-safe.
+    void stop();
+    bool stopping() const { return m_stopping; }
+
+    // Spawned tasks that have not finished
+    std::size_t tasks() const { return m_tasks.size(); }
+
+private:
+    friend class AsyncSession;
+
+    struct Detached;
+    static Detached detach(Task<void> task);
+
+    struct Unclaimed {
+        std::string data;
+        bool closed = false;
+    };
+
+    template <typename T>
+    static Task<void> capture(Task<T> task, std::optional<T>& result, bool& done) {
+        result = co_await std::move(task);
+        done = true;
+    }
+    static Task<void> capture(Task<void> task, bool& done);
+
+    void onAccepted(ConnectionId id);
+    void onReceived(ConnectionId id, std::string_view data);
+    void onClosed(ConnectionId id);
+    void runPosted();
+    void wake();
+
+    Transport& m_transport;
+    std::deque<std::coroutine_handle<>> m_ready;
+    std::deque<std::coroutine_handle<>> m_running;
+    // Frames of spawned tasks, destroyed with the executor if unfinished
+    std::unordered_set<void*> m_tasks;
+
+    std::deque<ConnectionId> m_accepted;
+    std::deque<std::coroutine_handle<>> m_acceptWaiters;
+    std::unordered_map<ConnectionId, AsyncSession*> m_sessions;
+    // Connections no session has taken yet keep what arrives for them.
+    // Every id accept() or connect() hands out has an entry until its
+    // session takes it or it closes with nothing unread, so an id must
+    // not be left without a session while its peer keeps sending.
+    std::unordered_map<ConnectionId, Unclaimed> m_unclaimed;
+
+    std::mutex m_postMutex;
+    std::vector<std::function<void()>> m_posted;
+    std::vector<std::function<void()>> m_postedRunning;
+    std::atomic<bool> m_postPending{false};
+    // An eventfd the transport watches, so post() ends its wait; -1
+    // where there is none and the wait is bounded instead
+    int m_wakeFd = -1;
+    std::function<void()> m_wakeHandler;
+    std::atomic<bool> m_stopping{false};
+};
+
+// One executor per thread, each with a transport of its own made on that
+// thread (io_uring rings and Qt sockets must stay on theirs). Sessions do
+// not move between threads: spread the work with post().
+class ExecutorPool {
+public:
+    ExecutorPool(std::size_t threads, std::function<std::unique_ptr<Transport>()> makeTransport);
+    // Stops every executor and joins the threads
+    ~ExecutorPool();
+
+    ExecutorPool(const ExecutorPool&) = delete;
+    ExecutorPool& operator=(const ExecutorPool&) = delete;
+
+    std::size_t size() const { return m_executors.size(); }
+
+    // Null if that thread could not make a transport
+    Executor* executor(std::size_t index) { return m_executors[index]; }
+
+    // Runs job(executor) on executor `index`'s thread
+    void post(std::size_t index, std::function<void(Executor&)> job);
+
+    void stop();
+
+private:
+    std::vector<Executor*> m_executors;
+    std::vector<std::thread> m_threads;
+};
+
+// ---------- AsyncSession ----------
+
+// A complete message from the peer. File payloads are "<name>\0<bytes>",
+// see splitFilePayload().
+struct AsyncMessage {
+    Channel channel = Channel::Chat;
+    std::uint64_t messageId = 0;
+    std::string payload;
+};
+
+// One peer connection speaking the chat protocol through a SessionCore
+// (rsa_chat_session.h), like ChatSession. Only one coroutine may wait in
+// recv() at a time; any number may wait in handshake() or send(). Pings
+// from the peer are answered from feed(); it never sends its own.
+class AsyncSession {
+public:
+    // Takes over connection `id`, as handed out by the executor's accept()
+    // or connect(), and sends our public key straight away, with a WKEY: line
+    // when `wideKeys` is given
+    AsyncSession(Executor& executor, ConnectionId id, const KeyPair& keys,
+                 const AnyRsaKeyPair* wideKeys = nullptr);
+    // Closes the connection once what was sent has gone out
+    ~AsyncSession();
+
+    AsyncSession(const AsyncSession&) = delete;
+    AsyncSession& operator=(const AsyncSession&) = delete;
+
+    // Resumes once the peer's key has arrived: true, or false if the
+    // connection closed first
+    auto handshake() {
+        struct Awaiter {
+            AsyncSession& session;
+            bool await_ready() const noexcept { return session.m_ready || session.m_closed; }
+            void await_suspend(std::coroutine_handle<> handle) { session.m_readyWaiters.push_back(handle); }
+            bool await_resume() const noexcept { return session.m_ready; }
+        };
+        return Awaiter{*this};
+    }
+
+    // The next complete message on any channel, in arrival order; nullopt
+    // once the connection has closed and every earlier message was taken
+    auto recv() {
+        struct Awaiter {
+            AsyncSession& session;
+            bool await_ready() const noexcept { return !session.m_inbox.empty() || session.m_closed; }
+            void await_suspend(std::coroutine_handle<> handle) { session.m_recvWaiter = handle; }
+            std::optional<AsyncMessage> await_resume() {
+                if (session.m_inbox.empty()) return std::nullopt;
+                AsyncMessage message = std::move(session.m_inbox.front());
+                session.m_inbox.pop_front();
+                return message;
+            }
+        };
+        return Awaiter{*this};
+    }
+
+    // Seals `payload` for the peer and queues it on the transport, which
+    // writes everything queued in one go at its next poll, so back-to-back
+    // sends pipeline without waiting for each other. Suspends only until
+    // the handshake; false if the connection closed, or for the control
+    // and file channels with a peer that lacks them.
+    auto send(std::string_view payload, Channel channel = Channel::Chat) {
+        struct Awaiter {
+            AsyncSession& session;
+            std::string_view payload;
+            Channel channel;
+            bool await_ready() const noexcept { return session.m_ready || session.m_closed; }
+            void await_suspend(std::coroutine_handle<> handle) { session.m_readyWaiters.push_back(handle); }
+            bool await_resume() { return session.write(payload, channel); }
+        };
+        return Awaiter{*this, payload, channel};
+    }
+
+    void close();
+
+    ConnectionId id() const { return m_id; }
+    bool isReady() const { return m_ready; }
+    bool isClosed() const { return m_closed; }
+    const PublicKey& remotePublicKey() const { return m_core.remotePublicKey(); }
+    const PeerCaps& peerCaps() const { return m_core.peerCaps(); }
+    const AnyRsaKey* remoteWideKey() const { return m_core.remoteWideKey(); }
+    // Corrupt or oversized messages discarded so far
+    std::uint64_t dropped() const { return m_dropped; }
+
+private:
+    friend class Executor;
+
+    void feed(std::string_view data);
+    void closed();
+    void keysExchanged();
+    bool write(std::string_view payload, Channel channel);
+    void wakeAll();
+
+    Executor& m_executor;
+    ConnectionId m_id;
+    SessionCore m_core;
+    bool m_ready = false;
+    bool m_closed = false;
+    std::uint64_t m_dropped = 0;
+    std::deque<AsyncMessage> m_inbox;
+    std::coroutine_handle<> m_recvWaiter;
+    std::vector<std::coroutine_handle<>> m_readyWaiters;
+    // Reused for every frame sealed by this session
+    std::vector<CipherWord> m_cipher;
+    std::string m_frame;
+    std::string m_piece;
+};
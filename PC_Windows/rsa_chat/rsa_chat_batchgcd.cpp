@@ -0,0 +1,138 @@
+#include "rsa_chat_batchgcd.h"
+#include "rsa_chat_bignum.h"
+#include "rsa_chat_rsakey.h"
+#include "rsa_chat_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <latch>
+#include <utility>
+
+// Runs fn(i, fork) for every node of one tree level. Wide levels give each
+// worker its own nodes; the narrow top of the tree has fewer nodes than
+// workers, so there the nodes go one by one on this thread and the pool
+// is handed down to split the big multiplications instead.
+static void forEachNode(ThreadPool& pool, std::size_t count,
+                        const std::function<void(std::size_t, ThreadPool*)>& fn) {
+    if (count < pool.size()) {
+        for (std::size_t i = 0; i < count; ++i) fn(i, &pool);
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::latch done(static_cast<std::ptrdiff_t>(pool.size()));
+    for (std::size_t w = 0; w < pool.size(); ++w) {
+        pool.submit([&] {
+            for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) fn(i, nullptr);
+            done.count_down();
+        });
+    }
+    done.wait();
+}
+
+// Cost is dominated by the top levels of both trees, whose nodes hold
+// most of the corpus. bigMul switches to Karatsuba at 32 limbs and
+// bigDivMod to Newton division at 64, so a level costs O(N^1.58) in the
+// corpus size N, and the whole scan O(N^1.58) as the levels shrink
+// geometrically, not O(N^2). Quasi-linear would need an FFT multiply;
+// `rsa_chat_bench crack` tracks both the scan and the primitives.
+static std::vector<Modulus128> batchGcd(std::span<const Modulus128> moduli, ThreadPool& pool) {
+    // With one modulus there is nothing to share
+    if (moduli.size() < 2) return std::vector<Modulus128>(moduli.size(), Modulus128{1, 0});
+
+    // Product tree, leaves first; each level pairs up the one below
+    std::vector<std::vector<BigNat>> tree(1);
+    tree[0].reserve(moduli.size());
+    for (const Modulus128& n : moduli) tree[0].push_back(bigFromLimbs(n.data(), n.size()));
+    while (tree.back().size() > 1) {
+        const std::vector<BigNat>& below = tree.back();
+        std::vector<BigNat> level((below.size() + 1) / 2);
+        forEachNode(pool, level.size(), [&](std::size_t i, ThreadPool* fork) {
+            level[i] = 2 * i + 1 < below.size() ? bigMul(below[2 * i], below[2 * i + 1], fork) : below[2 * i];
+        });
+        tree.push_back(std::move(level));
+    }
+
+    // Remainder tree, root down: P mod node^2 from P mod parent^2. Each
+    // level is dropped once the one below has been reduced from it.
+    std::vector<BigNat> remainders = std::move(tree.back());
+    tree.pop_back();
+    for (;;) {
+        const std::vector<BigNat>& nodes = tree.back();
+        std::vector<BigNat> reduced(nodes.size());
+        forEachNode(pool, nodes.size(), [&](std::size_t i, ThreadPool* fork) {
+            reduced[i] = bigMod(remainders[i / 2], bigMul(nodes[i], nodes[i], fork), fork);
+        });
+        remainders = std::move(reduced);
+        if (tree.size() == 1) break;
+        tree.pop_back();
+    }
+
+    // P mod n^2 = n * ((P / n) mod n), so one exact division leaves the
+    // product of the other moduli reduced mod n
+    std::vector<Modulus128> gcds(moduli.size());
+    forEachNode(pool, moduli.size(), [&](std::size_t i, ThreadPool*) {
+        BigNat others;
+        BigNat rest;
+        bigDivMod(remainders[i], tree[0][i], &others, rest);
+        Modulus128 reduced{};
+        std::copy(others.begin(), others.end(), reduced.begin());
+        gcds[i] = limbsGcd(moduli[i], reduced);
+    });
+    return gcds;
+}
+
+std::vector<Modulus128> batchGcd(std::span<const Modulus128> moduli, unsigned threads) {
+    ThreadPool pool(threads);
+    return batchGcd(moduli, pool);
+}
+
+static bool isOne(const Modulus128& v) {
+    return v[0] == 1 && v[1] == 0;
+}
+
+SharedFactorReport crackSharedFactors(std::span<const CrackTarget> targets, unsigned threads) {
+    SharedFactorReport report;
+    report.results.resize(targets.size());
+
+    // A key seen twice is the same key, not a shared factor
+    std::vector<Modulus128> moduli;
+    moduli.reserve(targets.size());
+    for (const CrackTarget& target : targets) {
+        if (!limbsIsZero(target.n)) moduli.push_back(target.n);
+    }
+    auto byValue = [](const Modulus128& a, const Modulus128& b) { return limbsLess(a, b); };
+    std::sort(moduli.begin(), moduli.end(), byValue);
+    moduli.erase(std::unique(moduli.begin(), moduli.end()), moduli.end());
+    report.distinctModuli = moduli.size();
+
+    ThreadPool pool(threads);
+    std::vector<Modulus128> factors = batchGcd(moduli, pool);
+
+    // gcd == n: both primes are elsewhere, in keys that are hits too
+    std::vector<std::size_t> hits;
+    for (std::size_t i = 0; i < moduli.size(); ++i) {
+        if (!isOne(factors[i])) hits.push_back(i);
+    }
+    report.sharedModuli = hits.size();
+    forEachNode(pool, hits.size(), [&](std::size_t h, ThreadPool*) {
+        const std::size_t i = hits[h];
+        if (factors[i] != moduli[i]) return;
+        for (std::size_t j : hits) {
+            const Modulus128 g = limbsGcd(moduli[i], moduli[j]);
+            if (!isOne(g) && g != moduli[i]) {
+                factors[i] = g;
+                break;
+            }
+        }
+    });
+
+    forEachNode(pool, targets.size(), [&](std::size_t t, ThreadPool*) {
+        const CrackTarget& target = targets[t];
+        auto it = std::lower_bound(moduli.begin(), moduli.end(), target.n, byValue);
+        if (it == moduli.end() || *it != target.n) return;
+        const Modulus128& factor = factors[static_cast<std::size_t>(it - moduli.begin())];
+        if (!isOne(factor) && factor != target.n) crackKeyWithFactor(target, factor, report.results[t]);
+    });
+    return report;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "rsa_chat_crack.h"
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Bernstein's batch GCD: finds every modulus that shares a prime with
+// another one in a corpus, without trying all pairs. A product tree
+// multiplies the moduli together, a remainder tree brings the product back
+// down as P mod n_i^2, and gcd(n_i, (P mod n_i^2) / n_i) is then
+// gcd(n_i, product of all the other moduli).
+//
+// generateKeys() draws its primes from 100..500, so in a class of any
+// size most demo keys share a factor with some other key.
+
+// gcd(n_i, product of the other moduli) for each entry. The moduli must
+// be distinct and nonzero; a result of 1 means no shared factor, a result
+// equal to n_i that both of its factors occur elsewhere.
+std::vector<Modulus128> batchGcd(std::span<const Modulus128> moduli, unsigned threads = 0);
+
+struct SharedFactorReport {
+    std::vector<CrackResult> results; // parallel to the targets
+    std::size_t distinctModuli = 0;
+    std::size_t sharedModuli = 0; // distinct moduli with a factor found elsewhere
+};
+
+// Runs batchGcd over the targets' moduli (repeated keys count once) and
+// finishes every key whose factor turned up. Moduli whose factors both
+// occur elsewhere are split by pairwise gcds against the other hits,
+// which stay few next to the whole corpus.
+SharedFactorReport crackSharedFactors(std::span<const CrackTarget> targets, unsigned threads = 0);
@@ -0,0 +1,953 @@
+// Micro-benchmarks for the core hot paths.
+//
+//   rsa_chat_bench            run everything
+//   rsa_chat_bench <group>    run groups whose name contains <group>
+//
+// RSA_CHAT_BENCH_CAPTURES=a.rsacap,b.rsacap makes the replay group run
+// recorded sessions instead of generated traffic.
+
+#include "QtExecutor.h"
+#include "rsa_chat_async.h"
+#include "rsa_chat_batchgcd.h"
+#include "rsa_chat_bignum.h"
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_capture.h"
+#include "rsa_chat_codebook.h"
+#include "rsa_chat_core.h"
+#include "rsa_chat_crack.h"
+#include "rsa_chat_decimal.h"
+#include "rsa_chat_modarith.h"
+#include "rsa_chat_probe.h"
+#include "rsa_chat_protocol.h"
+#include "rsa_chat_receive.h"
+#include "rsa_chat_rsakey.h"
+#include "rsa_chat_search.h"
+#include "rsa_chat_thread_pool.h"
+#include "rsa_chat_transport.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <span>
+#include <string>
+#include <vector>
+
+static volatile std::uint64_t g_sink;
+
+// Every plain operator new in the process, for the allocs/msg figures
+static std::atomic<std::uint64_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Keeps the compiler from specialising on constant moduli, which the real
+// code never sees
+template <typename T>
+static T opaque(T value) {
+    volatile T v = value;
+    return v;
+}
+
+// Runs `body` (which performs `opsPerCall` operations) until ~0.3 s have
+// passed and prints the mean time per operation.
+static void bench(const char* name, std::uint64_t opsPerCall, const std::function<void()>& body) {
+    using clock = std::chrono::steady_clock;
+    body(); // warm-up
+
+    std::uint64_t calls = 0;
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    do {
+        body();
+        ++calls;
+        elapsed = clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(300));
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    std::printf("  %-44s %12.1f ns/op\n", name, ns / static_cast<double>(calls * opsPerCall));
+}
+
+// ---------- modular exponentiation ----------
+
+// The pre-kernel modpow, kept verbatim as the baseline
+static int legacyModpow(int base, int exp, int mod) {
+    long long result = 1;
+    long long b = base % mod;
+    while (exp > 0) {
+        if (exp % 2 == 1) {
+            result = (result * b) % mod;
+        }
+        b = (b * b) % mod;
+        exp /= 2;
+    }
+    return (int)result;
+}
+
+// What a division-based 64-bit modpow needs: a 128-bit product reduced
+// by a hardware divide. MSVC has no __int128 but exposes both halves as
+// intrinsics on x64 (_udiv128 since VS 2019); elsewhere the baseline is
+// reported as unavailable rather than timed as something else.
+#if defined(__SIZEOF_INT128__) || (defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64))
+#define RSA_CHAT_BENCH_WIDE_DIVISION 1
+#endif
+
+#if defined(RSA_CHAT_BENCH_WIDE_DIVISION)
+// a * b % mod for a, b < mod, so the high word is below mod as _udiv128
+// requires
+static std::uint64_t divisionMulMod(std::uint64_t a, std::uint64_t b, std::uint64_t mod) {
+#if defined(__SIZEOF_INT128__)
+    return static_cast<std::uint64_t>(static_cast<unsigned __int128>(a) * b % mod);
+#else
+    std::uint64_t hi;
+    const std::uint64_t lo = _umul128(a, b, &hi);
+    std::uint64_t rem;
+    _udiv128(hi, lo, mod, &rem);
+    return rem;
+#endif
+}
+
+static std::uint64_t divisionModpow64(std::uint64_t base, std::uint64_t exp, std::uint64_t mod) {
+    std::uint64_t result = 1 % mod;
+    std::uint64_t b = base % mod;
+    while (exp > 0) {
+        if (exp & 1) result = divisionMulMod(result, b, mod);
+        b = divisionMulMod(b, b, mod);
+        exp >>= 1;
+    }
+    return result;
+}
+#endif
+
+// 32-bit operands: the product fits a 64-bit word on every compiler
+static std::uint64_t divisionModpow32(std::uint32_t base, std::uint32_t exp, std::uint32_t mod) {
+    std::uint64_t result = 1 % mod;
+    std::uint64_t b = base % mod;
+    while (exp > 0) {
+        if (exp & 1) result = result * b % mod;
+        b = b * b % mod;
+        exp >>= 1;
+    }
+    return result;
+}
+
+template <std::size_t L>
+static Limbs<L> randomOdd(std::mt19937_64& gen) {
+    Limbs<L> v;
+    for (auto& limb : v) limb = gen();
+    v[0] |= 1;
+    v[L - 1] |= std::uint64_t{1} << 63;
+    return v;
+}
+
+template <unsigned Bits>
+static void benchLimbs(std::mt19937_64& gen) {
+    constexpr std::size_t L = (Bits + 63) / 64;
+    Limbs<L> n = randomOdd<L>(gen);
+    Limbs<L> base = randomOdd<L>(gen);
+    base[L - 1] >>= 1;
+    Limbs<L> exp = randomOdd<L>(gen);
+    ModKernel<Bits> kernel(n);
+
+    std::string name = "ModKernel<" + std::to_string(Bits) + "> pow, full exponent";
+    bench(name.c_str(), 1, [&] { g_sink = kernel.pow(base, exp)[0]; });
+}
+
+static void benchModpow() {
+    std::printf("modpow\n");
+    std::mt19937_64 gen(42);
+
+    // Demo-sized keys as generateKeys() makes them: n ~ 17 bits
+    const int n = opaque(383 * 491);
+    const int d = opaque(56887);
+    std::vector<int> inputs(4096);
+    for (int& v : inputs) v = static_cast<int>(gen() % n);
+
+    bench("legacy modpow, 17-bit n", inputs.size(), [&] {
+        std::uint64_t acc = 0;
+        for (int v : inputs) acc += legacyModpow(v, d, n);
+        g_sink = acc;
+    });
+    ModPow32 modpow(n);
+    bench("ModPow32, 17-bit n", inputs.size(), [&] {
+        std::uint64_t acc = 0;
+        for (int v : inputs) acc += modpow(v, d);
+        g_sink = acc;
+    });
+
+    // The public side: generateKeys() exponents through the generic loop
+    // and through encryptMessage(), which takes their compiled chains
+    std::string bytes(4096, '\0');
+    for (char& c : bytes) c = static_cast<char>(gen());
+    std::vector<CipherWord> cipher(bytes.size());
+    char name[64];
+    for (int e : {3, 7, 65537}) {
+        const int exponent = opaque(e);
+        std::snprintf(name, sizeof(name), "ModPow32 per byte, e=%d", e);
+        bench(name, bytes.size(), [&] {
+            std::uint64_t acc = 0;
+            for (char c : bytes) acc += modpow(static_cast<unsigned char>(c), exponent);
+            g_sink = acc;
+        });
+        std::snprintf(name, sizeof(name), "encryptMessage per byte, e=%d", e);
+        bench(name, bytes.size(), [&] {
+            g_sink = g_sink + encryptMessage(std::as_bytes(std::span(bytes)), PublicKey{exponent, n}, cipher);
+        });
+    }
+
+    // Full 32-bit modulus and exponent
+    const std::uint32_t n32 = opaque(0xfffffffbu);
+    std::vector<std::uint32_t> inputs32(4096);
+    for (auto& v : inputs32) v = static_cast<std::uint32_t>(gen() % n32);
+    const std::uint32_t e32 = opaque(0xdeadbeefu);
+    bench("division loop, 32-bit n", inputs32.size(), [&] {
+        std::uint64_t acc = 0;
+        for (auto v : inputs32) acc += divisionModpow32(v, e32, n32);
+        g_sink = acc;
+    });
+    ModKernel<32> k32(n32);
+    bench("ModKernel<32>, 32-bit n", inputs32.size(), [&] {
+        std::uint64_t acc = 0;
+        for (auto v : inputs32) acc += k32.pow(v, e32);
+        g_sink = acc;
+    });
+
+    // 64-bit modulus and exponent
+    const std::uint64_t n64 = opaque(0xffffffffffffffc5ull);
+    std::vector<std::uint64_t> inputs64(1024);
+    for (auto& v : inputs64) v = gen() % n64;
+    const std::uint64_t e64 = opaque(0x9e3779b97f4a7c15ull);
+#if defined(RSA_CHAT_BENCH_WIDE_DIVISION)
+    bench("128-bit division loop, 64-bit n", inputs64.size(), [&] {
+        std::uint64_t acc = 0;
+        for (auto v : inputs64) acc += divisionModpow64(v, e64, n64);
+        g_sink = acc;
+    });
+#else
+    std::printf("  %-44s %15s\n", "128-bit division loop, 64-bit n", "unavailable");
+#endif
+    ModKernel<64> k64(n64);
+    bench("ModKernel<64>, 64-bit n", inputs64.size(), [&] {
+        std::uint64_t acc = 0;
+        for (auto v : inputs64) acc += k64.pow(v, e64);
+        g_sink = acc;
+    });
+
+    benchLimbs<128>(gen);
+    benchLimbs<512>(gen);
+    benchLimbs<2048>(gen);
+}
+
+// ---------- RsaKey<Bits> ----------
+
+template <unsigned Bits>
+static void benchKeyWidth() {
+    std::mt19937_64 gen(Bits);
+    RsaKeyPair<Bits> kp = generateKeysT<Bits>(gen);
+
+    std::vector<unsigned char> message(Bits >= 512 ? 16 : 1024);
+    for (auto& c : message) c = static_cast<unsigned char>(gen());
+    std::vector<typename RsaKey<Bits>::Value> cipher(message.size());
+    std::vector<unsigned char> plain(message.size());
+
+    std::string prefix = "RsaKey<" + std::to_string(Bits) + "> ";
+    bench((prefix + "encrypt, per byte").c_str(), message.size(),
+          [&] { encryptMessageT<Bits>(message, kp.pub, cipher); });
+    bench((prefix + "decrypt, per byte").c_str(), message.size(), [&] {
+        decryptMessageT<Bits>(std::span<const typename RsaKey<Bits>::Value>(cipher), kp.priv, plain);
+    });
+}
+
+static void benchRsaKey() {
+    std::printf("rsakey\n");
+    benchKeyWidth<32>();
+    benchKeyWidth<64>();
+    benchKeyWidth<512>();
+}
+
+// ---------- group send fan-out ----------
+
+static void benchFanout() {
+    std::printf("fanout\n");
+    constexpr std::size_t kMembers = 32;
+    std::mt19937_64 gen(7);
+
+    std::vector<RsaKeyPair<32>> keys;
+    for (std::size_t i = 0; i < kMembers; ++i) keys.push_back(generateKeysT<32>(gen));
+    std::vector<unsigned char> message(256);
+    for (auto& c : message) c = static_cast<unsigned char>('a' + gen() % 26);
+    std::vector<std::vector<RsaKey<32>::Value>> cipher(kMembers, std::vector<RsaKey<32>::Value>(message.size()));
+
+    bench("serial, 32 members x 256 bytes", 1, [&] {
+        for (std::size_t i = 0; i < kMembers; ++i) encryptMessageT<32>(message, keys[i].pub, cipher[i]);
+    });
+
+    ThreadPool pool;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::string name = "thread pool (" + std::to_string(pool.size()) + " workers), 32 members";
+    bench(name.c_str(), 1, [&] {
+        std::size_t remaining = kMembers;
+        for (std::size_t i = 0; i < kMembers; ++i) {
+            pool.submit([&, i] {
+                encryptMessageT<32>(message, keys[i].pub, cipher[i]);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0) done.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return remaining == 0; });
+    });
+}
+
+// ---------- receive path ----------
+
+static void benchReceive() {
+    std::printf("receive\n");
+    KeyPair keys = generateKeys();
+
+    // One read's worth of frames: short chat lines and longer compressed ones
+    constexpr std::size_t kFrames = 64;
+    const std::string shortText = "see you at eight, bring the notes";
+    std::string longText;
+    while (longText.size() < 400) longText += "the quick brown fox jumps over the lazy dog; ";
+    std::string batch;
+    for (std::size_t i = 0; i < kFrames; ++i) {
+        FrameHeader header;
+        std::vector<int> cipher = sealMessage(i % 4 == 0 ? longText : shortText, keys.pub, true, header);
+        header.messageId = i + 1;
+        batch += buildMessageFrame(cipher, header);
+    }
+
+    // The shape of the old path: a copy per line, a fresh vector and
+    // string per frame and a final copy for the UI
+    auto copying = [&] {
+        std::size_t pos = 0;
+        while (pos < batch.size()) {
+            std::size_t end = batch.find('\n', pos);
+            std::string line = batch.substr(pos, end - pos);
+            pos = end + 1;
+            FrameHeader header;
+            std::vector<int> cipher;
+            if (!parseMessageFrame(line, header, cipher)) continue;
+            std::string plain;
+            if (!openMessage(cipher, header, keys.priv, plain)) continue;
+            std::string shown = plain;
+            g_sink = g_sink + shown.size();
+        }
+    };
+
+    FrameReceiver receiver({nullptr, [](const FrameHeader&, std::string_view plain) { g_sink = g_sink + plain.size(); },
+                            nullptr},
+                           keys.priv);
+    auto arena = [&] { receiver.feed(batch.data(), batch.size()); };
+
+    auto allocsPerFrame = [&](const std::function<void()>& body) {
+        body(); // lets buffers and the arena reach their steady size
+        std::uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        body();
+        return static_cast<double>(g_allocations.load(std::memory_order_relaxed) - before) / kFrames;
+    };
+
+    bench("copy per frame (old path), per frame", kFrames, copying);
+    std::printf("  %-44s %12.2f allocs/frame\n", "copy per frame (old path)", allocsPerFrame(copying));
+    bench("arena receiver, per frame", kFrames, arena);
+    std::printf("  %-44s %12.2f allocs/frame\n", "arena receiver", allocsPerFrame(arena));
+}
+
+// ---------- captured sessions ----------
+
+static void benchCapture(const std::string& name, const Capture& capture) {
+    const ReplayStats once = replayCapture(capture);
+    std::printf("  %s: %zu reads, %.2f MB, %llu messages, checksum %016llx\n", name.c_str(),
+                capture.segments().size(), capture.bytes().size() / 1e6,
+                static_cast<unsigned long long>(once.messages), static_cast<unsigned long long>(once.checksum));
+    if (once.messages == 0) return;
+    bench("replay, per message", once.messages, [&] { g_sink = g_sink + replayCapture(capture).messages; });
+    ReplayStats best = once;
+    for (int i = 0; i < 5; ++i) {
+        const ReplayStats stats = replayCapture(capture);
+        if (stats.busySeconds < best.busySeconds) best = stats;
+    }
+    std::printf("  %-44s %12.1f MB/s\n", "replay throughput", best.megabytesPerSecond());
+}
+
+// Real traffic when captures are given, otherwise a generated session cut
+// into reads of random size the way TCP delivers them
+static void benchReplay() {
+    std::printf("replay\n");
+    if (const char* list = std::getenv("RSA_CHAT_BENCH_CAPTURES")) {
+        std::istringstream in(list);
+        std::string file;
+        while (std::getline(in, file, ',')) {
+            Capture capture;
+            if (!capture.load(file)) {
+                std::printf("  %-44s %15s\n", file.c_str(), "unreadable");
+                continue;
+            }
+            benchCapture(file, capture);
+        }
+        return;
+    }
+
+    KeyPair keys = generateKeys();
+    std::mt19937 gen(11);
+    std::string stream = "KEY:" + std::to_string(keys.pub.e) + ":" + std::to_string(keys.pub.n) + "\n";
+    stream += buildCapsLine(localCaps());
+    std::string longText;
+    while (longText.size() < 400) longText += "the quick brown fox jumps over the lazy dog; ";
+    // Every other frame bit-packed, as between current clients
+    const unsigned bits = bitpackBits(static_cast<std::uint32_t>(keys.pub.n));
+    for (std::uint64_t i = 0; i < 4000; ++i) {
+        const std::string text = i % 4 == 0 ? longText : "see you at eight, msg " + std::to_string(i);
+        FrameHeader header;
+        std::vector<int> cipher = sealMessage(text, keys.pub, true, header);
+        header.messageId = i + 1;
+        if (i % 2 && bits >= 8) header.packedBits = bits;
+        stream += buildMessageFrame(cipher, header);
+    }
+
+    const std::string file = "rsa_chat_bench_replay.rsacap";
+    {
+        CaptureWriter writer;
+        if (!writer.open(file, keys.priv)) {
+            std::printf("  %-44s %15s\n", "generated capture", "unwritable");
+            return;
+        }
+        std::uniform_int_distribution<std::size_t> readSize(1, 8192);
+        for (std::size_t pos = 0; pos < stream.size();) {
+            const std::size_t size = std::min(readSize(gen), stream.size() - pos);
+            writer.record(stream.data() + pos, size);
+            pos += size;
+        }
+    }
+    Capture capture;
+    const bool loaded = capture.load(file);
+    std::remove(file.c_str());
+    if (loaded) benchCapture("generated", capture);
+}
+
+// ---------- vector vs span core API ----------
+
+static void benchSpanApi() {
+    std::printf("span\n");
+    KeyPair keys = generateKeys();
+    const std::string message(256, 'm');
+
+    auto vectors = [&] {
+        std::vector<int> cipher = encryptMessage(message, keys.pub);
+        std::string plain = decryptMessage(cipher, keys.priv);
+        g_sink = g_sink + plain.size();
+    };
+
+    std::vector<CipherWord> cipher(message.size());
+    std::string plain(message.size(), '\0');
+    auto spans = [&] {
+        std::size_t n = encryptMessage(std::as_bytes(std::span(message)), keys.pub, cipher);
+        n = decryptMessage(std::span(cipher).first(n), keys.priv, std::as_writable_bytes(std::span(plain)));
+        g_sink = g_sink + n;
+    };
+
+    auto allocsPerCall = [&](const std::function<void()>& body) {
+        std::uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        body();
+        return g_allocations.load(std::memory_order_relaxed) - before;
+    };
+
+    bench("vector API, 256-byte round trip, per byte", message.size(), vectors);
+    std::printf("  %-44s %12llu allocs/call\n", "vector API",
+                static_cast<unsigned long long>(allocsPerCall(vectors)));
+    bench("span API, 256-byte round trip, per byte", message.size(), spans);
+    std::printf("  %-44s %12llu allocs/call\n", "span API",
+                static_cast<unsigned long long>(allocsPerCall(spans)));
+}
+
+// ---------- bit-packed ciphertext ----------
+
+static void benchBitpack() {
+    std::printf("bitpack\n");
+    KeyPair keys = generateKeys();
+    const unsigned bits = bitpackBits(static_cast<std::uint32_t>(keys.pub.n));
+
+    std::mt19937 gen(7);
+    std::string message(4096, '\0');
+    for (char& c : message) c = static_cast<char>(gen());
+    std::vector<CipherWord> cipher(message.size());
+    encryptMessage(std::as_bytes(std::span(message)), keys.pub, cipher);
+
+    std::vector<std::byte> packed(bitpackedBytes(cipher.size(), bits) + 32);
+    std::vector<CipherWord> unpacked(cipher.size());
+    char name[64];
+    for (BitpackKernel kernel : {BitpackKernel::Scalar, BitpackKernel::Sse41, BitpackKernel::Avx2}) {
+        if (!bitpackKernelSupported(kernel)) {
+            std::printf("  %-44s %15s\n", bitpackKernelName(kernel), "unsupported");
+            continue;
+        }
+        std::snprintf(name, sizeof(name), "%s pack, %u bits, per word", bitpackKernelName(kernel), bits);
+        bench(name, cipher.size(), [&] { g_sink = g_sink + bitpack(cipher, bits, packed, kernel); });
+        std::snprintf(name, sizeof(name), "%s unpack, %u bits, per word", bitpackKernelName(kernel), bits);
+        bench(name, cipher.size(), [&] {
+            g_sink = g_sink + bitunpack(packed, bits, unpacked, kernel);
+            g_sink = g_sink + unpacked[cipher.size() / 2];
+        });
+    }
+
+    // What one message costs in each representation
+    std::string decimal;
+    appendCipherList(cipher, decimal);
+    FrameHeader header;
+    std::string plainFrame;
+    appendMessageFrame(cipher, header, plainFrame);
+    header.packedBits = bits;
+    std::string packedFrame;
+    appendMessageFrame(cipher, header, packedFrame);
+    const double words = static_cast<double>(cipher.size());
+    std::printf("  %-44s %12.2f bytes/word\n", "int words in memory", static_cast<double>(sizeof(CipherWord)));
+    std::printf("  %-44s %12.2f bytes/word\n", "packed", static_cast<double>(bitpackedBytes(cipher.size(), bits)) / words);
+    std::printf("  %-44s %12.2f bytes/word\n", "decimal frame", static_cast<double>(plainFrame.size()) / words);
+    std::printf("  %-44s %12.2f bytes/word\n", "bits= frame", static_cast<double>(packedFrame.size()) / words);
+}
+
+// ---------- latency probes ----------
+
+// What a probe costs either end: it has to stay far below the RTT it
+// measures
+static void benchProbe() {
+    std::printf("probe\n");
+    const ProbePing ping{42, probeClockUs()};
+    const ProbePong pong{42, ping.sentUs, 37, {11000, 85000, 9000}};
+    const std::string pingLine = buildPingLine(ping);
+    const std::string pongLine = buildPongLine(pong);
+    const std::string_view pongText(pongLine.data(), pongLine.size() - 1);
+
+    bench("build ping", 1, [&] { g_sink = g_sink + buildPingLine(ping).size(); });
+    bench("answer ping (parse, sample stages, build pong)", 1, [&] {
+        static StageSampler sampler;
+        ProbePing parsed;
+        parsePingLine(std::string_view(pingLine.data(), pingLine.size() - 1), parsed);
+        const ProbePong answer{parsed.seq, parsed.sentUs, 0, sampler.sample()};
+        g_sink = g_sink + buildPongLine(answer).size();
+    });
+    bench("parse pong", 1, [&] {
+        ProbePong parsed;
+        g_sink = g_sink + parsePongLine(pongText, parsed) + parsed.stages.decryptNs;
+    });
+    LatencyEstimator estimator;
+    bench("estimator update", 1, [&] {
+        estimator.addSample(1000 + (g_sink & 63), pong.holdUs, pong.stages, pong.stages);
+        g_sink = g_sink + static_cast<std::uint64_t>(estimator.estimate().smoothedRttUs);
+    });
+}
+
+// ---------- decimal text ----------
+
+static void benchDecimal() {
+    std::printf("decimal\n");
+    KeyPair keys = generateKeys();
+    std::mt19937 gen(13);
+    std::string message(4096, '\0');
+    for (char& c : message) c = static_cast<char>(gen());
+    std::vector<CipherWord> cipher(message.size());
+    encryptMessage(std::as_bytes(std::span(message)), keys.pub, cipher);
+
+    std::string text;
+    bench("format, per word", cipher.size(), [&] {
+        text.clear();
+        appendDecimalList(cipher, DecimalList::Commas, text);
+        g_sink = g_sink + text.size();
+    });
+
+    // What the legacy parser did: find each comma, from_chars the part
+    std::vector<CipherWord> parsed(cipher.size());
+    bench("find + from_chars, per word", cipher.size(), [&] {
+        std::string_view body = text;
+        std::size_t count = 0;
+        while (!body.empty()) {
+            const std::size_t comma = body.find(',');
+            const std::string_view part = body.substr(0, comma);
+            std::from_chars(part.data(), part.data() + part.size(), parsed[count++]);
+            if (comma == std::string_view::npos) break;
+            body.remove_prefix(comma + 1);
+        }
+        g_sink = g_sink + parsed[count / 2];
+    });
+    char name[64];
+    for (DecimalKernel kernel : {DecimalKernel::Scalar, DecimalKernel::Sse41}) {
+        if (!decimalKernelSupported(kernel)) {
+            std::printf("  %-44s %15s\n", decimalKernelName(kernel), "unsupported");
+            continue;
+        }
+        std::snprintf(name, sizeof(name), "%s parse, per word", decimalKernelName(kernel));
+        bench(name, cipher.size(), [&] {
+            g_sink = g_sink + parseDecimalList(text, DecimalList::Commas, parsed, kernel);
+            g_sink = g_sink + parsed[cipher.size() / 2];
+        });
+    }
+
+    // For scale: what the words are parsed for
+    bench("decrypt, per word", cipher.size(), [&] {
+        g_sink = g_sink + decryptMessage(cipher, keys.priv, std::as_writable_bytes(std::span(message)));
+    });
+}
+
+// ---------- socket transports ----------
+
+static const char* transportKindName(TransportKind kind) {
+    switch (kind) {
+    case TransportKind::Qt: return "qt";
+    case TransportKind::Uring: return "io_uring";
+    case TransportKind::Epoll: return "epoll";
+    }
+    return "unknown";
+}
+
+static void benchTransport() {
+    std::printf("transport\n");
+    // Qt sockets need an application object for their event loop
+    static int argc = 1;
+    static char appName[] = "rsa_chat_bench";
+    static char* argv[] = {appName, nullptr};
+    if (!QCoreApplication::instance()) new QCoreApplication(argc, argv);
+
+    // A chat-sized frame, echoed back over localhost
+    std::string frame(63, 'x');
+    frame += '\n';
+    // Each backend over TCP, then with the shared-memory shortcut it
+    // takes to a peer on the same machine
+    for (TransportKind kind : {TransportKind::Qt, TransportKind::Uring, TransportKind::Epoll}) {
+        for (bool shortcut : {false, true}) {
+            std::unique_ptr<Transport> transport = makeTransport(kind, shortcut);
+            ConnectionId client = 0;
+            if (transport && transport->listen(0)) client = transport->connect("127.0.0.1", transport->localPort());
+            if (!client) {
+                std::printf("  %s%-*s %15s\n", shortcut ? "shm+" : "", shortcut ? 40 : 44,
+                            transportKindName(kind), "unavailable");
+                continue;
+            }
+
+            Transport* t = transport.get();
+            std::uint64_t sent = 0;
+            std::uint64_t echoed = 0;
+            t->setHandlers({nullptr,
+                            [&](ConnectionId id, std::string_view data) {
+                                if (id == client) {
+                                    echoed += data.size();
+                                } else {
+                                    t->send(id, data);
+                                }
+                            },
+                            nullptr});
+
+            // 1 frame in flight is pure per-message overhead; 32 in flight
+            // shows what batching the sends and wakeups buys
+            for (int window : {1, 32}) {
+                char name[64];
+                std::snprintf(name, sizeof(name), "%s echo, %d in flight, per frame", t->name(), window);
+                bench(name, static_cast<std::uint64_t>(window), [&] {
+                    for (int i = 0; i < window; ++i) t->send(client, frame);
+                    sent += static_cast<std::uint64_t>(window) * frame.size();
+                    while (echoed < sent) t->poll(100);
+                });
+            }
+        }
+    }
+}
+
+// ---------- coroutine sessions ----------
+
+static Task<void> asyncEcho(Executor& executor, ConnectionId id, const KeyPair& keys) {
+    AsyncSession session(executor, id, keys);
+    if (!co_await session.handshake()) co_return;
+    while (auto message = co_await session.recv()) co_await session.send(message->payload);
+}
+
+static Task<void> asyncServe(Executor& executor, const KeyPair& keys) {
+    while (ConnectionId id = co_await executor.accept()) executor.spawn(asyncEcho(executor, id, keys));
+}
+
+static Task<void> asyncHandshake(AsyncSession& session, std::size_t& remaining) {
+    co_await session.handshake();
+    --remaining;
+}
+
+static Task<void> asyncPing(AsyncSession& session, std::string_view message, std::size_t& remaining) {
+    co_await session.send(message);
+    co_await session.recv();
+    --remaining;
+}
+
+static void benchAsync() {
+    std::printf("async\n");
+    static int argc = 1;
+    static char appName[] = "rsa_chat_bench";
+    static char* argv[] = {appName, nullptr};
+    if (!QCoreApplication::instance()) new QCoreApplication(argc, argv);
+
+    // Both ends of every session run on this one thread, so each message
+    // is sealed, parsed and decrypted twice per round trip
+    const KeyPair keys = generateKeys();
+    const std::string message = "sixteen byte msg";
+    for (TransportKind kind : {TransportKind::Qt, TransportKind::Uring, TransportKind::Epoll}) {
+        std::unique_ptr<Transport> transport = makeTransport(kind, false);
+        if (!transport || !transport->listen(0)) {
+            std::printf("  %-44s %15s\n", transportKindName(kind), "unavailable");
+            continue;
+        }
+        Executor executor(*transport);
+        executor.spawn(asyncServe(executor, keys));
+
+        for (std::size_t count : {std::size_t{1}, std::size_t{1000}}) {
+            std::vector<std::unique_ptr<AsyncSession>> sessions;
+            for (std::size_t i = 0; i < count; ++i) {
+                const ConnectionId id = executor.connect("127.0.0.1", transport->localPort());
+                if (id) sessions.push_back(std::make_unique<AsyncSession>(executor, id, keys));
+            }
+            std::size_t remaining = sessions.size();
+            for (auto& session : sessions) executor.spawn(asyncHandshake(*session, remaining));
+            while (remaining > 0) executor.runOnce(-1);
+
+            // Every session has one message in flight at a time
+            char name[64];
+            std::snprintf(name, sizeof(name), "%s, %zu session%s, per round trip", transport->name(),
+                          sessions.size(), sessions.size() == 1 ? "" : "s");
+            bench(name, sessions.size(), [&] {
+                remaining = sessions.size();
+                for (auto& session : sessions) executor.spawn(asyncPing(*session, message, remaining));
+                while (remaining > 0) executor.runOnce(-1);
+            });
+
+            // The same sessions with the Qt event loop turning the
+            // executor through an ExecutorDriver instead of runOnce()
+            {
+                ExecutorDriver driver(executor);
+                QEventLoop loop;
+                std::snprintf(name, sizeof(name), "%s, %zu session%s, Qt loop, per round trip", transport->name(),
+                              sessions.size(), sessions.size() == 1 ? "" : "s");
+                bench(name, sessions.size(), [&] {
+                    remaining = sessions.size();
+                    for (auto& session : sessions) executor.spawn(asyncPing(*session, message, remaining));
+                    while (remaining > 0) loop.processEvents(QEventLoop::WaitForMoreEvents);
+                });
+            }
+
+            // The echo tasks see the close and finish
+            sessions.clear();
+            for (int i = 0; i < 10; ++i) executor.runOnce(0);
+        }
+    }
+}
+
+// ---------- key cracking ----------
+
+template <unsigned Bits>
+static std::vector<CrackTarget> crackTargets(std::size_t count) {
+    std::mt19937_64 gen(Bits);
+    std::vector<CrackTarget> targets(count);
+    for (CrackTarget& target : targets) {
+        const RsaKeyPair<Bits> kp = generateKeysT<Bits>(gen);
+        target.e = kp.pub.exponent[0];
+        for (std::size_t j = 0; j < kp.pub.modulus.size(); ++j) target.n[j] = kp.pub.modulus[j];
+    }
+    return targets;
+}
+
+static void benchCrack() {
+    std::printf("crack\n");
+    std::vector<CrackTarget> demo(256);
+    for (CrackTarget& target : demo) {
+        const KeyPair kp = generateKeys();
+        target.e = static_cast<std::uint64_t>(kp.pub.e);
+        target.n = {static_cast<std::uint64_t>(kp.pub.n), 0};
+    }
+    const std::vector<CrackTarget> wide = crackTargets<64>(64);
+
+    // One key at a time on this thread, then the whole set on every core
+    CrackResult result;
+    std::size_t next = 0;
+    bench("demo key, per key", 1, [&] {
+        crackKey(demo[next++ % demo.size()], result);
+        g_sink = g_sink + result.d[0];
+    });
+    bench("64-bit key, per key", 1, [&] {
+        crackKey(wide[next++ % wide.size()], result);
+        g_sink = g_sink + result.d[0];
+    });
+    bench("64-bit keys, all threads, per key", wide.size(),
+          [&] { g_sink = g_sink + crackKeys(wide)[0].d[0]; });
+
+    // Shared primes across a corpus: the whole scan, divided by its size.
+    // Quadratic trees would cost 16x as much per key at 16x the corpus;
+    // Karatsuba and Newton division keep it well under that.
+    for (std::size_t keys : {std::size_t{1024}, std::size_t{16384}}) {
+        std::vector<Modulus128> corpus;
+        for (const CrackTarget& target : crackTargets<64>(keys)) corpus.push_back(target.n);
+        char name[64];
+        std::snprintf(name, sizeof(name), "batch GCD, %zu 64-bit moduli, per key", keys);
+        bench(name, corpus.size(), [&] { g_sink = g_sink + batchGcd(corpus)[0][0]; });
+    }
+
+    // The tree's arithmetic on its own: each 4x in size should cost about
+    // 4^1.58 = 9x, not 16x
+    std::mt19937_64 gen(41);
+    for (std::size_t limbs : {std::size_t{256}, std::size_t{1024}, std::size_t{4096}}) {
+        BigNat a(limbs);
+        BigNat b(limbs);
+        for (auto& limb : a) limb = gen();
+        for (auto& limb : b) limb = gen();
+        a.back() |= 1;
+        b.back() |= 1;
+        // Off a multiple of a, so the remainder is never empty
+        BigNat dividend = bigMul(a, b);
+        bigAddTo(dividend, BigNat{12345});
+        char name[64];
+        std::snprintf(name, sizeof(name), "BigNat multiply, %zu limbs", limbs);
+        bench(name, 1, [&] { g_sink = g_sink + bigMul(a, b)[0]; });
+        std::snprintf(name, sizeof(name), "BigNat divide, %zu by %zu limbs", 2 * limbs, limbs);
+        bench(name, 1, [&] { g_sink = g_sink + bigMod(dividend, a)[0]; });
+    }
+}
+
+// ---------- codebook attack ----------
+
+static void benchCodebook() {
+    std::printf("codebook\n");
+    KeyPair keys = generateKeys();
+    const Codebook codebook(keys.pub);
+
+    std::mt19937 gen(11);
+    std::string message(4096, '\0');
+    for (char& c : message) c = static_cast<char>(gen());
+    std::vector<CipherWord> cipher(message.size());
+    encryptMessage(std::as_bytes(std::span(message)), keys.pub, cipher);
+    std::vector<std::byte> plain(cipher.size());
+
+    // The owner's decryption for scale, then the lookup without the key
+    bench("decrypt with private key, per word", cipher.size(), [&] {
+        g_sink = g_sink + decryptMessage(cipher, keys.priv, plain);
+    });
+    char name[64];
+    for (CodebookKernel kernel : {CodebookKernel::Scalar, CodebookKernel::Avx2}) {
+        if (!codebookKernelSupported(kernel)) {
+            std::printf("  %-44s %15s\n", codebookKernelName(kernel), "unsupported");
+            continue;
+        }
+        std::snprintf(name, sizeof(name), "%s codebook decode, per word", codebookKernelName(kernel));
+        bench(name, cipher.size(), [&] { g_sink = g_sink + codebook.decode(cipher, plain, kernel); });
+    }
+
+    // A two-key capture of short messages, as the CLI would read it
+    KeyPair other = generateKeys();
+    std::string capture = "KEY:" + std::to_string(keys.pub.e) + ":" + std::to_string(keys.pub.n) + "\n" +
+                          "KEY:" + std::to_string(other.pub.e) + ":" + std::to_string(other.pub.n) + "\n";
+    FrameHeader header;
+    std::vector<CipherWord> words;
+    for (int i = 0; i < 20000; ++i) {
+        sealMessage("message number " + std::to_string(i), i % 2 ? keys.pub : other.pub, true, header, words);
+        appendMessageFrame(words, header, capture);
+    }
+    CodebookAttack attack({[](const PublicKey&, std::string_view plain) { g_sink = g_sink + plain.size(); },
+                           [] {}});
+    bench("capture feed, per KB", capture.size() / 1024, [&] {
+        attack.feed(capture);
+        attack.finish();
+    });
+}
+
+// ---------- history search ----------
+
+static void benchSearch() {
+    std::printf("search\n");
+    // Chat-like text: a few thousand words, the common ones far more common
+    std::mt19937 gen(5);
+    std::vector<std::string> words(4000);
+    for (std::string& word : words) {
+        word.resize(2 + gen() % 7);
+        for (char& c : word) c = static_cast<char>('a' + gen() % 8);
+    }
+    auto message = [&] {
+        std::string text;
+        for (unsigned i = 3 + gen() % 10; i > 0; --i) {
+            const double u = static_cast<double>(gen()) / static_cast<double>(std::mt19937::max());
+            text += words[static_cast<std::size_t>(u * u * u * static_cast<double>(words.size() - 1))];
+            text += ' ';
+        }
+        return text;
+    };
+
+    SearchIndex index;
+    const std::uint32_t count = 1000000;
+    std::uint32_t doc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (; doc < count; ++doc) index.add(doc, message());
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("  %-44s %12.1f ns/op\n", "index 1M messages, per message", seconds * 1e9 / count);
+    std::printf("  %-44s %12.2f bytes/msg\n", "posting lists",
+                static_cast<double>(index.postingBytes()) / static_cast<double>(count));
+
+    const std::string common = words[0];
+    const std::string rare = words[words.size() / 2];
+    const std::string twoCommon = words[0] + " " + words[1];
+    const std::string prefix = words[0].substr(0, 1) + "*";
+    const std::string prefixAnd = words[0].substr(0, 2) + "* " + words[3].substr(0, 2) + "*";
+    for (const auto& [name, query] : {std::pair{"common word, 100 newest", common},
+                                      std::pair{"rare word, 100 newest", rare},
+                                      std::pair{"two common words, 100 newest", twoCommon},
+                                      std::pair{"one-letter prefix, 100 newest", prefix},
+                                      std::pair{"two prefixes, 100 newest", prefixAnd}}) {
+        bench(name, 1, [&] { g_sink = g_sink + index.search(query).size(); });
+    }
+    bench("add one more message", 1, [&] { index.add(doc++, message()); });
+}
+
+struct BenchGroup {
+    const char* name;
+    void (*run)();
+};
+
+int main(int argc, char* argv[]) {
+    const BenchGroup groups[] = {
+        {"modpow", benchModpow},
+        {"rsakey", benchRsaKey},
+        {"fanout", benchFanout},
+        {"receive", benchReceive},
+        {"replay", benchReplay},
+        {"span", benchSpanApi},
+        {"bitpack", benchBitpack},
+        {"decimal", benchDecimal},
+        {"transport", benchTransport},
+        {"async", benchAsync},
+        {"probe", benchProbe},
+        {"crack", benchCrack},
+        {"codebook", benchCodebook},
+        {"search", benchSearch},
+    };
+
+    const char* filter = argc > 1 ? argv[1] : "";
+    for (const BenchGroup& group : groups) {
+        if (std::strstr(group.name, filter)) group.run();
+    }
+    return 0;
+}
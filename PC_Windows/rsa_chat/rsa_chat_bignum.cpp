@@ -0,0 +1,380 @@
+#include "rsa_chat_bignum.h"
+#include "rsa_chat_modarith.h"
+#include "rsa_chat_thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <latch>
+#include <span>
+#include <utility>
+
+// Below this many limbs in the shorter operand schoolbook beats Karatsuba
+static constexpr std::size_t kKaratsubaLimbs = 32;
+// Smallest products worth splitting across the pool
+static constexpr std::size_t kForkLimbs = 1024;
+// Divisor and quotient both at least this long: divide by Newton
+static constexpr std::size_t kNewtonLimbs = 64;
+// Reciprocals up to this precision come straight from long division
+static constexpr std::size_t kReciprocalBaseBits = 2048;
+// Extra bits carried through each Newton step
+static constexpr std::size_t kGuardBits = 64;
+
+using Span = std::span<std::uint64_t>;
+using ConstSpan = std::span<const std::uint64_t>;
+
+static void trim(BigNat& a) {
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+
+BigNat bigFromLimbs(const std::uint64_t* limbs, std::size_t count) {
+    BigNat a(limbs, limbs + count);
+    trim(a);
+    return a;
+}
+
+int bigCompare(const BigNat& a, const BigNat& b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (std::size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+std::size_t bigBitWidth(const BigNat& a) {
+    if (a.empty()) return 0;
+    return a.size() * 64 - static_cast<std::size_t>(std::countl_zero(a.back()));
+}
+
+BigNat bigShiftLeft(const BigNat& a, std::size_t bits) {
+    if (a.empty()) return {};
+    const std::size_t limbShift = bits / 64;
+    const std::size_t bitShift = bits % 64;
+    BigNat r(a.size() + limbShift + 1, 0);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        r[i + limbShift] |= a[i] << bitShift;
+        if (bitShift) r[i + limbShift + 1] = a[i] >> (64 - bitShift);
+    }
+    trim(r);
+    return r;
+}
+
+BigNat bigShiftRight(const BigNat& a, std::size_t bits) {
+    const std::size_t limbShift = bits / 64;
+    const std::size_t bitShift = bits % 64;
+    if (limbShift >= a.size()) return {};
+    BigNat r(a.size() - limbShift);
+    for (std::size_t i = 0; i < r.size(); ++i) {
+        r[i] = a[i + limbShift] >> bitShift;
+        if (bitShift && i + limbShift + 1 < a.size()) r[i] |= a[i + limbShift + 1] << (64 - bitShift);
+    }
+    trim(r);
+    return r;
+}
+
+// r += b, b no longer than r; returns the carry out of r
+static std::uint64_t addInto(Span r, ConstSpan b) {
+    std::uint64_t carry = 0;
+    std::size_t i = 0;
+    for (; i < b.size(); ++i) {
+        std::uint64_t s = r[i] + b[i];
+        std::uint64_t c1 = s < r[i];
+        s += carry;
+        std::uint64_t c2 = s < carry;
+        r[i] = s;
+        carry = c1 | c2;
+    }
+    for (; carry && i < r.size(); ++i) carry = ++r[i] == 0;
+    return carry;
+}
+
+// r -= b, b no longer than r; returns the borrow out of r
+static std::uint64_t subInto(Span r, ConstSpan b) {
+    std::uint64_t borrow = 0;
+    std::size_t i = 0;
+    for (; i < b.size(); ++i) {
+        std::uint64_t d = r[i] - b[i];
+        std::uint64_t b1 = r[i] < b[i];
+        std::uint64_t b2 = d < borrow;
+        r[i] = d - borrow;
+        borrow = b1 | b2;
+    }
+    for (; borrow && i < r.size(); ++i) borrow = r[i]-- == 0;
+    return borrow;
+}
+
+void bigAddTo(BigNat& a, const BigNat& b) {
+    if (a.size() < b.size()) a.resize(b.size(), 0);
+    a.push_back(0);
+    addInto(a, b);
+    trim(a);
+}
+
+void bigSubFrom(BigNat& a, const BigNat& b) {
+    subInto(a, b);
+    trim(a);
+}
+
+// ---------- multiplication ----------
+
+static void mulSchool(ConstSpan a, ConstSpan b, Span r) {
+    std::fill(r.begin(), r.end(), 0);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        std::uint64_t carry = 0;
+        for (std::size_t j = 0; j < b.size(); ++j) r[i + j] = mulAdd(a[i], b[j], r[i + j], carry);
+        r[i + b.size()] = carry;
+    }
+}
+
+static void mulInto(ConstSpan a, ConstSpan b, Span r, ThreadPool* pool = nullptr);
+
+// a * b with b shorter than half of a: b times each b-sized slice of a
+static void mulUnbalanced(ConstSpan a, ConstSpan b, Span r) {
+    std::fill(r.begin(), r.end(), 0);
+    std::vector<std::uint64_t> part(2 * b.size());
+    for (std::size_t offset = 0; offset < a.size(); offset += b.size()) {
+        ConstSpan slice = a.subspan(offset, std::min(b.size(), a.size() - offset));
+        Span product(part.data(), slice.size() + b.size());
+        mulInto(slice, b, product);
+        addInto(r.subspan(offset), product);
+    }
+}
+
+// r = a * b, r.size() == a.size() + b.size(), a at least as long as b
+// and b longer than half of a
+static void mulKaratsuba(ConstSpan a, ConstSpan b, Span r, ThreadPool* pool) {
+    // a = a1 * B^h + a0 and b = b1 * B^h + b0; b1 is never empty
+    const std::size_t h = a.size() / 2;
+    ConstSpan a0 = a.first(h);
+    ConstSpan a1 = a.subspan(h);
+    ConstSpan b0 = b.first(h);
+    ConstSpan b1 = b.subspan(h);
+
+    // (a0 + a1) and (b0 + b1), one limb wider for the carry
+    std::vector<std::uint64_t> sumA(a1.begin(), a1.end());
+    sumA.push_back(0);
+    addInto(sumA, a0);
+    ConstSpan longB = b0.size() >= b1.size() ? b0 : b1;
+    ConstSpan shortB = b0.size() >= b1.size() ? b1 : b0;
+    std::vector<std::uint64_t> sumB(longB.begin(), longB.end());
+    sumB.push_back(0);
+    addInto(sumB, shortB);
+
+    // z0 = a0 * b0 and z2 = a1 * b1 land in place; z1 = (a0 + a1)(b0 + b1)
+    Span z0 = r.first(2 * h);
+    Span z2 = r.subspan(2 * h);
+    std::vector<std::uint64_t> z1(sumA.size() + sumB.size());
+    if (pool) {
+        std::latch done(3);
+        pool->submit([&] {
+            mulInto(a0, b0, z0);
+            done.count_down();
+        });
+        pool->submit([&] {
+            mulInto(a1, b1, z2);
+            done.count_down();
+        });
+        pool->submit([&] {
+            mulInto(sumA, sumB, z1);
+            done.count_down();
+        });
+        done.wait();
+    } else {
+        mulInto(a0, b0, z0);
+        mulInto(a1, b1, z2);
+        mulInto(sumA, sumB, z1);
+    }
+
+    // The middle term a0 * b1 + a1 * b0 = z1 - z0 - z2 fits what is left
+    // of r above B^h, so its zero top limbs can be dropped
+    subInto(z1, z0);
+    subInto(z1, z2);
+    addInto(r.subspan(h), ConstSpan(z1).first(std::min(z1.size(), r.size() - h)));
+}
+
+static void mulInto(ConstSpan a, ConstSpan b, Span r, ThreadPool* pool) {
+    if (a.size() < b.size()) std::swap(a, b);
+    if (b.size() < kKaratsubaLimbs) {
+        mulSchool(a, b, r);
+    } else if (a.size() >= 2 * b.size()) {
+        mulUnbalanced(a, b, r);
+    } else {
+        const bool fork = pool && pool->size() > 1 && b.size() >= kForkLimbs;
+        mulKaratsuba(a, b, r, fork ? pool : nullptr);
+    }
+}
+
+BigNat bigMul(const BigNat& a, const BigNat& b, ThreadPool* pool) {
+    if (a.empty() || b.empty()) return {};
+    BigNat r(a.size() + b.size());
+    mulInto(a, b, r, pool);
+    trim(r);
+    return r;
+}
+
+// ---------- division ----------
+
+// Knuth's algorithm D on 32-bit digits, so every step fits 64-bit
+// arithmetic without a 128-by-64 divide
+static void divSchool(const BigNat& a, const BigNat& m, BigNat* quotient, BigNat& remainder) {
+    auto toDigits = [](const BigNat& v) {
+        std::vector<std::uint32_t> d(v.size() * 2);
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            d[2 * i] = static_cast<std::uint32_t>(v[i]);
+            d[2 * i + 1] = static_cast<std::uint32_t>(v[i] >> 32);
+        }
+        while (!d.empty() && d.back() == 0) d.pop_back();
+        return d;
+    };
+    auto fromDigits = [](const std::vector<std::uint32_t>& d, std::size_t count) {
+        BigNat v((count + 1) / 2, 0);
+        for (std::size_t i = 0; i < count; ++i) v[i / 2] |= static_cast<std::uint64_t>(d[i]) << (32 * (i % 2));
+        trim(v);
+        return v;
+    };
+
+    constexpr std::uint64_t kBase = std::uint64_t{1} << 32;
+    const std::vector<std::uint32_t> u = toDigits(a);
+    const std::vector<std::uint32_t> v = toDigits(m);
+    const std::size_t un = u.size();
+    const std::size_t vn = v.size();
+    if (un < vn) {
+        if (quotient) quotient->clear();
+        remainder = a;
+        return;
+    }
+    std::vector<std::uint32_t> q(un - vn + 1, 0);
+
+    if (vn == 1) {
+        std::uint64_t rem = 0;
+        for (std::size_t j = un; j-- > 0;) {
+            const std::uint64_t cur = rem * kBase + u[j];
+            q[j] = static_cast<std::uint32_t>(cur / v[0]);
+            rem = cur % v[0];
+        }
+        if (quotient) *quotient = fromDigits(q, q.size());
+        remainder = bigFromLimbs(&rem, 1);
+        return;
+    }
+
+    // Normalise so the divisor's top digit has its high bit set
+    const int s = std::countl_zero(v[vn - 1]);
+    std::vector<std::uint32_t> vs(vn);
+    for (std::size_t i = vn - 1; i > 0; --i) {
+        vs[i] = (v[i] << s) | static_cast<std::uint32_t>(static_cast<std::uint64_t>(v[i - 1]) >> (32 - s));
+    }
+    vs[0] = v[0] << s;
+    std::vector<std::uint32_t> us(un + 1);
+    us[un] = static_cast<std::uint32_t>(static_cast<std::uint64_t>(u[un - 1]) >> (32 - s));
+    for (std::size_t i = un - 1; i > 0; --i) {
+        us[i] = (u[i] << s) | static_cast<std::uint32_t>(static_cast<std::uint64_t>(u[i - 1]) >> (32 - s));
+    }
+    us[0] = u[0] << s;
+
+    for (std::size_t j = un - vn + 1; j-- > 0;) {
+        // Estimate from the top two digits, then correct at most twice
+        const std::uint64_t top = static_cast<std::uint64_t>(us[j + vn]) * kBase + us[j + vn - 1];
+        std::uint64_t qhat = top / vs[vn - 1];
+        std::uint64_t rhat = top % vs[vn - 1];
+        while (qhat >= kBase || qhat * vs[vn - 2] > rhat * kBase + us[j + vn - 2]) {
+            --qhat;
+            rhat += vs[vn - 1];
+            if (rhat >= kBase) break;
+        }
+
+        // us[j..j+vn] -= qhat * vs
+        std::int64_t borrow = 0;
+        std::int64_t t;
+        for (std::size_t i = 0; i < vn; ++i) {
+            const std::uint64_t p = qhat * vs[i];
+            t = static_cast<std::int64_t>(us[i + j]) - borrow - static_cast<std::int64_t>(p & 0xffffffffu);
+            us[i + j] = static_cast<std::uint32_t>(t);
+            borrow = static_cast<std::int64_t>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<std::int64_t>(us[j + vn]) - borrow;
+        us[j + vn] = static_cast<std::uint32_t>(t);
+
+        q[j] = static_cast<std::uint32_t>(qhat);
+        if (t < 0) {
+            // qhat was one too big: add the divisor back
+            --q[j];
+            std::uint64_t carry = 0;
+            for (std::size_t i = 0; i < vn; ++i) {
+                const std::uint64_t sum = static_cast<std::uint64_t>(us[i + j]) + vs[i] + carry;
+                us[i + j] = static_cast<std::uint32_t>(sum);
+                carry = sum >> 32;
+            }
+            us[j + vn] += static_cast<std::uint32_t>(carry);
+        }
+    }
+
+    if (quotient) *quotient = fromDigits(q, q.size());
+    std::vector<std::uint32_t> r(vn);
+    for (std::size_t i = 0; i + 1 < vn; ++i) {
+        r[i] = (us[i] >> s) | static_cast<std::uint32_t>(static_cast<std::uint64_t>(us[i + 1]) << (32 - s));
+    }
+    r[vn - 1] = us[vn - 1] >> s;
+    remainder = fromDigits(r, vn);
+}
+
+// About 2^(n + k) / m for n = bigBitWidth(m), good to a few units: a k-bit
+// fixed-point 1/m. Each Newton step doubles the precision of the one
+// below it, and only the top k + guard bits of m take part.
+static BigNat reciprocal(const BigNat& m, std::size_t k, ThreadPool* pool) {
+    std::size_t n = bigBitWidth(m);
+    BigNat top = m;
+    if (n > k + kGuardBits) {
+        top = bigShiftRight(m, n - (k + kGuardBits));
+        n = k + kGuardBits;
+    }
+    const BigNat one = bigShiftLeft(BigNat{1}, n + k);
+    BigNat y;
+    if (k <= kReciprocalBaseBits) {
+        BigNat rest;
+        divSchool(one, top, &y, rest);
+        return y;
+    }
+
+    // y' = y + y * (1 - m * y), scaled
+    const std::size_t half = k / 2 + kGuardBits / 2;
+    y = bigShiftLeft(reciprocal(top, half, pool), k - half);
+    BigNat error = bigMul(top, y, pool);
+    if (bigCompare(error, one) <= 0) {
+        BigNat shortfall = one;
+        bigSubFrom(shortfall, error);
+        bigAddTo(y, bigShiftRight(bigMul(y, shortfall, pool), n + k));
+    } else {
+        bigSubFrom(error, one);
+        bigSubFrom(y, bigShiftRight(bigMul(y, error, pool), n + k));
+    }
+    return y;
+}
+
+void bigDivMod(const BigNat& a, const BigNat& m, BigNat* quotient, BigNat& remainder, ThreadPool* pool) {
+    if (bigCompare(a, m) < 0) {
+        if (quotient) quotient->clear();
+        remainder = a;
+        return;
+    }
+    if (m.size() < kNewtonLimbs || a.size() - m.size() < kNewtonLimbs) {
+        divSchool(a, m, quotient, remainder);
+        return;
+    }
+
+    // The estimate a * (1/m) is off by a unit or two; fix it up exactly
+    const std::size_t n = bigBitWidth(m);
+    const std::size_t k = bigBitWidth(a) - n + 3;
+    BigNat q = bigShiftRight(bigMul(a, reciprocal(m, k, pool), pool), n + k);
+    BigNat product = bigMul(q, m, pool);
+    const BigNat unit{1};
+    while (bigCompare(product, a) > 0) {
+        bigSubFrom(product, m);
+        bigSubFrom(q, unit);
+    }
+    remainder = a;
+    bigSubFrom(remainder, product);
+    while (bigCompare(remainder, m) >= 0) {
+        bigSubFrom(remainder, m);
+        bigAddTo(q, unit);
+    }
+    if (quotient) *quotient = std::move(q);
+}
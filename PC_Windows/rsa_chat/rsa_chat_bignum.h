@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Natural numbers of any size, for work whose operands grow far beyond
+// the fixed Limbs<L> widths (product trees over whole key corpora).
+// Little-endian 64-bit limbs without leading zero limbs; zero is empty.
+using BigNat = std::vector<std::uint64_t>;
+
+BigNat bigFromLimbs(const std::uint64_t* limbs, std::size_t count);
+
+// Negative, zero or positive as a <, == or > b
+int bigCompare(const BigNat& a, const BigNat& b);
+
+std::size_t bigBitWidth(const BigNat& a);
+
+BigNat bigShiftLeft(const BigNat& a, std::size_t bits);
+BigNat bigShiftRight(const BigNat& a, std::size_t bits);
+
+// a += b
+void bigAddTo(BigNat& a, const BigNat& b);
+
+// a -= b; requires a >= b
+void bigSubFrom(BigNat& a, const BigNat& b);
+
+// Schoolbook below a few dozen limbs, Karatsuba above. With a pool the
+// three half-size products of the top Karatsuba split run in parallel;
+// pass one only from a thread that is not itself a pool worker.
+BigNat bigMul(const BigNat& a, const BigNat& b, ThreadPool* pool = nullptr);
+
+// quotient = a / m and remainder = a % m for m != 0 (quotient may be
+// null). Long division while either side is short, otherwise Newton
+// iteration for 1/m so the cost stays a few multiplications.
+void bigDivMod(const BigNat& a, const BigNat& m, BigNat* quotient, BigNat& remainder,
+               ThreadPool* pool = nullptr);
+
+inline BigNat bigMod(const BigNat& a, const BigNat& m, ThreadPool* pool = nullptr) {
+    BigNat remainder;
+    bigDivMod(a, m, nullptr, remainder, pool);
+    return remainder;
+}
@@ -0,0 +1,318 @@
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_simd.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+// Widths the group kernels handle: from 8 bits each output byte gets at
+// most two words, and up to 25 bits a word plus its bit phase fits one
+// 32-bit lane
+static constexpr unsigned kMinSimdBits = 8;
+static constexpr unsigned kMaxSimdBits = 25;
+
+// The kernels read and write 32 bytes per group of 8 words
+static constexpr std::size_t kGroupSpan = 32;
+
+static constexpr char kPackedMagic[4] = {'R', 'S', 'A', 'P'};
+
+// ---------- scalar ----------
+
+static std::uint64_t wordMask(unsigned bits) {
+    return bits >= 32 ? 0xffffffffull : (1ull << bits) - 1;
+}
+
+static void packScalar(const CipherWord* words, std::size_t count, unsigned bits, std::byte* out) {
+    const std::uint64_t mask = wordMask(bits);
+    std::uint64_t acc = 0;
+    unsigned filled = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        acc |= (words[i] & mask) << filled;
+        filled += bits;
+        while (filled >= 8) {
+            *out++ = static_cast<std::byte>(acc);
+            acc >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0) *out = static_cast<std::byte>(acc);
+}
+
+static void unpackScalar(const std::byte* in, unsigned bits, CipherWord* words, std::size_t count) {
+    const std::uint64_t mask = wordMask(bits);
+    std::uint64_t acc = 0;
+    unsigned filled = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        while (filled < bits) {
+            acc |= static_cast<std::uint64_t>(std::to_integer<unsigned>(*in++)) << filled;
+            filled += 8;
+        }
+        words[i] = static_cast<CipherWord>(acc & mask);
+        acc >>= bits;
+        filled -= bits;
+    }
+}
+
+// ---------- SSE4.1 / AVX2 ----------
+
+#if defined(RSA_CHAT_X86)
+
+// Where each of the 8 words of a group sits, and the byte shuffles that
+// move words between 32-bit lanes and their packed bytes
+struct GroupLayout {
+    unsigned bits = 0;
+    std::array<std::uint32_t, 8> shift{};        // bit phase of word j in its first byte
+    std::array<std::uint32_t, 2> loadOffset{};   // unpack: byte where words 4h.. are loaded from
+    alignas(32) std::array<std::uint8_t, 32> unpackShuffle{};
+    alignas(32) std::array<std::uint32_t, 8> unpackMultiplier{};
+    // pack: [source half][parity] -> 32 output bytes
+    alignas(32) std::array<std::array<std::array<std::uint8_t, 32>, 2>, 2> packShuffle{};
+    alignas(32) std::array<std::uint32_t, 8> packMultiplier{};
+};
+
+static GroupLayout makeLayout(unsigned bits) {
+    GroupLayout layout;
+    layout.bits = bits;
+    std::array<std::uint32_t, 8> firstByte{};
+    for (unsigned j = 0; j < 8; ++j) {
+        firstByte[j] = j * bits / 8;
+        layout.shift[j] = j * bits % 8;
+    }
+    layout.loadOffset = {firstByte[0], firstByte[4]};
+
+    for (auto& byParity : layout.packShuffle) {
+        for (auto& mask : byParity) mask.fill(0x80);
+    }
+    for (unsigned j = 0; j < 8; ++j) {
+        const unsigned half = j / 4;
+        const unsigned lane = j % 4;
+        const std::uint32_t rel = firstByte[j] - layout.loadOffset[half];
+        for (unsigned k = 0; k < 4; ++k) {
+            layout.unpackShuffle[16 * half + 4 * lane + k] = static_cast<std::uint8_t>(rel + k);
+        }
+        // Multiplying moves the word to the top of the lane, a fixed
+        // right shift then brings it down without the bits above it
+        layout.unpackMultiplier[j] = 1u << (32 - layout.shift[j] - bits);
+        layout.packMultiplier[j] = 1u << layout.shift[j];
+
+        const unsigned bytes = (layout.shift[j] + bits + 7) / 8;
+        for (unsigned k = 0; k < bytes; ++k) {
+            layout.packShuffle[half][j % 2][firstByte[j] + k] = static_cast<std::uint8_t>(4 * lane + k);
+        }
+    }
+    return layout;
+}
+
+template <typename T>
+RSA_CHAT_TARGET("sse4.1")
+static __m128i load128(const T* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+RSA_CHAT_TARGET("sse4.1")
+static void packGroupsSse41(const CipherWord* words, std::size_t groups, const GroupLayout& layout, std::byte* out) {
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(wordMask(layout.bits)));
+    const __m128i mul0 = load128(layout.packMultiplier.data());
+    const __m128i mul1 = load128(layout.packMultiplier.data() + 4);
+    __m128i shuffles[2][2][2]; // [output half][source half][parity]
+    for (int o = 0; o < 2; ++o) {
+        for (int h = 0; h < 2; ++h) {
+            for (int p = 0; p < 2; ++p) shuffles[o][h][p] = load128(layout.packShuffle[h][p].data() + 16 * o);
+        }
+    }
+
+    for (std::size_t g = 0; g < groups; ++g, words += 8, out += layout.bits) {
+        __m128i a = _mm_mullo_epi32(_mm_and_si128(load128(words), mask), mul0);
+        __m128i b = _mm_mullo_epi32(_mm_and_si128(load128(words + 4), mask), mul1);
+        for (int o = 0; o < 2; ++o) {
+            __m128i bytes = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(a, shuffles[o][0][0]), _mm_shuffle_epi8(a, shuffles[o][0][1])),
+                _mm_or_si128(_mm_shuffle_epi8(b, shuffles[o][1][0]), _mm_shuffle_epi8(b, shuffles[o][1][1])));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * o), bytes);
+        }
+    }
+}
+
+RSA_CHAT_TARGET("sse4.1")
+static void unpackGroupsSse41(const std::byte* in, std::size_t groups, const GroupLayout& layout, CipherWord* words) {
+    const __m128i shuffle0 = load128(layout.unpackShuffle.data());
+    const __m128i shuffle1 = load128(layout.unpackShuffle.data() + 16);
+    const __m128i mul0 = load128(layout.unpackMultiplier.data());
+    const __m128i mul1 = load128(layout.unpackMultiplier.data() + 4);
+    const __m128i down = _mm_cvtsi32_si128(static_cast<int>(32 - layout.bits));
+
+    for (std::size_t g = 0; g < groups; ++g, in += layout.bits, words += 8) {
+        __m128i a = _mm_shuffle_epi8(load128(in + layout.loadOffset[0]), shuffle0);
+        __m128i b = _mm_shuffle_epi8(load128(in + layout.loadOffset[1]), shuffle1);
+        a = _mm_srl_epi32(_mm_mullo_epi32(a, mul0), down);
+        b = _mm_srl_epi32(_mm_mullo_epi32(b, mul1), down);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words), a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 4), b);
+    }
+}
+
+template <typename T>
+RSA_CHAT_TARGET("avx2")
+static __m256i load256(const T* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+RSA_CHAT_TARGET("avx2")
+static void packGroupsAvx2(const CipherWord* words, std::size_t groups, const GroupLayout& layout, std::byte* out) {
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(wordMask(layout.bits)));
+    const __m256i shifts = load256(layout.shift.data());
+    const __m256i lowEven = load256(layout.packShuffle[0][0].data());
+    const __m256i lowOdd = load256(layout.packShuffle[0][1].data());
+    const __m256i highEven = load256(layout.packShuffle[1][0].data());
+    const __m256i highOdd = load256(layout.packShuffle[1][1].data());
+
+    for (std::size_t g = 0; g < groups; ++g, words += 8, out += layout.bits) {
+        __m256i v = _mm256_sllv_epi32(_mm256_and_si256(load256(words), mask), shifts);
+        // Both output lanes need bytes from both source halves
+        __m256i low = _mm256_permute2x128_si256(v, v, 0x00);
+        __m256i high = _mm256_permute2x128_si256(v, v, 0x11);
+        __m256i bytes = _mm256_or_si256(
+            _mm256_or_si256(_mm256_shuffle_epi8(low, lowEven), _mm256_shuffle_epi8(low, lowOdd)),
+            _mm256_or_si256(_mm256_shuffle_epi8(high, highEven), _mm256_shuffle_epi8(high, highOdd)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), bytes);
+    }
+}
+
+RSA_CHAT_TARGET("avx2")
+static void unpackGroupsAvx2(const std::byte* in, std::size_t groups, const GroupLayout& layout, CipherWord* words) {
+    const __m256i shuffle = load256(layout.unpackShuffle.data());
+    const __m256i shifts = load256(layout.shift.data());
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(wordMask(layout.bits)));
+
+    for (std::size_t g = 0; g < groups; ++g, in += layout.bits, words += 8) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(load128(in + layout.loadOffset[0])),
+                                            load128(in + layout.loadOffset[1]), 1);
+        v = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(v, shuffle), shifts), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), v);
+    }
+}
+
+#endif
+
+// ---------- dispatch ----------
+
+bool bitpackKernelSupported(BitpackKernel kernel) {
+    switch (kernel) {
+    case BitpackKernel::Scalar: return true;
+    case BitpackKernel::Sse41: return cpuHasSse41();
+    case BitpackKernel::Avx2: return cpuHasAvx2();
+    }
+    return false;
+}
+
+BitpackKernel bitpackDefaultKernel() {
+    static const BitpackKernel kernel = bitpackKernelSupported(BitpackKernel::Avx2)    ? BitpackKernel::Avx2
+                                        : bitpackKernelSupported(BitpackKernel::Sse41) ? BitpackKernel::Sse41
+                                                                                         : BitpackKernel::Scalar;
+    return kernel;
+}
+
+const char* bitpackKernelName(BitpackKernel kernel) {
+    switch (kernel) {
+    case BitpackKernel::Scalar: return "scalar";
+    case BitpackKernel::Sse41: return "sse4.1";
+    case BitpackKernel::Avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+unsigned bitpackBits(std::uint32_t n) {
+    return n < 2 ? 1 : static_cast<unsigned>(std::bit_width(n - 1));
+}
+
+// Whole groups the vector kernels may take while every 32-byte access
+// stays inside a buffer of `bytes`
+static std::size_t simdGroups(std::size_t count, unsigned bits, std::size_t bytes, BitpackKernel kernel) {
+    if (kernel == BitpackKernel::Scalar || bits < kMinSimdBits || bits > kMaxSimdBits) return 0;
+    if (!bitpackKernelSupported(kernel) || bytes < kGroupSpan) return 0;
+    const std::size_t reachable = (bytes - kGroupSpan) / bits + 1;
+    return std::min(count / 8, reachable);
+}
+
+std::size_t bitpack(std::span<const CipherWord> words, unsigned bits, std::span<std::byte> out,
+                    BitpackKernel kernel) {
+    if (bits == 0 || bits > 32) return 0;
+    const std::size_t bytes = bitpackedBytes(words.size(), bits);
+    if (out.size() < bytes) return 0;
+
+    const std::size_t groups = simdGroups(words.size(), bits, out.size(), kernel);
+#if defined(RSA_CHAT_X86)
+    if (groups > 0) {
+        const GroupLayout layout = makeLayout(bits);
+        if (kernel == BitpackKernel::Avx2) {
+            packGroupsAvx2(words.data(), groups, layout, out.data());
+        } else {
+            packGroupsSse41(words.data(), groups, layout, out.data());
+        }
+    }
+#endif
+    // Each group ends on a byte boundary, so the tail starts on one too
+    packScalar(words.data() + groups * 8, words.size() - groups * 8, bits, out.data() + groups * bits);
+    return bytes;
+}
+
+std::size_t bitunpack(std::span<const std::byte> in, unsigned bits, std::span<CipherWord> words,
+                      BitpackKernel kernel) {
+    if (bits == 0 || bits > 32) return 0;
+    if (in.size() < bitpackedBytes(words.size(), bits)) return 0;
+
+    const std::size_t groups = simdGroups(words.size(), bits, in.size(), kernel);
+#if defined(RSA_CHAT_X86)
+    if (groups > 0) {
+        const GroupLayout layout = makeLayout(bits);
+        if (kernel == BitpackKernel::Avx2) {
+            unpackGroupsAvx2(in.data(), groups, layout, words.data());
+        } else {
+            unpackGroupsSse41(in.data(), groups, layout, words.data());
+        }
+    }
+#endif
+    unpackScalar(in.data() + groups * bits, bits, words.data() + groups * 8, words.size() - groups * 8);
+    return words.size();
+}
+
+// ---------- files ----------
+
+bool saveCipherPacked(std::span<const CipherWord> cipher, unsigned bits, const std::string& filename) {
+    if (bits == 0 || bits > 32 || cipher.size() > 0xffffffffu) return false;
+    std::vector<std::byte> data(bitpackedBytes(cipher.size(), bits));
+    bitpack(cipher, bits, data);
+
+    std::ofstream file(filename, std::ios::binary);
+    const auto count = static_cast<std::uint32_t>(cipher.size());
+    const unsigned char header[9] = {
+        static_cast<unsigned char>(kPackedMagic[0]), static_cast<unsigned char>(kPackedMagic[1]),
+        static_cast<unsigned char>(kPackedMagic[2]), static_cast<unsigned char>(kPackedMagic[3]),
+        static_cast<unsigned char>(bits),
+        static_cast<unsigned char>(count), static_cast<unsigned char>(count >> 8),
+        static_cast<unsigned char>(count >> 16), static_cast<unsigned char>(count >> 24),
+    };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+bool loadCipherPacked(const std::string& filename, std::vector<CipherWord>& cipher) {
+    std::ifstream file(filename, std::ios::binary);
+    unsigned char header[9];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+    if (std::memcmp(header, kPackedMagic, sizeof(kPackedMagic)) != 0) return false;
+    const unsigned bits = header[4];
+    const std::uint32_t count = header[5] | (header[6] << 8) | (header[7] << 16) |
+                                (static_cast<std::uint32_t>(header[8]) << 24);
+    if (bits == 0 || bits > 32) return false;
+
+    std::string data(std::istreambuf_iterator<char>(file), {});
+    // Checked before resizing, so a corrupt count cannot ask for gigabytes
+    if (data.size() != bitpackedBytes(count, bits)) return false;
+    cipher.resize(count);
+    return bitunpack(std::as_bytes(std::span(data)), bits, cipher) == count;
+}
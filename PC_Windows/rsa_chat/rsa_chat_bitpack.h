@@ -0,0 +1,59 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// Dense storage for ciphertext: every word is below n, so it is stored in
+// exactly ceil(log2(n)) bits, least significant bit first. With the demo
+// keys that is 14-18 bits per word instead of 32 in memory or 6-7
+// characters of decimal text on the wire.
+//
+// Words are packed in groups of 8, which always fill a whole number of
+// bytes; SSE4.1 and AVX2 kernels handle those groups for widths 8-25,
+// everything else (the tail, other widths, other CPUs) goes through the
+// scalar code. All kernels produce identical output.
+
+enum class BitpackKernel {
+    Scalar,
+    Sse41,
+    Avx2,
+};
+
+// Best kernel this CPU supports, detected once
+BitpackKernel bitpackDefaultKernel();
+
+bool bitpackKernelSupported(BitpackKernel kernel);
+
+const char* bitpackKernelName(BitpackKernel kernel);
+
+// Bits needed for any word below `n` (n >= 2)
+unsigned bitpackBits(std::uint32_t n);
+
+// Bytes taken by `count` words of `bits` bits
+constexpr std::size_t bitpackedBytes(std::size_t count, unsigned bits) {
+    return (count * bits + 7) / 8;
+}
+
+// Packs `words` (each below 2^bits, 1 <= bits <= 32) into `out`, which
+// needs bitpackedBytes(words.size(), bits) bytes. Returns the bytes
+// written, or 0 if `out` is too small. The vector kernels may clobber
+// up to 32 bytes of `out` past the packed data.
+std::size_t bitpack(std::span<const CipherWord> words, unsigned bits, std::span<std::byte> out,
+                    BitpackKernel kernel = bitpackDefaultKernel());
+
+// Unpacks words.size() words from `in`. Returns the number unpacked, or
+// 0 if `in` is too short.
+std::size_t bitunpack(std::span<const std::byte> in, unsigned bits, std::span<CipherWord> words,
+                      BitpackKernel kernel = bitpackDefaultKernel());
+
+// Binary cipher files: "RSAP", width byte, 32-bit little-endian word
+// count, packed words. About a third of the size of saveCipherToFile().
+bool saveCipherPacked(std::span<const CipherWord> cipher, unsigned bits, const std::string& filename);
+
+// Returns false for a missing or malformed file
+bool loadCipherPacked(const std::string& filename, std::vector<CipherWord>& cipher);
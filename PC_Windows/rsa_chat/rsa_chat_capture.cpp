@@ -0,0 +1,162 @@
+#include "rsa_chat_capture.h"
+#include "rsa_chat_receive.h"
+
+#include <iterator>
+#include <thread>
+
+static constexpr char kCaptureMagic[4] = {'R', 'S', 'A', 'C'};
+static constexpr unsigned char kCaptureVersion = 1;
+
+// A read is at most what one readyRead had buffered; anything larger is a
+// corrupt length
+static constexpr std::uint64_t kMaxSegmentBytes = 1u << 30;
+
+static constexpr std::uint64_t kFnvOffset = 14695981039346656037ull;
+static constexpr std::uint64_t kFnvPrime = 1099511628211ull;
+
+static bool readVarint(std::string_view& in, std::uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (in.empty()) return false;
+        const auto byte = static_cast<unsigned char>(in.front());
+        in.remove_prefix(1);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// ---------- recording ----------
+
+bool CaptureWriter::open(const std::string& filename, const PrivateKey& priv) {
+    close();
+    m_file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!m_file) return false;
+    m_file.write(kCaptureMagic, sizeof(kCaptureMagic));
+    m_file.put(static_cast<char>(kCaptureVersion));
+    writeVarint(static_cast<std::uint32_t>(priv.d));
+    writeVarint(static_cast<std::uint32_t>(priv.n));
+    m_last = std::chrono::steady_clock::now();
+    m_bytes = 0;
+    return static_cast<bool>(m_file);
+}
+
+void CaptureWriter::writeVarint(std::uint64_t value) {
+    while (value >= 0x80) {
+        m_file.put(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    m_file.put(static_cast<char>(value));
+}
+
+void CaptureWriter::record(const char* data, std::size_t size) {
+    if (!m_file.is_open() || size == 0) return;
+    const auto now = std::chrono::steady_clock::now();
+    writeVarint(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - m_last).count()));
+    m_last = now;
+    writeVarint(size);
+    m_file.write(data, static_cast<std::streamsize>(size));
+    m_bytes += size;
+}
+
+void CaptureWriter::close() {
+    if (m_file.is_open()) m_file.close();
+}
+
+// ---------- loading ----------
+
+bool Capture::load(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    const std::string data(std::istreambuf_iterator<char>(file), {});
+    return parse(data);
+}
+
+bool Capture::parse(std::string_view file) {
+    m_segments.clear();
+    m_bytes.clear();
+    if (file.size() < sizeof(kCaptureMagic) + 1 ||
+        file.substr(0, sizeof(kCaptureMagic)) != std::string_view(kCaptureMagic, sizeof(kCaptureMagic)) ||
+        static_cast<unsigned char>(file[sizeof(kCaptureMagic)]) != kCaptureVersion) {
+        return false;
+    }
+    file.remove_prefix(sizeof(kCaptureMagic) + 1);
+
+    std::uint64_t d = 0;
+    std::uint64_t n = 0;
+    if (!readVarint(file, d) || !readVarint(file, n)) return false;
+    m_key = {static_cast<int>(d), static_cast<int>(n)};
+
+    // The payload can only be smaller than the file
+    m_bytes.reserve(file.size());
+    std::uint64_t timeUs = 0;
+    while (!file.empty()) {
+        std::uint64_t gapUs = 0;
+        std::uint64_t size = 0;
+        if (!readVarint(file, gapUs) || !readVarint(file, size) || size > kMaxSegmentBytes || size > file.size()) {
+            return false;
+        }
+        timeUs += gapUs;
+        m_segments.push_back({timeUs, m_bytes.size(), static_cast<std::size_t>(size)});
+        m_bytes.append(file.substr(0, size));
+        file.remove_prefix(size);
+    }
+    return true;
+}
+
+// ---------- replay ----------
+
+static void hashInto(std::uint64_t& hash, std::string_view data) {
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= kFnvPrime;
+    }
+    // Keeps "ab" + "c" apart from "a" + "bc"
+    hash ^= 0xff;
+    hash *= kFnvPrime;
+}
+
+ReplayStats replayCapture(const Capture& capture, const ReplayOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    ReplayStats stats;
+    stats.checksum = kFnvOffset;
+
+    FrameReceiver receiver(
+        {
+            [&stats](std::string_view line) {
+                ++stats.lines;
+                hashInto(stats.checksum, line);
+            },
+            [&stats](const FrameHeader& header, std::string_view plain) {
+                ++stats.messages;
+                stats.plainBytes += plain.size();
+                stats.checksum ^= static_cast<std::uint64_t>(header.channel);
+                hashInto(stats.checksum, plain);
+            },
+            [&stats](FrameReceiver::Corrupt) { ++stats.corrupt; },
+        },
+        capture.key());
+
+    const bool paced = options.pacing == ReplayPacing::Original && options.speed > 0;
+    const Clock::time_point start = Clock::now();
+    Clock::duration busy{};
+    for (std::size_t i = 0; i < capture.segments().size(); ++i) {
+        if (paced) {
+            const auto due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(
+                                         static_cast<double>(capture.segments()[i].timeUs) / options.speed));
+            std::this_thread::sleep_until(due);
+            const double lagUs = std::chrono::duration<double, std::micro>(Clock::now() - due).count();
+            if (lagUs > stats.maxLagUs) stats.maxLagUs = lagUs;
+        }
+        const std::string_view segment = capture.segment(i);
+        const Clock::time_point before = Clock::now();
+        receiver.feed(segment.data(), segment.size());
+        busy += Clock::now() - before;
+        ++stats.segments;
+        stats.bytes += segment.size();
+    }
+
+    stats.busySeconds = std::chrono::duration<double>(busy).count();
+    stats.wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Recordings of the bytes a session received, read by read, so that real
+// traffic can be pushed through the receive path again without a peer.
+//
+// File layout, all numbers LEB128 varints:
+//   "RSAC", version byte (1)
+//   d, n of the private key the traffic was received with
+//   per read: microseconds since the previous read (or since the capture
+//   started), byte count, the bytes
+//
+// The key is in the file because replay has to decrypt. It is the
+// session's own key, which the GUI writes to disk anyway; keep captures
+// of real conversations as private as that key file.
+
+class CaptureWriter {
+public:
+    CaptureWriter() = default;
+    ~CaptureWriter() { close(); }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    // Starts a new file; false if it cannot be created
+    bool open(const std::string& filename, const PrivateKey& priv);
+    bool isOpen() const { return m_file.is_open(); }
+
+    // One read, stamped now
+    void record(const char* data, std::size_t size);
+
+    void close();
+
+    std::uint64_t bytes() const { return m_bytes; }
+
+private:
+    void writeVarint(std::uint64_t value);
+
+    std::ofstream m_file;
+    std::chrono::steady_clock::time_point m_last;
+    std::uint64_t m_bytes = 0;
+};
+
+struct CaptureSegment {
+    std::uint64_t timeUs = 0; // since the capture started
+    std::size_t offset = 0;   // into Capture::bytes()
+    std::size_t size = 0;
+};
+
+class Capture {
+public:
+    // Both return false for a missing, foreign or truncated file
+    bool load(const std::string& filename);
+    bool parse(std::string_view file);
+
+    const PrivateKey& key() const { return m_key; }
+    const std::vector<CaptureSegment>& segments() const { return m_segments; }
+    // Every read back to back, i.e. the protocol text of the connection
+    const std::string& bytes() const { return m_bytes; }
+
+    std::string_view segment(std::size_t index) const {
+        const CaptureSegment& s = m_segments[index];
+        return std::string_view(m_bytes).substr(s.offset, s.size);
+    }
+    std::uint64_t durationUs() const { return m_segments.empty() ? 0 : m_segments.back().timeUs; }
+
+private:
+    PrivateKey m_key{};
+    std::vector<CaptureSegment> m_segments;
+    std::string m_bytes;
+};
+
+// ---------- replay ----------
+
+enum class ReplayPacing {
+    Fast,     // every read straight after the previous one
+    Original, // each read at its recorded time, scaled by `speed`
+};
+
+struct ReplayOptions {
+    ReplayPacing pacing = ReplayPacing::Fast;
+    double speed = 1.0;
+};
+
+struct ReplayStats {
+    std::uint64_t segments = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t lines = 0;     // KEY:, CAPS:, probes and other non-message lines
+    std::uint64_t messages = 0;  // decrypted frames
+    std::uint64_t plainBytes = 0;
+    std::uint64_t corrupt = 0;
+    // FNV-1a over every line and plaintext in order: equal across runs
+    // and builds unless the decoded traffic changed
+    std::uint64_t checksum = 0;
+    double busySeconds = 0.0; // inside the receive path
+    double wallSeconds = 0.0;
+    // Original pacing only: how far the worst read started behind its
+    // recorded time, i.e. the receive path could not keep up
+    double maxLagUs = 0.0;
+
+    double megabytesPerSecond() const { return busySeconds > 0 ? bytes / busySeconds / 1e6 : 0.0; }
+};
+
+// Feeds the capture through FrameReceiver, read by read, decrypting with
+// the capture's key
+ReplayStats replayCapture(const Capture& capture, const ReplayOptions& options = {});
@@ -0,0 +1,57 @@
+#include "rsa_chat_channels.h"
+
+const char* channelName(Channel channel) {
+    switch (channel) {
+    case Channel::Chat: return "chat";
+    case Channel::Control: return "control";
+    case Channel::File: return "file";
+    case Channel::Count: break;
+    }
+    return "unknown";
+}
+
+ChannelAssembler::Result ChannelAssembler::add(Channel channel, std::string_view chunk, bool more,
+                                               std::string_view& message) {
+    const std::size_t index = static_cast<std::size_t>(channel);
+    std::string& partial = m_partial[index];
+
+    // After an overflow, drop chunks up to the end of that message
+    if (m_discarding[index]) {
+        if (!more) m_discarding[index] = false;
+        return Result::Partial;
+    }
+
+    if (partial.size() + chunk.size() > kMaxChannelMessage) {
+        partial.clear();
+        partial.shrink_to_fit();
+        m_discarding[index] = more;
+        return Result::Overflow;
+    }
+
+    if (!more && partial.empty()) {
+        // Unchunked message, the common case for chat
+        message = chunk;
+        return Result::Complete;
+    }
+
+    partial += chunk;
+    if (more) return Result::Partial;
+
+    message = partial;
+    return Result::Complete;
+}
+
+void ChannelAssembler::release(Channel channel) {
+    std::string& partial = m_partial[static_cast<std::size_t>(channel)];
+    // A finished transfer's buffer is not worth keeping around
+    if (partial.capacity() > kChannelChunkSize) {
+        std::string().swap(partial);
+    } else {
+        partial.clear();
+    }
+}
+
+void ChannelAssembler::reset() {
+    for (std::string& partial : m_partial) partial.clear();
+    m_discarding.fill(false);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "rsa_chat_protocol.h"
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Multiplexing of the chat, control and file channels over one
+// connection. Large messages go out as bounded chunks (more=1 on all but
+// the last), and the sender always picks the next chunk from the most
+// urgent non-empty channel, so a chat line waits for at most one file
+// chunk rather than for the whole transfer.
+
+// Plaintext bytes per chunk
+constexpr std::size_t kChannelChunkSize = 4096;
+
+// Largest message the receiver will reassemble on any channel
+constexpr std::size_t kMaxChannelMessage = 64u * 1024u * 1024u;
+
+// Strict priority, most urgent first
+constexpr std::array<Channel, kChannelCount> kChannelPriority = {
+    Channel::Control,
+    Channel::Chat,
+    Channel::File,
+};
+
+const char* channelName(Channel channel);
+
+// Per-channel FIFOs drained in kChannelPriority order
+template <typename Frame>
+class ChannelQueue {
+public:
+    void push(Channel channel, Frame frame) {
+        m_queues[static_cast<std::size_t>(channel)].push_back(std::move(frame));
+    }
+
+    bool empty() const {
+        for (const auto& queue : m_queues) {
+            if (!queue.empty()) return false;
+        }
+        return true;
+    }
+
+    std::size_t size(Channel channel) const { return m_queues[static_cast<std::size_t>(channel)].size(); }
+
+    bool pop(Frame& frame) {
+        for (Channel channel : kChannelPriority) {
+            auto& queue = m_queues[static_cast<std::size_t>(channel)];
+            if (queue.empty()) continue;
+            frame = std::move(queue.front());
+            queue.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        for (auto& queue : m_queues) queue.clear();
+    }
+
+private:
+    std::array<std::deque<Frame>, kChannelCount> m_queues;
+};
+
+// Joins chunks back into messages, independently per channel
+class ChannelAssembler {
+public:
+    enum class Result {
+        Partial,  // chunk stored, more to come
+        Complete, // `message` views the whole message
+        Overflow, // message exceeded kMaxChannelMessage and was discarded
+    };
+
+    // An unchunked message is passed through without a copy, so `message`
+    // may view `chunk`. Call release() once done with a completed message.
+    Result add(Channel channel, std::string_view chunk, bool more, std::string_view& message);
+
+    void release(Channel channel);
+
+    void reset();
+
+private:
+    std::array<std::string, kChannelCount> m_partial;
+    std::array<bool, kChannelCount> m_discarding{};
+};
@@ -0,0 +1,351 @@
+#include "rsa_chat_codebook.h"
+#include "rsa_chat_lz.h"
+#include "rsa_chat_receive.h"
+#include "rsa_chat_simd.h"
+#include "rsa_chat_thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <latch>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+// Table entry of a word that is no codeword; any bit above the low byte
+static constexpr std::uint16_t kNoByte = 0x100;
+
+// Beyond this a dense table costs more memory than it is worth; such
+// keys (never made by generateKeys()) get a sorted list instead
+static constexpr std::uint32_t kMaxDenseModulus = 1u << 26;
+
+// Reads smaller than this are decoded on the calling thread
+static constexpr std::size_t kParallelBytes = 256 * 1024;
+
+static constexpr std::size_t kNoKey = std::numeric_limits<std::size_t>::max();
+
+// ---------- kernels ----------
+
+static std::size_t decodeScalar(const CipherWord* cipher, std::size_t count, const std::uint16_t* table,
+                                CipherWord limit, std::byte* plain) {
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::uint16_t v = table[std::min(cipher[i], limit)];
+        if (v & ~std::uint16_t{0xff}) return i;
+        plain[i] = static_cast<std::byte>(v);
+    }
+    return count;
+}
+
+#if defined(RSA_CHAT_X86)
+
+// Whole groups of 8 while every word is a codeword; stops at the first
+// group that is not and leaves that one to the scalar loop
+RSA_CHAT_TARGET("avx2")
+static std::size_t decodeAvx2(const CipherWord* cipher, std::size_t count, const std::uint16_t* table,
+                              CipherWord limit, std::byte* plain) {
+    const __m256i limitV = _mm256_set1_epi32(static_cast<int>(limit));
+    const __m256i low16 = _mm256_set1_epi32(0xffff);
+    const __m256i notByte = _mm256_set1_epi32(0xff00);
+    // Low byte of each 32-bit lane to the front of its 128-bit half
+    const __m256i lowBytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8,
+                                              12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i halves = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cipher + i));
+        const __m256i index = _mm256_min_epu32(words, limitV);
+        // 16-bit entries fetched as 32-bit lanes, hence the spare entry
+        __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), index, 2);
+        v = _mm256_and_si256(v, low16);
+        if (!_mm256_testz_si256(v, notByte)) break;
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, lowBytes), halves);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(plain + i), _mm256_castsi256_si128(packed));
+    }
+    return i;
+}
+
+#endif
+
+bool codebookKernelSupported(CodebookKernel kernel) {
+    switch (kernel) {
+    case CodebookKernel::Scalar: return true;
+    case CodebookKernel::Avx2: return cpuHasAvx2();
+    }
+    return false;
+}
+
+CodebookKernel codebookDefaultKernel() {
+    static const CodebookKernel kernel =
+        codebookKernelSupported(CodebookKernel::Avx2) ? CodebookKernel::Avx2 : CodebookKernel::Scalar;
+    return kernel;
+}
+
+const char* codebookKernelName(CodebookKernel kernel) {
+    switch (kernel) {
+    case CodebookKernel::Scalar: return "scalar";
+    case CodebookKernel::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+// ---------- Codebook ----------
+
+Codebook::Codebook(const PublicKey& pub) : m_pub(pub) {
+    std::array<std::byte, 256> bytes;
+    for (std::size_t b = 0; b < bytes.size(); ++b) bytes[b] = static_cast<std::byte>(b);
+    std::array<CipherWord, 256> words;
+    encryptMessage(bytes, pub, words);
+
+    if (static_cast<std::uint32_t>(pub.n) <= kMaxDenseModulus) {
+        m_table.assign(static_cast<std::size_t>(pub.n) + 2, kNoByte);
+        for (std::size_t b = 0; b < words.size(); ++b) m_table[words[b]] = static_cast<std::uint16_t>(b);
+    } else {
+        m_sorted.reserve(words.size());
+        for (std::size_t b = 0; b < words.size(); ++b) m_sorted.emplace_back(words[b], static_cast<std::uint8_t>(b));
+        std::sort(m_sorted.begin(), m_sorted.end());
+    }
+}
+
+std::size_t Codebook::decode(std::span<const CipherWord> cipher, std::span<std::byte> plain,
+                             CodebookKernel kernel) const {
+    const std::size_t count = std::min(cipher.size(), plain.size());
+    if (m_table.empty()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            auto it = std::lower_bound(m_sorted.begin(), m_sorted.end(), std::make_pair(cipher[i], std::uint8_t{0}));
+            if (it == m_sorted.end() || it->first != cipher[i]) return i;
+            plain[i] = static_cast<std::byte>(it->second);
+        }
+        return count;
+    }
+
+    const auto limit = static_cast<CipherWord>(m_pub.n);
+    std::size_t done = 0;
+#if defined(RSA_CHAT_X86)
+    if (kernel == CodebookKernel::Avx2 && codebookKernelSupported(kernel)) {
+        done = decodeAvx2(cipher.data(), count, m_table.data(), limit, plain.data());
+    }
+#else
+    (void)kernel;
+#endif
+    return done + decodeScalar(cipher.data() + done, count - done, m_table.data(), limit, plain.data() + done);
+}
+
+// ---------- frequency analysis ----------
+
+std::string frequencyGuess(std::span<const CipherWord> cipher) {
+    // Bytes of casual English chat, most common first
+    static constexpr std::string_view kChatBytes = " etaoinsrhldcumwfgypbvkjxqzTIAESONHWMRLDCBYPGFUVKJXQZ.,'!?0123456789\n-:;\"()";
+
+    std::unordered_map<CipherWord, std::size_t> counts;
+    for (CipherWord w : cipher) ++counts[w];
+    std::vector<std::pair<std::size_t, CipherWord>> ranked;
+    ranked.reserve(counts.size());
+    for (const auto& [word, count] : counts) ranked.emplace_back(count, word);
+    // Ties broken by word, so the guess does not depend on hash order
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+
+    std::unordered_map<CipherWord, char> guess;
+    for (std::size_t r = 0; r < ranked.size(); ++r) guess[ranked[r].second] = r < kChatBytes.size() ? kChatBytes[r] : '?';
+    std::string text;
+    text.reserve(cipher.size());
+    for (CipherWord w : cipher) text += guess[w];
+    return text;
+}
+
+// ---------- CodebookAttack ----------
+
+// One worker's share of a read and what came out of it, emitted in order
+struct CodebookAttack::Slice {
+    struct Entry {
+        std::size_t key; // kNoKey: no known key fits
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    ReceiveArena arena{64 * 1024};
+    std::string text; // plaintexts back to back
+    std::vector<Entry> entries;
+    std::uint64_t words = 0;
+    std::size_t lastKey = 0; // consecutive frames mostly share a key
+
+    void clear() {
+        text.clear();
+        entries.clear();
+        words = 0;
+    }
+};
+
+CodebookAttack::CodebookAttack(Handlers handlers, unsigned threads)
+    : m_handlers(std::move(handlers)), m_pool(std::make_unique<ThreadPool>(threads)) {
+    for (std::size_t i = 0; i < m_pool->size(); ++i) m_slices.push_back(std::make_unique<Slice>());
+}
+
+CodebookAttack::~CodebookAttack() = default;
+
+void CodebookAttack::addKey(const PublicKey& pub) {
+    // Below 256 the bytes are not even distinct mod n
+    if (pub.e <= 0 || pub.n <= 256) return;
+    for (const auto& codebook : m_codebooks) {
+        if (codebook->key().e == pub.e && codebook->key().n == pub.n) return;
+    }
+    m_codebooks.push_back(std::make_unique<Codebook>(pub));
+}
+
+// Keys must be known before the frames sent under them are decoded, so
+// each read is searched for KEY: lines before any slice starts
+void CodebookAttack::addKeysFrom(std::string_view text) {
+    for (std::size_t at = text.find("KEY:"); at != std::string_view::npos; at = text.find("KEY:", at + 4)) {
+        const char* p = text.data() + at + 4;
+        const char* end = text.data() + text.size();
+        PublicKey pub{};
+        auto e = std::from_chars(p, end, pub.e);
+        if (e.ec != std::errc() || e.ptr == end || *e.ptr != ':') continue;
+        auto n = std::from_chars(e.ptr + 1, end, pub.n);
+        if (n.ec == std::errc()) addKey(pub);
+    }
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+void CodebookAttack::decodeLines(std::string_view text, Slice& slice) const {
+    while (!text.empty()) {
+        std::size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+
+        while (!line.empty() && isSpace(line.front())) line.remove_prefix(1);
+        while (!line.empty() && isSpace(line.back())) line.remove_suffix(1);
+        const bool legacy = line.starts_with("MSG:");
+        if (!legacy && !line.starts_with("XMSG:")) continue;
+
+        FrameHeader header;
+        std::pmr::vector<CipherWord> cipher(slice.arena.resource());
+        const bool parsed = legacy ? parseCipherList(line.substr(4), cipher) : parseMessageFrame(line, header, cipher);
+        if (!parsed || cipher.empty()) {
+            slice.arena.reset();
+            continue;
+        }
+
+        // Most wrong keys fail on the first word: only 256 of n words are
+        // codewords
+        const std::size_t offset = slice.text.size();
+        slice.text.resize(offset + cipher.size());
+        std::span<std::byte> plain = std::as_writable_bytes(std::span(slice.text).subspan(offset));
+        std::size_t key = kNoKey;
+        for (std::size_t k = 0; k < m_codebooks.size() && key == kNoKey; ++k) {
+            const std::size_t candidate = (slice.lastKey + k) % m_codebooks.size();
+            if (m_codebooks[candidate]->decode(cipher, plain) == cipher.size()) key = candidate;
+        }
+
+        std::size_t size = cipher.size();
+        if (key != kNoKey && header.compressed) {
+            std::pmr::string inflated(header.plainSize, '\0', slice.arena.resource());
+            if (lzDecompress(std::string_view(slice.text).substr(offset), inflated.data(), header.plainSize)) {
+                slice.text.replace(offset, std::string::npos, std::string_view(inflated));
+                size = inflated.size();
+            } else {
+                key = kNoKey;
+            }
+        }
+        if (key == kNoKey) {
+            slice.text.resize(offset);
+            size = 0;
+        } else {
+            slice.lastKey = key;
+            slice.words += cipher.size();
+        }
+        slice.entries.push_back({key, offset, size});
+        slice.arena.reset();
+    }
+}
+
+void CodebookAttack::emit(Slice& slice) {
+    for (const Slice::Entry& entry : slice.entries) {
+        ++m_stats.messages;
+        if (entry.key == kNoKey) {
+            if (m_handlers.unknown) m_handlers.unknown();
+            continue;
+        }
+        ++m_stats.decoded;
+        if (m_handlers.message) {
+            m_handlers.message(m_codebooks[entry.key]->key(),
+                               std::string_view(slice.text).substr(entry.offset, entry.size));
+        }
+    }
+    m_stats.words += slice.words;
+    slice.clear();
+}
+
+void CodebookAttack::feed(std::string_view data) {
+    m_stats.bytes += data.size();
+
+    // Finish the line left over from the previous read first
+    if (!m_partial.empty()) {
+        const std::size_t newline = data.find('\n');
+        if (newline == std::string_view::npos) {
+            m_partial.append(data);
+            return;
+        }
+        m_partial.append(data.substr(0, newline));
+        data.remove_prefix(newline + 1);
+        finish();
+    }
+
+    const std::size_t last = data.rfind('\n');
+    if (last == std::string_view::npos) {
+        m_partial.assign(data);
+        return;
+    }
+    const std::string_view lines = data.substr(0, last + 1);
+    addKeysFrom(lines);
+
+    // Cut at line boundaries into one slice per worker
+    const std::size_t parts = lines.size() < kParallelBytes ? 1 : m_slices.size();
+    std::vector<std::string_view> pieces;
+    std::string_view rest = lines;
+    for (std::size_t i = parts; i > 1 && !rest.empty(); --i) {
+        std::size_t cut = rest.find('\n', rest.size() / i);
+        cut = cut == std::string_view::npos ? rest.size() : cut + 1;
+        pieces.push_back(rest.substr(0, cut));
+        rest.remove_prefix(cut);
+    }
+    if (!rest.empty()) pieces.push_back(rest);
+
+    if (pieces.size() == 1) {
+        decodeLines(pieces[0], *m_slices[0]);
+    } else {
+        std::latch done(static_cast<std::ptrdiff_t>(pieces.size()));
+        for (std::size_t i = 0; i < pieces.size(); ++i) {
+            m_pool->submit([this, &pieces, &done, i] {
+                decodeLines(pieces[i], *m_slices[i]);
+                done.count_down();
+            });
+        }
+        done.wait();
+    }
+    for (std::size_t i = 0; i < pieces.size(); ++i) emit(*m_slices[i]);
+
+    m_partial.assign(data.substr(last + 1));
+}
+
+void CodebookAttack::finish() {
+    if (m_partial.empty()) return;
+    addKeysFrom(m_partial);
+    decodeLines(m_partial, *m_slices[0]);
+    emit(*m_slices[0]);
+    m_partial.clear();
+}
+
+const Codebook* CodebookAttack::decode(std::span<const CipherWord> cipher, std::string& plain) const {
+    plain.resize(cipher.size());
+    for (const auto& codebook : m_codebooks) {
+        if (codebook->decode(cipher, std::as_writable_bytes(std::span(plain))) == cipher.size()) return codebook.get();
+    }
+    plain.clear();
+    return nullptr;
+}
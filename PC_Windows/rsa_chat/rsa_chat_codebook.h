@@ -0,0 +1,125 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "rsa_chat_protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+// Reads captured traffic without any private key. encryptMessage() sends
+// every byte on its own as m^e mod n with no padding, so encrypting the
+// 256 possible bytes under the public key yields the whole code, and each
+// captured word is then one table lookup.
+
+enum class CodebookKernel {
+    Scalar,
+    Avx2, // eight words per gather
+};
+
+CodebookKernel codebookDefaultKernel();
+
+bool codebookKernelSupported(CodebookKernel kernel);
+
+const char* codebookKernelName(CodebookKernel kernel);
+
+// The forward table of one public key, inverted: the plain byte of every
+// word below n, or none. Takes about 2 * n bytes (500 KB for the largest
+// demo key) so a lookup is a single load.
+class Codebook {
+public:
+    explicit Codebook(const PublicKey& pub);
+
+    const PublicKey& key() const { return m_pub; }
+
+    // Decodes cipher.size() words into `plain`. Returns how many decoded
+    // before the first word that is not a codeword of this key; anything
+    // short of cipher.size() means the text was sent under another key.
+    std::size_t decode(std::span<const CipherWord> cipher, std::span<std::byte> plain,
+                       CodebookKernel kernel = codebookDefaultKernel()) const;
+
+private:
+    PublicKey m_pub;
+    // Indexed by word; one spare entry at n (the clamp target for words
+    // >= n) and one more so the 4-byte gathers stay in bounds
+    std::vector<std::uint16_t> m_table;
+    // Used instead when n is too big for a table
+    std::vector<std::pair<CipherWord, std::uint8_t>> m_sorted;
+};
+
+// Guesses text from word frequencies alone, for ciphertext whose key was
+// never seen: the most common word is taken for the most common byte of
+// chat text, the next for the next, and so on. Rough, but short words
+// and spaces show through after a few hundred characters.
+std::string frequencyGuess(std::span<const CipherWord> cipher);
+
+// Streams captured protocol text (either direction of a connection, or a
+// log of both) through the codebooks of every key seen so far. KEY: lines
+// add keys; MSG: and XMSG: frames are decoded under whichever known key
+// fits them, including compressed and bit-packed ones. Large reads are
+// cut at line boundaries and decoded on all workers at once; messages
+// still come out in capture order.
+class CodebookAttack {
+public:
+    struct Handlers {
+        // A message decoded under `key`; the text is valid during the call
+        std::function<void(const PublicKey& key, std::string_view plain)> message;
+        // A message that none of the known keys fits
+        std::function<void()> unknown;
+    };
+
+    struct Stats {
+        std::uint64_t bytes = 0;    // capture bytes fed
+        std::uint64_t messages = 0; // frames seen
+        std::uint64_t decoded = 0;  // frames decoded
+        std::uint64_t words = 0;    // cipher words decoded
+    };
+
+    explicit CodebookAttack(Handlers handlers, unsigned threads = 0);
+    ~CodebookAttack();
+
+    CodebookAttack(const CodebookAttack&) = delete;
+    CodebookAttack& operator=(const CodebookAttack&) = delete;
+
+    // Keys known from elsewhere, e.g. public key files; repeats are ignored
+    void addKey(const PublicKey& pub);
+
+    // Adds every KEY:e:n in `text`, e.g. the other direction's capture
+    void addKeysFrom(std::string_view text);
+
+    std::size_t keyCount() const { return m_codebooks.size(); }
+
+    // Handles every complete line, keeping a trailing partial line for
+    // the next call
+    void feed(std::string_view data);
+
+    // Handles a last line that had no newline
+    void finish();
+
+    // Decodes a bare cipher file's words under the first key that fits;
+    // null if none does
+    const Codebook* decode(std::span<const CipherWord> cipher, std::string& plain) const;
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Slice;
+
+    void decodeLines(std::string_view text, Slice& slice) const;
+    void emit(Slice& slice);
+
+    Handlers m_handlers;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::vector<std::unique_ptr<Codebook>> m_codebooks;
+    std::vector<std::unique_ptr<Slice>> m_slices;
+    std::string m_partial;
+    Stats m_stats;
+};
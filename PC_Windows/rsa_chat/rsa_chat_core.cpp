@@ -1,6 +1,11 @@
 #include "rsa_chat_core.h"
+#include "rsa_chat_decimal.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_modarith.h"
+#include <algorithm>
 #include <random>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 #include <QNetworkInterface>
 #include <QHostAddress>
@@ -45,19 +50,6 @@ static int modinv(int a, int m) {
     return x1 < 0 ? x1 + m0 : x1;
 }
 
-static int modpow(int base, int exp, int mod) {
-    long long result = 1;
-    long long b = base % mod;
-    while (exp > 0) {
-        if (exp % 2 == 1) {
-            result = (result * b) % mod;
-        }
-        b = (b * b) % mod;
-        exp /= 2;
-    }
-    return (int)result;
-}
-
 std::string getLocalIP() {
     QList<QHostAddress> addresses = QNetworkInterface::allAddresses();
 
@@ -104,6 +96,9 @@ std::string getLocalIP() {
 }
 
 KeyPair generateKeys() {
+    ScopedTimer timer(Histogram::GenerateKeys);
+    metricsAdd(Counter::KeysGenerated);
+
     std::random_device rd;
     std::mt19937 gen(rd());
 
@@ -163,42 +158,75 @@ PrivateKey loadPrivateKey(const std::string& filename) {
     return key;
 }
 
-std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub) {
-    std::vector<int> cipher;
-    cipher.reserve(message.size());
-    for (unsigned char c : message) {
-        long long ciph = modpow(static_cast<int>(c), pub.e, pub.n);
-        cipher.push_back(static_cast<int>(ciph));
+std::size_t encryptMessage(std::span<const std::byte> message, const PublicKey& pub, std::span<CipherWord> cipher) {
+    ScopedTimer timer(Histogram::Encrypt);
+    const std::size_t count = std::min(message.size(), cipher.size());
+    metricsAdd(Counter::BytesEncrypted, count);
+
+    // The small exponents every key uses get an unrolled chain; anything
+    // else, or a malformed even modulus, takes the generic loop
+    if (pub.n > 1 && (pub.n & 1)) {
+        const MontgomeryWord<std::uint32_t> kernel(static_cast<std::uint32_t>(pub.n));
+        const bool fixed = withFixedExponent(static_cast<std::uint64_t>(pub.e), [&](auto exponent) {
+            for (std::size_t i = 0; i < count; ++i) {
+                cipher[i] = fixedPow<decltype(exponent)::value>(kernel, std::to_integer<std::uint32_t>(message[i]));
+            }
+        });
+        if (fixed) return count;
+    }
+
+    ModPow32 modpow(pub.n);
+    for (std::size_t i = 0; i < count; ++i) {
+        cipher[i] = static_cast<CipherWord>(modpow(std::to_integer<int>(message[i]), pub.e));
+    }
+    return count;
+}
+
+std::size_t decryptMessage(std::span<const CipherWord> cipher, const PrivateKey& priv, std::span<std::byte> message) {
+    ScopedTimer timer(Histogram::Decrypt);
+    const std::size_t count = std::min(cipher.size(), message.size());
+    metricsAdd(Counter::BytesDecrypted, count);
+
+    ModPow32 modpow(priv.n);
+    for (std::size_t i = 0; i < count; ++i) {
+        message[i] = static_cast<std::byte>(modpow(cipher[i], priv.d));
     }
+    return count;
+}
+
+std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub) {
+    std::vector<int> cipher(message.size());
+    encryptMessage(std::as_bytes(std::span(message)),
+                   pub, {reinterpret_cast<CipherWord*>(cipher.data()), cipher.size()});
     return cipher;
 }
 
 std::string decryptMessage(const std::vector<int>& cipher, const PrivateKey& priv) {
-    std::string msg;
-    msg.reserve(cipher.size());
-    for (int num : cipher) {
-        long long plain = modpow(num, priv.d, priv.n);
-        msg.push_back(static_cast<char>(plain));
-    }
+    std::string msg(cipher.size(), '\0');
+    decryptMessage(cipherWords(cipher), priv, std::as_writable_bytes(std::span(msg)));
     return msg;
 }
 
+void saveCipherToFile(std::span<const CipherWord> cipher, const std::string& filename) {
+    std::string text;
+    appendDecimalList(cipher, DecimalList::Spaces, text);
+    std::ofstream file(filename, std::ios::binary);
+    file.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
 void saveCipherToFile(const std::vector<int>& cipher, const std::string& filename) {
-    std::ofstream file(filename);
-    for (size_t i = 0; i < cipher.size(); ++i) {
-        file << cipher[i];
-        if (i < cipher.size() - 1) file << " ";
-    }
-    file.close();
+    saveCipherToFile(cipherWords(cipher), filename);
 }
 
 std::vector<int> loadCipherFromFile(const std::string& filename) {
-    std::ifstream file(filename);
-    std::vector<int> cipher;
-    int num;
-    while (file >> num) {
-        cipher.push_back(num);
-    }
-    file.close();
+    std::ifstream file(filename, std::ios::binary);
+    const std::string text{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::vector<int> cipher(decimalListCapacity(text, DecimalList::Spaces));
+    const std::size_t count =
+        parseDecimalList(text, DecimalList::Spaces, {reinterpret_cast<CipherWord*>(cipher.data()), cipher.size()});
+    // Like reading ints one by one: stop at the first that does not fit
+    const auto end = std::find_if(cipher.begin(), cipher.begin() + static_cast<std::ptrdiff_t>(count),
+                                  [](int word) { return word < 0; });
+    cipher.erase(end, cipher.end());
     return cipher;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -28,10 +31,30 @@ PrivateKey loadPrivateKey(const std::string& filename);
 
 KeyPair generateKeys();
 
+// One ciphertext word per plaintext byte. Every word is below n, so it
+// always fits an unsigned 32-bit value.
+using CipherWord = std::uint32_t;
+
+// Encrypts into caller storage and returns the number of words written,
+// min(message.size(), cipher.size())
+std::size_t encryptMessage(std::span<const std::byte> message, const PublicKey& pub, std::span<CipherWord> cipher);
+
+// Decrypts into caller storage and returns the number of bytes written,
+// min(cipher.size(), message.size())
+std::size_t decryptMessage(std::span<const CipherWord> cipher, const PrivateKey& priv, std::span<std::byte> message);
+
 std::vector<int> encryptMessage(const std::string& message, const PublicKey& pub);
 
 std::string decryptMessage(const std::vector<int>& cipher, const PrivateKey& priv);
 
+// The int ciphertext of the vector API seen as words (int and uint32_t
+// may alias each other)
+inline std::span<const CipherWord> cipherWords(const std::vector<int>& cipher) {
+    return {reinterpret_cast<const CipherWord*>(cipher.data()), cipher.size()};
+}
+
+void saveCipherToFile(std::span<const CipherWord> cipher, const std::string& filename);
+
 void saveCipherToFile(const std::vector<int>& cipher, const std::string& filename);
 
 std::vector<int> loadCipherFromFile(const std::string& filename);
\ No newline at end of file
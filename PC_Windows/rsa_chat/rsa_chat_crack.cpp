@@ -0,0 +1,365 @@
+#include "rsa_chat_crack.h"
+#include "rsa_chat_rsakey.h"
+#include "rsa_chat_thread_pool.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <latch>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+
+// Steps between gcds in Brent's loop; the product of the differences
+// is accumulated in between
+static constexpr std::uint64_t kGcdBatch = 128;
+
+// ---------- 64-bit and 128-bit helpers ----------
+//
+// The walk runs on MontgomeryWord<uint64_t> when n fits one word and on
+// MontgomeryLimbs<2> otherwise; these overloads cover both value types.
+
+static bool isOne(std::uint64_t v) {
+    return v == 1;
+}
+
+static bool isOne(const Modulus128& v) {
+    return v[0] == 1 && v[1] == 0;
+}
+
+static std::uint64_t addMod(std::uint64_t a, std::uint64_t b, std::uint64_t n) {
+    std::uint64_t s = a + b;
+    return s < a || s >= n ? s - n : s;
+}
+
+static Modulus128 addMod(Modulus128 a, const Modulus128& b, const Modulus128& n) {
+    if (limbsAdd(a, b) || !limbsLess(a, n)) limbsSub(a, n);
+    return a;
+}
+
+static std::uint64_t absDiff(std::uint64_t a, std::uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+static Modulus128 absDiff(Modulus128 a, Modulus128 b) {
+    if (limbsLess(a, b)) std::swap(a, b);
+    limbsSub(a, b);
+    return a;
+}
+
+// Binary gcd. n is odd, so factors of two in `a` can simply be dropped.
+static std::uint64_t gcdOdd(std::uint64_t a, std::uint64_t n) {
+    if (a == 0) return n;
+    a >>= std::countr_zero(a);
+    while (n != 0) {
+        n >>= std::countr_zero(n);
+        if (a > n) std::swap(a, n);
+        n -= a;
+    }
+    return a;
+}
+
+static Modulus128 gcdOdd(const Modulus128& a, const Modulus128& n) {
+    return limbsGcd(a, n);
+}
+
+static std::uint64_t randomBelow(std::mt19937_64& gen, std::uint64_t n) {
+    return gen() % (n - 1) + 1;
+}
+
+static Modulus128 randomBelow(std::mt19937_64& gen, const Modulus128& n) {
+    Modulus128 v{gen(), gen()};
+    v = limbsShiftRight(v, 128 - (limbsBitWidth(n) - 1));
+    if (limbsIsZero(v)) v[0] = 1;
+    return v;
+}
+
+static Modulus128 widen(std::uint64_t v) {
+    return {v, 0};
+}
+
+// n / d by shift and subtract; run once per key, so speed is no concern
+static Modulus128 divide(const Modulus128& n, const Modulus128& d) {
+    Modulus128 quotient{};
+    Modulus128 rem{};
+    for (std::size_t bit = 128; bit-- > 0;) {
+        const bool top = rem[1] >> 63;
+        rem[1] = rem[1] << 1 | rem[0] >> 63;
+        rem[0] = rem[0] << 1 | static_cast<std::uint64_t>(limbsBit(n, bit));
+        if (top || !limbsLess(rem, d)) {
+            limbsSub(rem, d);
+            quotient[bit / 64] |= std::uint64_t{1} << (bit % 64);
+        }
+    }
+    return quotient;
+}
+
+static bool isPrime(const Modulus128& v) {
+    if (v[1] == 0 && v[0] < 4) return v[0] >= 2;
+    if (!(v[0] & 1)) return false;
+    for (std::uint32_t sp : smallPrimes()) {
+        if (limbsModSmall(v, sp) == 0) return v == widen(sp);
+    }
+    // A fixed seed keeps reports reproducible
+    std::mt19937_64 gen(0x5eed);
+    return isProbablePrime<128>(v, gen);
+}
+
+// ---------- Pollard rho, Brent's variant ----------
+
+// The walk is x -> x * x / R + c with the Montgomery product as is. That
+// is still a quadratic map mod every factor of n, which is all rho needs,
+// and it saves converting in and out of the Montgomery domain.
+template <typename Kernel, typename Value>
+static bool rhoBrent(const Kernel& kernel, const Value& n, std::mt19937_64& gen, Value& factor,
+                     const std::atomic<bool>* stop) {
+    const Value c = randomBelow(gen, n);
+    auto step = [&](const Value& v) { return addMod(kernel.mul(v, v), c, n); };
+
+    Value y = randomBelow(gen, n);
+    Value x = y;
+    Value ys = y;
+    Value product = randomBelow(gen, n);
+    Value g = n;
+    bool found = false;
+
+    for (std::uint64_t r = 1; !found; r *= 2) {
+        x = y;
+        for (std::uint64_t i = 0; i < r; ++i) y = step(y);
+        for (std::uint64_t k = 0; k < r && !found; k += kGcdBatch) {
+            ys = y;
+            const std::uint64_t batch = std::min(kGcdBatch, r - k);
+            for (std::uint64_t i = 0; i < batch; ++i) {
+                y = step(y);
+                product = kernel.mul(product, absDiff(x, y));
+            }
+            g = gcdOdd(product, n);
+            found = !isOne(g);
+            if (!found && stop && stop->load(std::memory_order_relaxed)) return false;
+        }
+    }
+
+    // The batch overshot to n: redo its steps one gcd at a time
+    if (g == n) {
+        do {
+            ys = step(ys);
+            g = gcdOdd(absDiff(x, ys), n);
+        } while (isOne(g));
+    }
+    if (g == n) return false;
+    factor = g;
+    return true;
+}
+
+bool findFactor(const Modulus128& n, Modulus128& factor, std::uint64_t seed, const std::atomic<bool>* stop) {
+    std::mt19937_64 gen(seed);
+    if (n[1] == 0) {
+        MontgomeryWord<std::uint64_t> kernel(n[0]);
+        std::uint64_t f;
+        if (!rhoBrent(kernel, n[0], gen, f, stop)) return false;
+        factor = widen(f);
+        return true;
+    }
+    MontgomeryLimbs<2> kernel(n);
+    return rhoBrent(kernel, n, gen, factor, stop);
+}
+
+// ---------- keys ----------
+
+enum class Presplit {
+    Found,       // trial division found a factor
+    NeedRho,     // odd composite without small factors
+    Unbreakable, // prime, even or tiny: not an RSA modulus
+};
+
+static Presplit presplit(const Modulus128& n, Modulus128& factor) {
+    if (!(n[0] & 1) || (n[1] == 0 && n[0] < 9)) return Presplit::Unbreakable;
+    for (std::uint32_t sp : smallPrimes()) {
+        if (limbsModSmall(n, sp) == 0) {
+            if (n == widen(sp)) return Presplit::Unbreakable;
+            factor = widen(sp);
+            return Presplit::Found;
+        }
+    }
+    return isPrime(n) ? Presplit::Unbreakable : Presplit::NeedRho;
+}
+
+// d from p and q as generateKeysT() derives it: d = (1 + k * phi) / e
+// with k = -phi^-1 mod e, i.e. the inverse of e mod phi
+bool crackKeyWithFactor(const CrackTarget& target, Modulus128 p, CrackResult& result) {
+    result = CrackResult{};
+    Modulus128 q = divide(target.n, p);
+    if (limbsMul<2>(p, q) != target.n) return false;
+    if (limbsLess(q, p)) std::swap(p, q);
+    // Only a two-prime n has the phi the key was built from
+    if (!isPrime(p) || !isPrime(q)) return false;
+
+    const std::uint64_t e = target.e;
+    if (e < 3 || e > 0xffffffffu) return false;
+    Modulus128 pMinus1 = p;
+    Modulus128 qMinus1 = q;
+    pMinus1[0] -= 1;
+    qMinus1[0] -= 1;
+    const Modulus128 phi = limbsMul<2>(pMinus1, qMinus1);
+    const std::uint64_t phiModE = limbsModSmall(phi, e);
+    if (gcdSmall(e, phiModE) != 1) return false;
+
+    const std::uint64_t k = (e - modinvSmall(phiModE, e)) % e;
+    Limbs<3> big{phi[0], phi[1], 0};
+    limbsMulSmallAdd(big, k, 1);
+    limbsDivSmall(big, e);
+    const Modulus128 d{big[0], big[1]};
+
+    // A round trip proves the key before it is reported
+    LimbKernel<128> kernel(target.n);
+    const Modulus128 probe = widen(2);
+    if (kernel.pow(kernel.pow(probe, widen(e)), d) != probe) return false;
+
+    result.broken = true;
+    result.p = p;
+    result.q = q;
+    result.d = d;
+    return true;
+}
+
+bool crackKey(const CrackTarget& target, CrackResult& result) {
+    result = CrackResult{};
+    Modulus128 p;
+    switch (presplit(target.n, p)) {
+    case Presplit::Unbreakable: return false;
+    case Presplit::Found: break;
+    case Presplit::NeedRho:
+        for (std::uint64_t seed = 1; !findFactor(target.n, p, seed); ++seed) {
+        }
+        break;
+    }
+    return crackKeyWithFactor(target, p, result);
+}
+
+// Several walks with different seeds on one key; the first factor stops
+// the others. Independent walks only shorten the expected time by about
+// the square root of their number, but that still helps a lone big key.
+static bool crackKeyRacing(const CrackTarget& target, CrackResult& result, ThreadPool& pool) {
+    result = CrackResult{};
+    Modulus128 p;
+    switch (presplit(target.n, p)) {
+    case Presplit::Unbreakable: return false;
+    case Presplit::Found: return crackKeyWithFactor(target, p, result);
+    case Presplit::NeedRho: break;
+    }
+
+    const std::size_t walkers = pool.size();
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    std::latch done(static_cast<std::ptrdiff_t>(walkers));
+    for (std::size_t w = 0; w < walkers; ++w) {
+        pool.submit([&, w] {
+            Modulus128 factor;
+            for (std::uint64_t seed = w + 1; !stop.load(std::memory_order_relaxed); seed += walkers) {
+                if (findFactor(target.n, factor, seed, &stop)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!stop.exchange(true)) p = factor;
+                    break;
+                }
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    return crackKeyWithFactor(target, p, result);
+}
+
+std::vector<CrackResult> crackKeys(std::span<const CrackTarget> targets, unsigned threads) {
+    std::vector<CrackResult> results(targets.size());
+    if (targets.empty()) return results;
+    ThreadPool pool(threads);
+
+    if (targets.size() < pool.size()) {
+        for (std::size_t i = 0; i < targets.size(); ++i) crackKeyRacing(targets[i], results[i], pool);
+        return results;
+    }
+
+    // Workers pull keys one at a time, so a slow key never holds up a
+    // fixed share of the others
+    std::atomic<std::size_t> next{0};
+    std::latch done(static_cast<std::ptrdiff_t>(pool.size()));
+    for (std::size_t w = 0; w < pool.size(); ++w) {
+        pool.submit([&] {
+            for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < targets.size();) {
+                crackKey(targets[i], results[i]);
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    return results;
+}
+
+bool demoPrivateKey(const CrackTarget& target, const CrackResult& result, PrivateKey& priv) {
+    if (!result.broken || target.n[1] != 0 || target.n[0] > 0x7fffffffu || result.d[1] != 0) return false;
+    priv.d = static_cast<int>(result.d[0]);
+    priv.n = static_cast<int>(target.n[0]);
+    return true;
+}
+
+// ---------- input ----------
+
+bool parseCrackTarget(std::string_view e, std::string_view n, CrackTarget& target) {
+    auto res = std::from_chars(e.data(), e.data() + e.size(), target.e);
+    if (res.ec != std::errc() || res.ptr != e.data() + e.size()) return false;
+    return limbsFromDecimal(n, target.n);
+}
+
+static std::string_view leadingDigits(std::string_view text) {
+    std::size_t end = 0;
+    while (end < text.size() && text[end] >= '0' && text[end] <= '9') ++end;
+    return text.substr(0, end);
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool readCrackTargets(const std::string& filename, const std::function<void(CrackTarget&&)>& sink) {
+    std::ifstream file(filename);
+    if (!file) return false;
+
+    std::string line;
+    std::size_t lineNumber = 0;
+    CrackTarget target;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        std::string_view text(line);
+        bool parsed = false;
+
+        if (std::size_t key = text.find("KEY:"); key != std::string_view::npos) {
+            // Logs may quote or escape the line, so stop at the first
+            // character that is not part of a number
+            text.remove_prefix(key + 4);
+            std::string_view e = leadingDigits(text);
+            if (e.size() < text.size() && text[e.size()] == ':') {
+                parsed = parseCrackTarget(e, leadingDigits(text.substr(e.size() + 1)), target);
+            }
+        } else {
+            // A public key file: "e n" and nothing else
+            while (!text.empty() && isSpace(text.front())) text.remove_prefix(1);
+            while (!text.empty() && isSpace(text.back())) text.remove_suffix(1);
+            std::string_view e = leadingDigits(text);
+            std::string_view rest = text.substr(e.size());
+            if (!e.empty() && !rest.empty() && isSpace(rest.front())) {
+                while (!rest.empty() && isSpace(rest.front())) rest.remove_prefix(1);
+                std::string_view n = leadingDigits(rest);
+                parsed = n.size() == rest.size() && parseCrackTarget(e, n, target);
+            }
+        }
+
+        if (parsed) {
+            target.source = filename + ":" + std::to_string(lineNumber);
+            sink(std::move(target));
+            target = CrackTarget{};
+        }
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "rsa_chat_modarith.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Breaks small RSA keys, to show in class why the demo keys are not
+// secure: n is factored with Pollard's rho in Brent's variant, then d is
+// rebuilt from p and q the same way the key generators derive it. Moduli
+// up to 128 bits are handled; the ~18-bit keys of generateKeys() fall to
+// trial division before rho even starts.
+
+using Modulus128 = Limbs<2>;
+
+// A captured public key
+struct CrackTarget {
+    std::string source; // "file:line", for the report
+    std::uint64_t e = 0;
+    Modulus128 n{};
+};
+
+struct CrackResult {
+    bool broken = false;
+    Modulus128 p{}; // p <= q
+    Modulus128 q{};
+    Modulus128 d{};
+};
+
+// Decimal e and n as found in a key file or a KEY: line. False if they
+// are not numbers or n does not fit in 128 bits.
+bool parseCrackTarget(std::string_view e, std::string_view n, CrackTarget& target);
+
+// Streams the keys in a text file to `sink`: "KEY:e:n" anywhere on a line
+// (chat logs, packet captures) and lines holding just "e n" (public key
+// files). Returns false if the file cannot be opened.
+bool readCrackTargets(const std::string& filename, const std::function<void(CrackTarget&&)>& sink);
+
+// One rho walk from `seed` looking for a nontrivial factor of an odd
+// composite n. False if the walk closed its cycle without one (retry with
+// another seed) or `stop` was raised.
+bool findFactor(const Modulus128& n, Modulus128& factor, std::uint64_t seed,
+                const std::atomic<bool>* stop = nullptr);
+
+// Factors target.n and derives d. False for moduli that are not the
+// product of two odd primes or whose e has no inverse.
+bool crackKey(const CrackTarget& target, CrackResult& result);
+
+// Finishes a key once some nontrivial factor of n is known, e.g. from a
+// shared-factor scan: checks n = p * q with both prime and derives d
+bool crackKeyWithFactor(const CrackTarget& target, Modulus128 factor, CrackResult& result);
+
+// Cracks every target on `threads` workers (0 = one per hardware thread).
+// With fewer keys than workers, several walks race on each key.
+std::vector<CrackResult> crackKeys(std::span<const CrackTarget> targets, unsigned threads = 0);
+
+// The int-API private key of a broken key from generateKeys(); false if
+// the key is too wide for it
+bool demoPrivateKey(const CrackTarget& target, const CrackResult& result, PrivateKey& priv);
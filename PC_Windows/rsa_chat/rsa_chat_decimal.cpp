@@ -0,0 +1,220 @@
+#include "rsa_chat_decimal.h"
+#include "rsa_chat_simd.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+// Enough for 2^32 - 1
+static constexpr std::size_t kMaxDigits = 10;
+
+// ---------- formatting ----------
+
+static constexpr std::array<char, 200> kDigitPairs = [] {
+    std::array<char, 200> pairs{};
+    for (int i = 0; i < 100; ++i) {
+        pairs[2 * i] = static_cast<char>('0' + i / 10);
+        pairs[2 * i + 1] = static_cast<char>('0' + i % 10);
+    }
+    return pairs;
+}();
+
+static constexpr std::array<std::uint32_t, kMaxDigits> kPowersOf10 = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u,
+};
+
+static unsigned decimalDigits(std::uint32_t value) {
+    // log10 from log2, then one compare to correct it; below 8 it is 1
+    const unsigned guess = (static_cast<unsigned>(std::bit_width(value)) * 1233) >> 12;
+    return guess + (guess == 0 || value >= kPowersOf10[guess] ? 1 : 0);
+}
+
+// Writes the digits ending just before `end`
+static void writeDigits(std::uint32_t value, char* end) {
+    while (value >= 100) {
+        end -= 2;
+        std::memcpy(end, &kDigitPairs[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        std::memcpy(end - 2, &kDigitPairs[2 * value], 2);
+    } else {
+        end[-1] = static_cast<char>('0' + value);
+    }
+}
+
+void appendDecimalList(std::span<const CipherWord> words, DecimalList format, std::string& out) {
+    const char separator = format == DecimalList::Commas ? ',' : ' ';
+    // Sized once for the worst case, trimmed at the end
+    const std::size_t start = out.size();
+    out.resize(start + words.size() * (kMaxDigits + 1));
+    char* dst = out.data() + start;
+    for (std::size_t i = 0; i < words.size(); ++i) {
+        if (i > 0) *dst++ = separator;
+        const unsigned digits = decimalDigits(words[i]);
+        writeDigits(words[i], dst + digits);
+        dst += digits;
+    }
+    out.resize(static_cast<std::size_t>(dst - out.data()));
+}
+
+// ---------- parsing ----------
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+std::size_t decimalListCapacity(std::string_view text, DecimalList format) {
+    if (format == DecimalList::Commas) {
+        return static_cast<std::size_t>(std::count(text.begin(), text.end(), ',')) + 1;
+    }
+    // A digit and a separator each
+    return (text.size() + 1) / 2;
+}
+
+// The digits at p and their value, which is too large for a word when
+// there are more than 10 after any leading zeros
+static std::size_t readLongDigits(const char* p, const char* end, std::uint64_t& value) {
+    value = 0;
+    std::size_t digits = 0;
+    std::size_t significant = 0;
+    while (p + digits < end && static_cast<unsigned char>(p[digits] - '0') < 10) {
+        if (significant < kMaxDigits + 1) value = value * 10 + static_cast<unsigned>(p[digits] - '0');
+        if (value != 0) ++significant;
+        ++digits;
+    }
+    return digits;
+}
+
+static std::size_t readDigitsScalar(const char* p, const char* end, std::uint64_t& value) {
+    value = 0;
+    std::size_t digits = 0;
+    while (p + digits < end && static_cast<unsigned char>(p[digits] - '0') < 10) {
+        if (digits == kMaxDigits) return readLongDigits(p, end, value);
+        value = value * 10 + static_cast<unsigned>(p[digits] - '0');
+        ++digits;
+    }
+    return digits;
+}
+
+// Takes one entry after another with `read`, which gives the digits at p
+// and their value. An entry counts if a separator or the end follows its
+// digits and the value fits a word.
+template <DecimalList Format, typename Read>
+static std::size_t parseEntries(const char* p, const char* end, std::span<CipherWord> out, Read read) {
+    std::size_t count = 0;
+    while (count < out.size()) {
+        if constexpr (Format == DecimalList::Spaces) {
+            while (p < end && isSpace(*p)) ++p;
+        }
+        if (p == end) break;
+
+        std::uint64_t value;
+        const char* next = p + read(p, end, value);
+        const bool separated = next == end || (Format == DecimalList::Commas ? *next == ',' : isSpace(*next));
+        const bool valid = next != p && value <= 0xffffffffu && separated;
+        if (valid) out[count++] = static_cast<CipherWord>(value);
+
+        if constexpr (Format == DecimalList::Spaces) {
+            if (!valid) break;
+            p = next;
+        } else {
+            if (!valid) {
+                const void* comma = std::memchr(next, ',', static_cast<std::size_t>(end - next));
+                next = comma ? static_cast<const char*>(comma) : end;
+            }
+            // Past the comma; a trailing one leaves no entry behind it
+            p = next == end ? end : next + 1;
+        }
+    }
+    return count;
+}
+
+#if defined(RSA_CHAT_X86)
+
+// pshufb masks that move the first n bytes to the top n lanes and zero
+// the rest, so every number lines up with the same place values
+static constexpr std::array<std::array<std::uint8_t, 16>, kMaxDigits + 1> kAlignDigits = [] {
+    std::array<std::array<std::uint8_t, 16>, kMaxDigits + 1> masks{};
+    for (std::size_t n = 0; n <= kMaxDigits; ++n) {
+        for (std::size_t lane = 0; lane < 16; ++lane) {
+            masks[n][lane] = lane >= 16 - n ? static_cast<std::uint8_t>(lane - (16 - n)) : 0x80;
+        }
+    }
+    return masks;
+}();
+
+// One 16-byte load finds where the digits at p stop; near the end of the
+// text, or past 10 digits, the scalar code takes over
+RSA_CHAT_TARGET("sse4.1")
+static std::size_t readDigitsSse41(const char* p, const char* end, std::uint64_t& value) {
+    if (end - p < 16) return readDigitsScalar(p, end, value);
+    const __m128i digits =
+        _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8('0'));
+    // A byte is a digit when, unsigned, it is at most 9
+    const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(isDigit));
+    const auto count = static_cast<unsigned>(std::countr_one(mask));
+    if (count > kMaxDigits) return readLongDigits(p, end, value);
+
+    const __m128i aligned =
+        _mm_shuffle_epi8(digits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(kAlignDigits[count].data())));
+    const __m128i tens = _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1);
+    const __m128i hundreds = _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1);
+    const __m128i tenThousands = _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1);
+    // Pairs of digits, then groups of 4, then of 8
+    const __m128i pairs = _mm_maddubs_epi16(aligned, tens);
+    const __m128i quads = _mm_madd_epi16(pairs, hundreds);
+    const __m128i octets = _mm_madd_epi16(_mm_packus_epi32(quads, quads), tenThousands);
+    const auto high = static_cast<std::uint32_t>(_mm_cvtsi128_si32(octets));
+    const auto low = static_cast<std::uint32_t>(_mm_extract_epi32(octets, 1));
+    value = std::uint64_t{high} * 100000000u + low;
+    return count;
+}
+
+#endif
+
+template <DecimalList Format>
+static std::size_t parseWith(std::string_view text, std::span<CipherWord> out, DecimalKernel kernel) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+#if defined(RSA_CHAT_X86)
+    if (kernel == DecimalKernel::Sse41 && decimalKernelSupported(kernel)) {
+        return parseEntries<Format>(p, end, out, readDigitsSse41);
+    }
+#else
+    (void)kernel;
+#endif
+    return parseEntries<Format>(p, end, out, readDigitsScalar);
+}
+
+// ---------- dispatch ----------
+
+bool decimalKernelSupported(DecimalKernel kernel) {
+    switch (kernel) {
+    case DecimalKernel::Scalar: return true;
+    case DecimalKernel::Sse41: return cpuHasSse41();
+    }
+    return false;
+}
+
+DecimalKernel decimalDefaultKernel() {
+    static const DecimalKernel kernel =
+        decimalKernelSupported(DecimalKernel::Sse41) ? DecimalKernel::Sse41 : DecimalKernel::Scalar;
+    return kernel;
+}
+
+const char* decimalKernelName(DecimalKernel kernel) {
+    switch (kernel) {
+    case DecimalKernel::Scalar: return "scalar";
+    case DecimalKernel::Sse41: return "sse4.1";
+    }
+    return "unknown";
+}
+
+std::size_t parseDecimalList(std::string_view text, DecimalList format, std::span<CipherWord> out,
+                             DecimalKernel kernel) {
+    return format == DecimalList::Commas ? parseWith<DecimalList::Commas>(text, out, kernel)
+                                         : parseWith<DecimalList::Spaces>(text, out, kernel);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Ciphertext as decimal text, for peers without XMSG frames and for the
+// cipher files written by saveCipherToFile(). Formatting writes two
+// digits at a time from a table straight into the output string; parsing
+// finds the digits of each number with one 16-byte compare and converts
+// them with multiply-adds (SSE4.1), or one digit at a time elsewhere.
+// Neither allocates per number, and all kernels give identical results.
+
+enum class DecimalList {
+    // "12,345,6", the legacy message body. Empty or malformed entries
+    // are skipped.
+    Commas,
+    // "12 345 6", cipher files. Any run of whitespace separates entries,
+    // and parsing stops at the first malformed one.
+    Spaces,
+};
+
+enum class DecimalKernel {
+    Scalar,
+    Sse41,
+};
+
+// Best kernel this CPU supports, detected once
+DecimalKernel decimalDefaultKernel();
+
+bool decimalKernelSupported(DecimalKernel kernel);
+
+const char* decimalKernelName(DecimalKernel kernel);
+
+// Appends the words separated by ',' or ' '
+void appendDecimalList(std::span<const CipherWord> words, DecimalList format, std::string& out);
+
+// Most entries `text` can hold, for sizing the output of parseDecimalList()
+std::size_t decimalListCapacity(std::string_view text, DecimalList format);
+
+// Parses up to out.size() entries of at most 10 digits and 2^32 - 1 into
+// `out`; returns how many
+std::size_t parseDecimalList(std::string_view text, DecimalList format, std::span<CipherWord> out,
+                             DecimalKernel kernel = decimalDefaultKernel());
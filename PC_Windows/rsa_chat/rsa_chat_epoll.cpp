@@ -0,0 +1,399 @@
+#include "rsa_chat_epoll.h"
+#include "rsa_chat_socket.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static constexpr int kMaxEvents = 256;
+static constexpr std::size_t kReadBufferBytes = 64 * 1024;
+
+// The top byte of epoll_event.data says what is ready, the rest is the
+// connection (or the index of a watched fd)
+enum class Source : std::uint64_t {
+    Listener = 1,
+    Connection = 2,
+    Watch = 3,
+};
+
+static constexpr unsigned kSourceShift = 56;
+
+static std::uint64_t eventData(Source source, std::uint64_t id) {
+    return static_cast<std::uint64_t>(source) << kSourceShift | id;
+}
+
+class EpollTransport final : public Transport {
+public:
+    EpollTransport() = default;
+    ~EpollTransport() override;
+
+    EpollTransport(const EpollTransport&) = delete;
+    EpollTransport& operator=(const EpollTransport&) = delete;
+
+    bool init();
+
+    bool listen(std::uint16_t port) override;
+    std::uint16_t localPort() const override { return m_port; }
+    ConnectionId connect(const std::string& host, std::uint16_t port) override;
+    ConnectionId connectAsync(const std::string& host, std::uint16_t port) override;
+    void send(ConnectionId id, std::string_view data) override;
+    void flush() override;
+    std::size_t pendingBytes(ConnectionId id) const override;
+    void close(ConnectionId id) override;
+    void setReceiving(ConnectionId id, bool enabled) override;
+    std::string peerAddress(ConnectionId id) const override;
+    void tune(ConnectionId id, const TcpTuning& tuning) override;
+    void poll(int timeoutMs) override;
+    void watch(int fd) override;
+    int waitFd() const override { return m_epollFd; }
+    bool prepareWait() override;
+    const char* name() const override { return "epoll"; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string pending;   // queued, not yet taken by the socket
+        std::size_t written = 0; // bytes of pending already written
+        bool dirty = false;    // listed in m_dirty
+        bool closing = false;
+        bool blocked = false;  // the socket was full; EPOLLOUT resumes it
+        bool connecting = false; // connectAsync() still waiting; blocked too
+        bool paused = false;   // setReceiving(false): the socket is not read
+        bool hungUp = false;   // seen while paused, reported on resume
+    };
+
+    ConnectionId addConnection(int fd);
+    void onWritable(ConnectionId id);
+    void markDirty(ConnectionId id, Connection& conn);
+    bool writePending(Connection& conn);
+    void reportDrained();
+    void onAccept();
+    void onReadable(ConnectionId id, bool hangup);
+    void finish(ConnectionId id);
+
+    int m_epollFd = -1;
+    int m_listenFd = -1;
+    // Held open so that with every other descriptor taken a pending
+    // connection can still be accepted and shut, see onAccept()
+    int m_spareFd = -1;
+    std::uint16_t m_port = 0;
+    ConnectionId m_nextId = 0;
+    std::unordered_map<ConnectionId, Connection> m_connections;
+    std::vector<ConnectionId> m_dirty;
+    // Emptied by the last flush or EPOLLOUT, for the drained handler
+    std::vector<ConnectionId> m_drained;
+    bool m_reportingDrained = false;
+    // Receiving again; read at the next poll(), as no new edge may come
+    std::vector<ConnectionId> m_resumed;
+    std::vector<int> m_watchFds;
+    std::unique_ptr<char[]> m_readBuffer{new char[kReadBufferBytes]};
+};
+
+EpollTransport::~EpollTransport() {
+    for (auto& [id, conn] : m_connections) ::close(conn.fd);
+    if (m_listenFd >= 0) ::close(m_listenFd);
+    if (m_spareFd >= 0) ::close(m_spareFd);
+    if (m_epollFd >= 0) ::close(m_epollFd);
+}
+
+bool EpollTransport::init() {
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    return m_epollFd >= 0;
+}
+
+ConnectionId EpollTransport::addConnection(int fd) {
+    const ConnectionId id = ++m_nextId;
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    setNoDelay(fd);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = eventData(Source::Connection, id);
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    m_connections[id].fd = fd;
+    return id;
+}
+
+bool EpollTransport::listen(std::uint16_t port) {
+    const int fd = listenSocket(port, SOCK_NONBLOCK, m_port);
+    if (fd < 0) return false;
+    m_listenFd = fd;
+    if (m_spareFd < 0) m_spareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = eventData(Source::Listener, 0);
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    return true;
+}
+
+ConnectionId EpollTransport::connect(const std::string& host, std::uint16_t port) {
+    // Blocking connect, then non-blocking from here on
+    const int fd = connectSocket(host, port);
+    if (fd < 0) return 0;
+    return addConnection(fd);
+}
+
+ConnectionId EpollTransport::connectAsync(const std::string& host, std::uint16_t port) {
+    sockaddr_storage addr{};
+    socklen_t addrLen = 0;
+    if (!resolveFirst(host, port, addr, addrLen)) return 0;
+
+    const int fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    const bool started =
+        fd >= 0 && (::connect(fd, reinterpret_cast<sockaddr*>(&addr), addrLen) == 0 || errno == EINPROGRESS);
+    if (!started) {
+        if (fd >= 0) ::close(fd);
+        return 0;
+    }
+    // EPOLLOUT says how it went; sends wait for it like for a full socket
+    const ConnectionId id = addConnection(fd);
+    Connection& conn = m_connections[id];
+    conn.connecting = true;
+    conn.blocked = true;
+    return id;
+}
+
+void EpollTransport::markDirty(ConnectionId id, Connection& conn) {
+    if (conn.dirty) return;
+    conn.dirty = true;
+    m_dirty.push_back(id);
+}
+
+void EpollTransport::send(ConnectionId id, std::string_view data) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing || data.empty()) return;
+    it->second.pending.append(data);
+    markDirty(id, it->second);
+}
+
+// True if everything queued is now with the kernel
+bool EpollTransport::writePending(Connection& conn) {
+    while (conn.written < conn.pending.size()) {
+        const ssize_t n = ::send(conn.fd, conn.pending.data() + conn.written, conn.pending.size() - conn.written,
+                                 MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.written += static_cast<std::size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            conn.blocked = true;
+            return false;
+        }
+        // The peer is gone; the read side reports it
+        conn.pending.clear();
+        conn.written = 0;
+        conn.closing = true;
+        break;
+    }
+    conn.pending.clear();
+    conn.written = 0;
+    // Wakes the read side, which then finishes the connection
+    if (conn.closing) ::shutdown(conn.fd, SHUT_RDWR);
+    return !conn.closing;
+}
+
+void EpollTransport::flush() {
+    for (ConnectionId id : m_dirty) {
+        auto it = m_connections.find(id);
+        if (it == m_connections.end()) continue;
+        Connection& conn = it->second;
+        conn.dirty = false;
+        // A blocked connection is picked up again by EPOLLOUT
+        if (!conn.blocked && writePending(conn)) m_drained.push_back(id);
+    }
+    m_dirty.clear();
+    reportDrained();
+}
+
+// After the writes, as the handlers may send and flush again; what those
+// drain is reported by the same loop
+void EpollTransport::reportDrained() {
+    if (m_reportingDrained) return;
+    m_reportingDrained = true;
+    for (std::size_t i = 0; i < m_drained.size(); ++i) {
+        if (m_handlers.drained) m_handlers.drained(m_drained[i]);
+    }
+    m_drained.clear();
+    m_reportingDrained = false;
+}
+
+std::size_t EpollTransport::pendingBytes(ConnectionId id) const {
+    auto it = m_connections.find(id);
+    return it == m_connections.end() ? 0 : it->second.pending.size() - it->second.written;
+}
+
+std::string EpollTransport::peerAddress(ConnectionId id) const {
+    auto it = m_connections.find(id);
+    return it == m_connections.end() ? std::string() : socketPeer(it->second.fd);
+}
+
+void EpollTransport::tune(ConnectionId id, const TcpTuning& tuning) {
+    auto it = m_connections.find(id);
+    if (it != m_connections.end()) tuneSocket(it->second.fd, tuning);
+}
+
+bool EpollTransport::prepareWait() {
+    flush();
+    return m_resumed.empty();
+}
+
+void EpollTransport::close(ConnectionId id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing) return;
+    Connection& conn = it->second;
+    conn.closing = true;
+    // Otherwise writePending() does this once the backlog is out
+    if (conn.pending.empty()) ::shutdown(conn.fd, SHUT_RDWR);
+    // Only the read side sees the connection end
+    setReceiving(id, true);
+}
+
+void EpollTransport::setReceiving(ConnectionId id, bool enabled) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.paused == !enabled) return;
+    it->second.paused = !enabled;
+    if (enabled) m_resumed.push_back(id);
+}
+
+void EpollTransport::watch(int fd) {
+    // Level-triggered: it keeps ending the wait until the owner reads it
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = eventData(Source::Watch, m_watchFds.size());
+    m_watchFds.push_back(fd);
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void EpollTransport::poll(int timeoutMs) {
+    flush();
+    epoll_event events[kMaxEvents];
+    const int count = ::epoll_wait(m_epollFd, events, kMaxEvents, m_resumed.empty() ? timeoutMs : 0);
+    for (int i = 0; i < count; ++i) {
+        const auto source = static_cast<Source>(events[i].data.u64 >> kSourceShift);
+        const std::uint64_t id = events[i].data.u64 & ((std::uint64_t(1) << kSourceShift) - 1);
+        switch (source) {
+        case Source::Listener: onAccept(); break;
+        case Source::Watch: break;
+        case Source::Connection: {
+            if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) onWritable(id);
+            const bool hangup = events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+            if (hangup || (events[i].events & EPOLLIN)) onReadable(id, hangup);
+            break;
+        }
+        }
+    }
+
+    // Whatever waited in the socket while it was paused
+    std::vector<ConnectionId> resumed;
+    resumed.swap(m_resumed);
+    for (ConnectionId id : resumed) {
+        auto it = m_connections.find(id);
+        if (it != m_connections.end() && !it->second.paused) onReadable(id, it->second.hungUp);
+    }
+}
+
+void EpollTransport::onWritable(ConnectionId id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || !it->second.blocked) return;
+    Connection& conn = it->second;
+    if (conn.connecting) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (::getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) error = errno;
+        // A refused or timed-out connect: the read side finds the error
+        // and reports the connection closed
+        if (error != 0) return;
+        conn.connecting = false;
+        if (m_handlers.connected) m_handlers.connected(id);
+        it = m_connections.find(id);
+        if (it == m_connections.end()) return;
+    }
+    it->second.blocked = false;
+    // Also here for a fresh connection with nothing queued
+    if (it->second.pending.empty()) return;
+    if (writePending(it->second)) {
+        m_drained.push_back(id);
+        reportDrained();
+    }
+}
+
+void EpollTransport::onAccept() {
+    for (;;) {
+        const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            // Out of descriptors, the connection stays queued and the
+            // level-triggered listener would report it again at once,
+            // forever. The spare descriptor makes room to take it and
+            // hang up, so the peer sees a close instead of a hang.
+            if ((errno != EMFILE && errno != ENFILE) || m_spareFd < 0) return;
+            ::close(m_spareFd);
+            const int shed = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (shed >= 0) ::close(shed);
+            m_spareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            if (shed < 0) return;
+            continue;
+        }
+        const ConnectionId id = addConnection(fd);
+        if (m_handlers.accepted) m_handlers.accepted(id);
+    }
+}
+
+// Edge-triggered, so the socket is read until it is empty. A short read
+// already says so, as anything arriving after it raises a new edge, but
+// after a hangup the read that returns 0 must still come.
+void EpollTransport::onReadable(ConnectionId id, bool hangup) {
+    for (;;) {
+        auto it = m_connections.find(id);
+        if (it == m_connections.end()) return;
+        // Stopped mid-read by a handler, or before it: left in the socket
+        if (it->second.paused) {
+            it->second.hungUp |= hangup;
+            return;
+        }
+        const ssize_t n = ::recv(it->second.fd, m_readBuffer.get(), kReadBufferBytes, 0);
+        if (n > 0) {
+            if (m_handlers.received) {
+                m_handlers.received(id, std::string_view(m_readBuffer.get(), static_cast<std::size_t>(n)));
+            }
+            if (!hangup && static_cast<std::size_t>(n) < kReadBufferBytes) return;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        // 0 is an orderly shutdown, anything else an error
+        finish(id);
+        return;
+    }
+}
+
+void EpollTransport::finish(ConnectionId id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) return;
+    // Closing the fd also takes it out of the epoll set
+    ::close(it->second.fd);
+    m_connections.erase(it);
+    if (m_handlers.closed) m_handlers.closed(id);
+}
+
+std::unique_ptr<Transport> makeEpollTransport() {
+    auto transport = std::make_unique<EpollTransport>();
+    if (!transport->init()) return nullptr;
+    return transport;
+}
+
+#else
+
+std::unique_ptr<Transport> makeEpollTransport() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+
+#include <memory>
+
+// Readiness-based backend of Transport on a plain epoll loop, for
+// kernels without io_uring and for code that wants the classic model:
+//
+//  - sockets are non-blocking and registered edge-triggered once, so a
+//    busy connection costs no epoll_ctl calls
+//  - sends are appended to a per-connection buffer and written at the
+//    next flush() or poll(); whatever the socket does not take waits for
+//    EPOLLOUT
+//  - reads go through one buffer shared by every connection
+//
+// Returns nullptr on non-Linux systems.
+std::unique_ptr<Transport> makeEpollTransport();
@@ -0,0 +1,132 @@
+#include "rsa_chat_lz.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+static constexpr std::size_t kMinMatch = 4;
+static constexpr std::size_t kMaxOffset = 65535;
+static constexpr int kHashBits = 12;
+
+static std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static std::uint32_t hash4(std::uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+static void writeLength(std::string& out, std::size_t len) {
+    len -= 15;
+    while (len >= 255) {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+static bool readLength(const unsigned char* in, std::size_t size, std::size_t& ip, std::size_t& len) {
+    while (true) {
+        if (ip >= size) return false;
+        unsigned char b = in[ip++];
+        len += b;
+        if (b != 255) return true;
+    }
+}
+
+// One sequence: token, literal run, then (unless it is the last one) a
+// back-reference. matchLen == 0 marks the final literal-only sequence.
+static void emitSequence(std::string& out, const unsigned char* literals, std::size_t litLen,
+                         std::size_t matchLen, std::size_t offset) {
+    std::size_t matchCode = matchLen ? matchLen - kMinMatch : 0;
+    unsigned char token = static_cast<unsigned char>(((litLen < 15 ? litLen : 15) << 4) |
+                                                     (matchCode < 15 ? matchCode : 15));
+    out.push_back(static_cast<char>(token));
+    if (litLen >= 15) writeLength(out, litLen);
+    out.append(reinterpret_cast<const char*>(literals), litLen);
+
+    if (matchLen == 0) return;
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) writeLength(out, matchCode);
+}
+
+std::string lzCompress(const std::string& input) {
+    const auto* src = reinterpret_cast<const unsigned char*>(input.data());
+    const std::size_t size = input.size();
+
+    std::string out;
+    out.reserve(size + size / 255 + 16);
+
+    std::array<std::uint32_t, 1u << kHashBits> table{};
+    std::size_t anchor = 0;
+    std::size_t ip = 0;
+
+    while (ip + kMinMatch <= size) {
+        std::uint32_t seq = read32(src + ip);
+        std::uint32_t h = hash4(seq);
+        std::size_t cand = table[h];
+        table[h] = static_cast<std::uint32_t>(ip);
+
+        if (cand < ip && ip - cand <= kMaxOffset && read32(src + cand) == seq) {
+            std::size_t len = kMinMatch;
+            while (ip + len < size && src[cand + len] == src[ip + len]) ++len;
+
+            emitSequence(out, src + anchor, ip - anchor, len, ip - cand);
+            ip += len;
+            anchor = ip;
+        } else {
+            // Skip faster through data that keeps missing
+            ip += 1 + ((ip - anchor) >> 6);
+        }
+    }
+
+    emitSequence(out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+bool lzDecompress(const std::string& input, std::size_t plainSize, std::string& output) {
+    output.assign(plainSize, '\0');
+    return lzDecompress(std::string_view(input), output.data(), plainSize);
+}
+
+bool lzDecompress(std::string_view input, char* output, std::size_t plainSize) {
+    const auto* in = reinterpret_cast<const unsigned char*>(input.data());
+    const std::size_t size = input.size();
+
+    std::size_t ip = 0;
+    std::size_t op = 0;
+
+    while (ip < size) {
+        unsigned char token = in[ip++];
+
+        std::size_t litLen = token >> 4;
+        if (litLen == 15 && !readLength(in, size, ip, litLen)) return false;
+        if (litLen > size - ip || litLen > plainSize - op) return false;
+        std::memcpy(&output[op], in + ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        if (ip == size) break;
+
+        if (size - ip < 2) return false;
+        std::size_t offset = in[ip] | (static_cast<std::size_t>(in[ip + 1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        std::size_t matchLen = token & 15;
+        if (matchLen == 15 && !readLength(in, size, ip, matchLen)) return false;
+        matchLen += kMinMatch;
+        if (matchLen > plainSize - op) return false;
+
+        // Byte-wise copy: the source may overlap the bytes being written
+        for (std::size_t i = 0; i < matchLen; ++i) {
+            output[op + i] = output[op - offset + i];
+        }
+        op += matchLen;
+    }
+
+    return op == plainSize;
+}
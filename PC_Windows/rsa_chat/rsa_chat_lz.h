@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Small LZ77 block codec (LZ4-style token/literal/offset layout) used to
+// shrink payloads before they are encrypted byte by byte.
+
+std::string lzCompress(const std::string& input);
+
+// Returns false if `input` is not a valid block or does not expand to
+// exactly `plainSize` bytes.
+bool lzDecompress(const std::string& input, std::size_t plainSize, std::string& output);
+
+// Same, into a caller-provided buffer of exactly `plainSize` bytes
+bool lzDecompress(std::string_view input, char* output, std::size_t plainSize);
@@ -0,0 +1,189 @@
+#include "rsa_chat_metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+struct HistogramShard {
+    std::array<std::atomic<std::uint64_t>, kHistogramBuckets> buckets{};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> max{0};
+};
+
+// Only the owning thread writes a shard, so plain load/store pairs are
+// enough; readers may see a slightly stale value, never a torn one.
+struct Shard {
+    std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+    std::array<HistogramShard, kHistogramCount> histograms;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::deque<Shard> shards;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+} // namespace
+
+static Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+static Shard& localShard() {
+    thread_local Shard* shard = nullptr;
+    if (!shard) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        shard = &reg.shards.emplace_back();
+    }
+    return *shard;
+}
+
+static void bump(std::atomic<std::uint64_t>& slot, std::uint64_t value) {
+    slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static std::size_t bucketIndex(std::uint64_t v) {
+    if (v < 16) return static_cast<std::size_t>(v);
+    int e = std::bit_width(v) - 1;
+    std::size_t sub = static_cast<std::size_t>(v >> (e - 3)) & 7;
+    return 16 + static_cast<std::size_t>(e - 4) * 8 + sub;
+}
+
+// Representative value (middle of the bucket) reported for percentiles
+static std::uint64_t bucketValue(std::size_t index) {
+    if (index < 16) return index;
+    int e = static_cast<int>((index - 16) / 8) + 4;
+    std::uint64_t sub = (index - 16) % 8;
+    std::uint64_t width = std::uint64_t{1} << (e - 3);
+    return (8 + sub) * width + width / 2;
+}
+
+void metricsAdd(Counter counter, std::uint64_t value) {
+    bump(localShard().counters[static_cast<std::size_t>(counter)], value);
+}
+
+void metricsRecord(Histogram histogram, std::uint64_t nanoseconds) {
+    HistogramShard& h = localShard().histograms[static_cast<std::size_t>(histogram)];
+    bump(h.buckets[bucketIndex(nanoseconds)], 1);
+    bump(h.sum, nanoseconds);
+    if (nanoseconds > h.max.load(std::memory_order_relaxed)) {
+        h.max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+MetricsSnapshot metricsSnapshot() {
+    MetricsSnapshot snap;
+    std::array<std::array<std::uint64_t, kHistogramBuckets>, kHistogramCount> buckets{};
+
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const Shard& shard : reg.shards) {
+            for (std::size_t i = 0; i < kCounterCount; ++i) {
+                snap.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+            }
+            for (std::size_t i = 0; i < kHistogramCount; ++i) {
+                const HistogramShard& h = shard.histograms[i];
+                for (std::size_t b = 0; b < kHistogramBuckets; ++b) {
+                    buckets[i][b] += h.buckets[b].load(std::memory_order_relaxed);
+                }
+                snap.histograms[i].sumNs += h.sum.load(std::memory_order_relaxed);
+                std::uint64_t max = h.max.load(std::memory_order_relaxed);
+                if (max > snap.histograms[i].maxNs) snap.histograms[i].maxNs = max;
+            }
+        }
+    }
+    snap.uptimeSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - reg.start).count();
+
+    for (std::size_t i = 0; i < kHistogramCount; ++i) {
+        HistogramSummary& s = snap.histograms[i];
+        for (std::uint64_t c : buckets[i]) s.count += c;
+        if (s.count == 0) continue;
+
+        // Ceiling ranks, so p99 of 100 samples is the 99th sample
+        const std::uint64_t ranks[3] = {(s.count * 50 + 99) / 100, (s.count * 90 + 99) / 100,
+                                        (s.count * 99 + 99) / 100};
+        std::uint64_t* outs[3] = {&s.p50Ns, &s.p90Ns, &s.p99Ns};
+        std::uint64_t seen = 0;
+        std::size_t next = 0;
+        for (std::size_t b = 0; b < kHistogramBuckets && next < 3; ++b) {
+            seen += buckets[i][b];
+            while (next < 3 && seen >= ranks[next]) {
+                *outs[next] = std::min(bucketValue(b), s.maxNs);
+                ++next;
+            }
+        }
+    }
+    return snap;
+}
+
+const char* counterName(Counter counter) {
+    switch (counter) {
+    case Counter::BytesEncrypted: return "bytes_encrypted";
+    case Counter::BytesDecrypted: return "bytes_decrypted";
+    case Counter::BytesSent: return "bytes_sent";
+    case Counter::BytesReceived: return "bytes_received";
+    case Counter::MessagesSent: return "messages_sent";
+    case Counter::MessagesReceived: return "messages_received";
+    case Counter::KeysGenerated: return "keys_generated";
+    case Counter::SocketWrites: return "socket_writes";
+    case Counter::ReceiveArenaSpills: return "receive_arena_spills";
+    case Counter::Count: break;
+    }
+    return "unknown";
+}
+
+const char* histogramName(Histogram histogram) {
+    switch (histogram) {
+    case Histogram::Encrypt: return "encrypt";
+    case Histogram::Decrypt: return "decrypt";
+    case Histogram::GenerateKeys: return "generate_keys";
+    case Histogram::Parse: return "parse";
+    case Histogram::SocketWrite: return "socket_write";
+    case Histogram::Count: break;
+    }
+    return "unknown";
+}
+
+std::string metricsToJson(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{\n  \"uptime_s\": " << snapshot.uptimeSeconds << ",\n  \"counters\": {";
+    for (std::size_t i = 0; i < kCounterCount; ++i) {
+        out << (i ? ", " : "") << "\"" << counterName(static_cast<Counter>(i))
+            << "\": " << snapshot.counters[i];
+    }
+    out << "},\n  \"rates_per_s\": {";
+    for (std::size_t i = 0; i < kCounterCount; ++i) {
+        double rate = snapshot.uptimeSeconds > 0 ? snapshot.counters[i] / snapshot.uptimeSeconds : 0.0;
+        out << (i ? ", " : "") << "\"" << counterName(static_cast<Counter>(i)) << "\": " << rate;
+    }
+    out << "},\n  \"histograms\": {";
+    for (std::size_t i = 0; i < kHistogramCount; ++i) {
+        const HistogramSummary& h = snapshot.histograms[i];
+        out << (i ? "," : "") << "\n    \"" << histogramName(static_cast<Histogram>(i))
+            << "\": {\"count\": " << h.count
+            << ", \"mean_ns\": " << (h.count ? h.sumNs / h.count : 0)
+            << ", \"p50_ns\": " << h.p50Ns
+            << ", \"p90_ns\": " << h.p90Ns
+            << ", \"p99_ns\": " << h.p99Ns
+            << ", \"max_ns\": " << h.maxNs << "}";
+    }
+    out << "\n  }\n}\n";
+    return out.str();
+}
+
+bool metricsDumpJson(const std::string& filename) {
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) return false;
+    file << metricsToJson(metricsSnapshot());
+    return static_cast<bool>(file);
+}
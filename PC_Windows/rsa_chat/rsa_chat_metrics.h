@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Process-wide counters and latency histograms for the hot paths.
+// Every thread records into its own shard, so recording never takes a
+// lock; metricsSnapshot() sums the shards.
+
+enum class Counter {
+    BytesEncrypted,
+    BytesDecrypted,
+    BytesSent,
+    BytesReceived,
+    MessagesSent,
+    MessagesReceived,
+    KeysGenerated,
+    SocketWrites,
+    ReceiveArenaSpills,
+    Count
+};
+
+enum class Histogram {
+    Encrypt,
+    Decrypt,
+    GenerateKeys,
+    Parse,
+    SocketWrite,
+    Count
+};
+
+constexpr std::size_t kCounterCount = static_cast<std::size_t>(Counter::Count);
+constexpr std::size_t kHistogramCount = static_cast<std::size_t>(Histogram::Count);
+
+// Log-linear buckets: 16 exact buckets, then 8 sub-buckets per power of
+// two, so any recorded value is off by at most 12.5%.
+constexpr std::size_t kHistogramBuckets = 16 + 60 * 8;
+
+struct HistogramSummary {
+    std::uint64_t count = 0;
+    std::uint64_t sumNs = 0;
+    std::uint64_t maxNs = 0;
+    std::uint64_t p50Ns = 0;
+    std::uint64_t p90Ns = 0;
+    std::uint64_t p99Ns = 0;
+};
+
+struct MetricsSnapshot {
+    double uptimeSeconds = 0.0;
+    std::array<std::uint64_t, kCounterCount> counters{};
+    std::array<HistogramSummary, kHistogramCount> histograms{};
+};
+
+void metricsAdd(Counter counter, std::uint64_t value = 1);
+
+void metricsRecord(Histogram histogram, std::uint64_t nanoseconds);
+
+MetricsSnapshot metricsSnapshot();
+
+const char* counterName(Counter counter);
+
+const char* histogramName(Histogram histogram);
+
+std::string metricsToJson(const MetricsSnapshot& snapshot);
+
+bool metricsDumpJson(const std::string& filename);
+
+// Records the lifetime of the scope into a histogram
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram histogram)
+        : m_histogram(histogram), m_start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        metricsRecord(m_histogram, static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
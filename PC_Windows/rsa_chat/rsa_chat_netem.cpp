@@ -0,0 +1,63 @@
+#include "rsa_chat_netem.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool parseLinkProfile(std::string_view name, LinkConditions& conditions) {
+    // Rough one-way figures; a round trip pays the latency twice
+    if (name == "lan") {
+        conditions = {0.5, 0.1, 100000, 0, 0};
+    } else if (name == "wifi") {
+        conditions = {5, 3, 40000, 1460, 0};
+    } else if (name == "congested-wifi") {
+        conditions = {30, 25, 4000, 536, 600};
+    } else if (name == "mobile") {
+        conditions = {60, 20, 8000, 1400, 300};
+    } else {
+        return false;
+    }
+    return true;
+}
+
+EmulatedLink::EmulatedLink(const LinkConditions& conditions, std::uint64_t seed)
+    : m_conditions(conditions), m_random(seed) {}
+
+// In [0, 1), from the top 53 bits
+double EmulatedLink::uniform() {
+    return static_cast<double>(m_random() >> 11) * 0x1.0p-53;
+}
+
+void EmulatedLink::push(Clock::time_point now, std::string_view data) {
+    using Duration = std::chrono::duration<double, std::milli>;
+    const std::size_t piece = m_conditions.fragmentBytes ? m_conditions.fragmentBytes : data.size();
+    while (!data.empty()) {
+        const std::string_view fragment = data.substr(0, piece);
+        data.remove_prefix(fragment.size());
+
+        Clock::time_point sent = now;
+        if (m_conditions.rateKbps > 0) {
+            // kbit/s is bits per millisecond
+            const double transmitMs = static_cast<double>(fragment.size()) * 8 / m_conditions.rateKbps;
+            sent = std::max(now, m_linkFree) + std::chrono::duration_cast<Clock::duration>(Duration(transmitMs));
+            m_linkFree = sent;
+        }
+        const double delayMs =
+            std::max(0.0, m_conditions.latencyMs + m_conditions.jitterMs * (2 * uniform() - 1));
+        const Clock::time_point due =
+            std::max(m_lastDue, sent + std::chrono::duration_cast<Clock::duration>(Duration(delayMs)));
+        m_lastDue = due;
+
+        m_queue.push_back({due, std::string(fragment)});
+        m_queued += fragment.size();
+    }
+}
+
+EmulatedLink::Clock::time_point EmulatedLink::nextDue() const {
+    return m_queue.empty() ? Clock::time_point::max() : m_queue.front().due;
+}
+
+EmulatedLink::Clock::time_point EmulatedLink::dropAt(Clock::time_point start) {
+    if (m_conditions.dropMeanSeconds <= 0) return Clock::time_point::max();
+    const double seconds = -m_conditions.dropMeanSeconds * std::log1p(-uniform());
+    return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+}
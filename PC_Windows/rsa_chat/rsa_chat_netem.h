@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <string_view>
+
+// Emulated network conditions for one direction of a proxied connection.
+// Everything random comes from a seeded mt19937_64 and is drawn without
+// the std distributions, so a seed gives the same run on every platform.
+
+struct LinkConditions {
+    double latencyMs = 0;
+    // Each fragment is delayed by latency plus up to +-jitter, uniform
+    double jitterMs = 0;
+    // Bandwidth cap in kbit/s; 0 = unlimited
+    double rateKbps = 0;
+    // Bytes are forwarded in pieces of at most this size; 0 = as read
+    std::size_t fragmentBytes = 0;
+    // Mean seconds until the connection is cut, exponentially
+    // distributed; 0 = never
+    double dropMeanSeconds = 0;
+};
+
+// "lan", "wifi", "congested-wifi" and "mobile"
+bool parseLinkProfile(std::string_view name, LinkConditions& conditions);
+
+// Bytes handed to push() come out of deliver() in the same order, each
+// fragment once its due time has passed. A stream cannot reorder, so a
+// fragment whose jitter would overtake the one before it waits for it.
+class EmulatedLink {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    EmulatedLink(const LinkConditions& conditions, std::uint64_t seed);
+
+    void push(Clock::time_point now, std::string_view data);
+
+    // Clock::time_point::max() when nothing is queued
+    Clock::time_point nextDue() const;
+
+    // Calls send(fragment) for everything due by now; returns the bytes
+    template <typename Send>
+    std::size_t deliver(Clock::time_point now, Send&& send) {
+        std::size_t bytes = 0;
+        while (!m_queue.empty() && m_queue.front().due <= now) {
+            send(std::string_view(m_queue.front().data));
+            bytes += m_queue.front().data.size();
+            m_queued -= m_queue.front().data.size();
+            m_queue.pop_front();
+        }
+        return bytes;
+    }
+
+    std::size_t queuedBytes() const { return m_queued; }
+
+    // When this connection is to be cut; Clock::time_point::max() if never
+    Clock::time_point dropAt(Clock::time_point start);
+
+private:
+    struct Fragment {
+        Clock::time_point due;
+        std::string data;
+    };
+
+    double uniform();
+
+    LinkConditions m_conditions;
+    std::mt19937_64 m_random;
+    std::deque<Fragment> m_queue;
+    std::size_t m_queued = 0;
+    // The bandwidth cap serialises fragments: the next one starts when
+    // this one is done
+    Clock::time_point m_linkFree{};
+    Clock::time_point m_lastDue{};
+};
@@ -0,0 +1,189 @@
+#include "rsa_chat_probe.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+static constexpr std::string_view kPingPrefix = "PING:";
+static constexpr std::string_view kPongPrefix = "PONG:";
+
+template <typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+
+// Splits off the text up to the next `sep`; false once `rest` is used up
+static bool nextField(std::string_view& rest, char sep, std::string_view& field) {
+    if (rest.data() == nullptr) return false;
+    const std::size_t pos = rest.find(sep);
+    field = rest.substr(0, pos);
+    rest = pos == std::string_view::npos ? std::string_view() : rest.substr(pos + 1);
+    return true;
+}
+
+std::uint64_t probeClockUs() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+// ---------- lines ----------
+
+std::string buildPingLine(const ProbePing& ping) {
+    std::string line(kPingPrefix);
+    line += std::to_string(ping.seq);
+    line += ':';
+    line += std::to_string(ping.sentUs);
+    line += '\n';
+    return line;
+}
+
+std::string buildPongLine(const ProbePong& pong) {
+    std::string line(kPongPrefix);
+    line += std::to_string(pong.seq);
+    line += ':';
+    line += std::to_string(pong.sentUs);
+    line += ':';
+    line += std::to_string(pong.holdUs);
+    line += ":enc=";
+    line += std::to_string(pong.stages.encryptNs);
+    line += ";dec=";
+    line += std::to_string(pong.stages.decryptNs);
+    line += ";parse=";
+    line += std::to_string(pong.stages.parseNs);
+    line += '\n';
+    return line;
+}
+
+bool parsePingLine(std::string_view line, ProbePing& ping) {
+    if (!line.starts_with(kPingPrefix)) return false;
+    std::string_view rest = line.substr(kPingPrefix.size());
+    std::string_view seq, sent;
+    return nextField(rest, ':', seq) && nextField(rest, ':', sent) && rest.data() == nullptr &&
+           parseNumber(seq, ping.seq) && parseNumber(sent, ping.sentUs);
+}
+
+bool parsePongLine(std::string_view line, ProbePong& pong) {
+    if (!line.starts_with(kPongPrefix)) return false;
+    std::string_view rest = line.substr(kPongPrefix.size());
+    std::string_view seq, sent, hold;
+    if (!nextField(rest, ':', seq) || !nextField(rest, ':', sent) || !nextField(rest, ':', hold) ||
+        !parseNumber(seq, pong.seq) || !parseNumber(sent, pong.sentUs) || !parseNumber(hold, pong.holdUs)) {
+        return false;
+    }
+
+    // Unknown attributes are skipped so later versions can add stages
+    pong.stages = StageTimes{};
+    std::string_view attribute;
+    while (nextField(rest, ';', attribute)) {
+        const std::size_t eq = attribute.find('=');
+        if (eq == std::string_view::npos) return false;
+        const std::string_view key = attribute.substr(0, eq);
+        std::uint64_t value = 0;
+        if (!parseNumber(attribute.substr(eq + 1), value)) return false;
+        if (key == "enc") pong.stages.encryptNs = value;
+        else if (key == "dec") pong.stages.decryptNs = value;
+        else if (key == "parse") pong.stages.parseNs = value;
+    }
+    return true;
+}
+
+// ---------- stage sampling ----------
+
+StageTimes StageSampler::sample() {
+    static constexpr Histogram kStages[] = {Histogram::Encrypt, Histogram::Decrypt, Histogram::Parse};
+    std::uint64_t* const times[] = {&m_times.encryptNs, &m_times.decryptNs, &m_times.parseNs};
+
+    const MetricsSnapshot snapshot = metricsSnapshot();
+    for (std::size_t i = 0; i < std::size(kStages); ++i) {
+        const HistogramSummary& now = snapshot.histograms[static_cast<std::size_t>(kStages[i])];
+        const std::uint64_t count = now.count - m_last[i].count;
+        if (count != 0) *times[i] = (now.sumNs - m_last[i].sumNs) / count;
+        m_last[i] = now;
+    }
+    return m_times;
+}
+
+// ---------- estimation ----------
+
+void LatencyEstimator::addSample(std::uint64_t rttUs, std::uint64_t holdUs, const StageTimes& local,
+                                 const StageTimes& peer) {
+    LatencyEstimate& e = m_estimate;
+    const double rtt = static_cast<double>(rttUs);
+    // A hold longer than the RTT can only be a bogus pong
+    const double hold = static_cast<double>(std::min(holdUs, rttUs));
+
+    if (e.samples == 0) {
+        e.smoothedRttUs = rtt;
+        e.rttVarianceUs = rtt / 2;
+        e.minRttUs = rtt;
+        e.peerHoldUs = hold;
+    } else {
+        e.rttVarianceUs = 0.75 * e.rttVarianceUs + 0.25 * std::fabs(e.smoothedRttUs - rtt);
+        e.smoothedRttUs = 0.875 * e.smoothedRttUs + 0.125 * rtt;
+        e.minRttUs = std::min(e.minRttUs, rtt);
+        e.peerHoldUs = 0.875 * e.peerHoldUs + 0.125 * hold;
+    }
+    ++e.samples;
+    e.lastRttUs = rtt;
+    e.networkUs = std::max(0.0, e.smoothedRttUs - e.peerHoldUs);
+    e.local = local;
+    e.peer = peer;
+    e.unansweredUs = 0.0;
+}
+
+const char* latencyBottleneck(const LatencyEstimate& estimate) {
+    if (estimate.samples == 0) return "unknown";
+    // The peer's hold covers frames it was still decrypting when the
+    // ping arrived, so a backlog there counts even between pongs
+    const double network = estimate.networkUs / 2;
+    const double local = estimate.local.totalNs() / 1000.0;
+    const double peer = std::max(estimate.peer.totalNs() / 1000.0, estimate.peerHoldUs);
+    if (network >= local && network >= peer) return "network";
+    return local >= peer ? "local CPU" : "peer CPU";
+}
+
+static double toMs(double us) {
+    return us / 1000.0;
+}
+
+std::string describeLatency(const LatencyEstimate& estimate) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    if (estimate.samples == 0) {
+        out << "RTT: waiting for the first probe";
+    } else {
+        out << "RTT " << toMs(estimate.smoothedRttUs) << " ms (min " << toMs(estimate.minRttUs) << ", +/-"
+            << toMs(estimate.rttVarianceUs) << "), network " << toMs(estimate.networkUs) << " ms, peer held "
+            << toMs(estimate.peerHoldUs) << " ms | per message: local " << estimate.local.totalNs() / 1e6
+            << " ms, peer " << estimate.peer.totalNs() / 1e6 << " ms | slowest: " << latencyBottleneck(estimate);
+    }
+    if (estimate.unansweredUs > 0) {
+        out << std::setprecision(1) << " | no reply for " << estimate.unansweredUs / 1e6 << " s";
+    }
+    return out.str();
+}
+
+static void appendStages(std::ostringstream& out, const StageTimes& stages) {
+    out << "{\"encrypt_ns\": " << stages.encryptNs << ", \"decrypt_ns\": " << stages.decryptNs
+        << ", \"parse_ns\": " << stages.parseNs << "}";
+}
+
+std::string latencyToJson(const LatencyEstimate& estimate) {
+    std::ostringstream out;
+    out << "{\"samples\": " << estimate.samples << ", \"rtt_us\": " << estimate.lastRttUs
+        << ", \"srtt_us\": " << estimate.smoothedRttUs << ", \"rttvar_us\": " << estimate.rttVarianceUs
+        << ", \"min_rtt_us\": " << estimate.minRttUs << ", \"network_us\": " << estimate.networkUs
+        << ", \"peer_hold_us\": " << estimate.peerHoldUs << ", \"unanswered_us\": " << estimate.unansweredUs
+        << ", \"local\": ";
+    appendStages(out, estimate.local);
+    out << ", \"peer\": ";
+    appendStages(out, estimate.peer);
+    out << ", \"bottleneck\": \"" << latencyBottleneck(estimate) << "\"}";
+    return out.str();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "rsa_chat_metrics.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Round-trip probes between peers that announced "pr" in their CAPS line.
+// Like KEY: and CAPS: they are plain lines outside the encryption, so the
+// probe itself costs no RSA work and the RTT is not inflated by it:
+//
+//   PING:<seq>:<sentUs>
+//   PONG:<seq>:<sentUs>:<holdUs>:enc=<ns>;dec=<ns>;parse=<ns>
+//
+// sentUs is the pinger's own clock, echoed back untouched, so the two
+// clocks never have to agree. holdUs is how long the answering side had
+// the ping before the pong went out, counted from the start of the read
+// that carried it: frames ahead of it in the same read are decrypted
+// first, and that wait is CPU on the far end, not network. The stage
+// times are the answering side's mean cost per message since its
+// previous pong.
+
+// Mean cost of one message in each stage, 0 = nothing measured yet
+struct StageTimes {
+    std::uint64_t encryptNs = 0;
+    std::uint64_t decryptNs = 0;
+    std::uint64_t parseNs = 0;
+
+    std::uint64_t totalNs() const { return encryptNs + decryptNs + parseNs; }
+};
+
+struct ProbePing {
+    std::uint32_t seq = 0;
+    std::uint64_t sentUs = 0;
+};
+
+struct ProbePong {
+    std::uint32_t seq = 0;
+    std::uint64_t sentUs = 0;
+    std::uint64_t holdUs = 0;
+    StageTimes stages;
+};
+
+// Monotonic microseconds for sentUs and holdUs
+std::uint64_t probeClockUs();
+
+// Both return the line with its trailing newline
+std::string buildPingLine(const ProbePing& ping);
+std::string buildPongLine(const ProbePong& pong);
+
+// `line` is a single protocol line without its trailing newline
+bool parsePingLine(std::string_view line, ProbePing& ping);
+bool parsePongLine(std::string_view line, ProbePong& pong);
+
+// Turns the process-wide Encrypt/Decrypt/Parse histograms into the mean
+// per message since the previous sample(). A stage with no new messages
+// keeps its last mean, so an idle direction still shows what it cost
+// recently.
+class StageSampler {
+public:
+    StageTimes sample();
+
+private:
+    HistogramSummary m_last[3]{};
+    StageTimes m_times;
+};
+
+// Everything the probes have learned about one peer
+struct LatencyEstimate {
+    std::uint64_t samples = 0;
+    double lastRttUs = 0.0;
+    double smoothedRttUs = 0.0;
+    double rttVarianceUs = 0.0;
+    double minRttUs = 0.0;
+    // Smoothed time the peer held our pings; the rest of the RTT is the
+    // network and both kernels
+    double peerHoldUs = 0.0;
+    double networkUs = 0.0;
+    StageTimes local;
+    StageTimes peer;
+    // How long the outstanding ping has gone unanswered, 0 if none has
+    double unansweredUs = 0.0;
+};
+
+// Which side most likely makes the chat slow: the network, our CPU or
+// the peer's CPU, compared per message (half an RTT against each side's
+// encrypt + decrypt + parse)
+const char* latencyBottleneck(const LatencyEstimate& estimate);
+
+// RTT smoothing as in RFC 6298 (alpha 1/8, beta 1/4); the peer's hold is
+// smoothed the same way and subtracted to leave the network part
+class LatencyEstimator {
+public:
+    void addSample(std::uint64_t rttUs, std::uint64_t holdUs, const StageTimes& local, const StageTimes& peer);
+    void setUnanswered(std::uint64_t us) { m_estimate.unansweredUs = static_cast<double>(us); }
+    const LatencyEstimate& estimate() const { return m_estimate; }
+
+private:
+    LatencyEstimate m_estimate;
+};
+
+// One line for a status bar or a log
+std::string describeLatency(const LatencyEstimate& estimate);
+
+// One JSON object on one line, for the headless tools
+std::string latencyToJson(const LatencyEstimate& estimate);
@@ -0,0 +1,353 @@
+#include "rsa_chat_protocol.h"
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_decimal.h"
+#include "rsa_chat_lz.h"
+
+#include <charconv>
+#include <memory>
+
+static constexpr std::string_view kCapsPrefix = "CAPS:";
+static constexpr std::string_view kFramePrefix = "XMSG:";
+static constexpr std::string_view kCapCompression = "lz";
+static constexpr std::string_view kCapChannels = "ch";
+static constexpr std::string_view kCapBitpack = "bp";
+static constexpr std::string_view kCapProbe = "pr";
+
+template <typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+
+PeerCaps localCaps() {
+    PeerCaps caps;
+    caps.announced = true;
+    caps.compression = true;
+    caps.channels = true;
+    caps.bitpack = true;
+    caps.probe = true;
+    return caps;
+}
+
+std::string buildCapsLine(const PeerCaps& caps) {
+    std::string line(kCapsPrefix);
+    const std::size_t start = line.size();
+    auto addToken = [&](std::string_view token) {
+        if (line.size() > start) line += ',';
+        line += token;
+    };
+    if (caps.compression) addToken(kCapCompression);
+    if (caps.channels) addToken(kCapChannels);
+    if (caps.bitpack) addToken(kCapBitpack);
+    if (caps.probe) addToken(kCapProbe);
+    line += '\n';
+    return line;
+}
+
+PeerCaps parseCapsLine(std::string_view line) {
+    PeerCaps caps;
+    if (line.substr(0, kCapsPrefix.size()) != kCapsPrefix) return caps;
+    caps.announced = true;
+
+    std::string_view rest = line.substr(kCapsPrefix.size());
+    while (!rest.empty()) {
+        std::size_t comma = rest.find(',');
+        std::string_view token = rest.substr(0, comma);
+        if (token == kCapCompression) caps.compression = true;
+        if (token == kCapChannels) caps.channels = true;
+        if (token == kCapBitpack) caps.bitpack = true;
+        if (token == kCapProbe) caps.probe = true;
+        if (comma == std::string_view::npos) break;
+        rest.remove_prefix(comma + 1);
+    }
+    return caps;
+}
+
+void appendCipherList(std::span<const CipherWord> cipher, std::string& out) {
+    appendDecimalList(cipher, DecimalList::Commas, out);
+}
+
+// ---------- base64 ----------
+
+static constexpr char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void appendBase64(std::span<const std::byte> data, std::string& out) {
+    const std::size_t start = out.size();
+    out.resize(start + (data.size() + 2) / 3 * 4);
+    char* dst = out.data() + start;
+    std::size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        const unsigned v = std::to_integer<unsigned>(data[i]) << 16 | std::to_integer<unsigned>(data[i + 1]) << 8 |
+                           std::to_integer<unsigned>(data[i + 2]);
+        *dst++ = kBase64Alphabet[v >> 18];
+        *dst++ = kBase64Alphabet[(v >> 12) & 63];
+        *dst++ = kBase64Alphabet[(v >> 6) & 63];
+        *dst++ = kBase64Alphabet[v & 63];
+    }
+    if (i < data.size()) {
+        const bool two = i + 1 < data.size();
+        const unsigned v = std::to_integer<unsigned>(data[i]) << 16 |
+                           (two ? std::to_integer<unsigned>(data[i + 1]) << 8 : 0u);
+        *dst++ = kBase64Alphabet[v >> 18];
+        *dst++ = kBase64Alphabet[(v >> 12) & 63];
+        *dst++ = two ? kBase64Alphabet[(v >> 6) & 63] : '=';
+        *dst++ = '=';
+    }
+}
+
+static int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+// Bytes `text` decodes to, padding optional; 0 for a length no encoder
+// produces
+static std::size_t base64DecodedSize(std::string_view text) {
+    while (!text.empty() && text.back() == '=') text.remove_suffix(1);
+    if (text.size() % 4 == 1) return 0;
+    return text.size() / 4 * 3 + (text.size() % 4 == 0 ? 0 : text.size() % 4 - 1);
+}
+
+// Decodes into `out`, which holds base64DecodedSize(text) bytes
+static bool decodeBase64(std::string_view text, std::byte* out) {
+    while (!text.empty() && text.back() == '=') text.remove_suffix(1);
+    unsigned acc = 0;
+    unsigned filled = 0;
+    for (char c : text) {
+        const int v = base64Value(c);
+        if (v < 0) return false;
+        acc = acc << 6 | static_cast<unsigned>(v);
+        filled += 6;
+        if (filled >= 8) {
+            filled -= 8;
+            *out++ = static_cast<std::byte>(acc >> filled);
+        }
+    }
+    return true;
+}
+
+// ---------- frames ----------
+
+// Packed bytes of the frame being built, reused across calls
+static std::span<const std::byte> packCipher(std::span<const CipherWord> cipher, unsigned bits) {
+    thread_local std::vector<std::byte> packed;
+    // Room for the vector kernels to store whole groups
+    packed.resize(bitpackedBytes(cipher.size(), bits) + 32);
+    return std::span<const std::byte>(packed).first(bitpack(cipher, bits, packed));
+}
+
+// "XMSG:<attributes>:", shared by both body kinds
+static void appendFrameHeader(const FrameHeader& header, std::string& out) {
+    out += kFramePrefix;
+    out += header.compressed ? "z=1" : "z=0";
+    if (header.compressed) {
+        out += ";len=";
+        out += std::to_string(header.plainSize);
+    }
+    if (header.messageId != 0) {
+        out += ";id=";
+        out += std::to_string(header.messageId);
+    }
+    if (header.channel != Channel::Chat) {
+        out += ";ch=";
+        out += std::to_string(static_cast<unsigned>(header.channel));
+    }
+    if (header.more) out += ";more=1";
+    if (header.packedBits != 0) {
+        out += ";bits=";
+        out += std::to_string(header.packedBits);
+    }
+    if (header.keyBits != 0) {
+        out += ";kw=";
+        out += std::to_string(header.keyBits);
+    }
+    out += ':';
+}
+
+void appendMessageFrame(std::span<const CipherWord> cipher, const FrameHeader& header, std::string& out) {
+    appendFrameHeader(header, out);
+    if (header.packedBits != 0) {
+        appendBase64(packCipher(cipher, header.packedBits), out);
+    } else {
+        appendCipherList(cipher, out);
+    }
+    out += '\n';
+}
+
+void appendWideMessageFrame(const AnyRsaKey& pub, std::span<const std::uint64_t> cipher,
+                            const FrameHeader& header, std::string& out) {
+    appendFrameHeader(header, out);
+    appendRsaCipherList(pub, cipher, out);
+    out += '\n';
+}
+
+std::string buildMessageFrame(const std::vector<int>& cipher, const FrameHeader& header) {
+    std::string frame;
+    appendMessageFrame(cipherWords(cipher), header, frame);
+    return frame;
+}
+
+// Shared by the std::vector and arena-backed overloads
+template <typename Cipher>
+static bool parseCipherWords(std::string_view body, Cipher& cipher) {
+    // Sized once, so an arena-backed vector never leaves abandoned smaller
+    // copies behind as it grows
+    cipher.resize(decimalListCapacity(body, DecimalList::Commas));
+    static_assert(sizeof(typename Cipher::value_type) == sizeof(CipherWord));
+    std::span<CipherWord> words(reinterpret_cast<CipherWord*>(cipher.data()), cipher.size());
+    cipher.resize(parseDecimalList(body, DecimalList::Commas, words));
+    return true;
+}
+
+// A bits= body. The word count is implied: with at least 8 bits a word,
+// the padding in the last byte is never a whole word.
+template <typename Cipher>
+static bool parsePackedWords(std::string_view body, unsigned bits, Cipher& cipher) {
+    const std::size_t bytes = base64DecodedSize(body);
+    if (bytes == 0) return false;
+    // The scratch comes from the cipher's allocator, i.e. the receive
+    // arena for frames read off a connection
+    using ByteAlloc =
+        typename std::allocator_traits<typename Cipher::allocator_type>::template rebind_alloc<std::byte>;
+    std::vector<std::byte, ByteAlloc> packed(bytes, ByteAlloc(cipher.get_allocator()));
+    if (!decodeBase64(body, packed.data())) return false;
+
+    cipher.resize(bytes * 8 / bits);
+    static_assert(sizeof(typename Cipher::value_type) == sizeof(CipherWord));
+    std::span<CipherWord> words(reinterpret_cast<CipherWord*>(cipher.data()), cipher.size());
+    return bitunpack(packed, bits, words) == words.size();
+}
+
+bool parseFrameHeader(std::string_view line, FrameHeader& header, std::string_view& body) {
+    if (line.substr(0, kFramePrefix.size()) != kFramePrefix) return false;
+    line.remove_prefix(kFramePrefix.size());
+
+    std::size_t colon = line.find(':');
+    if (colon == std::string_view::npos) return false;
+    std::string_view attrs = line.substr(0, colon);
+    body = line.substr(colon + 1);
+
+    header = FrameHeader{};
+    while (!attrs.empty()) {
+        std::size_t semi = attrs.find(';');
+        std::string_view attr = attrs.substr(0, semi);
+        std::size_t eq = attr.find('=');
+        if (eq != std::string_view::npos) {
+            std::string_view key = attr.substr(0, eq);
+            std::string_view value = attr.substr(eq + 1);
+            if (key == "z") {
+                header.compressed = value == "1";
+            } else if (key == "len") {
+                if (!parseNumber(value, header.plainSize)) return false;
+            } else if (key == "id") {
+                if (!parseNumber(value, header.messageId)) return false;
+            } else if (key == "ch") {
+                unsigned channel;
+                if (!parseNumber(value, channel) || channel >= kChannelCount) return false;
+                header.channel = static_cast<Channel>(channel);
+            } else if (key == "more") {
+                header.more = value == "1";
+            } else if (key == "bits") {
+                if (!parseNumber(value, header.packedBits) || header.packedBits < 8 || header.packedBits > 32) {
+                    return false;
+                }
+            } else if (key == "kw") {
+                if (!parseNumber(value, header.keyBits) || rsaKeyWidthFor(header.keyBits) != header.keyBits) {
+                    return false;
+                }
+            }
+            // Unknown attributes are skipped so the header can grow
+        }
+        if (semi == std::string_view::npos) break;
+        attrs.remove_prefix(semi + 1);
+    }
+    if (header.compressed && header.plainSize > kMaxPlainSize) return false;
+    return header.keyBits == 0 || header.packedBits == 0;
+}
+
+template <typename Cipher>
+static bool parseBody(std::string_view body, const FrameHeader& header, Cipher& cipher) {
+    // A kw= body needs the wide key; see FrameReceiver
+    if (header.keyBits != 0) return false;
+    if (header.packedBits != 0) return parsePackedWords(body, header.packedBits, cipher);
+    return parseCipherWords(body, cipher);
+}
+
+template <typename Cipher>
+static bool parseFrame(std::string_view line, FrameHeader& header, Cipher& cipher) {
+    std::string_view body;
+    return parseFrameHeader(line, header, body) && parseBody(body, header, cipher);
+}
+
+bool parseFrameBody(std::string_view body, const FrameHeader& header, std::pmr::vector<CipherWord>& cipher) {
+    return parseBody(body, header, cipher);
+}
+
+bool parseMessageFrame(std::string_view line, FrameHeader& header, std::vector<int>& cipher) {
+    return parseFrame(line, header, cipher);
+}
+
+bool parseMessageFrame(std::string_view line, FrameHeader& header, std::pmr::vector<CipherWord>& cipher) {
+    return parseFrame(line, header, cipher);
+}
+
+bool parseCipherList(std::string_view body, std::pmr::vector<CipherWord>& cipher) {
+    return parseCipherWords(body, cipher);
+}
+
+// Returns what should be encrypted: `message` itself, or its compressed
+// form in `packed` when that is allowed and actually smaller
+static std::string_view compressForSeal(const std::string& message, bool allowCompression,
+                                        FrameHeader& header, std::string& packed) {
+    header = FrameHeader{};
+    if (allowCompression && message.size() >= kMinCompressSize && message.size() <= kMaxPlainSize) {
+        packed = lzCompress(message);
+        if (packed.size() < message.size()) {
+            header.compressed = true;
+            header.plainSize = static_cast<std::uint32_t>(message.size());
+            return packed;
+        }
+    }
+    return message;
+}
+
+std::vector<int> sealMessage(const std::string& message, const PublicKey& pub,
+                             bool allowCompression, FrameHeader& header) {
+    std::string packed;
+    std::string_view payload = compressForSeal(message, allowCompression, header, packed);
+    std::vector<int> cipher(payload.size());
+    encryptMessage(std::as_bytes(std::span(payload)), pub,
+                   {reinterpret_cast<CipherWord*>(cipher.data()), cipher.size()});
+    return cipher;
+}
+
+void sealMessage(const std::string& message, const PublicKey& pub, bool allowCompression,
+                 FrameHeader& header, std::vector<CipherWord>& cipher) {
+    std::string packed;
+    std::string_view payload = compressForSeal(message, allowCompression, header, packed);
+    cipher.resize(payload.size());
+    encryptMessage(std::as_bytes(std::span(payload)), pub, cipher);
+}
+
+void sealMessage(const std::string& message, const AnyRsaKey& pub, bool allowCompression,
+                 FrameHeader& header, std::vector<std::uint64_t>& cipher) {
+    std::string packed;
+    std::string_view payload = compressForSeal(message, allowCompression, header, packed);
+    header.keyBits = rsaKeyWidth(pub);
+    cipher.resize(payload.size() * rsaWordLimbs(pub));
+    rsaEncrypt(pub, std::as_bytes(std::span(payload)), cipher);
+}
+
+bool openMessage(const std::vector<int>& cipher, const FrameHeader& header,
+                 const PrivateKey& priv, std::string& message) {
+    std::string plain = decryptMessage(cipher, priv);
+    if (!header.compressed) {
+        message = std::move(plain);
+        return true;
+    }
+    return lzDecompress(plain, header.plainSize, message);
+}
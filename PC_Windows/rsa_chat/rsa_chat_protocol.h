@@ -0,0 +1,111 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "rsa_chat_rsakey.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Optional features a peer announces with a "CAPS:" line right after its
+// "KEY:" line. Older clients never send one and ignore ours.
+struct PeerCaps {
+    bool announced = false;   // peer understands "XMSG:" frames
+    bool compression = false; // peer can inflate LZ-compressed payloads
+    bool channels = false;    // peer demultiplexes ch= and reassembles more=
+    bool bitpack = false;     // peer reads bit-packed bodies (bits=)
+    bool probe = false;       // peer answers PING: lines (rsa_chat_probe.h)
+};
+
+// Logical streams sharing one connection, listed in no particular order;
+// see kChannelPriority in rsa_chat_channels.h
+enum class Channel : std::uint8_t {
+    Chat = 0,
+    Control = 1,
+    File = 2,
+    Count
+};
+
+constexpr std::size_t kChannelCount = static_cast<std::size_t>(Channel::Count);
+
+// Attributes carried in front of the ciphertext of an "XMSG:" frame:
+//   XMSG:z=1;len=123;id=42;ch=2;more=1:c1,c2,...
+// ch= and more= are only sent to peers that announced channel support;
+// a frame without them is a complete chat message. With bits=W the body
+// is base64 of the words packed W bits each (see rsa_chat_bitpack.h)
+// instead of the decimal list. With kw=B the frame was sealed under the
+// B-bit key the receiver sent in a "WKEY:" line and the body is the
+// decimal list of those wider words; kw= and bits= never appear together.
+// Only peers that sent a WKEY: line ever get kw= frames.
+struct FrameHeader {
+    bool compressed = false;
+    std::uint32_t plainSize = 0;
+    std::uint64_t messageId = 0; // 0 = untraced
+    Channel channel = Channel::Chat;
+    bool more = false; // further chunks of the same message follow
+    unsigned packedBits = 0; // 0 = decimal body, else 8-32
+    unsigned keyBits = 0; // 0 = demo KEY: key, else the WKEY: width
+};
+
+// Payloads shorter than this are never worth compressing
+constexpr std::size_t kMinCompressSize = 64;
+
+// Upper bound on an inflated payload, so a bogus len= cannot make us
+// allocate arbitrary amounts of memory.
+constexpr std::uint32_t kMaxPlainSize = 16u * 1024u * 1024u;
+
+// Longest line a receiver buffers: a kMaxPlainSize payload as decimal
+// 32-bit words, "4294967295," each, behind the frame attributes
+constexpr std::size_t kMaxFrameLine = std::size_t{kMaxPlainSize} * 11 + 256;
+
+PeerCaps localCaps();
+
+std::string buildCapsLine(const PeerCaps& caps);
+
+// `line` is a single protocol line without its trailing newline
+PeerCaps parseCapsLine(std::string_view line);
+
+std::string buildMessageFrame(const std::vector<int>& cipher, const FrameHeader& header);
+
+// Appends the frame, newline included, to `out`
+void appendMessageFrame(std::span<const CipherWord> cipher, const FrameHeader& header, std::string& out);
+
+// A kw= frame: `cipher` is flattened as rsaEncrypt() leaves it
+void appendWideMessageFrame(const AnyRsaKey& pub, std::span<const std::uint64_t> cipher,
+                            const FrameHeader& header, std::string& out);
+
+// Appends "c1,c2,...", the body of both frame kinds
+void appendCipherList(std::span<const CipherWord> cipher, std::string& out);
+
+// Splits an "XMSG:" line into its attributes and undecoded body, so a
+// caller can pick the key a kw= body needs before decoding it
+bool parseFrameHeader(std::string_view line, FrameHeader& header, std::string_view& body);
+
+// Decodes the body of a frame without kw=
+bool parseFrameBody(std::string_view body, const FrameHeader& header, std::pmr::vector<CipherWord>& cipher);
+
+bool parseMessageFrame(std::string_view line, FrameHeader& header, std::vector<int>& cipher);
+bool parseMessageFrame(std::string_view line, FrameHeader& header, std::pmr::vector<CipherWord>& cipher);
+
+// Comma-separated ciphertext words, the body of a legacy "MSG:" frame
+bool parseCipherList(std::string_view body, std::pmr::vector<CipherWord>& cipher);
+
+// Compresses (when allowed and worthwhile) and encrypts `message`,
+// describing what was done in `header`.
+std::vector<int> sealMessage(const std::string& message, const PublicKey& pub,
+                             bool allowCompression, FrameHeader& header);
+
+// Same, into a reusable buffer
+void sealMessage(const std::string& message, const PublicKey& pub, bool allowCompression,
+                 FrameHeader& header, std::vector<CipherWord>& cipher);
+
+// Same, under a WKEY: key; sets header.keyBits
+void sealMessage(const std::string& message, const AnyRsaKey& pub, bool allowCompression,
+                 FrameHeader& header, std::vector<std::uint64_t>& cipher);
+
+// Reverses sealMessage(). Returns false for a corrupt compressed payload.
+bool openMessage(const std::vector<int>& cipher, const FrameHeader& header,
+                 const PrivateKey& priv, std::string& message);
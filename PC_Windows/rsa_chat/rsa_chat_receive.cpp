@@ -0,0 +1,184 @@
+#include "rsa_chat_receive.h"
+#include "rsa_chat_lz.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+#include <utility>
+#include <vector>
+
+// The block stops growing here; frames bigger than this (huge legacy
+// messages) just keep spilling rather than pinning their size forever
+static constexpr std::size_t kMaxArenaBlock = 4u * 1024u * 1024u;
+
+void* ReceiveArena::SpillResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    ++allocations;
+    bytesSinceReset += bytes;
+    metricsAdd(Counter::ReceiveArenaSpills);
+    return ::operator new(bytes, std::align_val_t(alignment));
+}
+
+void ReceiveArena::SpillResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+    ::operator delete(p, bytes, std::align_val_t(alignment));
+}
+
+bool ReceiveArena::SpillResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+ReceiveArena::ReceiveArena(std::size_t blockBytes)
+    : m_blockBytes(blockBytes), m_block(std::make_unique<std::byte[]>(blockBytes)) {
+    m_resource.emplace(m_block.get(), m_blockBytes, &m_spill);
+}
+
+void ReceiveArena::reset() {
+    m_resource->release();
+    if (m_spill.bytesSinceReset == 0 || m_blockBytes >= kMaxArenaBlock) {
+        m_spill.bytesSinceReset = 0;
+        return;
+    }
+
+    m_blockBytes = std::min(std::bit_ceil(m_blockBytes + m_spill.bytesSinceReset), kMaxArenaBlock);
+    m_spill.bytesSinceReset = 0;
+    m_resource.reset();
+    m_block = std::make_unique<std::byte[]>(m_blockBytes);
+    m_resource.emplace(m_block.get(), m_blockBytes, &m_spill);
+}
+
+FrameReceiver::FrameReceiver(Handlers handlers, const PrivateKey& priv)
+    : m_handlers(std::move(handlers)), m_priv(priv), m_arena(32 * 1024) {}
+
+void FrameReceiver::feed(const char* data, std::size_t size) {
+    std::string_view input(data, size);
+
+    // The tail of an oversized line is skipped without being kept
+    if (m_skipping) {
+        std::size_t newline = input.find('\n');
+        if (newline == std::string_view::npos) return;
+        input.remove_prefix(newline + 1);
+        m_skipping = false;
+    }
+
+    // Finish the line left over from the previous read first
+    if (!m_partial.empty()) {
+        std::size_t newline = input.find('\n');
+        const std::size_t more = newline == std::string_view::npos ? input.size() : newline;
+        if (m_partial.size() + more > kMaxFrameLine) {
+            dropOversized(newline == std::string_view::npos);
+            if (newline == std::string_view::npos) return;
+            input.remove_prefix(newline + 1);
+        } else if (newline == std::string_view::npos) {
+            m_partial.append(input);
+            return;
+        } else {
+            m_partial.append(input.substr(0, newline));
+            input.remove_prefix(newline + 1);
+            handleLine(m_partial);
+            // Keeps the capacity for the next split line
+            m_partial.clear();
+        }
+    }
+
+    // Complete lines are handled straight from the read buffer
+    while (!input.empty()) {
+        std::size_t newline = input.find('\n');
+        if (newline == std::string_view::npos) {
+            if (input.size() > kMaxFrameLine) {
+                dropOversized(true);
+            } else {
+                m_partial.assign(input);
+            }
+            break;
+        }
+        handleLine(input.substr(0, newline));
+        input.remove_prefix(newline + 1);
+    }
+}
+
+void FrameReceiver::dropOversized(bool skipRest) {
+    // No frame is this long, so it is garbage or an attack; the buffer it
+    // grew is handed back rather than kept for the next split line
+    std::string().swap(m_partial);
+    m_skipping = skipRest;
+    if (m_handlers.corrupt) m_handlers.corrupt(Corrupt::Oversized);
+}
+
+void FrameReceiver::reset() {
+    m_partial.clear();
+    m_skipping = false;
+    m_arena.reset();
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+void FrameReceiver::handleLine(std::string_view line) {
+    while (!line.empty() && isSpace(line.front())) line.remove_prefix(1);
+    while (!line.empty() && isSpace(line.back())) line.remove_suffix(1);
+    if (line.empty()) return;
+
+    if (line.starts_with("XMSG:")) {
+        handleMessage(line, false);
+    } else if (line.starts_with("MSG:")) {
+        handleMessage(line.substr(4), true);
+    } else if (m_handlers.line) {
+        m_handlers.line(line);
+    }
+    // Nothing from the frame outlives its handler
+    m_arena.reset();
+}
+
+void FrameReceiver::handleMessage(std::string_view line, bool legacy) {
+    TraceSpan messageSpan("receive_message");
+    std::pmr::memory_resource* arena = m_arena.resource();
+
+    FrameHeader header;
+    std::pmr::vector<CipherWord> cipher(arena);
+    std::pmr::vector<std::uint64_t> wideCipher(arena);
+    bool parsed;
+    {
+        TraceSpan parseSpan("parse");
+        ScopedTimer parseTimer(Histogram::Parse);
+        std::string_view body = line;
+        if (legacy) {
+            parsed = parseCipherList(body, cipher);
+        } else if (!parseFrameHeader(line, header, body)) {
+            parsed = false;
+        } else if (header.keyBits != 0) {
+            // Sealed under our WKEY: key, which must be the width it claims
+            parsed = m_widePriv && rsaKeyWidth(*m_widePriv) == header.keyBits &&
+                     parseRsaCipherList(*m_widePriv, body, wideCipher);
+        } else {
+            parsed = parseFrameBody(body, header, cipher);
+        }
+        parseSpan.setMessageId(header.messageId);
+    }
+    if (!parsed || (cipher.empty() && wideCipher.empty())) return;
+    metricsAdd(Counter::MessagesReceived);
+    messageSpan.setMessageId(header.messageId);
+    traceFlow("message", header.messageId, false);
+
+    const std::size_t plainSize = header.keyBits != 0 ? wideCipher.size() / rsaWordLimbs(*m_widePriv) : cipher.size();
+    std::pmr::string plain(plainSize, '\0', arena);
+    std::pmr::string inflated(arena);
+    {
+        TraceSpan decryptSpan("decrypt", header.messageId);
+        if (header.keyBits != 0) {
+            rsaDecrypt(*m_widePriv, wideCipher, std::as_writable_bytes(std::span(plain)));
+        } else {
+            decryptMessage(cipher, m_priv, std::as_writable_bytes(std::span(plain)));
+        }
+        if (header.compressed) {
+            inflated.resize(header.plainSize);
+            if (!lzDecompress(plain, inflated.data(), header.plainSize)) {
+                if (m_handlers.corrupt) m_handlers.corrupt(Corrupt::Compression);
+                return;
+            }
+        }
+    }
+
+    if (m_handlers.message) m_handlers.message(header, header.compressed ? inflated : plain);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "rsa_chat_core.h"
+#include "rsa_chat_protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Receive side of a connection, kept free of Qt so the bench can drive
+// it. Bytes go in through feed(), lines are split off in place, message
+// frames are parsed and decrypted into scratch memory from an arena, and
+// the plaintext is handed out as a view. Once the arena has grown to the
+// size of a typical frame, receiving a message does not touch the heap.
+
+// Bump allocator for the scratch of one frame. What does not fit the
+// block spills to the heap, and the block grows at the next reset() so
+// a frame of that size fits from then on.
+class ReceiveArena {
+public:
+    explicit ReceiveArena(std::size_t blockBytes = 16 * 1024);
+
+    ReceiveArena(const ReceiveArena&) = delete;
+    ReceiveArena& operator=(const ReceiveArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*m_resource; }
+
+    // Frees everything handed out since the last reset
+    void reset();
+
+    std::size_t blockBytes() const { return m_blockBytes; }
+
+    // Heap allocations made because the block was too small
+    std::uint64_t spills() const { return m_spill.allocations; }
+
+private:
+    class SpillResource : public std::pmr::memory_resource {
+    public:
+        std::uint64_t allocations = 0;
+        std::size_t bytesSinceReset = 0;
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    SpillResource m_spill;
+    std::size_t m_blockBytes;
+    std::unique_ptr<std::byte[]> m_block;
+    std::optional<std::pmr::monotonic_buffer_resource> m_resource;
+};
+
+class FrameReceiver {
+public:
+    enum class Corrupt {
+        Compression, // the compressed payload did not inflate
+        Oversized,   // the line grew past kMaxFrameLine and was discarded
+    };
+
+    struct Handlers {
+        // KEY:, CAPS: and any other line that is not a message
+        std::function<void(std::string_view line)> line;
+        // A decrypted message, valid only during the call. Legacy "MSG:"
+        // frames come with a default header.
+        std::function<void(const FrameHeader& header, std::string_view plain)> message;
+        // A frame that was dropped, and why
+        std::function<void(Corrupt what)> corrupt;
+    };
+
+    explicit FrameReceiver(Handlers handlers, const PrivateKey& priv = {});
+
+    void setPrivateKey(const PrivateKey& priv) { m_priv = priv; }
+
+    // The private half of our WKEY: key, for kw= frames. Without one they
+    // are ignored like any other frame we cannot read.
+    void setWidePrivateKey(const AnyRsaKey& priv) { m_widePriv = priv; }
+
+    // Handles every complete line in `data`, keeping a trailing partial
+    // line for the next call. A partial line is never kept past
+    // kMaxFrameLine bytes: the rest of it up to the next newline is
+    // skipped and reported through corrupt().
+    void feed(const char* data, std::size_t size);
+
+    // Drops any partial line, e.g. when a new socket is attached
+    void reset();
+
+    const ReceiveArena& arena() const { return m_arena; }
+
+private:
+    void handleLine(std::string_view line);
+    void handleMessage(std::string_view line, bool legacy);
+    void dropOversized(bool skipRest);
+
+    Handlers m_handlers;
+    PrivateKey m_priv;
+    std::optional<AnyRsaKey> m_widePriv;
+    std::string m_partial;
+    // Inside an oversized line, dropping input up to its newline
+    bool m_skipping = false;
+    ReceiveArena m_arena;
+};
@@ -0,0 +1,190 @@
+#include "rsa_chat_rsakey.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+const std::vector<std::uint32_t>& smallPrimes() {
+    static const std::vector<std::uint32_t> primes = [] {
+        std::vector<std::uint32_t> out;
+        std::vector<bool> composite(1000, false);
+        for (std::uint32_t i = 3; i < composite.size(); i += 2) {
+            if (composite[i]) continue;
+            out.push_back(i);
+            for (std::uint32_t j = i * i; j < composite.size(); j += 2 * i) composite[j] = true;
+        }
+        return out;
+    }();
+    return primes;
+}
+
+std::uint64_t gcdSmall(std::uint64_t a, std::uint64_t b) {
+    while (b != 0) {
+        std::uint64_t t = b;
+        b = a % b;
+        a = t;
+    }
+    return a;
+}
+
+std::uint64_t modinvSmall(std::uint64_t a, std::uint64_t m) {
+    std::int64_t m0 = static_cast<std::int64_t>(m);
+    std::int64_t aa = static_cast<std::int64_t>(a);
+    std::int64_t mm = m0;
+    std::int64_t t, q, x0 = 0, x1 = 1;
+    if (m == 1) return 0;
+    while (aa > 1) {
+        q = aa / mm;
+        t = mm;
+        mm = aa % mm;
+        aa = t;
+        t = x0;
+        x0 = x1 - q * x0;
+        x1 = t;
+    }
+    return static_cast<std::uint64_t>(x1 < 0 ? x1 + m0 : x1);
+}
+
+// ---------- runtime dispatch ----------
+
+unsigned rsaKeyWidthFor(unsigned modulusBits) {
+    for (unsigned width : {32u, 64u, 512u, 2048u}) {
+        if (modulusBits <= width) return width;
+    }
+    return 0;
+}
+
+unsigned rsaKeyWidth(const AnyRsaKey& key) {
+    return std::visit([](const auto& k) { return std::decay_t<decltype(k)>::kBits; }, key);
+}
+
+std::size_t rsaWordLimbs(const AnyRsaKey& key) {
+    return std::visit([](const auto& k) { return std::decay_t<decltype(k)>::kLimbs; }, key);
+}
+
+template <unsigned Bits>
+static AnyRsaKeyPair generateWidth() {
+    std::random_device rd;
+    std::mt19937_64 gen((static_cast<std::uint64_t>(rd()) << 32) | rd());
+    RsaKeyPair<Bits> kp = generateKeysT<Bits>(gen);
+    return AnyRsaKeyPair{kp.pub, kp.priv};
+}
+
+AnyRsaKeyPair generateRsaKeys(unsigned width) {
+    switch (width) {
+    case 32: return generateWidth<32>();
+    case 64: return generateWidth<64>();
+    case 512: return generateWidth<512>();
+    case 2048: return generateWidth<2048>();
+    default: break;
+    }
+    throw std::invalid_argument("unsupported RSA key width " + std::to_string(width));
+}
+
+template <unsigned Bits>
+static bool parseWidth(std::string_view exponent, std::string_view modulus, AnyRsaKey& key) {
+    RsaKey<Bits> k;
+    if (!limbsFromDecimal(exponent, k.exponent) || !limbsFromDecimal(modulus, k.modulus)) return false;
+    key = k;
+    return true;
+}
+
+bool parseRsaKey(std::string_view exponent, std::string_view modulus, AnyRsaKey& key) {
+    // Parse at the widest size first just to measure the modulus
+    Limbs<RsaKey<2048>::kLimbs> n;
+    if (!limbsFromDecimal(modulus, n)) return false;
+    if ((n[0] & 1) == 0 || limbsBitWidth(n) < 2) return false;
+
+    switch (rsaKeyWidthFor(static_cast<unsigned>(limbsBitWidth(n)))) {
+    case 32: return parseWidth<32>(exponent, modulus, key);
+    case 64: return parseWidth<64>(exponent, modulus, key);
+    case 512: return parseWidth<512>(exponent, modulus, key);
+    case 2048: return parseWidth<2048>(exponent, modulus, key);
+    default: return false;
+    }
+}
+
+std::string rsaKeyExponentText(const AnyRsaKey& key) {
+    return std::visit([](const auto& k) { return limbsToDecimal(k.exponent); }, key);
+}
+
+std::string rsaKeyModulusText(const AnyRsaKey& key) {
+    return std::visit([](const auto& k) { return limbsToDecimal(k.modulus); }, key);
+}
+
+// The kernels work on arrays of limb arrays; the flat spans go through a
+// small stack buffer so neither side is reinterpreted as the other
+static constexpr std::size_t kDispatchChunk = 64;
+
+std::size_t rsaEncrypt(const AnyRsaKey& pub, std::span<const std::byte> message, std::span<std::uint64_t> cipher) {
+    return std::visit(
+        [&](const auto& k) {
+            using Key = std::decay_t<decltype(k)>;
+            std::array<typename Key::Value, kDispatchChunk> words;
+            const std::size_t total = std::min(message.size(), cipher.size() / Key::kLimbs);
+            const auto* in = reinterpret_cast<const unsigned char*>(message.data());
+            for (std::size_t pos = 0; pos < total; pos += kDispatchChunk) {
+                const std::size_t count = std::min(kDispatchChunk, total - pos);
+                encryptMessageT<Key::kBits>({in + pos, count}, k, {words.data(), count});
+                for (std::size_t i = 0; i < count; ++i) {
+                    std::copy(words[i].begin(), words[i].end(), cipher.begin() + (pos + i) * Key::kLimbs);
+                }
+            }
+            return total;
+        },
+        pub);
+}
+
+std::size_t rsaDecrypt(const AnyRsaKey& priv, std::span<const std::uint64_t> cipher, std::span<std::byte> message) {
+    return std::visit(
+        [&](const auto& k) {
+            using Key = std::decay_t<decltype(k)>;
+            std::array<typename Key::Value, kDispatchChunk> words;
+            const std::size_t total = std::min(cipher.size() / Key::kLimbs, message.size());
+            auto* out = reinterpret_cast<unsigned char*>(message.data());
+            for (std::size_t pos = 0; pos < total; pos += kDispatchChunk) {
+                const std::size_t count = std::min(kDispatchChunk, total - pos);
+                for (std::size_t i = 0; i < count; ++i) {
+                    auto first = cipher.begin() + (pos + i) * Key::kLimbs;
+                    std::copy(first, first + Key::kLimbs, words[i].begin());
+                }
+                decryptMessageT<Key::kBits>({words.data(), count}, k, {out + pos, count});
+            }
+            return total;
+        },
+        priv);
+}
+
+void appendRsaCipherList(const AnyRsaKey& key, std::span<const std::uint64_t> cipher, std::string& out) {
+    std::visit(
+        [&](const auto& k) {
+            using Key = std::decay_t<decltype(k)>;
+            typename Key::Value word;
+            for (std::size_t pos = 0; pos + Key::kLimbs <= cipher.size(); pos += Key::kLimbs) {
+                if (pos != 0) out += ',';
+                std::copy(cipher.begin() + pos, cipher.begin() + pos + Key::kLimbs, word.begin());
+                out += limbsToDecimal(word);
+            }
+        },
+        key);
+}
+
+bool parseRsaCipherList(const AnyRsaKey& key, std::string_view body, std::pmr::vector<std::uint64_t>& cipher) {
+    return std::visit(
+        [&](const auto& k) {
+            using Key = std::decay_t<decltype(k)>;
+            cipher.clear();
+            cipher.reserve((static_cast<std::size_t>(std::count(body.begin(), body.end(), ',')) + 1) * Key::kLimbs);
+            typename Key::Value word;
+            while (!body.empty()) {
+                const std::size_t comma = body.find(',');
+                // Only words the private key can have produced
+                if (!limbsFromDecimal(body.substr(0, comma), word) || !limbsLess(word, k.modulus)) return false;
+                cipher.insert(cipher.end(), word.begin(), word.end());
+                if (comma == std::string_view::npos) break;
+                body.remove_prefix(comma + 1);
+            }
+            return !cipher.empty();
+        },
+        key);
+}
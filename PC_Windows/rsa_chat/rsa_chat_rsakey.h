@@ -0,0 +1,422 @@
+#pragma once
+
+// Width-parameterised RSA keys. RsaKey<Bits> stores its exponent and
+// modulus as std::array limbs sized at compile time, and the
+// *T<Bits>() functions below run on the matching ModKernel<Bits> with no
+// heap allocation. The int-based API in rsa_chat_core.h is the demo-sized
+// special case every peer speaks; AnyRsaKey picks an instantiation at
+// runtime from the width of a key, for the optional wide keys peers
+// exchange in WKEY: lines (see rsa_chat_protocol.h).
+
+#include "rsa_chat_modarith.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+template <unsigned Bits>
+struct RsaKey {
+    static constexpr unsigned kBits = Bits;
+    static constexpr std::size_t kLimbs = (Bits + 63) / 64;
+    using Value = Limbs<kLimbs>;
+
+    Value exponent{}; // e for a public key, d for a private one
+    Value modulus{};
+};
+
+template <unsigned Bits>
+struct RsaKeyPair {
+    RsaKey<Bits> pub;
+    RsaKey<Bits> priv;
+};
+
+constexpr std::uint64_t kDefaultPublicExponent = 65537;
+
+// ---------- limb helpers ----------
+
+template <std::size_t L>
+inline Limbs<L> limbsFromWord(std::uint64_t v) {
+    Limbs<L> r{};
+    r[0] = v;
+    return r;
+}
+
+// v = v * m + a, returns the carry out of the top limb
+template <std::size_t L>
+inline std::uint64_t limbsMulSmallAdd(Limbs<L>& v, std::uint64_t m, std::uint64_t a) {
+    std::uint64_t carry = a;
+    for (std::size_t i = 0; i < L; ++i) v[i] = mulAdd(v[i], m, 0, carry);
+    return carry;
+}
+
+// v /= d for d < 2^32, returns the remainder. Works in 32-bit halves so
+// no 128-by-64 division is needed.
+template <std::size_t L>
+inline std::uint64_t limbsDivSmall(Limbs<L>& v, std::uint64_t d) {
+    std::uint64_t rem = 0;
+    for (std::size_t i = L; i-- > 0;) {
+        std::uint64_t hiPart = (rem << 32) | (v[i] >> 32);
+        std::uint64_t qHi = hiPart / d;
+        rem = hiPart % d;
+        std::uint64_t loPart = (rem << 32) | (v[i] & 0xffffffffu);
+        std::uint64_t qLo = loPart / d;
+        rem = loPart % d;
+        v[i] = (qHi << 32) | qLo;
+    }
+    return rem;
+}
+
+template <std::size_t L>
+inline std::uint64_t limbsModSmall(Limbs<L> v, std::uint64_t d) {
+    return limbsDivSmall(v, d);
+}
+
+template <std::size_t L>
+inline Limbs<L> limbsShiftRight(const Limbs<L>& v, std::size_t bits) {
+    Limbs<L> r{};
+    std::size_t limbShift = bits / 64;
+    std::size_t bitShift = bits % 64;
+    for (std::size_t i = 0; i + limbShift < L; ++i) {
+        r[i] = v[i + limbShift] >> bitShift;
+        if (bitShift && i + limbShift + 1 < L) r[i] |= v[i + limbShift + 1] << (64 - bitShift);
+    }
+    return r;
+}
+
+template <std::size_t L>
+inline Limbs<L> limbsShiftLeft(const Limbs<L>& v, std::size_t bits) {
+    Limbs<L> r{};
+    std::size_t limbShift = bits / 64;
+    std::size_t bitShift = bits % 64;
+    for (std::size_t i = limbShift; i < L; ++i) {
+        r[i] = v[i - limbShift] << bitShift;
+        if (bitShift && i > limbShift) r[i] |= v[i - limbShift - 1] >> (64 - bitShift);
+    }
+    return r;
+}
+
+// Number of low zero bits; v must not be zero
+template <std::size_t L>
+inline std::size_t limbsTrailingZeros(const Limbs<L>& v) {
+    std::size_t i = 0;
+    while (v[i] == 0) ++i;
+    return i * 64 + static_cast<std::size_t>(std::countr_zero(v[i]));
+}
+
+// Schoolbook product truncated to Out limbs (callers size Out to fit)
+template <std::size_t Out, std::size_t A, std::size_t B>
+inline Limbs<Out> limbsMul(const Limbs<A>& a, const Limbs<B>& b) {
+    Limbs<Out> r{};
+    for (std::size_t i = 0; i < A && i < Out; ++i) {
+        std::uint64_t carry = 0;
+        for (std::size_t j = 0; j < B && i + j < Out; ++j) {
+            r[i + j] = mulAdd(a[i], b[j], r[i + j], carry);
+        }
+        if (i + B < Out) r[i + B] = carry;
+    }
+    return r;
+}
+
+template <std::size_t L>
+inline bool limbsIsZero(const Limbs<L>& v) {
+    for (std::uint64_t limb : v) {
+        if (limb) return false;
+    }
+    return true;
+}
+
+// Binary gcd, so no multi-limb division is needed; gcd(0, b) = b
+template <std::size_t L>
+Limbs<L> limbsGcd(Limbs<L> a, Limbs<L> b) {
+    if (limbsIsZero(a)) return b;
+    if (limbsIsZero(b)) return a;
+    const std::size_t aZeros = limbsTrailingZeros(a);
+    const std::size_t bZeros = limbsTrailingZeros(b);
+    a = limbsShiftRight(a, aZeros);
+    b = limbsShiftRight(b, bZeros);
+    while (true) {
+        if (limbsLess(b, a)) std::swap(a, b);
+        limbsSub(b, a);
+        if (limbsIsZero(b)) break;
+        b = limbsShiftRight(b, limbsTrailingZeros(b));
+    }
+    return limbsShiftLeft(a, aZeros < bZeros ? aZeros : bZeros);
+}
+
+template <std::size_t L>
+std::string limbsToDecimal(Limbs<L> v) {
+    if (limbsIsZero(v)) return "0";
+    std::string digits;
+    while (!limbsIsZero(v)) {
+        std::uint64_t chunk = limbsDivSmall(v, 1000000000u);
+        for (int i = 0; i < 9; ++i) {
+            digits.push_back(static_cast<char>('0' + chunk % 10));
+            chunk /= 10;
+            if (chunk == 0 && limbsIsZero(v)) break;
+        }
+    }
+    return std::string(digits.rbegin(), digits.rend());
+}
+
+template <std::size_t L>
+bool limbsFromDecimal(std::string_view text, Limbs<L>& out) {
+    if (text.empty()) return false;
+    out = Limbs<L>{};
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        if (limbsMulSmallAdd(out, 10, static_cast<std::uint64_t>(c - '0'))) return false;
+    }
+    return true;
+}
+
+// ---------- kernel view ----------
+
+// Presents ModKernel<Bits> with limb-array inputs and outputs whatever its
+// native word type is, so the generic code below can be written once.
+template <unsigned Bits>
+class LimbKernel {
+    using Kernel = ModKernel<Bits>;
+    using Native = typename Kernel::Value;
+
+public:
+    static constexpr std::size_t kLimbs = (Bits + 63) / 64;
+    using Value = Limbs<kLimbs>;
+
+    explicit LimbKernel(const Value& n) : m_kernel(toNative(n)) {}
+
+    Value toMont(const Value& a) const { return fromNative(m_kernel.toMont(toNative(a))); }
+
+    Value fromMont(const Value& a) const { return fromNative(m_kernel.fromMont(toNative(a))); }
+
+    Value mul(const Value& a, const Value& b) const {
+        return fromNative(m_kernel.mul(toNative(a), toNative(b)));
+    }
+
+    template <std::size_t E>
+    Value pow(const Value& base, const Limbs<E>& exp) const {
+        if constexpr (std::is_integral_v<Native>) {
+            return fromNative(m_kernel.pow(toNative(base), static_cast<Native>(exp[0])));
+        } else {
+            return m_kernel.pow(base, exp);
+        }
+    }
+
+private:
+    static Native toNative(const Value& v) {
+        if constexpr (std::is_integral_v<Native>) {
+            return static_cast<Native>(v[0]);
+        } else {
+            return v;
+        }
+    }
+
+    static Value fromNative(const Native& v) {
+        if constexpr (std::is_integral_v<Native>) {
+            return limbsFromWord<kLimbs>(v);
+        } else {
+            return v;
+        }
+    }
+
+    Kernel m_kernel;
+};
+
+// ---------- primes and key generation ----------
+
+const std::vector<std::uint32_t>& smallPrimes();
+
+// Miller-Rabin on an odd n > 3
+template <unsigned Bits>
+bool isProbablePrime(const Limbs<(Bits + 63) / 64>& n, std::mt19937_64& gen, int rounds = 24) {
+    constexpr std::size_t L = (Bits + 63) / 64;
+    Limbs<L> nMinus1 = n;
+    nMinus1[0] -= 1;
+
+    std::size_t s = 0;
+    while (!limbsBit(nMinus1, s)) ++s;
+    Limbs<L> d = limbsShiftRight(nMinus1, s);
+
+    LimbKernel<Bits> kernel(n);
+    const Limbs<L> one = kernel.toMont(limbsFromWord<L>(1));
+    const Limbs<L> minusOne = kernel.toMont(nMinus1);
+    const std::size_t width = limbsBitWidth(n);
+
+    for (int round = 0; round < rounds; ++round) {
+        // Random base in [2, 2^(width-1)), which is below n - 1
+        Limbs<L> a;
+        for (auto& limb : a) limb = gen();
+        a = limbsShiftRight(a, L * 64 - (width - 1));
+        if (limbsLess(a, limbsFromWord<L>(2))) a = limbsFromWord<L>(2);
+
+        Limbs<L> x = kernel.toMont(kernel.pow(a, d));
+        if (x == one || x == minusOne) continue;
+
+        bool witness = true;
+        for (std::size_t r = 1; r < s; ++r) {
+            x = kernel.mul(x, x);
+            if (x == minusOne) {
+                witness = false;
+                break;
+            }
+            if (x == one) break;
+        }
+        if (witness) return false;
+    }
+    return true;
+}
+
+// Random prime with exactly Bits bits and the top two bits set, so the
+// product of two of them has exactly 2 * Bits bits
+template <unsigned Bits>
+Limbs<(Bits + 63) / 64> randomPrime(std::mt19937_64& gen) {
+    constexpr std::size_t L = (Bits + 63) / 64;
+    static_assert(Bits >= 8, "prime too small");
+    const auto& primes = smallPrimes();
+
+    while (true) {
+        Limbs<L> p;
+        for (auto& limb : p) limb = gen();
+        p = limbsShiftRight(p, L * 64 - Bits);
+        p[(Bits - 1) / 64] |= std::uint64_t{1} << ((Bits - 1) % 64);
+        p[(Bits - 2) / 64] |= std::uint64_t{1} << ((Bits - 2) % 64);
+        p[0] |= 1;
+
+        bool composite = false;
+        for (std::uint32_t sp : primes) {
+            if (limbsModSmall(p, sp) == 0) {
+                composite = !(p == limbsFromWord<L>(sp));
+                break;
+            }
+        }
+        if (composite) continue;
+        if (isProbablePrime<Bits>(p, gen)) return p;
+    }
+}
+
+// Inverse of a mod m for small m, as in the int core's modinv()
+std::uint64_t modinvSmall(std::uint64_t a, std::uint64_t m);
+
+std::uint64_t gcdSmall(std::uint64_t a, std::uint64_t b);
+
+template <unsigned Bits>
+RsaKeyPair<Bits> generateKeysT(std::mt19937_64& gen) {
+    static_assert(Bits >= 32 && Bits % 2 == 0, "unsupported key width");
+    constexpr std::size_t L = RsaKey<Bits>::kLimbs;
+    constexpr unsigned Half = Bits / 2;
+
+    while (true) {
+        auto p = randomPrime<Half>(gen);
+        auto q = randomPrime<Half>(gen);
+        if (p == q) continue;
+
+        Limbs<L> n = limbsMul<L>(p, q);
+        p[0] -= 1;
+        q[0] -= 1;
+        Limbs<L> phi = limbsMul<L>(p, q);
+
+        std::uint64_t e = kDefaultPublicExponent;
+        std::uint64_t phiModE = limbsModSmall(phi, e);
+        while (gcdSmall(e, phiModE) != 1) {
+            e += 2;
+            phiModE = limbsModSmall(phi, e);
+        }
+
+        // d = (1 + k * phi) / e with k = -phi^-1 mod e, which keeps all the
+        // multi-limb work to one small multiply and one small divide
+        std::uint64_t k = (e - modinvSmall(phiModE, e)) % e;
+        Limbs<L + 1> big{};
+        for (std::size_t i = 0; i < L; ++i) big[i] = phi[i];
+        limbsMulSmallAdd(big, k, 1);
+        limbsDivSmall(big, e);
+
+        RsaKeyPair<Bits> kp;
+        kp.pub.modulus = n;
+        kp.pub.exponent = limbsFromWord<L>(e);
+        kp.priv.modulus = n;
+        for (std::size_t i = 0; i < L; ++i) kp.priv.exponent[i] = big[i];
+        return kp;
+    }
+}
+
+// One ciphertext word per message byte; returns the number written
+template <unsigned Bits>
+std::size_t encryptMessageT(std::span<const unsigned char> message, const RsaKey<Bits>& pub,
+                            std::span<typename RsaKey<Bits>::Value> cipher) {
+    constexpr std::size_t L = RsaKey<Bits>::kLimbs;
+    const std::size_t count = message.size() < cipher.size() ? message.size() : cipher.size();
+    LimbKernel<Bits> kernel(pub.modulus);
+    // 65537 and the other usual exponents get an unrolled chain
+    if (limbsBitWidth(pub.exponent) <= 64) {
+        const bool fixed = withFixedExponent(pub.exponent[0], [&](auto exponent) {
+            for (std::size_t i = 0; i < count; ++i) {
+                cipher[i] = fixedPow<decltype(exponent)::value>(kernel, limbsFromWord<L>(message[i]));
+            }
+        });
+        if (fixed) return count;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        cipher[i] = kernel.pow(limbsFromWord<L>(message[i]), pub.exponent);
+    }
+    return count;
+}
+
+template <unsigned Bits>
+std::size_t decryptMessageT(std::span<const typename RsaKey<Bits>::Value> cipher, const RsaKey<Bits>& priv,
+                            std::span<unsigned char> message) {
+    const std::size_t count = cipher.size() < message.size() ? cipher.size() : message.size();
+    LimbKernel<Bits> kernel(priv.modulus);
+    for (std::size_t i = 0; i < count; ++i) {
+        message[i] = static_cast<unsigned char>(kernel.pow(cipher[i], priv.exponent)[0]);
+    }
+    return count;
+}
+
+// ---------- runtime dispatch ----------
+
+using AnyRsaKey = std::variant<RsaKey<32>, RsaKey<64>, RsaKey<512>, RsaKey<2048>>;
+
+struct AnyRsaKeyPair {
+    AnyRsaKey pub;
+    AnyRsaKey priv;
+};
+
+// Smallest supported width holding a modulus of `modulusBits` bits, or 0
+unsigned rsaKeyWidthFor(unsigned modulusBits);
+
+unsigned rsaKeyWidth(const AnyRsaKey& key);
+
+// 64-bit limbs per ciphertext word for this key
+std::size_t rsaWordLimbs(const AnyRsaKey& key);
+
+// Throws std::invalid_argument for an unsupported width
+AnyRsaKeyPair generateRsaKeys(unsigned width);
+
+// Parses the decimal exponent/modulus of a key file or WKEY: line and
+// picks the instantiation from the modulus width
+bool parseRsaKey(std::string_view exponent, std::string_view modulus, AnyRsaKey& key);
+
+std::string rsaKeyExponentText(const AnyRsaKey& key);
+
+std::string rsaKeyModulusText(const AnyRsaKey& key);
+
+// Ciphertext is flattened, rsaWordLimbs(key) limbs per message byte, into
+// caller storage: the number of bytes encrypted is returned,
+// min(message.size(), cipher.size() / rsaWordLimbs(key))
+std::size_t rsaEncrypt(const AnyRsaKey& pub, std::span<const std::byte> message, std::span<std::uint64_t> cipher);
+
+// Returns the number of bytes written, min(cipher words, message.size())
+std::size_t rsaDecrypt(const AnyRsaKey& priv, std::span<const std::uint64_t> cipher, std::span<std::byte> message);
+
+// Comma-separated decimal words, the body of a kw= frame
+void appendRsaCipherList(const AnyRsaKey& key, std::span<const std::uint64_t> cipher, std::string& out);
+
+// False for a malformed list or a word not below the key's modulus
+bool parseRsaCipherList(const AnyRsaKey& key, std::string_view body, std::pmr::vector<std::uint64_t>& cipher);
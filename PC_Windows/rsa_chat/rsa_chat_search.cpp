@@ -0,0 +1,209 @@
+#include "rsa_chat_search.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+static constexpr std::size_t kBlockDocs = 128;
+// Longer words are cut here, in queries too, so they still match
+static constexpr std::size_t kMaxTermBytes = 48;
+static constexpr SearchIndex::DocId kNoDoc = std::numeric_limits<SearchIndex::DocId>::max();
+
+// ---------- words ----------
+
+static std::size_t utf8Length(unsigned char lead) {
+    if (lead < 0xC0) return 1; // ASCII, or a stray continuation byte
+    if (lead < 0xE0) return 2;
+    if (lead < 0xF0) return 3;
+    return 4;
+}
+
+// Calls fn(word, prefix) for each word of `text`; `prefix` says a '*'
+// follows it
+template <typename Fn>
+static void forEachTerm(std::string_view text, Fn&& fn) {
+    std::string word;
+    auto flush = [&](std::size_t next) {
+        if (word.empty()) return;
+        fn(std::string_view(word), next < text.size() && text[next] == '*');
+        word.clear();
+    };
+
+    std::size_t i = 0;
+    while (i < text.size()) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c < 0x80) {
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')) {
+                if (word.size() < kMaxTermBytes) word += static_cast<char>(c);
+            } else if (c >= 'A' && c <= 'Z') {
+                if (word.size() < kMaxTermBytes) word += static_cast<char>(c - 'A' + 'a');
+            } else {
+                flush(i);
+            }
+            ++i;
+            continue;
+        }
+
+        const std::size_t length = std::min(utf8Length(c), text.size() - i);
+        const std::string_view character = text.substr(i, length);
+        i += length;
+        if (length >= 3) {
+            // CJK and the like: every character is a word
+            flush(i - length);
+            word = character;
+            flush(i);
+        } else if (word.size() + length <= kMaxTermBytes) {
+            word += character;
+        }
+    }
+    flush(i);
+}
+
+static void appendVarint(std::vector<std::uint8_t>& out, std::uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+// ---------- indexing ----------
+
+void SearchIndex::add(DocId doc, std::string_view text) {
+    // Each word once per message, and one dictionary lookup for it
+    std::size_t used = 0;
+    forEachTerm(text, [&](std::string_view term, bool) {
+        if (used == m_scratch.size()) m_scratch.emplace_back();
+        m_scratch[used++].assign(term);
+    });
+    std::sort(m_scratch.begin(), m_scratch.begin() + static_cast<std::ptrdiff_t>(used));
+    used = static_cast<std::size_t>(std::unique(m_scratch.begin(), m_scratch.begin() + static_cast<std::ptrdiff_t>(used)) -
+                                    m_scratch.begin());
+
+    for (std::size_t t = 0; t < used; ++t) {
+        auto it = m_terms.find(m_scratch[t]);
+        if (it == m_terms.end()) it = m_terms.emplace(m_scratch[t], Postings{}).first;
+        Postings& postings = it->second;
+        if (postings.count > 0 && doc <= postings.last) continue;
+
+        const std::size_t before = postings.bytes.size() + postings.blocks.size() * sizeof(Block);
+        if (postings.count % kBlockDocs == 0) {
+            postings.blocks.push_back({doc, static_cast<std::uint32_t>(postings.bytes.size())});
+        } else {
+            appendVarint(postings.bytes, doc - postings.last);
+        }
+        postings.last = doc;
+        ++postings.count;
+        m_postingBytes += postings.bytes.size() + postings.blocks.size() * sizeof(Block) - before;
+    }
+    ++m_documents;
+}
+
+// ---------- queries ----------
+
+// Walks the union of one or more posting lists from the newest id down.
+// An exact word is a union of one; a prefix spans every word it starts.
+class SearchIndex::Cursor {
+public:
+    void addList(const Postings& postings) {
+        m_lists.push_back({&postings});
+        m_heap.push_back({postings.last, m_lists.size() - 1});
+    }
+
+    bool empty() const { return m_lists.empty(); }
+
+    void start() { std::make_heap(m_heap.begin(), m_heap.end()); }
+
+    // The largest id at most `bound` in any of the lists, or kNoDoc. Lists
+    // only move down, and only those above the bound move at all.
+    DocId seek(DocId bound) {
+        while (!m_heap.empty() && m_heap.front().first > bound) {
+            std::pop_heap(m_heap.begin(), m_heap.end());
+            const std::size_t list = m_heap.back().second;
+            const DocId doc = m_lists[list].seek(bound);
+            if (doc == kNoDoc) {
+                m_heap.pop_back();
+            } else {
+                m_heap.back().first = doc;
+                std::push_heap(m_heap.begin(), m_heap.end());
+            }
+        }
+        return m_heap.empty() ? kNoDoc : m_heap.front().first;
+    }
+
+private:
+    struct List {
+        const Postings* postings;
+
+        // Scans the one block `bound` falls in; a block is short enough
+        // that keeping it decoded would cost more than it saves
+        DocId seek(DocId bound) const {
+            if (bound >= postings->last) return postings->last;
+            const std::vector<Block>& blocks = postings->blocks;
+            auto it = std::upper_bound(blocks.begin(), blocks.end(), bound,
+                                       [](DocId value, const Block& b) { return value < b.first; });
+            if (it == blocks.begin()) return kNoDoc;
+            --it;
+            const std::uint8_t* p = postings->bytes.data() + it->offset;
+            const std::uint8_t* end = postings->bytes.data() +
+                                      (it + 1 != blocks.end() ? (it + 1)->offset : postings->bytes.size());
+            DocId doc = it->first;
+            while (p < end) {
+                std::uint32_t gap = 0;
+                for (unsigned shift = 0;; shift += 7) {
+                    const std::uint8_t byte = *p++;
+                    gap |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) break;
+                }
+                if (doc + gap > bound) break;
+                doc += gap;
+            }
+            return doc;
+        }
+    };
+
+    std::vector<List> m_lists;
+    std::vector<std::pair<DocId, std::size_t>> m_heap; // max-heap on id
+};
+
+std::vector<SearchIndex::DocId> SearchIndex::search(std::string_view query, std::size_t limit) const {
+    std::vector<Cursor> cursors;
+    bool missing = false;
+    forEachTerm(query, [&](std::string_view term, bool prefix) {
+        Cursor& cursor = cursors.emplace_back();
+        if (prefix) {
+            for (auto it = m_terms.lower_bound(term); it != m_terms.end() && it->first.starts_with(term); ++it) {
+                cursor.addList(it->second);
+            }
+        } else if (auto it = m_terms.find(term); it != m_terms.end()) {
+            cursor.addList(it->second);
+        }
+        missing = missing || cursor.empty();
+    });
+
+    std::vector<DocId> results;
+    if (cursors.empty() || missing || limit == 0) return results;
+    for (Cursor& cursor : cursors) cursor.start();
+
+    // Leapfrog: each list in turn moves down to the current target, and a
+    // target every list agrees on is a hit
+    DocId target = kNoDoc - 1;
+    std::size_t agreed = 0;
+    for (std::size_t i = 0;; i = (i + 1) % cursors.size()) {
+        const DocId doc = cursors[i].seek(target);
+        if (doc == kNoDoc) break;
+        if (doc != target) {
+            target = doc;
+            agreed = 1;
+        } else if (++agreed < cursors.size()) {
+            continue;
+        }
+        if (agreed == cursors.size()) {
+            results.push_back(doc);
+            if (results.size() == limit || doc == 0) break;
+            target = doc - 1;
+            agreed = 0;
+        }
+    }
+    return results;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Inverted index over chat messages, built as they arrive. Every word maps
+// to the ids of the messages containing it, stored as varint gaps in
+// blocks of 128 with the first id of each block kept aside, so a list
+// costs a byte or two per message and a lookup decodes only the block it
+// lands in. Queries walk the lists newest first and stop at the limit, so
+// a common word costs no more than a rare one.
+//
+// Words are runs of ASCII letters and digits (case-folded) and of other
+// UTF-8 letters, except that CJK characters, which come without spaces,
+// are words of their own.
+class SearchIndex {
+public:
+    using DocId = std::uint32_t;
+
+    // Indexes `text` as message `doc`. Ids must grow from call to call;
+    // words of a message whose id does not are dropped.
+    void add(DocId doc, std::string_view text);
+
+    // Ids of the messages holding every word of `query`, newest first and
+    // at most `limit` of them. A word followed by '*' matches any word it
+    // starts.
+    std::vector<DocId> search(std::string_view query, std::size_t limit = 100) const;
+
+    std::size_t documentCount() const { return m_documents; }
+    std::size_t termCount() const { return m_terms.size(); }
+    // Posting lists and block tables, without the dictionary
+    std::size_t postingBytes() const { return m_postingBytes; }
+
+private:
+    struct Block {
+        DocId first;
+        std::uint32_t offset; // into Postings::bytes
+    };
+
+    struct Postings {
+        std::vector<std::uint8_t> bytes; // gaps after each block's first id
+        std::vector<Block> blocks;
+        DocId last = 0;
+        std::uint32_t count = 0;
+    };
+
+    class Cursor;
+
+    std::map<std::string, Postings, std::less<>> m_terms;
+    std::vector<std::string> m_scratch;
+    std::size_t m_documents = 0;
+    std::size_t m_postingBytes = 0;
+};
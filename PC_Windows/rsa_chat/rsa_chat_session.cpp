@@ -0,0 +1,178 @@
+#include "rsa_chat_session.h"
+#include "rsa_chat_bitpack.h"
+#include "rsa_chat_metrics.h"
+#include "rsa_chat_trace.h"
+
+#include <charconv>
+#include <utility>
+
+// ---------- sealing ----------
+
+std::size_t appendSealedFrame(const std::string& payload, const PublicKey& pub, const AnyRsaKey* widePub,
+                              const PeerCaps& caps, std::uint64_t messageId, Channel channel, bool more,
+                              FrameHeader& header, std::vector<CipherWord>& cipher, std::string& out) {
+    // Encrypt with THEIR public key, compressing first if the peer can
+    // inflate it
+    header = FrameHeader{};
+    // Only XMSG: frames carry kw=
+    const bool wide = widePub && caps.announced;
+    thread_local std::vector<std::uint64_t> wideCipher;
+    {
+        TraceSpan encryptSpan("encrypt", messageId);
+        if (wide) {
+            sealMessage(payload, *widePub, caps.compression, header, wideCipher);
+            cipher.clear();
+        } else {
+            sealMessage(payload, pub, caps.compression, header, cipher);
+        }
+    }
+    header.messageId = messageId;
+    if (caps.channels) {
+        header.channel = channel;
+        header.more = more;
+    }
+    if (wide) {
+        TraceSpan buildSpan("build_frame", messageId);
+        appendWideMessageFrame(*widePub, wideCipher, header, out);
+        return wideCipher.size() / rsaWordLimbs(*widePub);
+    }
+    // The frame format needs at least 8 bits a word; a modulus that small
+    // cannot carry a byte anyway
+    const unsigned bits = bitpackBits(static_cast<std::uint32_t>(pub.n));
+    if (caps.bitpack && bits >= 8) header.packedBits = bits;
+
+    TraceSpan buildSpan("build_frame", messageId);
+    if (caps.announced) {
+        appendMessageFrame(cipher, header, out);
+    } else {
+        out += "MSG:";
+        appendCipherList(cipher, out);
+        out += '\n';
+    }
+    return cipher.size();
+}
+
+std::uint64_t newMessageId(const PeerCaps& caps) {
+    return traceEnabled() && caps.announced ? traceNewMessageId() : 0;
+}
+
+std::string buildFilePayload(std::string_view name, std::string_view data) {
+    std::string payload;
+    payload.reserve(name.size() + 1 + data.size());
+    payload += name;
+    payload += '\0';
+    payload += data;
+    return payload;
+}
+
+bool splitFilePayload(std::string_view payload, std::string_view& name, std::string_view& data) {
+    const std::size_t nul = payload.find('\0');
+    if (nul == std::string_view::npos) return false;
+    name = payload.substr(0, nul);
+    data = payload.substr(nul + 1);
+    return true;
+}
+
+// ---------- SessionCore ----------
+
+SessionCore::SessionCore(Handlers handlers, const KeyPair& keys)
+    : m_handlers(std::move(handlers)), m_keys(keys),
+      m_receiver({[this](std::string_view line) { handleLine(line); },
+                  [this](const FrameHeader& header, std::string_view plain) { handleFrame(header, plain); },
+                  [this](FrameReceiver::Corrupt what) {
+                      drop(what == FrameReceiver::Corrupt::Oversized ? "Dropped an oversized line."
+                                                                     : "Dropped a corrupt compressed message.");
+                  }},
+                 keys.priv) {}
+
+std::string SessionCore::helloLines() const {
+    std::string hello = "KEY:" + std::to_string(m_keys.pub.e) + ":" + std::to_string(m_keys.pub.n) + "\n";
+    if (m_wideKeys) {
+        hello += "WKEY:" + rsaKeyExponentText(m_wideKeys->pub) + ":" + rsaKeyModulusText(m_wideKeys->pub) + "\n";
+    }
+    hello += buildCapsLine(localCaps());
+    return hello;
+}
+
+void SessionCore::setWideKeys(const AnyRsaKeyPair& keys) {
+    m_wideKeys = keys;
+    m_receiver.setWidePrivateKey(keys.priv);
+}
+
+void SessionCore::reset() {
+    m_receiver.reset();
+    m_assembler.reset();
+    m_remotePublicKey = PublicKey{};
+    m_remoteWideKey.reset();
+    m_peerCaps = PeerCaps{};
+    m_keyArrived = false;
+}
+
+void SessionCore::feed(std::string_view data) {
+    m_feedStartUs = probeClockUs();
+    metricsAdd(Counter::BytesReceived, data.size());
+    // Frames may be split across reads under load; the receiver keeps any
+    // partial line until the rest of it arrives
+    m_receiver.feed(data.data(), data.size());
+    if (m_keyArrived) {
+        m_keyArrived = false;
+        if (m_handlers.ready) m_handlers.ready();
+    }
+}
+
+void SessionCore::handleLine(std::string_view line) {
+    // Message frames never get here, only handshake and probe lines.
+    // Probes come every second, so they are matched first.
+    if (ProbePing ping; parsePingLine(line, ping)) {
+        const ProbePong pong{ping.seq, ping.sentUs, probeClockUs() - m_feedStartUs, m_pongStages.sample()};
+        if (m_handlers.send) m_handlers.send(buildPongLine(pong));
+    } else if (ProbePong pong; parsePongLine(line, pong)) {
+        if (m_handlers.pong) m_handlers.pong(pong);
+    } else if (line.starts_with("KEY:")) {
+        // KEY:<e>:<n>
+        const std::string_view fields = line.substr(4);
+        const std::size_t colon = fields.find(':');
+        if (colon == std::string_view::npos) return;
+        int e = 0;
+        int n = 0;
+        const char* eEnd = fields.data() + colon;
+        const char* nEnd = fields.data() + fields.size();
+        const auto eResult = std::from_chars(fields.data(), eEnd, e);
+        const auto nResult = std::from_chars(eEnd + 1, nEnd, n);
+        if (eResult.ec != std::errc() || eResult.ptr != eEnd || nResult.ec != std::errc() || nResult.ptr != nEnd) {
+            return;
+        }
+        m_remotePublicKey = {e, n};
+        m_keyArrived = true;
+        if (m_handlers.key) m_handlers.key(m_remotePublicKey);
+    } else if (line.starts_with("WKEY:")) {
+        // WKEY:<e>:<n>, sent right after KEY: so it is in before ready()
+        const std::string_view fields = line.substr(5);
+        const std::size_t colon = fields.find(':');
+        if (colon == std::string_view::npos) return;
+        AnyRsaKey key;
+        if (parseRsaKey(fields.substr(0, colon), fields.substr(colon + 1), key)) m_remoteWideKey = key;
+    } else if (line.starts_with("CAPS:")) {
+        m_peerCaps = parseCapsLine(line);
+        if (m_handlers.caps) m_handlers.caps(m_peerCaps);
+    }
+}
+
+void SessionCore::handleFrame(const FrameHeader& header, std::string_view plain) {
+    std::string_view message;
+    switch (m_assembler.add(header.channel, plain, header.more, message)) {
+    case ChannelAssembler::Result::Partial:
+        return;
+    case ChannelAssembler::Result::Overflow:
+        drop(std::string("Dropped an oversized ") + channelName(header.channel) + " message.");
+        return;
+    case ChannelAssembler::Result::Complete:
+        break;
+    }
+    if (m_handlers.message) m_handlers.message(header.channel, header.messageId, message);
+    m_assembler.release(header.channel);
+}
+
+void SessionCore::drop(const std::string& reason) {
+    if (m_handlers.dropped) m_handlers.dropped(reason);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "rsa_chat_channels.h"
+#include "rsa_chat_core.h"
+#include "rsa_chat_probe.h"
+#include "rsa_chat_protocol.h"
+#include "rsa_chat_receive.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The chat protocol of one connection, free of Qt and of any transport:
+// the KEY:/CAPS: handshake (plus WKEY: when a wide key is set), answering PING: lines, decrypting and
+// reassembling frames, and sealing payloads for the peer. ChatSession
+// (Qt signals) and AsyncSession (coroutines) wrap it and only move its
+// bytes.
+
+// Compresses, encrypts and frames one message, or one chunk of it, for a
+// peer with key `pub` and capabilities `caps`, appending the frame to
+// `out`. A peer that sent a WKEY: key gets a kw= frame under `widePub`
+// instead, leaving `cipher` empty. `header` and `cipher` are left
+// describing it; returns the number of ciphertext words. Touches no
+// session, so group sends run it on worker threads.
+std::size_t appendSealedFrame(const std::string& payload, const PublicKey& pub, const AnyRsaKey* widePub,
+                              const PeerCaps& caps, std::uint64_t messageId, Channel channel, bool more,
+                              FrameHeader& header, std::vector<CipherWord>& cipher, std::string& out);
+
+// Trace ID for a new chat message; 0 unless tracing is on and the peer
+// reads XMSG: frames, the only ones that carry it
+std::uint64_t newMessageId(const PeerCaps& caps);
+
+// File transfers are "<name>\0<bytes>" on the file channel
+std::string buildFilePayload(std::string_view name, std::string_view data);
+bool splitFilePayload(std::string_view payload, std::string_view& name, std::string_view& data);
+
+class SessionCore {
+public:
+    struct Handlers {
+        // Protocol lines (pongs) to write and flush straight away
+        std::function<void(std::string_view data)> send;
+        // The peer's KEY: and CAPS: lines (WKEY: is kept, not reported)
+        std::function<void(const PublicKey& key)> key;
+        std::function<void(const PeerCaps& caps)> caps;
+        // The key exchange is done. Fires once the whole read that carried
+        // the KEY: line, normally with the CAPS: line, has been handled.
+        std::function<void()> ready;
+        // A PONG: line, for the owner's LatencyEstimator
+        std::function<void(const ProbePong& pong)> pong;
+        // A complete message, valid only during the call
+        std::function<void(Channel channel, std::uint64_t messageId, std::string_view payload)> message;
+        // A corrupt or oversized message that was discarded
+        std::function<void(const std::string& reason)> dropped;
+    };
+
+    SessionCore(Handlers handlers, const KeyPair& keys);
+
+    SessionCore(const SessionCore&) = delete;
+    SessionCore& operator=(const SessionCore&) = delete;
+
+    // Our KEY:, WKEY: and CAPS: lines, the first thing either side sends.
+    // Old peers ignore the CAPS: line and keep using plain MSG: frames,
+    // and ignore WKEY: so we keep reading their demo-key frames.
+    std::string helloLines() const;
+
+    // A wide key pair to offer in WKEY:, set before helloLines()
+    void setWideKeys(const AnyRsaKeyPair& keys);
+
+    // One read from the connection, handlers called from inside
+    void feed(std::string_view data);
+
+    // Forgets the peer, e.g. before a new connection
+    void reset();
+
+    const KeyPair& keys() const { return m_keys; }
+    const PublicKey& remotePublicKey() const { return m_remotePublicKey; }
+    const PeerCaps& peerCaps() const { return m_peerCaps; }
+    // The peer's WKEY: key, null if it sent none
+    const AnyRsaKey* remoteWideKey() const { return m_remoteWideKey ? &*m_remoteWideKey : nullptr; }
+
+    // appendSealedFrame() for this peer
+    std::size_t seal(const std::string& payload, std::uint64_t messageId, Channel channel, bool more,
+                     FrameHeader& header, std::vector<CipherWord>& cipher, std::string& out) const {
+        return appendSealedFrame(payload, m_remotePublicKey, remoteWideKey(), m_peerCaps, messageId, channel, more,
+                                 header, cipher, out);
+    }
+
+private:
+    void handleLine(std::string_view line);
+    void handleFrame(const FrameHeader& header, std::string_view plain);
+    void drop(const std::string& reason);
+
+    Handlers m_handlers;
+    KeyPair m_keys;
+    std::optional<AnyRsaKeyPair> m_wideKeys;
+    FrameReceiver m_receiver;
+    ChannelAssembler m_assembler;
+    PublicKey m_remotePublicKey{};
+    std::optional<AnyRsaKey> m_remoteWideKey;
+    PeerCaps m_peerCaps;
+    // Set by a KEY: line, acted on once the rest of the read has been
+    // handled
+    bool m_keyArrived = false;
+    StageSampler m_pongStages;
+    // When the read being fed started, for the hold time in our pongs
+    std::uint64_t m_feedStartUs = 0;
+};
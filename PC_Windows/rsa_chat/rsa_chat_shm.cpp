@@ -0,0 +1,793 @@
+#include "rsa_chat_shm.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#endif
+
+bool isLocalAddress(const std::string& host) {
+    if (host == "localhost" || host == "::1" || host.starts_with("127.")) return true;
+#if defined(__linux__)
+    // Peers on a shared machine often give its LAN address instead
+    in_addr v4{};
+    in6_addr v6{};
+    const bool isV4 = ::inet_pton(AF_INET, host.c_str(), &v4) == 1;
+    const bool isV6 = !isV4 && ::inet_pton(AF_INET6, host.c_str(), &v6) == 1;
+    if (!isV4 && !isV6) return false;
+    ifaddrs* list = nullptr;
+    if (::getifaddrs(&list) != 0) return false;
+    bool found = false;
+    for (ifaddrs* ifa = list; ifa && !found; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr) continue;
+        if (isV4 && ifa->ifa_addr->sa_family == AF_INET) {
+            found = reinterpret_cast<sockaddr_in*>(ifa->ifa_addr)->sin_addr.s_addr == v4.s_addr;
+        } else if (isV6 && ifa->ifa_addr->sa_family == AF_INET6) {
+            found = std::memcmp(&reinterpret_cast<sockaddr_in6*>(ifa->ifa_addr)->sin6_addr, &v6, sizeof(v6)) == 0;
+        }
+    }
+    ::freeifaddrs(list);
+    return found;
+#else
+    return false;
+#endif
+}
+
+#if defined(__linux__)
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// Per direction; a chat frame is tens of bytes, a file chunk a few KB
+static constexpr std::size_t kRingBytes = 1 << 20;
+// At most what one received() hands over
+static constexpr std::size_t kDrainBytes = 64 * 1024;
+// Ids of shared-memory connections; the network transport counts up from 1
+static constexpr ConnectionId kLocalBit = ConnectionId{1} << 62;
+// How long either side waits for the other's half of the handshake
+static constexpr int kHandshakeMs = 1000;
+
+// epoll_event.data: channel number << 2 | what became ready. For
+// Accept, the number of an accepted socket still owed the connector's
+// fds, or 0 for the timer that drops those running late.
+enum class Source : std::uint64_t {
+    Listen = 0,
+    Socket = 1,
+    Bell = 2,
+    Accept = 3,
+};
+
+// Positions count every byte ever written or read, so full and empty
+// differ without a spare slot. Each index has one writer.
+struct Ring {
+    alignas(64) std::atomic<std::uint64_t> tail{0}; // producer
+    alignas(64) std::atomic<std::uint64_t> head{0}; // consumer
+    // The consumer is about to sleep, or the producer is stuck on a full
+    // ring; whoever sees the flag clears it and rings the bell
+    alignas(64) std::atomic<std::uint32_t> readerAsleep{0};
+    alignas(64) std::atomic<std::uint32_t> writerBlocked{0};
+    alignas(64) char data[kRingBytes];
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ring indices are shared between processes");
+
+// rings[0] carries what the connecting side sends, rings[1] the replies
+struct Region {
+    Ring rings[2];
+};
+
+static socklen_t rendezvousAddress(std::uint16_t port, sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    // Abstract namespace: nothing on disk to clean up after a crash
+    const int length = std::snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "rsa_chat.%u", port);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + static_cast<std::size_t>(length));
+}
+
+// Anyone can bind an abstract name, so each side checks that the other
+// end of the rendezvous runs as the same user before any fd is passed
+// or mapped: the peer of a connected socket for the connector is the
+// listener as it was when it called listen()
+static bool samePeerUser(int fd) {
+    ucred cred{};
+    socklen_t length = sizeof(cred);
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) == 0 && length == sizeof(cred) &&
+           cred.uid == ::geteuid();
+}
+
+static bool waitReadable(int fd, int timeoutMs) {
+    pollfd p{fd, POLLIN, 0};
+    return ::poll(&p, 1, timeoutMs) == 1;
+}
+
+static void ringBell(int bell) {
+    const std::uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = ::write(bell, &one, sizeof(one));
+}
+
+// Copies as much of `data` as fits behind `tail`; returns how much
+static std::size_t ringWrite(Ring& ring, std::uint64_t& tail, std::string_view data) {
+    const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+    const std::size_t count = std::min<std::size_t>(data.size(), kRingBytes - static_cast<std::size_t>(tail - head));
+    const std::size_t offset = static_cast<std::size_t>(tail % kRingBytes);
+    const std::size_t first = std::min(count, kRingBytes - offset);
+    std::memcpy(ring.data + offset, data.data(), first);
+    std::memcpy(ring.data, data.data() + first, count - first);
+    tail += count;
+    return count;
+}
+
+class SharedMemoryTransport final : public Transport {
+public:
+    explicit SharedMemoryTransport(std::unique_ptr<Transport> network);
+    ~SharedMemoryTransport() override;
+
+    SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+    SharedMemoryTransport& operator=(const SharedMemoryTransport&) = delete;
+
+    bool listen(std::uint16_t port) override;
+    std::uint16_t localPort() const override { return m_network->localPort(); }
+    ConnectionId connect(const std::string& host, std::uint16_t port) override;
+    ConnectionId connectAsync(const std::string& host, std::uint16_t port) override;
+    void send(ConnectionId id, std::string_view data) override;
+    void flush() override;
+    std::size_t pendingBytes(ConnectionId id) const override;
+    void close(ConnectionId id) override;
+    void setReceiving(ConnectionId id, bool enabled) override;
+    std::string peerAddress(ConnectionId id) const override;
+    void tune(ConnectionId id, const TcpTuning& tuning) override;
+    void poll(int timeoutMs) override;
+    void watch(int fd) override { m_network->watch(fd); }
+    // The network transport watches m_epoll, so its fd covers ours
+    int waitFd() const override { return m_network->waitFd(); }
+    bool prepareWait() override;
+    const char* name() const override { return m_name.c_str(); }
+
+private:
+    struct Channel {
+        int socket = -1;
+        int bell = -1;     // rung by the peer
+        int peerBell = -1; // rung for the peer
+        Region* region = nullptr;
+        Ring* in = nullptr;
+        Ring* out = nullptr;
+        std::uint64_t outTail = 0; // written into `out`, not yet published
+        std::string pending;       // did not fit into `out`
+        bool dirty = false;        // listed in m_dirty
+        bool closing = false;      // finish once everything is published
+        bool peerGone = false;     // finish once `in` is drained
+        bool handshaking = false;  // connectAsync(): the listener's ack is due
+        bool paused = false;       // setReceiving(false): `in` is left alone
+
+        ~Channel();
+    };
+
+    enum class Handshake { Waiting, Failed, Accepted };
+    struct PendingAccept {
+        int socket = -1;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    ConnectionId connectLocal(std::uint16_t port, bool wait);
+    bool acceptLocal();
+    Handshake receiveRegion(int socket);
+    void awaitRegion(int socket, std::chrono::steady_clock::time_point deadline);
+    bool onAcceptEvent(std::uint64_t number);
+    void expireAccepts();
+    ConnectionId addChannel(int socket, Region* region, int bell, int peerBell, bool connector);
+    void markDirty(ConnectionId id, Channel& channel);
+    bool publish(Channel& channel);
+    bool drain(ConnectionId id, Channel& channel);
+    bool processEvents();
+    bool readyToSleep();
+    void reportDrained();
+    void finish(ConnectionId id);
+
+    std::unique_ptr<Transport> m_network;
+    std::string m_name;
+    int m_epoll = -1;
+    int m_listenFd = -1;
+    // Accepted sockets whose connector has not sent its fds yet, and the
+    // timerfd set for the earliest deadline among them
+    std::unordered_map<std::uint64_t, PendingAccept> m_pendingAccepts;
+    std::uint64_t m_nextPending = 0;
+    int m_acceptTimer = -1;
+    ConnectionId m_nextId = 0;
+    // Held by pointer: handlers may open connections while one is in use
+    std::unordered_map<ConnectionId, std::unique_ptr<Channel>> m_channels;
+    std::vector<ConnectionId> m_dirty;
+    std::vector<ConnectionId> m_stillDirty;
+    std::vector<ConnectionId> m_scan;
+    // Published in full by the last flush(), for the drained handler
+    std::vector<ConnectionId> m_drained;
+    bool m_reportingDrained = false;
+};
+
+SharedMemoryTransport::Channel::~Channel() {
+    if (socket >= 0) ::close(socket);
+    if (bell >= 0) ::close(bell);
+    if (peerBell >= 0) ::close(peerBell);
+    if (region) ::munmap(region, sizeof(Region));
+}
+
+SharedMemoryTransport::SharedMemoryTransport(std::unique_ptr<Transport> network)
+    : m_network(std::move(network)), m_name(std::string("shm+") + m_network->name()) {
+    // Connections of the network transport report straight through
+    m_network->setHandlers({
+        [this](ConnectionId id) {
+            if (m_handlers.accepted) m_handlers.accepted(id);
+        },
+        [this](ConnectionId id, std::string_view data) {
+            if (m_handlers.received) m_handlers.received(id, data);
+        },
+        [this](ConnectionId id) {
+            if (m_handlers.closed) m_handlers.closed(id);
+        },
+        [this](ConnectionId id) {
+            if (m_handlers.connected) m_handlers.connected(id);
+        },
+        [this](ConnectionId id) {
+            if (m_handlers.drained) m_handlers.drained(id);
+        },
+    });
+    // One fd for all local activity, so the network transport's wait
+    // also ends when a peer rings or connects
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll >= 0) m_network->watch(m_epoll);
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    m_channels.clear();
+    for (const auto& [number, pending] : m_pendingAccepts) ::close(pending.socket);
+    if (m_acceptTimer >= 0) ::close(m_acceptTimer);
+    if (m_listenFd >= 0) ::close(m_listenFd);
+    // The network transport may still watch the epoll fd until it goes
+    m_network.reset();
+    if (m_epoll >= 0) ::close(m_epoll);
+}
+
+bool SharedMemoryTransport::listen(std::uint16_t port) {
+    if (!m_network->listen(port)) return false;
+    if (m_epoll < 0) return true;
+
+    // A name already taken is another process on this port, or someone
+    // squatting it; either way local peers would not reach us, so the
+    // caller hears about it instead of getting a silent TCP fallback
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return false;
+    sockaddr_un addr;
+    const socklen_t length = rendezvousAddress(m_network->localPort(), addr);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = static_cast<std::uint64_t>(Source::Listen);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), length) < 0 || ::listen(fd, SOMAXCONN) < 0 ||
+        ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ::close(fd);
+        return false;
+    }
+    m_listenFd = fd;
+
+    // Without it a connector that never sends its fds keeps its socket
+    // until it hangs up
+    m_acceptTimer = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    event.data.u64 = static_cast<std::uint64_t>(Source::Accept);
+    if (m_acceptTimer >= 0 && ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_acceptTimer, &event) < 0) {
+        ::close(m_acceptTimer);
+        m_acceptTimer = -1;
+    }
+    return true;
+}
+
+ConnectionId SharedMemoryTransport::connect(const std::string& host, std::uint16_t port) {
+    if (m_epoll >= 0 && isLocalAddress(host)) {
+        if (const ConnectionId id = connectLocal(port, true)) return id;
+    }
+    return m_network->connect(host, port);
+}
+
+ConnectionId SharedMemoryTransport::connectAsync(const std::string& host, std::uint16_t port) {
+    if (m_epoll >= 0 && isLocalAddress(host)) {
+        if (const ConnectionId id = connectLocal(port, false)) return id;
+    }
+    return m_network->connectAsync(host, port);
+}
+
+// Creates the region and both bells and hands them to the listener. With
+// `wait` it blocks for the listener's acknowledgement; otherwise that is
+// left to processEvents(), which reports connected() or closed(). 0 if
+// nobody local listens on the port.
+ConnectionId SharedMemoryTransport::connectLocal(std::uint16_t port, bool wait) {
+    // Connecting to a listening Unix socket completes at once
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    sockaddr_un addr;
+    const socklen_t length = rendezvousAddress(port, addr);
+    // Someone else's socket under the name gets nothing and the caller
+    // goes over the network instead
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), length) < 0 || !samePeerUser(fd)) {
+        ::close(fd);
+        return 0;
+    }
+
+    const int memory = ::memfd_create("rsa_chat_shm", MFD_CLOEXEC);
+    void* mapped = MAP_FAILED;
+    if (memory >= 0 && ::ftruncate(memory, sizeof(Region)) == 0) {
+        mapped = ::mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    }
+    const int bells[2] = {::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK), ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+    auto fail = [&] {
+        for (int bell : bells) {
+            if (bell >= 0) ::close(bell);
+        }
+        if (mapped != MAP_FAILED) ::munmap(mapped, sizeof(Region));
+        if (memory >= 0) ::close(memory);
+        ::close(fd);
+        return ConnectionId{0};
+    };
+    if (mapped == MAP_FAILED || bells[0] < 0 || bells[1] < 0) return fail();
+    Region* region = new (mapped) Region;
+
+    // The region, then our bell, then the listener's
+    const int fds[3] = {memory, bells[0], bells[1]};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    char byte = 0;
+    iovec iov{&byte, 1};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (::sendmsg(fd, &message, MSG_NOSIGNAL) != 1) return fail();
+    if (wait) {
+        // Connecting to ourselves: nobody else is going to answer
+        if (m_listenFd >= 0 && port == m_network->localPort()) acceptLocal();
+        if (!waitReadable(fd, kHandshakeMs) || ::recv(fd, &byte, 1, 0) != 1) return fail();
+    }
+    ::close(memory);
+
+    const ConnectionId id = addChannel(fd, region, bells[0], bells[1], true);
+    // Sends can go into the ring already; the listener reads them once
+    // it has mapped the region
+    if (id && !wait) m_channels[id]->handshaking = true;
+    return id;
+}
+
+// True if any peer got through. Runs on the event loop, so a connector
+// whose fds are not in yet is left to processEvents() rather than waited
+// for.
+bool SharedMemoryTransport::acceptLocal() {
+    bool accepted = false;
+    for (;;) {
+        const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) return accepted;
+        if (!samePeerUser(fd)) {
+            ::close(fd);
+            continue;
+        }
+        // The connector sends its fds right after connecting, so they are
+        // usually there already
+        switch (receiveRegion(fd)) {
+        case Handshake::Waiting:
+            awaitRegion(fd, std::chrono::steady_clock::now() + std::chrono::milliseconds(kHandshakeMs));
+            break;
+        case Handshake::Failed:
+            break;
+        case Handshake::Accepted:
+            accepted = true;
+            break;
+        }
+    }
+}
+
+// Maps the connector's region and reports the new channel. Takes
+// ownership of `socket` unless the fds have not arrived yet.
+SharedMemoryTransport::Handshake SharedMemoryTransport::receiveRegion(int socket) {
+    int fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    char byte = 0;
+    iovec iov{&byte, 1};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    const ssize_t got = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return Handshake::Waiting;
+    if (got == 1) {
+        const cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+    }
+
+    void* mapped = MAP_FAILED;
+    struct stat info {};
+    if (fds[0] >= 0 && ::fstat(fds[0], &info) == 0 && static_cast<std::size_t>(info.st_size) >= sizeof(Region)) {
+        mapped = ::mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    }
+    if (fds[0] >= 0) ::close(fds[0]);
+    if (mapped == MAP_FAILED || fds[1] < 0 || fds[2] < 0) {
+        if (mapped != MAP_FAILED) ::munmap(mapped, sizeof(Region));
+        if (fds[1] >= 0) ::close(fds[1]);
+        if (fds[2] >= 0) ::close(fds[2]);
+        ::close(socket);
+        return Handshake::Failed;
+    }
+
+    // The connector built the region before sending it
+    const ConnectionId id = addChannel(socket, static_cast<Region*>(mapped), fds[2], fds[1], false);
+    if (!id) return Handshake::Failed;
+    byte = 1;
+    ::send(socket, &byte, 1, MSG_NOSIGNAL);
+    if (m_handlers.accepted) m_handlers.accepted(id);
+    return Handshake::Accepted;
+}
+
+// Watches `socket` for the connector's fds until `deadline`
+void SharedMemoryTransport::awaitRegion(int socket, std::chrono::steady_clock::time_point deadline) {
+    const std::uint64_t number = ++m_nextPending;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u64 = number << 2 | static_cast<std::uint64_t>(Source::Accept);
+    if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &event) < 0) {
+        ::close(socket);
+        return;
+    }
+    m_pendingAccepts.emplace(number, PendingAccept{socket, deadline});
+    expireAccepts();
+}
+
+// True if a peer got through
+bool SharedMemoryTransport::onAcceptEvent(std::uint64_t number) {
+    if (number == 0) {
+        std::uint64_t expirations;
+        [[maybe_unused]] const ssize_t got = ::read(m_acceptTimer, &expirations, sizeof(expirations));
+        expireAccepts();
+        return false;
+    }
+    auto it = m_pendingAccepts.find(number);
+    if (it == m_pendingAccepts.end()) return false;
+    const PendingAccept pending = it->second;
+    m_pendingAccepts.erase(it);
+    // addChannel() registers the socket again under its channel number
+    ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, pending.socket, nullptr);
+    switch (receiveRegion(pending.socket)) {
+    case Handshake::Waiting:
+        awaitRegion(pending.socket, pending.deadline);
+        return false;
+    case Handshake::Failed:
+        return false;
+    case Handshake::Accepted:
+        return true;
+    }
+    return false;
+}
+
+// Drops the pending accepts that are past their deadline and sets the
+// timer for the next one
+void SharedMemoryTransport::expireAccepts() {
+    const auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto it = m_pendingAccepts.begin(); it != m_pendingAccepts.end();) {
+        if (it->second.deadline <= now) {
+            ::close(it->second.socket);
+            it = m_pendingAccepts.erase(it);
+            continue;
+        }
+        next = std::min(next, it->second.deadline);
+        ++it;
+    }
+    if (m_acceptTimer < 0 || m_pendingAccepts.empty()) return;
+    // All zero would disarm it
+    const auto wait = std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(next - now),
+                               std::chrono::nanoseconds(1));
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(wait.count() / 1000000000);
+    spec.it_value.tv_nsec = static_cast<long>(wait.count() % 1000000000);
+    ::timerfd_settime(m_acceptTimer, 0, &spec, nullptr);
+}
+
+// Takes ownership of every fd and the mapping, also on failure
+ConnectionId SharedMemoryTransport::addChannel(int socket, Region* region, int bell, int peerBell, bool connector) {
+    auto channel = std::make_unique<Channel>();
+    channel->socket = socket;
+    channel->bell = bell;
+    channel->peerBell = peerBell;
+    channel->region = region;
+    channel->in = &region->rings[connector ? 1 : 0];
+    channel->out = &region->rings[connector ? 0 : 1];
+    channel->outTail = channel->out->tail.load(std::memory_order_relaxed);
+
+    const ConnectionId number = ++m_nextId;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u64 = number << 2 | static_cast<std::uint64_t>(Source::Socket);
+    if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &event) < 0) return 0;
+    event.events = EPOLLIN;
+    event.data.u64 = number << 2 | static_cast<std::uint64_t>(Source::Bell);
+    if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, bell, &event) < 0) return 0;
+
+    const ConnectionId id = kLocalBit | number;
+    m_channels.emplace(id, std::move(channel));
+    return id;
+}
+
+void SharedMemoryTransport::markDirty(ConnectionId id, Channel& channel) {
+    if (channel.dirty) return;
+    channel.dirty = true;
+    m_dirty.push_back(id);
+}
+
+void SharedMemoryTransport::send(ConnectionId id, std::string_view data) {
+    if (!(id & kLocalBit)) {
+        m_network->send(id, data);
+        return;
+    }
+    auto it = m_channels.find(id);
+    if (it == m_channels.end() || it->second->closing || it->second->peerGone || data.empty()) return;
+    Channel& channel = *it->second;
+    // Straight into shared memory; the reader sees it at the next flush()
+    if (channel.pending.empty()) data.remove_prefix(ringWrite(*channel.out, channel.outTail, data));
+    channel.pending.append(data);
+    markDirty(id, channel);
+}
+
+// Makes everything written visible to the reader and wakes it if it
+// sleeps. False while some of it is still waiting for room in the ring.
+bool SharedMemoryTransport::publish(Channel& channel) {
+    Ring& out = *channel.out;
+    for (;;) {
+        if (!channel.pending.empty()) {
+            channel.pending.erase(0, ringWrite(out, channel.outTail, channel.pending));
+        }
+        out.tail.store(channel.outTail, std::memory_order_release);
+        // Pairs with the reader's store of readerAsleep and reload of tail
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (out.readerAsleep.load(std::memory_order_relaxed) && out.readerAsleep.exchange(0)) {
+            ringBell(channel.peerBell);
+        }
+        if (channel.pending.empty()) return true;
+
+        // Full: have the reader ring once it makes room, unless it already did
+        out.writerBlocked.store(1, std::memory_order_seq_cst);
+        if (channel.outTail - out.head.load(std::memory_order_seq_cst) == kRingBytes) return false;
+    }
+}
+
+void SharedMemoryTransport::flush() {
+    m_network->flush();
+    m_stillDirty.clear();
+    for (ConnectionId id : m_dirty) {
+        auto it = m_channels.find(id);
+        if (it == m_channels.end()) continue;
+        Channel& channel = *it->second;
+        channel.dirty = !publish(channel);
+        if (channel.dirty) {
+            m_stillDirty.push_back(id);
+        } else if (!channel.closing) {
+            m_drained.push_back(id);
+        }
+    }
+    m_dirty.swap(m_stillDirty);
+    reportDrained();
+}
+
+// After the loop, as the handlers may send and flush again
+void SharedMemoryTransport::reportDrained() {
+    if (m_reportingDrained) return;
+    m_reportingDrained = true;
+    for (std::size_t i = 0; i < m_drained.size(); ++i) {
+        if (m_handlers.drained) m_handlers.drained(m_drained[i]);
+    }
+    m_drained.clear();
+    m_reportingDrained = false;
+}
+
+std::size_t SharedMemoryTransport::pendingBytes(ConnectionId id) const {
+    if (!(id & kLocalBit)) return m_network->pendingBytes(id);
+    auto it = m_channels.find(id);
+    return it == m_channels.end() ? 0 : it->second->pending.size();
+}
+
+std::string SharedMemoryTransport::peerAddress(ConnectionId id) const {
+    if (!(id & kLocalBit)) return m_network->peerAddress(id);
+    // Only loopback names take the shortcut
+    return m_channels.count(id) ? "127.0.0.1" : "";
+}
+
+void SharedMemoryTransport::tune(ConnectionId id, const TcpTuning& tuning) {
+    if (!(id & kLocalBit)) m_network->tune(id, tuning);
+}
+
+void SharedMemoryTransport::close(ConnectionId id) {
+    if (!(id & kLocalBit)) {
+        m_network->close(id);
+        return;
+    }
+    auto it = m_channels.find(id);
+    if (it == m_channels.end()) return;
+    it->second->closing = true;
+    // What is left in the ring is drained before the channel goes
+    it->second->paused = false;
+}
+
+void SharedMemoryTransport::setReceiving(ConnectionId id, bool enabled) {
+    if (!(id & kLocalBit)) {
+        m_network->setReceiving(id, enabled);
+        return;
+    }
+    // A paused reader stops freeing ring space, which blocks the writer
+    // once the ring is full; processEvents() looks at every ring anyway
+    auto it = m_channels.find(id);
+    if (it != m_channels.end()) it->second->paused = !enabled;
+}
+
+// Hands what is in the inbound ring to the handler, straight out of the
+// shared region, then frees the space. False if there was nothing.
+bool SharedMemoryTransport::drain(ConnectionId id, Channel& channel) {
+    if (channel.paused) return false;
+    Ring& in = *channel.in;
+    in.readerAsleep.store(0, std::memory_order_relaxed);
+    std::uint64_t head = in.head.load(std::memory_order_relaxed);
+    const std::uint64_t tail = in.tail.load(std::memory_order_acquire);
+    if (tail == head) return false;
+    if (tail - head > kRingBytes) {
+        // Only a broken or hostile peer writes that
+        channel.peerGone = true;
+        return false;
+    }
+    // In pieces, so that a handler that pauses leaves the rest in the ring
+    while (head != tail && !channel.paused) {
+        const std::size_t offset = static_cast<std::size_t>(head % kRingBytes);
+        const std::size_t length = std::min({static_cast<std::size_t>(tail - head), kRingBytes - offset, kDrainBytes});
+        if (m_handlers.received) m_handlers.received(id, std::string_view(in.data + offset, length));
+        head += length;
+    }
+    in.head.store(head, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (in.writerBlocked.load(std::memory_order_relaxed) && in.writerBlocked.exchange(0)) {
+        ringBell(channel.peerBell);
+    }
+    return true;
+}
+
+// True if any handler ran
+bool SharedMemoryTransport::processEvents() {
+    if (m_epoll < 0) return false;
+    bool active = false;
+    epoll_event events[64];
+    const int count = ::epoll_wait(m_epoll, events, 64, 0);
+    for (int i = 0; i < count; ++i) {
+        const auto source = static_cast<Source>(events[i].data.u64 & 3);
+        const ConnectionId id = kLocalBit | events[i].data.u64 >> 2;
+        if (source == Source::Listen) {
+            active |= acceptLocal();
+            continue;
+        }
+        if (source == Source::Accept) {
+            active |= onAcceptEvent(events[i].data.u64 >> 2);
+            continue;
+        }
+        auto it = m_channels.find(id);
+        if (it == m_channels.end()) continue;
+        if (source == Source::Bell) {
+            std::uint64_t rings;
+            [[maybe_unused]] const ssize_t got = ::read(it->second->bell, &rings, sizeof(rings));
+        } else {
+            // The peer writes to the socket only to acknowledge the
+            // handshake, so otherwise readable means gone
+            char byte;
+            const ssize_t got = ::recv(it->second->socket, &byte, 1, MSG_DONTWAIT);
+            if (got == 1 && it->second->handshaking) {
+                it->second->handshaking = false;
+                if (m_handlers.connected) m_handlers.connected(id);
+                active = true;
+            } else if (got >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                it->second->peerGone = true;
+            }
+        }
+    }
+
+    // Every ring, bell or not: a writer only rings for a sleeping reader.
+    // By id, since handlers may open and close connections.
+    m_scan.clear();
+    for (const auto& [id, channel] : m_channels) m_scan.push_back(id);
+    for (ConnectionId id : m_scan) {
+        auto it = m_channels.find(id);
+        if (it == m_channels.end()) continue;
+        active |= drain(id, *it->second);
+        it = m_channels.find(id);
+        if (it == m_channels.end()) continue;
+        const Channel& channel = *it->second;
+        // A paused channel may still hold the peer's last words
+        if ((channel.peerGone && !channel.paused) ||
+            (channel.closing && !channel.dirty && channel.pending.empty())) {
+            finish(id);
+            active = true;
+        }
+    }
+    return active;
+}
+
+// The peer sees the socket close and, after draining what is left in the
+// ring, closes its end too
+void SharedMemoryTransport::finish(ConnectionId id) {
+    m_channels.erase(id);
+    if (m_handlers.closed) m_handlers.closed(id);
+}
+
+void SharedMemoryTransport::poll(int timeoutMs) {
+    flush();
+    // Whatever came in while the caller was busy counts as activity
+    if (processEvents()) timeoutMs = 0;
+    flush();
+
+    if (timeoutMs != 0 && !readyToSleep()) timeoutMs = 0;
+    m_network->poll(timeoutMs);
+
+    processEvents();
+    flush();
+}
+
+// Every peer that publishes from here on rings; whatever came in before
+// the flag was up is caught by the second look. False if a channel has
+// work already.
+bool SharedMemoryTransport::readyToSleep() {
+    bool ready = true;
+    for (auto& [id, channel] : m_channels) {
+        Ring& in = *channel->in;
+        in.readerAsleep.store(1, std::memory_order_seq_cst);
+        const bool waiting = in.tail.load(std::memory_order_seq_cst) != in.head.load(std::memory_order_relaxed);
+        // A paused ring keeps what it has until setReceiving()
+        const bool readable = !channel->paused && (waiting || channel->peerGone);
+        if (readable || (channel->closing && !channel->dirty)) ready = false;
+    }
+    return ready;
+}
+
+// The epoll fd is checked too: with the Qt backend only the event loop
+// watches it, and nothing else would call poll() for what it reports
+bool SharedMemoryTransport::prepareWait() {
+    flush();
+    if (!m_network->prepareWait() || !readyToSleep()) return false;
+    if (m_epoll < 0) return true;
+    pollfd local{m_epoll, POLLIN, 0};
+    return ::poll(&local, 1, 0) == 0;
+}
+
+std::unique_ptr<Transport> withSharedMemory(std::unique_ptr<Transport> network) {
+    if (!network) return network;
+    return std::make_unique<SharedMemoryTransport>(std::move(network));
+}
+
+#else
+
+std::unique_ptr<Transport> withSharedMemory(std::unique_ptr<Transport> network) {
+    return network;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+
+#include <memory>
+#include <string>
+
+// Same-host shortcut for any Transport. listen() also opens a rendezvous
+// named after the port (an abstract Unix socket), and connect() to an
+// address of this machine goes through it when it is there: the two ends
+// then share a memory region with a single-producer/single-consumer ring
+// per direction, so bytes are copied once, straight into the peer's view,
+// and no system call is made while both sides are busy. An eventfd per
+// end wakes a sleeping peer; it is only rung when the peer said it is
+// going to sleep. Everything else, and any peer elsewhere, goes to the
+// wrapped transport, and connection ids of both kinds mix freely.
+//
+// The Unix socket stays open for the life of the connection: its EOF is
+// how either side learns that the other closed or died.
+//
+// Both ends of the rendezvous check with SO_PEERCRED that the other runs
+// as the same user, so another account on the machine can neither pose
+// as the listener nor map a region into it. listen() fails if the
+// rendezvous cannot be set up, e.g. because its name is already taken.
+//
+// Linux only; elsewhere the network transport is returned unchanged.
+std::unique_ptr<Transport> withSharedMemory(std::unique_ptr<Transport> network);
+
+// Loopback, "localhost" and this machine's own interface addresses
+bool isLocalAddress(const std::string& host);
@@ -0,0 +1,47 @@
+#include "rsa_chat_simd.h"
+
+#if defined(RSA_CHAT_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+bool cpuHasSse41() {
+#if defined(RSA_CHAT_X86)
+    static const bool sse41 = [] {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 19)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+    }();
+    return sse41;
+#else
+    return false;
+#endif
+}
+
+bool cpuHasAvx2() {
+#if defined(RSA_CHAT_X86)
+    static const bool avx2 = [] {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        // The OS must save the YMM registers too
+        const bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        if (!osAvx) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }();
+    return avx2;
+#else
+    return false;
+#endif
+}
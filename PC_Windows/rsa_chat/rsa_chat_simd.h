@@ -0,0 +1,20 @@
+#pragma once
+
+// Vector kernels are compiled per function for their instruction set and
+// chosen at run time, so one binary runs on any x86 CPU. Off x86 only the
+// scalar code is built.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RSA_CHAT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+// MSVC compiles any intrinsic without per-function target flags
+#define RSA_CHAT_TARGET(isa)
+#else
+#define RSA_CHAT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// What this CPU (and OS) supports, detected once; false off x86
+bool cpuHasSse41();
+bool cpuHasAvx2();
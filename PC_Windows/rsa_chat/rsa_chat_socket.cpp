@@ -0,0 +1,122 @@
+#include "rsa_chat_socket.h"
+
+#if defined(__linux__)
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <cstring>
+
+void setNoDelay(int fd) {
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+void tuneSocket(int fd, const TcpTuning& tuning) {
+    int noDelay = tuning.noDelay ? 1 : 0;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    if (tuning.sendBufferBytes > 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &tuning.sendBufferBytes, sizeof(tuning.sendBufferBytes));
+    }
+    if (tuning.receiveBufferBytes > 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &tuning.receiveBufferBytes, sizeof(tuning.receiveBufferBytes));
+    }
+    if (tuning.unsentLimitBytes > 0) {
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &tuning.unsentLimitBytes, sizeof(tuning.unsentLimitBytes));
+    }
+}
+
+std::string socketPeer(int fd) {
+    sockaddr_storage addr{};
+    socklen_t length = sizeof(addr);
+    if (::getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &length) < 0) return {};
+    char text[INET6_ADDRSTRLEN] = {};
+    if (addr.ss_family == AF_INET) {
+        ::inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&addr)->sin_addr, text, sizeof(text));
+    } else if (addr.ss_family == AF_INET6) {
+        const in6_addr& in6 = reinterpret_cast<sockaddr_in6*>(&addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&in6)) {
+            ::inet_ntop(AF_INET, in6.s6_addr + 12, text, sizeof(text));
+        } else {
+            ::inet_ntop(AF_INET6, &in6, text, sizeof(text));
+        }
+    }
+    return text;
+}
+
+int listenSocket(std::uint16_t port, int flags, std::uint16_t& boundPort) {
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    const bool v6 = fd >= 0;
+    if (!v6) fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    int zero = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_storage addr{};
+    socklen_t addrLen;
+    if (v6) {
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        auto* in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        in6->sin6_addr = in6addr_any;
+        addrLen = sizeof(sockaddr_in6);
+    } else {
+        auto* in4 = reinterpret_cast<sockaddr_in*>(&addr);
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        in4->sin_addr.s_addr = htonl(INADDR_ANY);
+        addrLen = sizeof(sockaddr_in);
+    }
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0 || ::listen(fd, SOMAXCONN) < 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    boundPort = ntohs(v6 ? reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port
+                         : reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+    return fd;
+}
+
+static addrinfo* resolve(const std::string& host, std::uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &results) != 0) return nullptr;
+    return results;
+}
+
+int connectSocket(const std::string& host, std::uint16_t port) {
+    addrinfo* results = resolve(host, port);
+    if (!results) return -1;
+
+    int fd = -1;
+    for (addrinfo* ai = results; ai; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(results);
+    return fd;
+}
+
+bool resolveFirst(const std::string& host, std::uint16_t port, sockaddr_storage& addr, socklen_t& length) {
+    addrinfo* results = resolve(host, port);
+    if (!results) return false;
+    const bool fits = results->ai_addrlen <= sizeof(addr);
+    if (fits) {
+        std::memcpy(&addr, results->ai_addr, results->ai_addrlen);
+        length = static_cast<socklen_t>(results->ai_addrlen);
+    }
+    ::freeaddrinfo(results);
+    return fits;
+}
+
+#endif
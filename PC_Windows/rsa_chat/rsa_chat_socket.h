@@ -0,0 +1,36 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+
+#include <cstdint>
+#include <string>
+
+// Plain BSD-socket plumbing shared by the epoll and io_uring backends,
+// which differ only in how they wait. Linux only, like them.
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+
+void setNoDelay(int fd);
+
+void tuneSocket(int fd, const TcpTuning& tuning);
+
+// IPv4 peers of the dual-stack listener without the ::ffff: prefix
+std::string socketPeer(int fd);
+
+// Listening socket on `port` (0 picks a free one), dual-stack like
+// QHostAddress::Any and IPv4 only where IPv6 is missing. `flags` are
+// extra socket() type flags such as SOCK_NONBLOCK. Returns the fd and
+// the port it got, or -1.
+int listenSocket(std::uint16_t port, int flags, std::uint16_t& boundPort);
+
+// Blocking connect to the first of the host's addresses that answers;
+// the fd, or -1
+int connectSocket(const std::string& host, std::uint16_t port);
+
+// First address of `host`, for a connect that is not waited for: trying
+// the next one would mean waiting for this one to fail first
+bool resolveFirst(const std::string& host, std::uint16_t port, sockaddr_storage& addr, socklen_t& length);
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads draining one FIFO of jobs. Jobs must not
+// touch Qt objects living on other threads; hand results back through a
+// queued call instead.
+class ThreadPool {
+public:
+    // 0 picks one worker per hardware thread
+    explicit ThreadPool(std::size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> job);
+
+    std::size_t size() const { return m_workers.size(); }
+
+private:
+    void workerLoop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_jobs;
+    std::vector<std::thread> m_workers;
+    bool m_stopping = false;
+};
@@ -0,0 +1,157 @@
+#include "rsa_chat_trace.h"
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+
+namespace {
+
+constexpr std::size_t kRingCapacity = 1u << 14;
+
+struct TraceEvent {
+    const char* name;
+    std::int64_t startUs;
+    std::int64_t durationNs;
+    std::uint64_t messageId;
+    char phase; // 'X' span, 's'/'f' flow start/finish
+};
+
+// The mutex is only ever contended while an export is running
+struct Ring {
+    std::mutex mutex;
+    std::array<TraceEvent, kRingCapacity> events;
+    std::uint64_t written = 0;
+    int tid = 0;
+};
+
+struct TraceRegistry {
+    std::atomic<bool> enabled{false};
+    std::atomic<std::uint64_t> nextMessage{1};
+    std::uint64_t processTag = std::random_device{}();
+    std::mutex mutex;
+    std::deque<Ring> rings;
+};
+
+} // namespace
+
+static TraceRegistry& traceRegistry() {
+    static TraceRegistry instance;
+    return instance;
+}
+
+static Ring& localRing() {
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        TraceRegistry& reg = traceRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        ring = &reg.rings.emplace_back();
+        ring->tid = static_cast<int>(reg.rings.size());
+    }
+    return *ring;
+}
+
+static void appendEvent(const TraceEvent& event) {
+    Ring& ring = localRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.written % kRingCapacity] = event;
+    ++ring.written;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+void traceSetEnabled(bool enabled) {
+    traceRegistry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool traceEnabled() {
+    return traceRegistry().enabled.load(std::memory_order_relaxed);
+}
+
+std::uint64_t traceNewMessageId() {
+    TraceRegistry& reg = traceRegistry();
+    std::uint64_t seq = reg.nextMessage.fetch_add(1, std::memory_order_relaxed);
+    return (reg.processTag << 32) | (seq & 0xffffffffu);
+}
+
+std::int64_t traceNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void traceRecord(const char* name, std::int64_t startUs, std::int64_t durationNs,
+                 std::uint64_t messageId) {
+    appendEvent(TraceEvent{name, startUs, durationNs, messageId, 'X'});
+}
+
+void traceFlow(const char* name, std::uint64_t messageId, bool begin) {
+    if (!traceEnabled() || messageId == 0) return;
+    appendEvent(TraceEvent{name, traceNowUs(), 0, messageId, begin ? 's' : 'f'});
+}
+
+bool traceExportChromeJson(const std::string& filename, const std::string& processName) {
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file) return false;
+
+    TraceRegistry& reg = traceRegistry();
+    const std::uint64_t pid = reg.processTag & 0x7fffffff;
+
+    // One event per line, so traceMergeChromeJson() can splice files
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+         << ",\"args\":{\"name\":\"" << jsonEscape(processName) << "\"}}";
+
+    std::lock_guard<std::mutex> regLock(reg.mutex);
+    for (Ring& ring : reg.rings) {
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        std::uint64_t first = ring.written > kRingCapacity ? ring.written - kRingCapacity : 0;
+        for (std::uint64_t i = first; i < ring.written; ++i) {
+            const TraceEvent& ev = ring.events[i % kRingCapacity];
+            file << ",\n{\"name\":\"" << ev.name << "\",\"cat\":\"rsa_chat\",\"ph\":\"" << ev.phase
+                 << "\",\"ts\":" << ev.startUs << ",\"pid\":" << pid << ",\"tid\":" << ring.tid;
+            if (ev.phase == 'X') {
+                file << ",\"dur\":" << ev.durationNs / 1000.0;
+            } else {
+                file << ",\"id\":\"" << ev.messageId << "\"";
+                if (ev.phase == 'f') file << ",\"bp\":\"e\"";
+            }
+            if (ev.messageId != 0) {
+                file << ",\"args\":{\"msg_id\":\"" << ev.messageId << "\"}";
+            }
+            file << "}";
+        }
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+bool traceMergeChromeJson(const std::vector<std::string>& inputs, const std::string& output) {
+    std::ofstream out(output, std::ios::trunc);
+    if (!out) return false;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const std::string& input : inputs) {
+        std::ifstream in(input);
+        if (!in) return false;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] != '{' || line.rfind("{\"displayTimeUnit\"", 0) == 0) continue;
+            if (line.back() == ',') line.pop_back();
+            out << (first ? "\n" : ",\n") << line;
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Optional span tracing. Each thread appends to its own fixed-size ring
+// (oldest events are overwritten), and the rings are exported in the
+// Chrome trace-event JSON format understood by chrome://tracing and
+// Perfetto. Timestamps are wall-clock microseconds so the traces of two
+// peers on different machines can be merged into one timeline; spans
+// carry the message ID from the frame header to tie both sides together.
+
+void traceSetEnabled(bool enabled);
+
+bool traceEnabled();
+
+// Unique across peers: a random per-process prefix plus a counter
+std::uint64_t traceNewMessageId();
+
+void traceRecord(const char* name, std::int64_t startUs, std::int64_t durationNs,
+                 std::uint64_t messageId);
+
+// Flow arrows between the sender's and receiver's spans of one message
+void traceFlow(const char* name, std::uint64_t messageId, bool begin);
+
+bool traceExportChromeJson(const std::string& filename, const std::string& processName);
+
+// Combines files written by traceExportChromeJson() into one trace
+bool traceMergeChromeJson(const std::vector<std::string>& inputs, const std::string& output);
+
+std::int64_t traceNowUs();
+
+// Records the lifetime of the scope as a complete ("X") event. `name`
+// must be a string literal or otherwise outlive the trace buffers.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, std::uint64_t messageId = 0)
+        : m_name(name), m_messageId(messageId), m_active(traceEnabled()) {
+        if (m_active) {
+            m_startUs = traceNowUs();
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (!m_active) return;
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        traceRecord(m_name, m_startUs,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                    m_messageId);
+    }
+
+    void setMessageId(std::uint64_t messageId) { m_messageId = messageId; }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    std::uint64_t m_messageId;
+    bool m_active;
+    std::int64_t m_startUs = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,29 @@
+#include "rsa_chat_transport.h"
+#include "QtTransport.h"
+#include "rsa_chat_epoll.h"
+#include "rsa_chat_shm.h"
+#include "rsa_chat_uring.h"
+
+std::unique_ptr<Transport> makeTransport(TransportKind kind, bool sameHostShortcut) {
+    std::unique_ptr<Transport> network;
+    switch (kind) {
+    case TransportKind::Qt: network = std::make_unique<QtTransport>(); break;
+    case TransportKind::Uring: network = makeUringTransport(); break;
+    case TransportKind::Epoll: network = makeEpollTransport(); break;
+    }
+    if (network && sameHostShortcut) return withSharedMemory(std::move(network));
+    return network;
+}
+
+bool parseTransportKind(std::string_view text, TransportKind& kind) {
+    if (text == "qt") {
+        kind = TransportKind::Qt;
+    } else if (text == "uring" || text == "io_uring") {
+        kind = TransportKind::Uring;
+    } else if (text == "epoll") {
+        kind = TransportKind::Epoll;
+    } else {
+        return false;
+    }
+    return true;
+}
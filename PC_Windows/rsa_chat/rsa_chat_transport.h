@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Byte-stream transport for the chat sessions and the headless targets: a
+// listening socket and any number of TCP connections driven from one
+// thread by poll(), or by the Qt event loop through TransportDriver
+// (QtTransport.h). Sends are queued and go out together at the next
+// flush() or poll(), so a batch of replies costs one submission instead
+// of a syscall each.
+//
+// Three backends: Qt sockets (everywhere; needs a QCoreApplication),
+// io_uring (Linux 5.19+) and a plain epoll loop (Linux). Any of them can
+// be wrapped with the same-host shortcut in rsa_chat_shm.h.
+
+using ConnectionId = std::uint64_t;
+
+enum class TransportKind {
+    Qt,
+    Uring,
+    Epoll,
+};
+
+// Socket options for one connection, see Transport::tune(); 0 keeps the
+// OS default
+struct TcpTuning {
+    bool noDelay = true;
+    int sendBufferBytes = 0;
+    int receiveBufferBytes = 0;
+    // TCP_NOTSENT_LOWAT where the OS has it
+    int unsentLimitBytes = 0;
+};
+
+class Transport {
+public:
+    struct Handlers {
+        // A peer connected to the listening socket
+        std::function<void(ConnectionId id)> accepted;
+        // Bytes from a connection, valid only during the call
+        std::function<void(ConnectionId id, std::string_view data)> received;
+        // The connection is gone, whoever closed it
+        std::function<void(ConnectionId id)> closed;
+        // A connection from connectAsync() is up
+        std::function<void(ConnectionId id)> connected;
+        // Everything send() had queued for the connection is now with the
+        // kernel (or in the shared ring): pendingBytes() is 0
+        std::function<void(ConnectionId id)> drained;
+    };
+
+    virtual ~Transport() = default;
+
+    void setHandlers(Handlers handlers) { m_handlers = std::move(handlers); }
+
+    // Port 0 picks a free one, see localPort()
+    virtual bool listen(std::uint16_t port) = 0;
+    virtual std::uint16_t localPort() const = 0;
+
+    // Blocks until connected. Returns 0 on failure.
+    virtual ConnectionId connect(const std::string& host, std::uint16_t port) = 0;
+
+    // Returns at once; connected() or, if the peer cannot be reached,
+    // closed() follows from poll(). Sends made in between go out once the
+    // connection is up. 0 only if the host name does not resolve, which
+    // is the one step that may still block.
+    virtual ConnectionId connectAsync(const std::string& host, std::uint16_t port) = 0;
+
+    virtual void send(ConnectionId id, std::string_view data) = 0;
+    virtual void flush() = 0;
+    // Queued by send() and not yet taken by the kernel
+    virtual std::size_t pendingBytes(ConnectionId id) const = 0;
+
+    // Sends what is queued, then closes; closed() follows from poll()
+    virtual void close(ConnectionId id) = 0;
+
+    // While off, nothing more is read from the connection: at most a
+    // buffer's worth is held here and the peer's sends back up into its
+    // own socket (or shared ring), as with any slow reader. On for every
+    // new connection. A hangup is only reported once receiving is back on.
+    virtual void setReceiving(ConnectionId id, bool enabled) = 0;
+
+    // Numeric address of the peer; empty once the connection is gone
+    virtual std::string peerAddress(ConnectionId id) const = 0;
+    // Same-host connections have no socket and ignore it
+    virtual void tune(ConnectionId id, const TcpTuning& tuning) = 0;
+
+    // Flushes, waits up to timeoutMs (-1 = no limit) for activity and
+    // runs the handlers for it
+    virtual void poll(int timeoutMs) = 0;
+
+    // Also ends the wait in poll() when fd turns readable; reading it is
+    // up to the caller
+    virtual void watch(int fd) = 0;
+
+    // For waiting in another event loop instead of poll(): the fd that
+    // turns readable when there is work, which poll(0) then does. -1 for
+    // the Qt backend, whose sockets are on the Qt event loop already.
+    virtual int waitFd() const = 0;
+    // Flushes and gets ready for that wait as poll() does before it
+    // sleeps; false if there is work already and poll(0) is due at once
+    virtual bool prepareWait() = 0;
+
+    virtual const char* name() const = 0;
+
+protected:
+    Handlers m_handlers;
+};
+
+// nullptr when the backend is not available on this system. Peers on the
+// same machine go through shared memory unless sameHostShortcut is off.
+std::unique_ptr<Transport> makeTransport(TransportKind kind, bool sameHostShortcut = true);
+
+bool parseTransportKind(std::string_view text, TransportKind& kind);
@@ -0,0 +1,718 @@
+#include "rsa_chat_uring.h"
+#include "rsa_chat_socket.h"
+
+#if defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+static constexpr unsigned kSubmitEntries = 256;
+// Multishot operations post many completions per submission
+static constexpr unsigned kCompleteEntries = 4096;
+
+// Provided receive buffers; the count must be a power of two
+static constexpr unsigned kRecvBuffers = 256;
+static constexpr std::size_t kRecvBufferBytes = 16 * 1024;
+static constexpr std::uint16_t kBufferGroup = 0;
+
+// Registered send buffers; a connection has at most one write in flight
+static constexpr unsigned kSendSlots = 64;
+static constexpr std::size_t kSendSlotBytes = 64 * 1024;
+
+// The top byte of user_data says what completed, the rest is the connection
+enum class Op : std::uint64_t {
+    Accept = 1,
+    Recv = 2,
+    Write = 3,
+    Watch = 4,
+    Connect = 5,
+    Cancel = 6,
+};
+
+static constexpr unsigned kOpShift = 56;
+
+static std::uint64_t userData(Op op, ConnectionId id) {
+    return static_cast<std::uint64_t>(op) << kOpShift | id;
+}
+
+static int ringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(SYS_io_uring_setup, entries, params));
+}
+
+static int ringEnter(int fd, unsigned submit, unsigned minComplete, unsigned flags, const void* arg,
+                     std::size_t argSize) {
+    return static_cast<int>(::syscall(SYS_io_uring_enter, fd, submit, minComplete, flags, arg, argSize));
+}
+
+static int ringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(::syscall(SYS_io_uring_register, fd, opcode, arg, count));
+}
+
+// Ring indices are shared with the kernel
+template <typename T>
+static T loadAcquire(T* p) {
+    return std::atomic_ref<T>(*p).load(std::memory_order_acquire);
+}
+
+template <typename T>
+static void storeRelease(T* p, T value) {
+    std::atomic_ref<T>(*p).store(value, std::memory_order_release);
+}
+
+class UringTransport final : public Transport {
+public:
+    UringTransport() = default;
+    ~UringTransport() override;
+
+    UringTransport(const UringTransport&) = delete;
+    UringTransport& operator=(const UringTransport&) = delete;
+
+    // False when the kernel lacks a feature we rely on
+    bool init();
+
+    bool listen(std::uint16_t port) override;
+    std::uint16_t localPort() const override { return m_port; }
+    ConnectionId connect(const std::string& host, std::uint16_t port) override;
+    ConnectionId connectAsync(const std::string& host, std::uint16_t port) override;
+    void send(ConnectionId id, std::string_view data) override;
+    void flush() override;
+    std::size_t pendingBytes(ConnectionId id) const override;
+    void close(ConnectionId id) override;
+    void setReceiving(ConnectionId id, bool enabled) override;
+    std::string peerAddress(ConnectionId id) const override;
+    void tune(ConnectionId id, const TcpTuning& tuning) override;
+    void poll(int timeoutMs) override;
+    void watch(int fd) override;
+    int waitFd() const override { return m_ringFd; }
+    bool prepareWait() override;
+    const char* name() const override { return "io_uring"; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string pending;   // queued, not yet copied into a send slot
+        int slot = -1;         // send slot being written, -1 = none
+        std::uint32_t slotLength = 0;
+        std::uint32_t slotDone = 0;
+        bool dirty = false;    // listed in m_dirty
+        bool closing = false;
+        bool recvDone = false; // the receive has ended for good
+        bool recvArmed = false; // a receive is in the kernel
+        bool connecting = false; // connectAsync() still waiting; no writes yet
+        bool paused = false;   // setReceiving(false): no receive is re-armed
+        // Arrived between setReceiving(false) and the cancel taking hold;
+        // handed over on resume
+        std::string held;
+        // The address connectAsync() connects to, alive until it completes
+        sockaddr_storage peer{};
+        socklen_t peerLength = 0;
+    };
+
+    io_uring_sqe* nextSqe();
+    unsigned unsubmitted() const;
+    void submit(unsigned minComplete, int timeoutMs);
+    void drainCompletions();
+
+    ConnectionId addConnection(int fd);
+    void markDirty(ConnectionId id, Connection& conn);
+    void prepareWrites();
+    void startWrite(ConnectionId id, Connection& conn);
+    void queueWrite(ConnectionId id, const Connection& conn);
+    void armAccept();
+    void armRecv(ConnectionId id, Connection& conn);
+    void armConnect(ConnectionId id, Connection& conn);
+    void cancelRecv(ConnectionId id);
+    void deliverHeld();
+    void armWatch(std::size_t index);
+    void recycleBuffer(unsigned bid);
+
+    void onAccept(const io_uring_cqe& cqe);
+    void onRecv(ConnectionId id, const io_uring_cqe& cqe);
+    void onWrite(ConnectionId id, const io_uring_cqe& cqe);
+    void onConnect(ConnectionId id, const io_uring_cqe& cqe);
+    void onWatch(std::size_t index, const io_uring_cqe& cqe);
+    void finishIfDone(ConnectionId id);
+
+    char* slotData(int slot) { return m_sendMemory.get() + static_cast<std::size_t>(slot) * kSendSlotBytes; }
+
+    int m_ringFd = -1;
+    void* m_ringMemory = MAP_FAILED;
+    std::size_t m_ringBytes = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    std::size_t m_sqeBytes = 0;
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_sqLocalTail = 0; // filled but not yet published to the kernel
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+
+    // The ring of provided buffers. Addressed as a plain array: in C++
+    // the header's flexible-array union puts bufs[] 8 bytes too far.
+    io_uring_buf* m_bufRing = nullptr;
+    std::size_t m_bufRingBytes = 0;
+    std::uint16_t m_bufTail = 0;
+    std::unique_ptr<char[]> m_recvMemory;
+
+    std::unique_ptr<char[]> m_sendMemory;
+    std::vector<int> m_freeSlots;
+
+    int m_listenFd = -1;
+    std::uint16_t m_port = 0;
+    // Cleared if the kernel (< 6.0) rejects multishot receive
+    bool m_multishotRecv = true;
+
+    ConnectionId m_nextId = 0;
+    std::unordered_map<ConnectionId, Connection> m_connections;
+    std::vector<ConnectionId> m_dirty;
+    std::vector<ConnectionId> m_stillDirty;
+    // Receiving again with data held back; handed over at the next poll()
+    std::vector<ConnectionId> m_resumed;
+    // Foreign fds whose readiness ends poll(), by the index in user_data
+    std::vector<int> m_watchFds;
+};
+
+UringTransport::~UringTransport() {
+    for (auto& [id, conn] : m_connections) ::close(conn.fd);
+    if (m_listenFd >= 0) ::close(m_listenFd);
+    // Closing the ring drops the buffer registrations with it
+    if (m_ringFd >= 0) ::close(m_ringFd);
+    if (m_sqes) ::munmap(m_sqes, m_sqeBytes);
+    if (m_ringMemory != MAP_FAILED) ::munmap(m_ringMemory, m_ringBytes);
+    if (m_bufRing) ::munmap(m_bufRing, m_bufRingBytes);
+}
+
+bool UringTransport::init() {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+                   IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = kCompleteEntries;
+    m_ringFd = ringSetup(kSubmitEntries, &params);
+    if (m_ringFd < 0) {
+        // The extra flags are only hints; older kernels reject them
+        params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = kCompleteEntries;
+        m_ringFd = ringSetup(kSubmitEntries, &params);
+    }
+    if (m_ringFd < 0) return false;
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) return false;
+
+    const std::size_t sqBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const std::size_t cqBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_ringBytes = std::max(sqBytes, cqBytes);
+    m_ringMemory = ::mmap(nullptr, m_ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+                          IORING_OFF_SQ_RING);
+    if (m_ringMemory == MAP_FAILED) return false;
+    m_sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, m_sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd,
+                        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* ring = static_cast<char*>(m_ringMemory);
+    m_sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqLocalTail = *m_sqTail;
+    // Slot i of the ring always holds SQE i
+    unsigned* array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; ++i) array[i] = i;
+    m_cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+    // Receive buffers the kernel picks from as data arrives
+    m_bufRingBytes = kRecvBuffers * sizeof(io_uring_buf);
+    void* bufRing = ::mmap(nullptr, m_bufRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRing == MAP_FAILED) return false;
+    m_bufRing = static_cast<io_uring_buf*>(bufRing);
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(m_bufRing);
+    reg.ring_entries = kRecvBuffers;
+    reg.bgid = kBufferGroup;
+    if (ringRegister(m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+    m_recvMemory.reset(new char[kRecvBuffers * kRecvBufferBytes]);
+    for (unsigned bid = 0; bid < kRecvBuffers; ++bid) recycleBuffer(bid);
+
+    // Send buffers, pinned once instead of mapped on every write
+    m_sendMemory.reset(new char[kSendSlots * kSendSlotBytes]);
+    iovec slots[kSendSlots];
+    for (unsigned i = 0; i < kSendSlots; ++i) slots[i] = {slotData(static_cast<int>(i)), kSendSlotBytes};
+    if (ringRegister(m_ringFd, IORING_REGISTER_BUFFERS, slots, kSendSlots) < 0) return false;
+    for (int i = kSendSlots - 1; i >= 0; --i) m_freeSlots.push_back(i);
+    return true;
+}
+
+// ---------- submission and completion queues ----------
+
+unsigned UringTransport::unsubmitted() const {
+    return m_sqLocalTail - loadAcquire(m_sqHead);
+}
+
+io_uring_sqe* UringTransport::nextSqe() {
+    if (unsubmitted() == m_sqEntries) submit(0, 0);
+    io_uring_sqe* sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++m_sqLocalTail;
+    return sqe;
+}
+
+void UringTransport::submit(unsigned minComplete, int timeoutMs) {
+    storeRelease(m_sqTail, m_sqLocalTail);
+    const unsigned count = unsubmitted();
+    if (count == 0 && minComplete == 0) return;
+
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    const void* argPtr = nullptr;
+    std::size_t argSize = _NSIG / 8;
+    if (minComplete > 0 && timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<std::uint64_t>(&timeout);
+        argPtr = &arg;
+        argSize = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    // EINTR and ETIME just end the wait; whatever was submitted shows
+    // up in the SQ head either way
+    ringEnter(m_ringFd, count, minComplete, flags, argPtr, argSize);
+}
+
+void UringTransport::drainCompletions() {
+    for (;;) {
+        const unsigned head = *m_cqHead;
+        if (head == loadAcquire(m_cqTail)) break;
+        // Copied out and released first, so handlers may submit freely
+        const io_uring_cqe cqe = m_cqes[head & m_cqMask];
+        storeRelease(m_cqHead, head + 1);
+
+        const auto op = static_cast<Op>(cqe.user_data >> kOpShift);
+        const ConnectionId id = cqe.user_data & ((std::uint64_t(1) << kOpShift) - 1);
+        switch (op) {
+        case Op::Accept: onAccept(cqe); break;
+        case Op::Recv: onRecv(id, cqe); break;
+        case Op::Write: onWrite(id, cqe); break;
+        case Op::Watch: onWatch(static_cast<std::size_t>(id), cqe); break;
+        case Op::Connect: onConnect(id, cqe); break;
+        // Whether the receive was still there or not, its own
+        // completion says how it ended
+        case Op::Cancel: break;
+        }
+    }
+}
+
+void UringTransport::recycleBuffer(unsigned bid) {
+    io_uring_buf& buf = m_bufRing[m_bufTail & (kRecvBuffers - 1)];
+    buf.addr = reinterpret_cast<std::uint64_t>(m_recvMemory.get() + bid * kRecvBufferBytes);
+    buf.len = kRecvBufferBytes;
+    buf.bid = static_cast<std::uint16_t>(bid);
+    ++m_bufTail;
+    // The tail lives in the reserved field of the first entry
+    storeRelease(&m_bufRing[0].resv, m_bufTail);
+}
+
+// ---------- operations ----------
+
+void UringTransport::armAccept() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = userData(Op::Accept, 0);
+}
+
+void UringTransport::armRecv(ConnectionId id, Connection& conn) {
+    conn.recvArmed = true;
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.fd;
+    sqe->ioprio = m_multishotRecv ? IORING_RECV_MULTISHOT : 0;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = userData(Op::Recv, id);
+}
+
+void UringTransport::armConnect(ConnectionId id, Connection& conn) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(&conn.peer);
+    sqe->off = conn.peerLength;
+    sqe->user_data = userData(Op::Connect, id);
+}
+
+// A multishot receive keeps going until cancelled
+void UringTransport::cancelRecv(ConnectionId id) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = userData(Op::Recv, id);
+    sqe->user_data = userData(Op::Cancel, id);
+}
+
+void UringTransport::armWatch(std::size_t index) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_watchFds[index];
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = userData(Op::Watch, index);
+}
+
+void UringTransport::queueWrite(ConnectionId id, const Connection& conn) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(slotData(conn.slot) + conn.slotDone);
+    sqe->len = conn.slotLength - conn.slotDone;
+    sqe->buf_index = static_cast<std::uint16_t>(conn.slot);
+    sqe->user_data = userData(Op::Write, id);
+}
+
+ConnectionId UringTransport::addConnection(int fd) {
+    const ConnectionId id = ++m_nextId;
+    Connection& conn = m_connections[id];
+    conn.fd = fd;
+    armRecv(id, conn);
+    return id;
+}
+
+bool UringTransport::listen(std::uint16_t port) {
+    const int fd = listenSocket(port, 0, m_port);
+    if (fd < 0) return false;
+    m_listenFd = fd;
+    armAccept();
+    submit(0, 0);
+    return true;
+}
+
+ConnectionId UringTransport::connect(const std::string& host, std::uint16_t port) {
+    const int fd = connectSocket(host, port);
+    if (fd < 0) return 0;
+
+    setNoDelay(fd);
+    const ConnectionId id = addConnection(fd);
+    submit(0, 0);
+    return id;
+}
+
+ConnectionId UringTransport::connectAsync(const std::string& host, std::uint16_t port) {
+    sockaddr_storage addr{};
+    socklen_t addrLen = 0;
+    if (!resolveFirst(host, port, addr, addrLen)) return 0;
+    const int fd = ::socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 0;
+    setNoDelay(fd);
+    const ConnectionId id = ++m_nextId;
+    Connection& conn = m_connections[id];
+    conn.fd = fd;
+    conn.connecting = true;
+    conn.peer = addr;
+    conn.peerLength = addrLen;
+    armConnect(id, conn);
+    submit(0, 0);
+    return id;
+}
+
+void UringTransport::markDirty(ConnectionId id, Connection& conn) {
+    if (conn.dirty) return;
+    conn.dirty = true;
+    m_dirty.push_back(id);
+}
+
+void UringTransport::send(ConnectionId id, std::string_view data) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing || data.empty()) return;
+    it->second.pending.append(data);
+    markDirty(id, it->second);
+}
+
+void UringTransport::startWrite(ConnectionId id, Connection& conn) {
+    conn.slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    const std::size_t length = std::min(conn.pending.size(), kSendSlotBytes);
+    std::memcpy(slotData(conn.slot), conn.pending.data(), length);
+    conn.pending.erase(0, length);
+    conn.slotLength = static_cast<std::uint32_t>(length);
+    conn.slotDone = 0;
+    queueWrite(id, conn);
+}
+
+// Turns queued sends into write SQEs; they reach the kernel with the
+// next submit
+void UringTransport::prepareWrites() {
+    m_stillDirty.clear();
+    for (ConnectionId id : m_dirty) {
+        auto it = m_connections.find(id);
+        if (it == m_connections.end()) continue;
+        Connection& conn = it->second;
+        conn.dirty = false;
+        // A busy connection is picked up again when its write completes,
+        // a connecting one when the connect does
+        if (conn.slot >= 0 || conn.pending.empty() || conn.connecting) continue;
+        if (m_freeSlots.empty()) {
+            conn.dirty = true;
+            m_stillDirty.push_back(id);
+            continue;
+        }
+        startWrite(id, conn);
+    }
+    m_dirty.swap(m_stillDirty);
+}
+
+void UringTransport::flush() {
+    prepareWrites();
+    submit(0, 0);
+}
+
+std::size_t UringTransport::pendingBytes(ConnectionId id) const {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) return 0;
+    const Connection& conn = it->second;
+    return conn.pending.size() + (conn.slot >= 0 ? conn.slotLength - conn.slotDone : 0);
+}
+
+std::string UringTransport::peerAddress(ConnectionId id) const {
+    auto it = m_connections.find(id);
+    return it == m_connections.end() ? std::string() : socketPeer(it->second.fd);
+}
+
+void UringTransport::tune(ConnectionId id, const TcpTuning& tuning) {
+    auto it = m_connections.find(id);
+    if (it != m_connections.end()) tuneSocket(it->second.fd, tuning);
+}
+
+void UringTransport::close(ConnectionId id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing) return;
+    Connection& conn = it->second;
+    conn.closing = true;
+    // Otherwise the last write completion does this
+    if (conn.slot < 0 && conn.pending.empty()) ::shutdown(conn.fd, SHUT_RDWR);
+    // Only the receive sees the connection end
+    setReceiving(id, true);
+}
+
+void UringTransport::setReceiving(ConnectionId id, bool enabled) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.paused == !enabled) return;
+    Connection& conn = it->second;
+    conn.paused = !enabled;
+    if (conn.connecting) return;
+    if (!enabled) {
+        if (conn.recvArmed && !conn.recvDone) cancelRecv(id);
+        return;
+    }
+    // An end seen while paused is reported by deliverHeld(), behind the
+    // data held back with it
+    if (!conn.held.empty() || conn.recvDone) m_resumed.push_back(id);
+    if (conn.recvDone) return;
+    // Still armed if the cancel has not completed yet; its completion
+    // then re-arms
+    if (!conn.recvArmed) armRecv(id, conn);
+}
+
+void UringTransport::watch(int fd) {
+    m_watchFds.push_back(fd);
+    armWatch(m_watchFds.size() - 1);
+    submit(0, 0);
+}
+
+void UringTransport::poll(int timeoutMs) {
+    prepareWrites();
+    const bool ready = loadAcquire(m_cqTail) != *m_cqHead || !m_resumed.empty();
+    // Sends and the wait share one io_uring_enter
+    submit(ready || timeoutMs == 0 ? 0 : 1, timeoutMs);
+    deliverHeld();
+    drainCompletions();
+}
+
+// GETEVENTS with nothing to wait for runs the task work that posts
+// completions, as the wait in poll() would; without it the ring fd may
+// stay quiet with them still outstanding
+bool UringTransport::prepareWait() {
+    prepareWrites();
+    storeRelease(m_sqTail, m_sqLocalTail);
+    ringEnter(m_ringFd, unsubmitted(), 0, IORING_ENTER_GETEVENTS, nullptr, _NSIG / 8);
+    return loadAcquire(m_cqTail) == *m_cqHead && m_resumed.empty();
+}
+
+// Before any newer completion, so the stream stays in order. In reads of
+// the usual size, so a handler can pause again halfway through.
+void UringTransport::deliverHeld() {
+    std::vector<ConnectionId> resumed;
+    resumed.swap(m_resumed);
+    for (ConnectionId id : resumed) {
+        std::string held;
+        std::size_t done = 0;
+        for (;;) {
+            auto it = m_connections.find(id);
+            if (it == m_connections.end()) break;
+            if (held.empty()) held.swap(it->second.held);
+            if (it->second.paused || done == held.size()) {
+                // Anything received meanwhile queued up behind the rest
+                held.erase(0, done);
+                it->second.held.insert(0, held);
+                // An end seen while paused comes after the last of it
+                if (!it->second.paused) finishIfDone(id);
+                break;
+            }
+            const std::size_t length = std::min(held.size() - done, kRecvBufferBytes);
+            const std::string_view data(held.data() + done, length);
+            done += length;
+            if (m_handlers.received) m_handlers.received(id, data);
+        }
+    }
+}
+
+// ---------- completions ----------
+
+void UringTransport::onAccept(const io_uring_cqe& cqe) {
+    if (cqe.res >= 0) {
+        setNoDelay(cqe.res);
+        const ConnectionId id = addConnection(cqe.res);
+        if (m_handlers.accepted) m_handlers.accepted(id);
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE) && m_listenFd >= 0) armAccept();
+}
+
+void UringTransport::onRecv(ConnectionId id, const io_uring_cqe& cqe) {
+    auto it = m_connections.find(id);
+    if (it != m_connections.end() && !(cqe.flags & IORING_CQE_F_MORE)) it->second.recvArmed = false;
+
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+        const unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        const std::string_view data(m_recvMemory.get() + bid * kRecvBufferBytes, static_cast<std::size_t>(cqe.res));
+        if (it != m_connections.end() && (it->second.paused || !it->second.held.empty())) {
+            // The cancel has not caught up yet, or held data still waits
+            // for the next poll(): keep the order
+            it->second.held.append(data);
+        } else if (m_handlers.received) {
+            m_handlers.received(id, data);
+        }
+        recycleBuffer(bid);
+        it = m_connections.find(id);
+        if (it != m_connections.end() && !it->second.recvArmed && !it->second.paused) armRecv(id, it->second);
+        return;
+    }
+
+    if (it == m_connections.end()) return;
+    Connection& conn = it->second;
+    if (cqe.res == -ECANCELED || cqe.res == -ENOBUFS) {
+        // Cancelled by setReceiving(false), or every buffer was in use
+        // and they are back in the ring by now
+        if (!conn.paused) armRecv(id, conn);
+        return;
+    }
+    if (cqe.res == -EINVAL && m_multishotRecv) {
+        m_multishotRecv = false;
+        armRecv(id, conn);
+        return;
+    }
+
+    // 0 is an orderly shutdown, anything else an error. While paused, or
+    // with data still held back, it waits for setReceiving(id, true).
+    conn.recvDone = true;
+    conn.closing = true;
+    conn.pending.clear();
+    finishIfDone(id);
+}
+
+// A failed connect ends like a receive that found the peer gone
+void UringTransport::onConnect(ConnectionId id, const io_uring_cqe& cqe) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) return;
+    Connection& conn = it->second;
+    conn.connecting = false;
+    if (cqe.res < 0) {
+        conn.recvDone = true;
+        conn.closing = true;
+        conn.pending.clear();
+        finishIfDone(id);
+        return;
+    }
+    if (!conn.paused) armRecv(id, conn);
+    if (!conn.pending.empty()) markDirty(id, conn);
+    if (m_handlers.connected) m_handlers.connected(id);
+}
+
+void UringTransport::onWrite(ConnectionId id, const io_uring_cqe& cqe) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) return;
+    Connection& conn = it->second;
+
+    if (cqe.res > 0) {
+        conn.slotDone += static_cast<std::uint32_t>(cqe.res);
+        if (conn.slotDone < conn.slotLength) {
+            // Short write: the rest goes before anything else queued
+            queueWrite(id, conn);
+            return;
+        }
+    } else {
+        conn.pending.clear();
+        conn.closing = true;
+    }
+
+    m_freeSlots.push_back(conn.slot);
+    conn.slot = -1;
+    if (!conn.pending.empty()) {
+        markDirty(id, conn);
+    } else if (conn.closing) {
+        // Wakes the receive, which then finishes the connection
+        ::shutdown(conn.fd, SHUT_RDWR);
+        finishIfDone(id);
+    } else if (m_handlers.drained) {
+        m_handlers.drained(id);
+    }
+}
+
+void UringTransport::onWatch(std::size_t index, const io_uring_cqe& cqe) {
+    // The completion itself was the point; the owner reads the fd
+    if (!(cqe.flags & IORING_CQE_F_MORE) && cqe.res != -EBADF) armWatch(index);
+}
+
+void UringTransport::finishIfDone(ConnectionId id) {
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || !it->second.recvDone || it->second.slot >= 0) return;
+    if (it->second.paused || !it->second.held.empty()) return;
+    ::close(it->second.fd);
+    m_connections.erase(it);
+    if (m_handlers.closed) m_handlers.closed(id);
+}
+
+std::unique_ptr<Transport> makeUringTransport() {
+    auto transport = std::make_unique<UringTransport>();
+    if (!transport->init()) return nullptr;
+    return transport;
+}
+
+#else
+
+std::unique_ptr<Transport> makeUringTransport() {
+    return nullptr;
+}
+
+#endif
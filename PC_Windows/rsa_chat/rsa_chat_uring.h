@@ -0,0 +1,18 @@
+#pragma once
+
+#include "rsa_chat_transport.h"
+
+#include <memory>
+
+// io_uring backend of Transport, talking to the kernel directly rather
+// than through liburing.
+//
+//  - accept and receive are multishot: one submission keeps delivering
+//    completions, receives land in a ring of provided buffers
+//  - sends are copied into registered (pinned) buffers and written with
+//    WRITE_FIXED, all connections' sends in one submission
+//  - poll() submits and waits in a single io_uring_enter
+//
+// Returns nullptr on non-Linux systems and on kernels without provided
+// buffer rings.
+std::unique_ptr<Transport> makeUringTransport();
@@ -0,0 +1,383 @@
+#pragma once
+
+// Modular multiplication/exponentiation kernels. Montgomery reduction
+// keeps division out of the inner loops; the kernel is picked at compile
+// time from the modulus width:
+//
+//   ModKernel<32>   32-bit words, 64-bit products
+//   ModKernel<64>   64-bit words, 128-bit products
+//   ModKernel<N>    ceil(N/64) 64-bit limbs (CIOS multiplication)
+//
+// All kernels need an odd modulus, which every RSA modulus is. Values
+// passed to pow() are in the normal (non-Montgomery) domain and < n.
+//
+// The Qt and Android builds both compile this one file from shared/;
+// each CMakeLists.txt refuses to configure if a local copy reappears.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__SIZEOF_INT128__)
+#include <intrin.h>
+#endif
+
+// Full 64x64 -> 128-bit product, returned as (hi, lo)
+inline std::uint64_t mulWide(std::uint64_t a, std::uint64_t b, std::uint64_t& hi) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+    hi = static_cast<std::uint64_t>(p >> 64);
+    return static_cast<std::uint64_t>(p);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return _umul128(a, b, &hi);
+#else
+    // 32-bit targets (armeabi-v7a, x86, 32-bit MSVC): four 32x32 products
+    const std::uint64_t aLo = a & 0xffffffffu, aHi = a >> 32;
+    const std::uint64_t bLo = b & 0xffffffffu, bHi = b >> 32;
+    const std::uint64_t ll = aLo * bLo;
+    const std::uint64_t lh = aLo * bHi;
+    const std::uint64_t hl = aHi * bLo;
+    const std::uint64_t hh = aHi * bHi;
+    // Cannot overflow: each term is below 2^32
+    const std::uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | (ll & 0xffffffffu);
+#endif
+}
+
+// a * b + c + carry, low word returned, high word left in carry
+inline std::uint64_t mulAdd(std::uint64_t a, std::uint64_t b, std::uint64_t c, std::uint64_t& carry) {
+    std::uint64_t hi;
+    std::uint64_t lo = mulWide(a, b, hi);
+    lo += c;
+    hi += lo < c;
+    lo += carry;
+    hi += lo < carry;
+    carry = hi;
+    return lo;
+}
+
+// n^-1 mod 2^w by Newton iteration (n odd)
+template <typename Word>
+constexpr Word wordInverse(Word n) {
+    Word inv = n; // correct to 3 bits
+    for (int i = 0; i < 6; ++i) inv *= Word(2) - n * inv;
+    return inv;
+}
+
+// Single-word Montgomery arithmetic for 32- and 64-bit moduli
+template <typename Word>
+class MontgomeryWord {
+    static_assert(std::is_same_v<Word, std::uint32_t> || std::is_same_v<Word, std::uint64_t>,
+                  "MontgomeryWord supports 32- and 64-bit words");
+    static constexpr int kBits = sizeof(Word) * 8;
+
+public:
+    using Value = Word;
+
+    explicit MontgomeryWord(Word n) : m_n(n), m_nInv(wordInverse(n)) {
+        // R mod n and R^2 mod n, R = 2^kBits. Done once per key, so the
+        // shift-and-subtract loop is fine here.
+        Word r = static_cast<Word>(0 - n) % n;
+        m_r2 = r;
+        for (int i = 0; i < kBits; ++i) m_r2 = addMod(m_r2, m_r2);
+        m_one = r;
+    }
+
+    Word modulus() const { return m_n; }
+
+    Word toMont(Word a) const { return mul(a, m_r2); }
+
+    Word fromMont(Word a) const { return reduce(0, a); }
+
+    Word mul(Word a, Word b) const {
+        if constexpr (kBits == 32) {
+            std::uint64_t t = static_cast<std::uint64_t>(a) * b;
+            return reduce(static_cast<Word>(t >> 32), static_cast<Word>(t));
+        } else {
+            std::uint64_t hi;
+            std::uint64_t lo = mulWide(a, b, hi);
+            return reduce(hi, lo);
+        }
+    }
+
+    Word pow(Word base, Word exp) const {
+        Word result = m_one;
+        Word b = toMont(base);
+        while (exp) {
+            if (exp & 1) result = mul(result, b);
+            b = mul(b, b);
+            exp >>= 1;
+        }
+        return fromMont(result);
+    }
+
+private:
+    Word addMod(Word a, Word b) const {
+        Word s = a + b;
+        if (s < a || s >= m_n) s -= m_n;
+        return s;
+    }
+
+    // REDC of the double-word value hi:lo. With m = lo * n^-1 mod R the
+    // low halves of hi:lo and m*n are equal, so (hi:lo - m*n) / R is just
+    // hi - high(m*n), which lies in (-n, n).
+    Word reduce(Word hi, Word lo) const {
+        Word m = lo * m_nInv;
+        Word mnHi;
+        if constexpr (kBits == 32) {
+            mnHi = static_cast<Word>((static_cast<std::uint64_t>(m) * m_n) >> 32);
+        } else {
+            mulWide(m, m_n, mnHi);
+        }
+        Word r = hi - mnHi;
+        return hi < mnHi ? r + m_n : r;
+    }
+
+    Word m_n;
+    Word m_nInv;
+    Word m_r2;
+    Word m_one;
+};
+
+template <std::size_t L>
+using Limbs = std::array<std::uint64_t, L>;
+
+template <std::size_t L>
+inline bool limbsLess(const Limbs<L>& a, const Limbs<L>& b) {
+    for (std::size_t i = L; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i];
+    }
+    return false;
+}
+
+// a -= b, returns the borrow
+template <std::size_t L>
+inline std::uint64_t limbsSub(Limbs<L>& a, const Limbs<L>& b) {
+    std::uint64_t borrow = 0;
+    for (std::size_t i = 0; i < L; ++i) {
+        std::uint64_t d = a[i] - b[i];
+        std::uint64_t b1 = a[i] < b[i];
+        std::uint64_t r = d - borrow;
+        std::uint64_t b2 = d < borrow;
+        a[i] = r;
+        borrow = b1 | b2;
+    }
+    return borrow;
+}
+
+// a += b, returns the carry
+template <std::size_t L>
+inline std::uint64_t limbsAdd(Limbs<L>& a, const Limbs<L>& b) {
+    std::uint64_t carry = 0;
+    for (std::size_t i = 0; i < L; ++i) {
+        std::uint64_t s = a[i] + b[i];
+        std::uint64_t c1 = s < a[i];
+        s += carry;
+        std::uint64_t c2 = s < carry;
+        a[i] = s;
+        carry = c1 | c2;
+    }
+    return carry;
+}
+
+template <std::size_t L>
+inline std::size_t limbsBitWidth(const Limbs<L>& a) {
+    for (std::size_t i = L; i-- > 0;) {
+        if (a[i]) {
+            std::size_t bits = 64;
+            while (!(a[i] >> (bits - 1))) --bits;
+            return i * 64 + bits;
+        }
+    }
+    return 0;
+}
+
+template <std::size_t L>
+inline bool limbsBit(const Limbs<L>& a, std::size_t bit) {
+    return (a[bit / 64] >> (bit % 64)) & 1;
+}
+
+// Multi-limb Montgomery arithmetic (CIOS), fully on the stack
+template <std::size_t L>
+class MontgomeryLimbs {
+public:
+    using Value = Limbs<L>;
+
+    explicit MontgomeryLimbs(const Value& n) : m_n(n), m_nInv(0 - wordInverse(n[0])) {
+        // R mod n by shift-and-subtract from 1, then on to R^2 mod n
+        Value x{};
+        x[0] = 1;
+        for (std::size_t i = 0; i < 2 * 64 * L; ++i) {
+            std::uint64_t carry = limbsAdd(x, x);
+            if (carry || !limbsLess(x, m_n)) limbsSub(x, m_n);
+            if (i + 1 == 64 * L) m_one = x;
+        }
+        m_r2 = x;
+    }
+
+    const Value& modulus() const { return m_n; }
+
+    Value toMont(const Value& a) const { return mul(a, m_r2); }
+
+    Value fromMont(const Value& a) const {
+        Value one{};
+        one[0] = 1;
+        return mul(a, one);
+    }
+
+    Value mul(const Value& a, const Value& b) const {
+        std::array<std::uint64_t, L + 2> t{};
+        for (std::size_t i = 0; i < L; ++i) {
+            std::uint64_t carry = 0;
+            for (std::size_t j = 0; j < L; ++j) {
+                t[j] = mulAdd(a[j], b[i], t[j], carry);
+            }
+            std::uint64_t s = t[L] + carry;
+            t[L + 1] = s < carry;
+            t[L] = s;
+
+            std::uint64_t m = t[0] * m_nInv;
+            carry = 0;
+            mulAdd(m, m_n[0], t[0], carry);
+            for (std::size_t j = 1; j < L; ++j) {
+                t[j - 1] = mulAdd(m, m_n[j], t[j], carry);
+            }
+            s = t[L] + carry;
+            t[L - 1] = s;
+            t[L] = t[L + 1] + (s < carry);
+        }
+
+        Value r;
+        for (std::size_t i = 0; i < L; ++i) r[i] = t[i];
+        if (t[L] || !limbsLess(r, m_n)) limbsSub(r, m_n);
+        return r;
+    }
+
+    // Fixed 4-bit window: 15 precomputed powers, one multiply per window
+    template <std::size_t E>
+    Value pow(const Value& base, const Limbs<E>& exp) const {
+        std::array<Value, 16> table;
+        table[0] = m_one;
+        table[1] = toMont(base);
+        for (std::size_t i = 2; i < 16; ++i) table[i] = mul(table[i - 1], table[1]);
+
+        Value result = m_one;
+        std::size_t bits = limbsBitWidth(exp);
+        std::size_t windows = (bits + 3) / 4;
+        for (std::size_t w = windows; w-- > 0;) {
+            for (int k = 0; k < 4; ++k) result = mul(result, result);
+            std::size_t bit = w * 4;
+            unsigned digit = static_cast<unsigned>((exp[bit / 64] >> (bit % 64)) & 0xf);
+            if (digit) result = mul(result, table[digit]);
+        }
+        return fromMont(result);
+    }
+
+private:
+    Value m_n;
+    std::uint64_t m_nInv;
+    Value m_r2;
+    Value m_one;
+};
+
+template <unsigned Bits>
+using ModKernel = std::conditional_t<
+    (Bits <= 32), MontgomeryWord<std::uint32_t>,
+    std::conditional_t<(Bits <= 64), MontgomeryWord<std::uint64_t>, MontgomeryLimbs<(Bits + 63) / 64>>>;
+
+// Exponentiation for the int-based key API. Handles negative bases and
+// falls back to plain reduction for the even moduli a malformed key could
+// carry; real keys always take the Montgomery path.
+class ModPow32 {
+public:
+    explicit ModPow32(std::int64_t mod)
+        : m_mod(mod), m_kernel(mod > 1 && (mod & 1) && mod <= 0xffffffffLL ? static_cast<std::uint32_t>(mod) : 1) {}
+
+    std::int64_t operator()(std::int64_t base, std::int64_t exp) const {
+        if (m_mod <= 1) return 0;
+        std::int64_t b = base % m_mod;
+        if (b < 0) b += m_mod;
+        if (exp <= 0) return 1;
+
+        if ((m_mod & 1) && m_mod <= 0xffffffffLL) {
+            return m_kernel.pow(static_cast<std::uint32_t>(b), static_cast<std::uint32_t>(exp));
+        }
+
+        std::uint64_t result = 1;
+        std::uint64_t sq = static_cast<std::uint64_t>(b);
+        std::uint64_t mod = static_cast<std::uint64_t>(m_mod);
+        while (exp > 0) {
+            if (exp & 1) result = mulModSlow(result, sq, mod);
+            sq = mulModSlow(sq, sq, mod);
+            exp >>= 1;
+        }
+        return static_cast<std::int64_t>(result);
+    }
+
+private:
+    static std::uint64_t mulModSlow(std::uint64_t a, std::uint64_t b, std::uint64_t mod) {
+        std::uint64_t hi;
+        std::uint64_t lo = mulWide(a, b, hi);
+        // hi < mod here, so the 128-by-64 division cannot overflow
+        std::uint64_t rem = hi;
+        for (int i = 63; i >= 0; --i) {
+            bool top = rem >> 63;
+            rem = (rem << 1) | ((lo >> i) & 1);
+            if (top || rem >= mod) rem -= mod;
+        }
+        return rem;
+    }
+
+    std::int64_t m_mod;
+    MontgomeryWord<std::uint32_t> m_kernel;
+};
+
+// ---------- fixed public exponents ----------
+
+// x^E in Montgomery form by the binary addition chain of E, unrolled at
+// compile time: one squaring per bit below the top, one multiply per set
+// bit. For 3, 5, 7, 17 and 65537 that chain is also the shortest.
+template <std::uint64_t E, typename Kernel>
+inline typename Kernel::Value montChain(const Kernel& kernel, const typename Kernel::Value& xm) {
+    static_assert(E >= 1, "exponent must be positive");
+    if constexpr (E == 1) {
+        return xm;
+    } else {
+        const typename Kernel::Value half = montChain<E / 2>(kernel, xm);
+        const typename Kernel::Value square = kernel.mul(half, half);
+        if constexpr (E & 1) {
+            return kernel.mul(square, xm);
+        } else {
+            return square;
+        }
+    }
+}
+
+// x^E mod n for an odd exponent E > 1 fixed at compile time, x < n. The
+// last multiply takes x in the normal domain, which brings the result out
+// of Montgomery form without a separate conversion: e = 3 costs the
+// conversion in and two multiplies.
+template <std::uint64_t E, typename Kernel>
+inline typename Kernel::Value fixedPow(const Kernel& kernel, const typename Kernel::Value& x) {
+    static_assert(E > 1 && (E & 1), "fixedPow needs an odd exponent above 1");
+    const typename Kernel::Value rest = montChain<E - 1>(kernel, kernel.toMont(x));
+    return kernel.mul(rest, x);
+}
+
+// Calls fn(std::integral_constant<std::uint64_t, E>{}) if e is one of the
+// exponents with a compiled chain and returns whether it did. generateKeys()
+// nearly always picks 3, 5 or 7; 17 and 65537 are the usual choices of
+// bigger keys.
+template <typename Fn>
+inline bool withFixedExponent(std::uint64_t e, Fn&& fn) {
+    switch (e) {
+    case 3: fn(std::integral_constant<std::uint64_t, 3>{}); return true;
+    case 5: fn(std::integral_constant<std::uint64_t, 5>{}); return true;
+    case 7: fn(std::integral_constant<std::uint64_t, 7>{}); return true;
+    case 17: fn(std::integral_constant<std::uint64_t, 17>{}); return true;
+    case 65537: fn(std::integral_constant<std::uint64_t, 65537>{}); return true;
+    default: return false;
+    }
+}